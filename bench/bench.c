@@ -0,0 +1,312 @@
+#include <vulkan/vulkan.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "buffer.h"
+#include "context.h"
+#include "kernel.h"
+#include "pipeline_cache.h"
+#include "profiler.h"
+#include "timer.h"
+#include "variants.h"
+
+// Sweeps double.comp over element counts, memory placements and workgroup sizes, reporting the median and
+// 99th percentile of the device time of each dispatch (timestamp queries) and of the host time from submit
+// to fence wait. Results go to stdout as a table and optionally to a CSV file for regression tracking.
+
+static const uint32_t localSizes[] = { 32, 64, 128, 256, 512, 1024 };
+
+typedef struct BenchOptions {
+	uint64_t minElements;
+	uint64_t maxElements;
+	uint32_t warmup;
+	uint32_t iterations;
+	// Each configuration stops repeating after this much host time, once it has at least 3 samples
+	uint64_t budgetNs;
+	int host;
+	int device;
+	const KernelVariant* variant;
+	const char* csvPath;
+} BenchOptions;
+
+typedef struct BenchResult {
+	uint32_t samples;
+	uint64_t gpuMedianNs;
+	uint64_t gpuP99Ns;
+	uint64_t hostMedianNs;
+	uint64_t hostP99Ns;
+	double throughputGBs;
+} BenchResult;
+
+static int CompareU64(const void* a, const void* b) {
+	uint64_t x = *(const uint64_t*) a;
+	uint64_t y = *(const uint64_t*) b;
+	return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of count sorted samples
+static uint64_t Percentile(const uint64_t* sorted, uint32_t count, uint32_t percent) {
+	if (count == 0) {
+		return 0;
+	}
+	uint32_t rank = (percent * count + 99) / 100;
+	return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+// Run warmup + measured dispatches of one configuration and summarize the measured ones
+static VkResult RunBenchConfiguration(ComputeContext* context, ComputeKernel* kernel, const ComputeBuffer* buffers,
+	uint64_t elementCount, const BenchOptions* options, BenchResult* benchResult) {
+
+	memset(benchResult, 0, sizeof(*benchResult));
+
+	uint32_t groupCountX = 0;
+	uint32_t groupCountY = 0;
+	uint32_t groupCountZ = 0;
+	VkResult result = ComputeDispatchSize(context, kernel, elementCount, &groupCountX, &groupCountY, &groupCountZ);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+	uint32_t pushConstant = (uint32_t) elementCount;
+
+	for (uint32_t i = 0; i < options->warmup; ++i) {
+		result = DispatchComputeKernel(context, kernel, buffers, &pushConstant, groupCountX, groupCountY, groupCountZ);
+		if (result != VK_SUCCESS) {
+			return result;
+		}
+	}
+
+	ClearProfileEvents(context->profiler);
+	uint64_t startTime = GetTimeNs();
+	for (uint32_t i = 0; i < options->iterations; ++i) {
+		result = DispatchComputeKernel(context, kernel, buffers, &pushConstant, groupCountX, groupCountY, groupCountZ);
+		if (result != VK_SUCCESS) {
+			return result;
+		}
+		if (i + 1 >= 3 && GetTimeNs() - startTime > options->budgetNs) {
+			break;
+		}
+	}
+
+	// Every dispatch adds one GPU event (if the compute queue has timestamps) and one submit event
+	const Profiler* profiler = context->profiler;
+	uint64_t* gpuSamples = calloc(profiler->eventCount + 1, sizeof(uint64_t));
+	uint64_t* hostSamples = calloc(profiler->eventCount + 1, sizeof(uint64_t));
+	if (gpuSamples == NULL || hostSamples == NULL) {
+		free(gpuSamples);
+		free(hostSamples);
+		return VK_ERROR_OUT_OF_HOST_MEMORY;
+	}
+	uint32_t gpuCount = 0;
+	uint32_t hostCount = 0;
+	for (uint32_t i = 0; i < profiler->eventCount; ++i) {
+		if (profiler->events[i].type == PROFILE_EVENT_GPU) {
+			gpuSamples[gpuCount++] = profiler->events[i].durationNs;
+		}
+		else if (profiler->events[i].type == PROFILE_EVENT_SUBMIT) {
+			hostSamples[hostCount++] = profiler->events[i].durationNs;
+		}
+	}
+	qsort(gpuSamples, gpuCount, sizeof(uint64_t), CompareU64);
+	qsort(hostSamples, hostCount, sizeof(uint64_t), CompareU64);
+
+	benchResult->samples = hostCount;
+	benchResult->gpuMedianNs = Percentile(gpuSamples, gpuCount, 50);
+	benchResult->gpuP99Ns = Percentile(gpuSamples, gpuCount, 99);
+	benchResult->hostMedianNs = Percentile(hostSamples, hostCount, 50);
+	benchResult->hostP99Ns = Percentile(hostSamples, hostCount, 99);
+	free(gpuSamples);
+	free(hostSamples);
+
+	// Throughput counts one read and one write per element, over the device time when it is available
+	uint64_t medianNs = benchResult->gpuMedianNs > 0 ? benchResult->gpuMedianNs : benchResult->hostMedianNs;
+	if (medianNs > 0) {
+		benchResult->throughputGBs = (double) (elementCount * 2 * sizeof(float)) / (double) medianNs;
+	}
+	return VK_SUCCESS;
+}
+
+static void PrintUsage(void) {
+	puts("Usage: vkbench [options]");
+	puts("  --min <N>            smallest element count (default 1024)");
+	puts("  --max <N>            largest element count (default 1073741824)");
+	puts("  --warmup <N>         unmeasured dispatches per configuration (default 3)");
+	puts("  --iterations <N>     measured dispatches per configuration (default 50)");
+	puts("  --budget-ms <N>      stop a configuration early after this long (default 2000)");
+	puts("  --placement <p>      host, device or all (default all)");
+	puts("  --variant <name>     scalar, vec4, scalar-grid or vec4-grid (default scalar)");
+	puts("  --csv <file>         also write results as CSV");
+}
+
+int main(int argc, char** argv) {
+	BenchOptions options = { 0 };
+	options.minElements = 1024;
+	options.maxElements = 1024ull * 1024 * 1024;
+	options.warmup = 3;
+	options.iterations = 50;
+	options.budgetNs = 2000ull * 1000 * 1000;
+	options.host = 1;
+	options.device = 1;
+	options.variant = &kernelVariants[0];
+
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--min") && i + 1 < argc) {
+			options.minElements = strtoull(argv[++i], NULL, 10);
+		}
+		else if (!strcmp(argv[i], "--max") && i + 1 < argc) {
+			options.maxElements = strtoull(argv[++i], NULL, 10);
+		}
+		else if (!strcmp(argv[i], "--warmup") && i + 1 < argc) {
+			options.warmup = (uint32_t) strtoul(argv[++i], NULL, 10);
+		}
+		else if (!strcmp(argv[i], "--iterations") && i + 1 < argc) {
+			options.iterations = (uint32_t) strtoul(argv[++i], NULL, 10);
+		}
+		else if (!strcmp(argv[i], "--budget-ms") && i + 1 < argc) {
+			options.budgetNs = strtoull(argv[++i], NULL, 10) * 1000 * 1000;
+		}
+		else if (!strcmp(argv[i], "--placement") && i + 1 < argc) {
+			++i;
+			options.host = !strcmp(argv[i], "host") || !strcmp(argv[i], "all");
+			options.device = !strcmp(argv[i], "device") || !strcmp(argv[i], "all");
+		}
+		else if (!strcmp(argv[i], "--variant") && i + 1 < argc) {
+			options.variant = FindKernelVariant(argv[++i]);
+			if (options.variant == NULL) {
+				printf("Unknown kernel variant %s\n", argv[i]);
+				exit(1);
+			}
+		}
+		else if (!strcmp(argv[i], "--csv") && i + 1 < argc) {
+			options.csvPath = argv[++i];
+		}
+		else {
+			PrintUsage();
+			exit(1);
+		}
+	}
+	if (options.minElements == 0 || options.iterations == 0 || (!options.host && !options.device)) {
+		PrintUsage();
+		exit(1);
+	}
+
+	ComputeContext context = { 0 };
+	VkResult result = CreateComputeContext(&context);
+	if (result != VK_SUCCESS) {
+		puts("Failed to create compute context");
+		exit(1);
+	}
+	result = LoadPipelineCache(&context, ".", NULL);
+	if (result != VK_SUCCESS) {
+		puts("Failed to load pipeline cache");
+		exit(1);
+	}
+
+	Profiler profiler = { 0 };
+	result = CreateProfiler(context.physicalDevice, context.device, context.hostQueryReset, &profiler);
+	if (result != VK_SUCCESS) {
+		puts("Failed to create profiler");
+		exit(1);
+	}
+	context.profiler = &profiler;
+
+	FILE* csv = NULL;
+	if (options.csvPath != NULL) {
+		csv = fopen(options.csvPath, "w");
+		if (csv == NULL) {
+			printf("Failed to open %s\n", options.csvPath);
+			exit(1);
+		}
+		fprintf(csv, "device,variant,placement,elements,local_size,samples,gpu_median_ns,gpu_p99_ns,"
+			"host_median_ns,host_p99_ns,throughput_gbs\n");
+	}
+
+	printf("%-7s %12s %6s %7s %12s %12s %12s %12s %9s\n", "memory", "elements", "local", "samples",
+		"gpu med ms", "gpu p99 ms", "host med ms", "host p99 ms", "GB/s");
+
+	const VkPhysicalDeviceLimits* limits = &context.physicalDeviceProperties.limits;
+	const BufferLocation locations[] = { BUFFER_LOCATION_HOST, BUFFER_LOCATION_DEVICE };
+	const char* locationNames[] = { "host", "device" };
+	for (uint32_t l = 0; l < 2; ++l) {
+		if ((locations[l] == BUFFER_LOCATION_HOST && !options.host) || (locations[l] == BUFFER_LOCATION_DEVICE && !options.device)) {
+			continue;
+		}
+
+		for (uint64_t elementCount = options.minElements; elementCount <= options.maxElements; elementCount *= 4) {
+			const VkDeviceSize size = elementCount * sizeof(float);
+			if (size > limits->maxStorageBufferRange) {
+				printf("%-7s %12llu skipped: larger than maxStorageBufferRange\n", locationNames[l], (unsigned long long) elementCount);
+				continue;
+			}
+
+			ComputeBuffer buffers[2] = { 0 };
+			if (CreateComputeBuffer(&context, size, locations[l], &buffers[0]) != VK_SUCCESS ||
+				CreateComputeBuffer(&context, size, locations[l], &buffers[1]) != VK_SUCCESS) {
+				printf("%-7s %12llu skipped: out of memory\n", locationNames[l], (unsigned long long) elementCount);
+				DestroyComputeBuffer(&context, &buffers[0]);
+				DestroyComputeBuffer(&context, &buffers[1]);
+				continue;
+			}
+			result = ClearComputeBuffers(&context, buffers, 2);
+			if (result != VK_SUCCESS) {
+				puts("Failed to clear buffers");
+				exit(1);
+			}
+
+			for (uint32_t s = 0; s < sizeof(localSizes) / sizeof(localSizes[0]); ++s) {
+				if (localSizes[s] > limits->maxComputeWorkGroupSize[0] || localSizes[s] > limits->maxComputeWorkGroupInvocations) {
+					continue;
+				}
+
+				ComputeKernelCreateInfo kernelInfo = { 0 };
+				GetKernelVariantCreateInfo(options.variant, &kernelInfo);
+				kernelInfo.localSizeX = localSizes[s];
+				kernelInfo.elementsPerInvocation = 1;
+
+				ComputeKernel kernel = { 0 };
+				result = CreateComputeKernel(&context, &kernelInfo, &kernel);
+				if (result != VK_SUCCESS) {
+					printf("Failed to create kernel from file %s\n", kernelInfo.shaderFile);
+					exit(1);
+				}
+
+				BenchResult benchResult = { 0 };
+				result = RunBenchConfiguration(&context, &kernel, buffers, elementCount, &options, &benchResult);
+				DestroyComputeKernel(&context, &kernel);
+				if (result == VK_ERROR_FEATURE_NOT_PRESENT) {
+					continue;
+				}
+				if (result != VK_SUCCESS) {
+					puts("Failed to run benchmark");
+					exit(1);
+				}
+
+				printf("%-7s %12llu %6u %7u %12.4f %12.4f %12.4f %12.4f %9.2f\n", locationNames[l],
+					(unsigned long long) elementCount, localSizes[s], benchResult.samples,
+					NsToMs(benchResult.gpuMedianNs), NsToMs(benchResult.gpuP99Ns),
+					NsToMs(benchResult.hostMedianNs), NsToMs(benchResult.hostP99Ns), benchResult.throughputGBs);
+				if (csv != NULL) {
+					fprintf(csv, "\"%s\",%s,%s,%llu,%u,%u,%llu,%llu,%llu,%llu,%.3f\n",
+						context.physicalDeviceProperties.deviceName, options.variant->name, locationNames[l],
+						(unsigned long long) elementCount, localSizes[s], benchResult.samples,
+						(unsigned long long) benchResult.gpuMedianNs, (unsigned long long) benchResult.gpuP99Ns,
+						(unsigned long long) benchResult.hostMedianNs, (unsigned long long) benchResult.hostP99Ns,
+						benchResult.throughputGBs);
+				}
+			}
+
+			DestroyComputeBuffer(&context, &buffers[0]);
+			DestroyComputeBuffer(&context, &buffers[1]);
+		}
+	}
+
+	if (csv != NULL && fclose(csv) != 0) {
+		printf("Failed to write %s\n", options.csvPath);
+	}
+
+	SavePipelineCache(&context);
+	context.profiler = NULL;
+	DestroyProfiler(&profiler);
+	DestroyComputeContext(&context);
+	return 0;
+}
@@ -0,0 +1,514 @@
+#include "allocator.h"
+#include <vulkan/vulkan.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment) {
+	if (alignment <= 1) {
+		return value;
+	}
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+uint32_t FindMemoryTypeIndex(const VkPhysicalDeviceMemoryProperties* memoryProperties, uint32_t typeBits, VkMemoryPropertyFlags properties) {
+	for (uint32_t i = 0; i < memoryProperties->memoryTypeCount; ++i) {
+		if ((typeBits & (1u << i)) &&
+			(memoryProperties->memoryTypes[i].propertyFlags & properties) == properties) {
+			return i;
+		}
+	}
+	return UINT32_MAX;
+}
+
+int ScoreMemoryType(VkMemoryPropertyFlags propertyFlags, MemoryUsage usage) {
+	// Neither can back an ordinary storage buffer
+	if (propertyFlags & (VK_MEMORY_PROPERTY_PROTECTED_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)) {
+		return -1;
+	}
+	const int deviceLocal = (propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0;
+	const int hostVisible = (propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+	const int hostCoherent = (propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+	const int hostCached = (propertyFlags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) != 0;
+	switch (usage) {
+	case MEMORY_USAGE_DEVICE:
+		// Leave host visible device memory, often a small BAR window, to uploads
+		return (deviceLocal ? 4 : 0) + (hostVisible ? 0 : 1);
+	case MEMORY_USAGE_UPLOAD:
+		if (!hostVisible || !hostCoherent) {
+			return -1;
+		}
+		// Host visible device memory is often a small BAR window that host reads cross the bus for, so prefer
+		// system memory
+		return (deviceLocal ? 0 : 2) + (hostCached ? 0 : 1);
+	case MEMORY_USAGE_READBACK:
+		if (!hostVisible) {
+			return -1;
+		}
+		// Uncached reads are an order of magnitude slower than cached ones plus an invalidate, and reads of
+		// device local memory cross the bus
+		return (hostCached ? 8 : 0) + (hostCoherent ? 2 : 0) + (deviceLocal ? 0 : 1);
+	}
+	return -1;
+}
+
+uint32_t SelectMemoryTypeIndex(const VkPhysicalDeviceMemoryProperties* memoryProperties, uint32_t typeBits, MemoryUsage usage) {
+	uint32_t bestIndex = UINT32_MAX;
+	int bestScore = -1;
+	for (uint32_t i = 0; i < memoryProperties->memoryTypeCount; ++i) {
+		if (!(typeBits & (1u << i))) {
+			continue;
+		}
+		int score = ScoreMemoryType(memoryProperties->memoryTypes[i].propertyFlags, usage);
+		if (score > bestScore) {
+			bestIndex = i;
+			bestScore = score;
+		}
+	}
+	return bestIndex;
+}
+
+void InitMemoryAllocator(MemoryAllocator* allocator, VkDevice device, const VkPhysicalDeviceMemoryProperties* memoryProperties,
+	uint32_t maxAllocationCount, VkDeviceSize blockSize) {
+
+	memset(allocator, 0, sizeof(*allocator));
+	allocator->device = device;
+	allocator->memoryProperties = *memoryProperties;
+	allocator->maxAllocationCount = maxAllocationCount;
+	allocator->blockSize = blockSize > 0 ? blockSize : DEFAULT_MEMORY_BLOCK_SIZE;
+}
+
+static void DestroyBlock(MemoryAllocator* allocator, MemoryBlock* block) {
+	if (block->mapped != NULL) {
+		vkUnmapMemory(allocator->device, block->memory);
+	}
+	vkFreeMemory(allocator->device, block->memory, NULL);
+	--allocator->deviceAllocationCount;
+
+	MemoryRange* range = block->freeRanges;
+	while (range != NULL) {
+		MemoryRange* next = range->next;
+		free(range);
+		range = next;
+	}
+	free(block);
+}
+
+void DestroyMemoryAllocator(MemoryAllocator* allocator) {
+	for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; ++i) {
+		MemoryBlock* block = allocator->pools[i];
+		while (block != NULL) {
+			MemoryBlock* next = block->next;
+			if (block->allocationCount > 0) {
+				printf("Freeing memory block with %u live allocations\n", block->allocationCount);
+			}
+			DestroyBlock(allocator, block);
+			block = next;
+		}
+		allocator->pools[i] = NULL;
+	}
+}
+
+static VkResult CreateBlock(MemoryAllocator* allocator, uint32_t memoryTypeIndex, VkDeviceSize size, int dedicated, MemoryBlock** pBlock) {
+	if (allocator->maxAllocationCount > 0 && allocator->deviceAllocationCount >= allocator->maxAllocationCount) {
+		puts("Reached maxMemoryAllocationCount");
+		return VK_ERROR_TOO_MANY_OBJECTS;
+	}
+
+	MemoryBlock* block = calloc(1, sizeof(MemoryBlock));
+	MemoryRange* range = calloc(1, sizeof(MemoryRange));
+	if (block == NULL || range == NULL) {
+		free(block);
+		free(range);
+		return VK_ERROR_OUT_OF_HOST_MEMORY;
+	}
+
+	VkMemoryAllocateFlagsInfo allocateFlagsInfo = { 0 };
+	allocateFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+	allocateFlagsInfo.pNext = NULL;
+	allocateFlagsInfo.flags = allocator->allocateFlags;
+	allocateFlagsInfo.deviceMask = 0;
+
+	VkMemoryAllocateInfo memoryAllocateInfo = { 0 };
+	memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memoryAllocateInfo.pNext = allocator->allocateFlags != 0 ? &allocateFlagsInfo : NULL;
+	memoryAllocateInfo.memoryTypeIndex = memoryTypeIndex;
+	memoryAllocateInfo.allocationSize = size;
+
+	VkResult result = vkAllocateMemory(allocator->device, &memoryAllocateInfo, NULL, &block->memory);
+	if (result != VK_SUCCESS) {
+		free(block);
+		free(range);
+		return result;
+	}
+	++allocator->deviceAllocationCount;
+
+	// Host visible blocks are mapped once for their whole lifetime, since memory can only be mapped once at a time
+	if (allocator->memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		result = vkMapMemory(allocator->device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped);
+		if (result != VK_SUCCESS) {
+			puts("Failed to map memory block");
+			block->mapped = NULL;
+			block->freeRanges = range;
+			DestroyBlock(allocator, block);
+			return result;
+		}
+	}
+
+	range->offset = 0;
+	range->size = size;
+	range->next = NULL;
+	block->size = size;
+	block->memoryTypeIndex = memoryTypeIndex;
+	block->dedicated = dedicated;
+	block->freeRanges = range;
+
+	block->next = allocator->pools[memoryTypeIndex];
+	allocator->pools[memoryTypeIndex] = block;
+
+	*pBlock = block;
+	return VK_SUCCESS;
+}
+
+// Best-fit search for an aligned range of the given size. Returns 0 if the block cannot hold it.
+static int TakeRange(MemoryBlock* block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset) {
+	MemoryRange* best = NULL;
+	MemoryRange* bestPrev = NULL;
+	VkDeviceSize bestLeftover = 0;
+
+	MemoryRange* prev = NULL;
+	for (MemoryRange* range = block->freeRanges; range != NULL; prev = range, range = range->next) {
+		VkDeviceSize padding = AlignUp(range->offset, alignment) - range->offset;
+		if (padding + size > range->size) {
+			continue;
+		}
+		VkDeviceSize leftover = range->size - padding - size;
+		if (best == NULL || leftover < bestLeftover) {
+			best = range;
+			bestPrev = prev;
+			bestLeftover = leftover;
+		}
+	}
+	if (best == NULL) {
+		return 0;
+	}
+
+	VkDeviceSize alignedOffset = AlignUp(best->offset, alignment);
+	VkDeviceSize padding = alignedOffset - best->offset;
+
+	// Keep the tail after the allocation as a free range
+	if (bestLeftover > 0) {
+		MemoryRange* tail = malloc(sizeof(MemoryRange));
+		if (tail == NULL) {
+			return 0;
+		}
+		tail->offset = alignedOffset + size;
+		tail->size = bestLeftover;
+		tail->next = best->next;
+		best->next = tail;
+	}
+
+	// Keep the alignment padding in front of the allocation as a free range, or drop the node if there is none
+	if (padding > 0) {
+		best->size = padding;
+	}
+	else {
+		if (bestPrev != NULL) {
+			bestPrev->next = best->next;
+		}
+		else {
+			block->freeRanges = best->next;
+		}
+		free(best);
+	}
+
+	*offset = alignedOffset;
+	return 1;
+}
+
+// Return a range to the block's free list, merging it with adjacent free ranges
+static void ReleaseRange(MemoryBlock* block, VkDeviceSize offset, VkDeviceSize size) {
+	MemoryRange* prev = NULL;
+	MemoryRange* next = block->freeRanges;
+	while (next != NULL && next->offset < offset) {
+		prev = next;
+		next = next->next;
+	}
+
+	if (prev != NULL && prev->offset + prev->size == offset) {
+		prev->size += size;
+		if (next != NULL && prev->offset + prev->size == next->offset) {
+			prev->size += next->size;
+			prev->next = next->next;
+			free(next);
+		}
+		return;
+	}
+
+	if (next != NULL && offset + size == next->offset) {
+		next->offset = offset;
+		next->size += size;
+		return;
+	}
+
+	MemoryRange* range = malloc(sizeof(MemoryRange));
+	if (range == NULL) {
+		// Leak the range rather than corrupt the list; it is reclaimed when the block is destroyed
+		return;
+	}
+	range->offset = offset;
+	range->size = size;
+	range->next = next;
+	if (prev != NULL) {
+		prev->next = range;
+	}
+	else {
+		block->freeRanges = range;
+	}
+}
+
+static VkResult AllocateFromType(MemoryAllocator* allocator, uint32_t memoryTypeIndex, const VkMemoryRequirements* requirements,
+	MemoryAllocation* allocation) {
+
+	VkDeviceSize size = requirements->size;
+	VkDeviceSize alignment = requirements->alignment;
+	const VkMemoryPropertyFlags propertyFlags = allocator->memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+	if ((propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+		// Both are powers of two, so the larger is a multiple of the smaller
+		size = AlignUp(size, allocator->nonCoherentAtomSize);
+		if (allocator->nonCoherentAtomSize > alignment) {
+			alignment = allocator->nonCoherentAtomSize;
+		}
+	}
+	MemoryBlock* block = NULL;
+	VkDeviceSize offset = 0;
+	VkResult result = VK_SUCCESS;
+
+	if (size > allocator->blockSize / 2) {
+		result = CreateBlock(allocator, memoryTypeIndex, size, 1, &block);
+		if (result != VK_SUCCESS) {
+			return result;
+		}
+		TakeRange(block, size, 1, &offset);
+	}
+	else {
+		for (block = allocator->pools[memoryTypeIndex]; block != NULL; block = block->next) {
+			if (!block->dedicated && TakeRange(block, size, alignment, &offset)) {
+				break;
+			}
+		}
+
+		// No room in existing blocks. If a full-size block cannot be allocated, retry with smaller ones.
+		if (block == NULL) {
+			VkDeviceSize blockSize = allocator->blockSize;
+			do {
+				result = CreateBlock(allocator, memoryTypeIndex, blockSize, 0, &block);
+				blockSize /= 2;
+			} while ((result == VK_ERROR_OUT_OF_DEVICE_MEMORY || result == VK_ERROR_OUT_OF_HOST_MEMORY) &&
+				blockSize >= size && blockSize >= allocator->blockSize / 8);
+			if (result != VK_SUCCESS) {
+				return result;
+			}
+			if (!TakeRange(block, size, alignment, &offset)) {
+				return VK_ERROR_OUT_OF_HOST_MEMORY;
+			}
+		}
+	}
+
+	block->usedBytes += size;
+	++block->allocationCount;
+
+	allocation->block = block;
+	allocation->memory = block->memory;
+	allocation->offset = offset;
+	allocation->size = size;
+	allocation->memoryTypeIndex = memoryTypeIndex;
+	allocation->mapped = block->mapped != NULL ? (char*) block->mapped + offset : NULL;
+	return VK_SUCCESS;
+}
+
+VkResult AllocateDeviceMemory(MemoryAllocator* allocator, const VkMemoryRequirements* requirements,
+	VkMemoryPropertyFlags properties, MemoryAllocation* allocation) {
+
+	memset(allocation, 0, sizeof(*allocation));
+	if (requirements->size == 0) {
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+
+	// Try each compatible memory type in order, moving on if one runs out of space
+	VkResult result = VK_ERROR_FEATURE_NOT_PRESENT;
+	uint32_t typeBits = requirements->memoryTypeBits;
+	uint32_t memoryTypeIndex = FindMemoryTypeIndex(&allocator->memoryProperties, typeBits, properties);
+	while (memoryTypeIndex != UINT32_MAX) {
+		result = AllocateFromType(allocator, memoryTypeIndex, requirements, allocation);
+		if (result != VK_ERROR_OUT_OF_DEVICE_MEMORY) {
+			break;
+		}
+		typeBits &= ~(1u << memoryTypeIndex);
+		memoryTypeIndex = FindMemoryTypeIndex(&allocator->memoryProperties, typeBits, properties);
+	}
+
+	if (result == VK_ERROR_FEATURE_NOT_PRESENT) {
+		puts("Failed to find a compatible memory type");
+	}
+	return result;
+}
+
+VkResult AllocateDeviceMemoryForUsage(MemoryAllocator* allocator, const VkMemoryRequirements* requirements,
+	MemoryUsage usage, MemoryAllocation* allocation) {
+
+	memset(allocation, 0, sizeof(*allocation));
+	if (requirements->size == 0) {
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+
+	VkResult result = VK_ERROR_FEATURE_NOT_PRESENT;
+	uint32_t typeBits = requirements->memoryTypeBits;
+	uint32_t memoryTypeIndex = SelectMemoryTypeIndex(&allocator->memoryProperties, typeBits, usage);
+	while (memoryTypeIndex != UINT32_MAX) {
+		result = AllocateFromType(allocator, memoryTypeIndex, requirements, allocation);
+		if (result != VK_ERROR_OUT_OF_DEVICE_MEMORY) {
+			break;
+		}
+		typeBits &= ~(1u << memoryTypeIndex);
+		memoryTypeIndex = SelectMemoryTypeIndex(&allocator->memoryProperties, typeBits, usage);
+	}
+
+	if (result == VK_ERROR_FEATURE_NOT_PRESENT) {
+		puts("Failed to find a compatible memory type");
+	}
+	return result;
+}
+
+VkResult AllocateDeviceMemoryOfType(MemoryAllocator* allocator, const VkMemoryRequirements* requirements,
+	uint32_t memoryTypeIndex, MemoryAllocation* allocation) {
+
+	memset(allocation, 0, sizeof(*allocation));
+	if (requirements->size == 0 || memoryTypeIndex >= allocator->memoryProperties.memoryTypeCount ||
+		!(requirements->memoryTypeBits & (1u << memoryTypeIndex))) {
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+	}
+	return AllocateFromType(allocator, memoryTypeIndex, requirements, allocation);
+}
+
+void FreeDeviceMemory(MemoryAllocator* allocator, MemoryAllocation* allocation) {
+	MemoryBlock* block = allocation->block;
+	if (block == NULL) {
+		return;
+	}
+
+	ReleaseRange(block, allocation->offset, allocation->size);
+	block->usedBytes -= allocation->size;
+	--block->allocationCount;
+
+	// Release empty blocks, but keep the last shared block of each type around to avoid allocation churn
+	if (block->allocationCount == 0) {
+		MemoryBlock** link = &allocator->pools[block->memoryTypeIndex];
+		int otherSharedBlocks = 0;
+		for (MemoryBlock* other = *link; other != NULL; other = other->next) {
+			if (other != block && !other->dedicated) {
+				otherSharedBlocks = 1;
+			}
+		}
+		if (block->dedicated || otherSharedBlocks) {
+			while (*link != block) {
+				link = &(*link)->next;
+			}
+			*link = block->next;
+			DestroyBlock(allocator, block);
+		}
+	}
+
+	memset(allocation, 0, sizeof(*allocation));
+}
+
+// The atom-aligned range of the memory object covering size bytes at offset into allocation. Returns 0 if there
+// is nothing to flush or invalidate.
+static int GetNonCoherentRange(const MemoryAllocator* allocator, const MemoryAllocation* allocation,
+	VkDeviceSize offset, VkDeviceSize size, VkMappedMemoryRange* range) {
+
+	if (allocation->memory == VK_NULL_HANDLE || allocation->mapped == NULL || offset >= allocation->size ||
+		(allocator->memoryProperties.memoryTypes[allocation->memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+		return 0;
+	}
+	if (size == VK_WHOLE_SIZE || size > allocation->size - offset) {
+		size = allocation->size - offset;
+	}
+	if (size == 0) {
+		return 0;
+	}
+
+	// Allocations in non-coherent memory start and end on atom boundaries, so the widened range stays inside
+	const VkDeviceSize atomSize = allocator->nonCoherentAtomSize > 0 ? allocator->nonCoherentAtomSize : 1;
+	const VkDeviceSize start = (allocation->offset + offset) / atomSize * atomSize;
+	const VkDeviceSize end = AlignUp(allocation->offset + offset + size, atomSize);
+	range->sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	range->pNext = NULL;
+	range->memory = allocation->memory;
+	range->offset = start;
+	range->size = end - start;
+	return 1;
+}
+
+VkResult FlushMemoryAllocation(const MemoryAllocator* allocator, const MemoryAllocation* allocation,
+	VkDeviceSize offset, VkDeviceSize size) {
+
+	VkMappedMemoryRange range = { 0 };
+	if (!GetNonCoherentRange(allocator, allocation, offset, size, &range)) {
+		return VK_SUCCESS;
+	}
+	return vkFlushMappedMemoryRanges(allocator->device, 1, &range);
+}
+
+VkResult InvalidateMemoryAllocation(const MemoryAllocator* allocator, const MemoryAllocation* allocation,
+	VkDeviceSize offset, VkDeviceSize size) {
+
+	VkMappedMemoryRange range = { 0 };
+	if (!GetNonCoherentRange(allocator, allocation, offset, size, &range)) {
+		return VK_SUCCESS;
+	}
+	return vkInvalidateMappedMemoryRanges(allocator->device, 1, &range);
+}
+
+void GetMemoryAllocatorStats(const MemoryAllocator* allocator, uint32_t memoryTypeIndex, MemoryAllocatorStats* stats) {
+	memset(stats, 0, sizeof(*stats));
+
+	for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; ++i) {
+		if (memoryTypeIndex != UINT32_MAX && memoryTypeIndex != i) {
+			continue;
+		}
+		for (const MemoryBlock* block = allocator->pools[i]; block != NULL; block = block->next) {
+			++stats->blockCount;
+			stats->allocationCount += block->allocationCount;
+			stats->reservedBytes += block->size;
+			stats->usedBytes += block->usedBytes;
+			for (const MemoryRange* range = block->freeRanges; range != NULL; range = range->next) {
+				stats->freeBytes += range->size;
+				if (range->size > stats->largestFreeRange) {
+					stats->largestFreeRange = range->size;
+				}
+			}
+		}
+	}
+
+	if (stats->reservedBytes > 0) {
+		stats->utilisation = (double) stats->usedBytes / (double) stats->reservedBytes;
+	}
+	if (stats->freeBytes > 0) {
+		stats->fragmentation = 1.0 - (double) stats->largestFreeRange / (double) stats->freeBytes;
+	}
+}
+
+void PrintMemoryAllocatorStats(const MemoryAllocator* allocator) {
+	for (uint32_t i = 0; i < allocator->memoryProperties.memoryTypeCount; ++i) {
+		if (allocator->pools[i] == NULL) {
+			continue;
+		}
+		MemoryAllocatorStats stats;
+		GetMemoryAllocatorStats(allocator, i, &stats);
+		printf("Memory type %u: %u blocks, %u allocations, %llu/%llu bytes used (%.1f%%), fragmentation %.1f%%\n",
+			i, stats.blockCount, stats.allocationCount,
+			(unsigned long long) stats.usedBytes, (unsigned long long) stats.reservedBytes,
+			stats.utilisation * 100.0, stats.fragmentation * 100.0);
+	}
+}
@@ -0,0 +1,114 @@
+#include <vulkan/vulkan.h>
+
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#define DEFAULT_MEMORY_BLOCK_SIZE (64ull * 1024 * 1024)
+
+// A free byte range inside a block, kept in a list sorted by offset
+typedef struct MemoryRange {
+	VkDeviceSize offset;
+	VkDeviceSize size;
+	struct MemoryRange* next;
+} MemoryRange;
+
+// One VkDeviceMemory slab that allocations are carved out of
+typedef struct MemoryBlock {
+	VkDeviceMemory memory;
+	VkDeviceSize size;
+	VkDeviceSize usedBytes;
+	uint32_t allocationCount;
+	uint32_t memoryTypeIndex;
+	int dedicated;
+	void* mapped;
+	MemoryRange* freeRanges;
+	struct MemoryBlock* next;
+} MemoryBlock;
+
+typedef struct MemoryAllocation {
+	MemoryBlock* block;
+	VkDeviceMemory memory;
+	VkDeviceSize offset;
+	VkDeviceSize size;
+	uint32_t memoryTypeIndex;
+	// Host pointer to offset if the memory type is host visible, otherwise NULL
+	void* mapped;
+} MemoryAllocation;
+
+typedef struct MemoryAllocator {
+	VkDevice device;
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	VkDeviceSize blockSize;
+	uint32_t maxAllocationCount;
+	uint32_t deviceAllocationCount;
+	// Flags every VkDeviceMemory is allocated with, e.g. VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT so that buffers
+	// bound to it can have device addresses
+	VkMemoryAllocateFlags allocateFlags;
+	// VkPhysicalDeviceLimits::nonCoherentAtomSize. Allocations in host visible, non-coherent memory are aligned
+	// and sized to whole atoms, so flushing or invalidating one never touches its neighbours.
+	VkDeviceSize nonCoherentAtomSize;
+	MemoryBlock* pools[VK_MAX_MEMORY_TYPES];
+} MemoryAllocator;
+
+typedef struct MemoryAllocatorStats {
+	uint32_t blockCount;
+	uint32_t allocationCount;
+	VkDeviceSize reservedBytes;
+	VkDeviceSize usedBytes;
+	VkDeviceSize freeBytes;
+	VkDeviceSize largestFreeRange;
+	// usedBytes / reservedBytes
+	double utilisation;
+	// 1 - largestFreeRange / freeBytes: 0 when all free space is contiguous, approaching 1 when it is scattered
+	double fragmentation;
+} MemoryAllocatorStats;
+
+// How the host uses a resource, for ranking the memory types it could live in
+typedef enum MemoryUsage {
+	// Only the device accesses it
+	MEMORY_USAGE_DEVICE,
+	// The host writes it and the device reads it through a persistent mapping, without flushes, so it must be
+	// host coherent; uncached, write-combined memory is fine
+	MEMORY_USAGE_UPLOAD,
+	// The device writes it and the host reads it; cached memory matters far more than coherence
+	MEMORY_USAGE_READBACK
+} MemoryUsage;
+
+// Returns the index of a memory type allowed by typeBits that has all of the requested properties, or UINT32_MAX
+uint32_t FindMemoryTypeIndex(const VkPhysicalDeviceMemoryProperties* memoryProperties, uint32_t typeBits, VkMemoryPropertyFlags properties);
+
+// Score of a memory type with propertyFlags for usage, higher is better, or a negative value if it is unusable
+int ScoreMemoryType(VkMemoryPropertyFlags propertyFlags, MemoryUsage usage);
+// Returns the index of the highest scoring memory type allowed by typeBits, or UINT32_MAX
+uint32_t SelectMemoryTypeIndex(const VkPhysicalDeviceMemoryProperties* memoryProperties, uint32_t typeBits, MemoryUsage usage);
+
+// blockSize of 0 selects DEFAULT_MEMORY_BLOCK_SIZE. maxAllocationCount is VkPhysicalDeviceLimits::maxMemoryAllocationCount.
+void InitMemoryAllocator(MemoryAllocator* allocator, VkDevice device, const VkPhysicalDeviceMemoryProperties* memoryProperties,
+	uint32_t maxAllocationCount, VkDeviceSize blockSize);
+void DestroyMemoryAllocator(MemoryAllocator* allocator);
+
+// Sub-allocate memory that satisfies requirements from a block of a memory type with all of the requested properties.
+// Requests larger than half the block size get a dedicated VkDeviceMemory.
+VkResult AllocateDeviceMemory(MemoryAllocator* allocator, const VkMemoryRequirements* requirements,
+	VkMemoryPropertyFlags properties, MemoryAllocation* allocation);
+// Same as AllocateDeviceMemory, trying the memory types in order of their score for usage
+VkResult AllocateDeviceMemoryForUsage(MemoryAllocator* allocator, const VkMemoryRequirements* requirements,
+	MemoryUsage usage, MemoryAllocation* allocation);
+// Same as AllocateDeviceMemory, from exactly one memory type
+VkResult AllocateDeviceMemoryOfType(MemoryAllocator* allocator, const VkMemoryRequirements* requirements,
+	uint32_t memoryTypeIndex, MemoryAllocation* allocation);
+void FreeDeviceMemory(MemoryAllocator* allocator, MemoryAllocation* allocation);
+
+// Make host writes to size bytes at offset into a mapped allocation visible to the device, or device writes
+// visible to the host, widened to whole nonCoherentAtomSize atoms. size may be VK_WHOLE_SIZE for the rest of the
+// allocation. Both do nothing for host coherent memory.
+VkResult FlushMemoryAllocation(const MemoryAllocator* allocator, const MemoryAllocation* allocation,
+	VkDeviceSize offset, VkDeviceSize size);
+VkResult InvalidateMemoryAllocation(const MemoryAllocator* allocator, const MemoryAllocation* allocation,
+	VkDeviceSize offset, VkDeviceSize size);
+
+// Statistics for one memory type, or for all memory types if memoryTypeIndex is UINT32_MAX
+void GetMemoryAllocatorStats(const MemoryAllocator* allocator, uint32_t memoryTypeIndex, MemoryAllocatorStats* stats);
+void PrintMemoryAllocatorStats(const MemoryAllocator* allocator);
+
+#endif
@@ -0,0 +1,245 @@
+#include "autotune.h"
+#include "buffer.h"
+#include "timer.h"
+#include <vulkan/vulkan.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Push constants are only guaranteed up to 128 bytes
+#define MAX_AUTOTUNE_PUSH_CONSTANT_SIZE 128
+// Dispatches recorded back to back per submission, so submission overhead does not dominate small sizes
+#define AUTOTUNE_DISPATCHES_PER_SUBMIT 8
+// Timed submissions per candidate; the fastest one is kept
+#define AUTOTUNE_REPEATS 3
+
+static const uint32_t localSizeCandidates[] = { 32, 64, 128, 256, 512, 1024 };
+static const uint32_t elementsPerInvocationCandidates[] = { 1, 2, 4, 8 };
+
+static int GetAutotunePath(const ComputeContext* context, const char* directory, char* path, size_t size) {
+	char identifier[64];
+	if (!GetDeviceIdentifier(context, identifier, sizeof(identifier))) {
+		return 0;
+	}
+	int length = snprintf(path, size, "%s/autotune_%s.txt", directory, identifier);
+	return length >= 0 && (size_t) length < size;
+}
+
+// Kernels are identified by their shader, plus the dispatch cap for grid-stride kernels which share a shader. The
+// best configuration depends on the problem size, so results are also keyed by elementCount rounded down to a
+// power of two
+static void GetAutotuneKey(const ComputeKernelCreateInfo* createInfo, uint64_t elementCount, char* key, size_t size) {
+	uint64_t sizeBucket = 1;
+	while (sizeBucket <= elementCount / 2) {
+		sizeBucket *= 2;
+	}
+	if (createInfo->maxGroupCount > 0) {
+		snprintf(key, size, "%s:grid%u:n%llu", createInfo->shaderFile, createInfo->maxGroupCount, (unsigned long long) sizeBucket);
+	}
+	else {
+		snprintf(key, size, "%s:n%llu", createInfo->shaderFile, (unsigned long long) sizeBucket);
+	}
+}
+
+// Look up the line "<key> <elementCount> <localSizeX> <elementsPerInvocation> <dispatchNs>" for a kernel
+static int LoadAutotuneResult(const char* path, const char* key, AutotuneResult* result) {
+	FILE* file = fopen(path, "r");
+	if (file == NULL) {
+		return 0;
+	}
+
+	int found = 0;
+	char line[1024];
+	char name[512];
+	unsigned long long elementCount = 0;
+	unsigned long long dispatchNs = 0;
+	uint32_t localSizeX = 0;
+	uint32_t elementsPerInvocation = 0;
+	while (!found && fgets(line, sizeof(line), file) != NULL) {
+		if (sscanf(line, "%511s %llu %u %u %llu", name, &elementCount, &localSizeX, &elementsPerInvocation, &dispatchNs) == 5 &&
+			strcmp(name, key) == 0 && localSizeX > 0 && elementsPerInvocation > 0) {
+			result->localSizeX = localSizeX;
+			result->elementsPerInvocation = elementsPerInvocation;
+			result->dispatchNs = dispatchNs;
+			result->loaded = 1;
+			found = 1;
+		}
+	}
+	fclose(file);
+	return found;
+}
+
+// Replace the kernel's line in the autotune file, keeping the results of other kernels
+static VkResult SaveAutotuneResult(const char* path, const char* key, uint64_t elementCount, const AutotuneResult* result) {
+	char tempPath[576];
+	if (!GetTempFilePath(path, tempPath, sizeof(tempPath))) {
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+
+	FILE* output = fopen(tempPath, "w");
+	if (output == NULL) {
+		printf("Failed to open autotune file %s\n", tempPath);
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+
+	FILE* input = fopen(path, "r");
+	if (input != NULL) {
+		char line[1024];
+		char name[512];
+		while (fgets(line, sizeof(line), input) != NULL) {
+			if (sscanf(line, "%511s", name) == 1 && strcmp(name, key) != 0) {
+				fputs(line, output);
+			}
+		}
+		fclose(input);
+	}
+
+	fprintf(output, "%s %llu %u %u %llu\n", key, (unsigned long long) elementCount,
+		result->localSizeX, result->elementsPerInvocation, (unsigned long long) result->dispatchNs);
+	if (fclose(output) != 0) {
+		printf("Failed to write autotune file %s\n", tempPath);
+		remove(tempPath);
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+
+	if (rename(tempPath, path) != 0) {
+		// rename does not replace an existing file on Windows
+		remove(path);
+		if (rename(tempPath, path) != 0) {
+			printf("Failed to write autotune file %s\n", path);
+			remove(tempPath);
+			return VK_ERROR_INITIALIZATION_FAILED;
+		}
+	}
+	return VK_SUCCESS;
+}
+
+// Benchmark every supported candidate and return the fastest in best
+static VkResult RunAutotune(ComputeContext* context, const ComputeKernelCreateInfo* createInfo,
+	uint64_t elementCount, VkDeviceSize elementSize, AutotuneResult* best) {
+
+	if (createInfo->pushConstantSize < sizeof(uint32_t) || createInfo->pushConstantSize > MAX_AUTOTUNE_PUSH_CONSTANT_SIZE ||
+		elementCount == 0 || elementCount > UINT32_MAX) {
+		puts("Invalid autotune configuration");
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+
+	ComputeBuffer* buffers = calloc(createInfo->bindingCount, sizeof(ComputeBuffer));
+	if (buffers == NULL) {
+		return VK_ERROR_OUT_OF_HOST_MEMORY;
+	}
+	VkResult result = VK_SUCCESS;
+	for (uint32_t i = 0; i < createInfo->bindingCount && result == VK_SUCCESS; ++i) {
+		result = CreateComputeBuffer(context, elementCount * elementSize, BUFFER_LOCATION_DEVICE, &buffers[i]);
+	}
+	if (result == VK_SUCCESS) {
+		// Zero every buffer so the candidates all read the same, well-behaved values
+		result = ClearComputeBuffers(context, buffers, createInfo->bindingCount);
+	}
+
+	uint32_t pushConstants[MAX_AUTOTUNE_PUSH_CONSTANT_SIZE / sizeof(uint32_t)] = { 0 };
+	pushConstants[0] = (uint32_t) elementCount;
+
+	memset(best, 0, sizeof(*best));
+	const uint32_t localSizeCount = sizeof(localSizeCandidates) / sizeof(localSizeCandidates[0]);
+	const uint32_t elementsPerInvocationCount = sizeof(elementsPerInvocationCandidates) / sizeof(elementsPerInvocationCandidates[0]);
+	const VkPhysicalDeviceLimits* limits = &context->physicalDeviceProperties.limits;
+	for (uint32_t i = 0; i < localSizeCount && result == VK_SUCCESS; ++i) {
+		if (localSizeCandidates[i] > limits->maxComputeWorkGroupSize[0] ||
+			localSizeCandidates[i] > limits->maxComputeWorkGroupInvocations) {
+			continue;
+		}
+
+		for (uint32_t j = 0; j < elementsPerInvocationCount && result == VK_SUCCESS; ++j) {
+			ComputeKernelCreateInfo candidateInfo = *createInfo;
+			candidateInfo.localSizeX = localSizeCandidates[i];
+			candidateInfo.elementsPerInvocation = elementsPerInvocationCandidates[j];
+
+			// A candidate the driver cannot build is skipped rather than ending the tune
+			ComputeKernel kernel = { 0 };
+			if (CreateComputeKernel(context, &candidateInfo, &kernel) != VK_SUCCESS) {
+				printf("Autotune local size %4u x %u elements per invocation: skipped, kernel creation failed\n",
+					candidateInfo.localSizeX, candidateInfo.elementsPerInvocation);
+				continue;
+			}
+
+			uint32_t groupCountX = 0;
+			uint32_t groupCountY = 0;
+			uint32_t groupCountZ = 0;
+			if (ComputeDispatchSize(context, &kernel, elementCount, &groupCountX, &groupCountY, &groupCountZ) != VK_SUCCESS) {
+				DestroyComputeKernel(context, &kernel);
+				continue;
+			}
+
+			result = BindComputeBuffers(context, &kernel, buffers);
+
+			// The first submission warms up the pipeline and caches and is not counted
+			uint64_t fastestNs = UINT64_MAX;
+			for (uint32_t repeat = 0; repeat <= AUTOTUNE_REPEATS && result == VK_SUCCESS; ++repeat) {
+				uint64_t elapsedNs = 0;
+				result = TimeComputeKernel(context, &kernel, pushConstants, groupCountX, groupCountY, groupCountZ,
+					AUTOTUNE_DISPATCHES_PER_SUBMIT, &elapsedNs);
+				if (repeat > 0 && elapsedNs < fastestNs) {
+					fastestNs = elapsedNs;
+				}
+			}
+			DestroyComputeKernel(context, &kernel);
+			if (result != VK_SUCCESS) {
+				break;
+			}
+
+			uint64_t dispatchNs = fastestNs / AUTOTUNE_DISPATCHES_PER_SUBMIT;
+			printf("Autotune local size %4u x %u elements per invocation: %.3f ms\n",
+				candidateInfo.localSizeX, candidateInfo.elementsPerInvocation, NsToMs(dispatchNs));
+			if (best->localSizeX == 0 || dispatchNs < best->dispatchNs) {
+				best->localSizeX = candidateInfo.localSizeX;
+				best->elementsPerInvocation = candidateInfo.elementsPerInvocation;
+				best->dispatchNs = dispatchNs;
+			}
+		}
+	}
+
+	for (uint32_t i = 0; i < createInfo->bindingCount; ++i) {
+		DestroyComputeBuffer(context, &buffers[i]);
+	}
+	free(buffers);
+
+	if (result == VK_SUCCESS && best->localSizeX == 0) {
+		puts("No autotune candidate is supported by this device");
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+	}
+	return result;
+}
+
+VkResult AutotuneComputeKernel(ComputeContext* context, const char* directory, const ComputeKernelCreateInfo* createInfo,
+	uint64_t elementCount, VkDeviceSize elementSize, int retune, AutotuneResult* result) {
+
+	memset(result, 0, sizeof(*result));
+
+	char path[512];
+	if (!GetAutotunePath(context, directory, path, sizeof(path))) {
+		puts("Autotune path is too long");
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+
+	char key[512];
+	GetAutotuneKey(createInfo, elementCount, key, sizeof(key));
+
+	// A stored result is only trusted if the device can still build it
+	const VkPhysicalDeviceLimits* limits = &context->physicalDeviceProperties.limits;
+	if (!retune && LoadAutotuneResult(path, key, result) &&
+		result->localSizeX <= limits->maxComputeWorkGroupSize[0] &&
+		result->localSizeX <= limits->maxComputeWorkGroupInvocations) {
+		return VK_SUCCESS;
+	}
+	memset(result, 0, sizeof(*result));
+
+	VkResult vkResult = RunAutotune(context, createInfo, elementCount, elementSize, result);
+	if (vkResult != VK_SUCCESS) {
+		return vkResult;
+	}
+
+	// Failing to persist the winner only costs a retune on the next run
+	SaveAutotuneResult(path, key, elementCount, result);
+	return VK_SUCCESS;
+}
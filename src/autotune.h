@@ -0,0 +1,29 @@
+#include <vulkan/vulkan.h>
+#include "context.h"
+#include "kernel.h"
+
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+// Number of elements dispatched per measurement when the caller does not pick a size
+#define DEFAULT_AUTOTUNE_ELEMENT_COUNT (1u << 22)
+
+typedef struct AutotuneResult {
+	uint32_t localSizeX;
+	uint32_t elementsPerInvocation;
+	// Fastest measured time of one dispatch over the benchmark size
+	uint64_t dispatchNs;
+	// Non-zero if the result was read from a previous run instead of measured
+	int loaded;
+} AutotuneResult;
+
+// Pick the fastest localSizeX and elementsPerInvocation for an elementwise kernel on this device. The winner is
+// persisted per shader, grid-stride cap and power-of-two size bucket in directory/autotune_<device identifier>.txt,
+// so the candidates are only benchmarked the first time a kernel runs at that size on a device and driver, or
+// whenever retune is non-zero. createInfo describes the kernel; its localSizeX and elementsPerInvocation are
+// ignored. Each candidate is dispatched over elementCount elements of elementSize bytes in every binding, with the
+// element count as the first push constant and the rest zeroed. Candidates that fail to build are skipped.
+VkResult AutotuneComputeKernel(ComputeContext* context, const char* directory, const ComputeKernelCreateInfo* createInfo,
+	uint64_t elementCount, VkDeviceSize elementSize, int retune, AutotuneResult* result);
+
+#endif
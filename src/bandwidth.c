@@ -0,0 +1,104 @@
+#include "bandwidth.h"
+#include "timer.h"
+#include <vulkan/vulkan.h>
+#include <stdio.h>
+#include <string.h>
+
+// Passes recorded into one submission, so submission overhead is amortized
+#define BANDWIDTH_PASSES_PER_SUBMIT 8
+// Timed submissions; the fastest one is kept
+#define BANDWIDTH_REPEATS 5
+
+static void SetThroughput(BandwidthResult* result) {
+	result->throughputGBs = result->passNs > 0 ? (double) result->bytesMoved / (double) result->passNs : 0.0;
+}
+
+VkResult MeasureKernelBandwidth(ComputeContext* context, ComputeKernel* kernel, const ComputeBuffer* buffers,
+	uint64_t elementCount, VkDeviceSize bytesPerElement, const void* pushConstants, BandwidthResult* result) {
+
+	memset(result, 0, sizeof(*result));
+
+	uint32_t groupCountX = 0;
+	uint32_t groupCountY = 0;
+	uint32_t groupCountZ = 0;
+	VkResult vkResult = ComputeDispatchSize(context, kernel, elementCount, &groupCountX, &groupCountY, &groupCountZ);
+	if (vkResult != VK_SUCCESS) {
+		return vkResult;
+	}
+	vkResult = BindComputeBuffers(context, kernel, buffers);
+	if (vkResult != VK_SUCCESS) {
+		return vkResult;
+	}
+
+	// The first submission is a warmup and is not counted
+	uint64_t fastestNs = UINT64_MAX;
+	for (uint32_t repeat = 0; repeat <= BANDWIDTH_REPEATS; ++repeat) {
+		uint64_t elapsedNs = 0;
+		vkResult = TimeComputeKernel(context, kernel, pushConstants, groupCountX, groupCountY, groupCountZ,
+			BANDWIDTH_PASSES_PER_SUBMIT, &elapsedNs);
+		if (vkResult != VK_SUCCESS) {
+			return vkResult;
+		}
+		if (repeat > 0 && elapsedNs < fastestNs) {
+			fastestNs = elapsedNs;
+		}
+	}
+
+	result->passNs = fastestNs / BANDWIDTH_PASSES_PER_SUBMIT;
+	result->bytesMoved = elementCount * bytesPerElement;
+	SetThroughput(result);
+	return VK_SUCCESS;
+}
+
+VkResult MeasureCopyBandwidth(ComputeContext* context, const ComputeBuffer* src, const ComputeBuffer* dst,
+	VkDeviceSize size, BandwidthResult* result) {
+
+	memset(result, 0, sizeof(*result));
+
+	VkBufferCopy region = { 0 };
+	region.srcOffset = 0;
+	region.dstOffset = 0;
+	region.size = size;
+
+	// Copies write the same destination, so order them like the kernel passes
+	VkMemoryBarrier memoryBarrier = { 0 };
+	memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memoryBarrier.pNext = NULL;
+	memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	uint64_t fastestNs = UINT64_MAX;
+	for (uint32_t repeat = 0; repeat <= BANDWIDTH_REPEATS; ++repeat) {
+		VkResult vkResult = BeginComputeCommandBuffer(context);
+		if (vkResult != VK_SUCCESS) {
+			return vkResult;
+		}
+		for (uint32_t i = 0; i < BANDWIDTH_PASSES_PER_SUBMIT; ++i) {
+			if (i > 0) {
+				vkCmdPipelineBarrier(context->commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+					0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+			}
+			vkCmdCopyBuffer(context->commandBuffer, src->buffer, dst->buffer, 1, &region);
+		}
+		vkResult = vkEndCommandBuffer(context->commandBuffer);
+		if (vkResult != VK_SUCCESS) {
+			puts("Failed to end recording command buffer");
+			return vkResult;
+		}
+
+		uint64_t startTime = GetTimeNs();
+		vkResult = SubmitAndWait(context);
+		uint64_t elapsedNs = GetTimeNs() - startTime;
+		if (vkResult != VK_SUCCESS) {
+			return vkResult;
+		}
+		if (repeat > 0 && elapsedNs < fastestNs) {
+			fastestNs = elapsedNs;
+		}
+	}
+
+	result->passNs = fastestNs / BANDWIDTH_PASSES_PER_SUBMIT;
+	result->bytesMoved = 2 * size;
+	SetThroughput(result);
+	return VK_SUCCESS;
+}
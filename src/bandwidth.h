@@ -0,0 +1,28 @@
+#include <vulkan/vulkan.h>
+#include "context.h"
+#include "buffer.h"
+#include "kernel.h"
+
+#ifndef BANDWIDTH_H
+#define BANDWIDTH_H
+
+typedef struct BandwidthResult {
+	// Fastest measured time of one pass over the buffers
+	uint64_t passNs;
+	// Bytes read plus bytes written by one pass
+	VkDeviceSize bytesMoved;
+	// bytesMoved per passNs, in units of 1e9 bytes per second
+	double throughputGBs;
+} BandwidthResult;
+
+// Measure the memory throughput of an elementwise kernel over elementCount elements, counting
+// bytesPerElement bytes of reads and writes per element. Buffers are bound to the kernel first.
+VkResult MeasureKernelBandwidth(ComputeContext* context, ComputeKernel* kernel, const ComputeBuffer* buffers,
+	uint64_t elementCount, VkDeviceSize bytesPerElement, const void* pushConstants, BandwidthResult* result);
+
+// Measure vkCmdCopyBuffer throughput from src to dst, counting size bytes read and size bytes written per copy.
+// Vulkan does not report the memory clock or bus width, so this is the practical peak kernels are compared against.
+VkResult MeasureCopyBandwidth(ComputeContext* context, const ComputeBuffer* src, const ComputeBuffer* dst,
+	VkDeviceSize size, BandwidthResult* result);
+
+#endif
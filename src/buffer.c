@@ -0,0 +1,234 @@
+#include "buffer.h"
+#include <vulkan/vulkan.h>
+#include <stdio.h>
+#include <string.h>
+
+// Create the buffer and allocate its memory of memoryTypeIndex, or else of the best type for location
+static VkResult CreateBuffer(ComputeContext* context, VkDeviceSize size, BufferLocation location, uint32_t memoryTypeIndex,
+	ComputeBuffer* buffer) {
+
+	memset(buffer, 0, sizeof(*buffer));
+	buffer->size = size;
+	buffer->location = location;
+
+	// Native kernels work on plain host memory, wherever the buffer was asked to live
+	if (context->cpuBackend) {
+		buffer->mapped = AllocateCpuMemory(size);
+		if (buffer->mapped == NULL) {
+			puts("Failed to allocate memory for buffer");
+			return VK_ERROR_OUT_OF_HOST_MEMORY;
+		}
+		return VK_SUCCESS;
+	}
+
+	VkBufferCreateInfo bufferCreateInfo = { 0 };
+	bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferCreateInfo.pNext = NULL;
+	bufferCreateInfo.flags = 0;
+	bufferCreateInfo.size = size;
+	bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	if (context->bufferDeviceAddress) {
+		bufferCreateInfo.usage |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+	}
+	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	bufferCreateInfo.queueFamilyIndexCount = 1;
+	bufferCreateInfo.pQueueFamilyIndices = &context->computeQueueIndex;
+
+	VkResult result = vkCreateBuffer(context->device, &bufferCreateInfo, NULL, &buffer->buffer);
+	if (result != VK_SUCCESS) {
+		puts("Failed to create buffer");
+		return result;
+	}
+
+	VkMemoryRequirements memoryRequirements = { 0 };
+	vkGetBufferMemoryRequirements(context->device, buffer->buffer, &memoryRequirements);
+
+	if (memoryTypeIndex != UINT32_MAX) {
+		result = AllocateDeviceMemoryOfType(&context->allocator, &memoryRequirements, memoryTypeIndex, &buffer->allocation);
+	}
+	else {
+		MemoryUsage usage = MEMORY_USAGE_UPLOAD;
+		if (location == BUFFER_LOCATION_DEVICE) {
+			usage = MEMORY_USAGE_DEVICE;
+		}
+		else if (location == BUFFER_LOCATION_READBACK) {
+			usage = MEMORY_USAGE_READBACK;
+		}
+		result = AllocateDeviceMemoryForUsage(&context->allocator, &memoryRequirements, usage, &buffer->allocation);
+	}
+	if (result != VK_SUCCESS) {
+		puts("Failed to allocate memory for buffer");
+		DestroyComputeBuffer(context, buffer);
+		return result;
+	}
+
+	result = vkBindBufferMemory(context->device, buffer->buffer, buffer->allocation.memory, buffer->allocation.offset);
+	if (result != VK_SUCCESS) {
+		puts("Failed to bind memory to buffer");
+		DestroyComputeBuffer(context, buffer);
+		return result;
+	}
+
+	if (context->bufferDeviceAddress) {
+		VkBufferDeviceAddressInfo addressInfo = { 0 };
+		addressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+		addressInfo.pNext = NULL;
+		addressInfo.buffer = buffer->buffer;
+		buffer->address = vkGetBufferDeviceAddress(context->device, &addressInfo);
+	}
+
+	// Device local memory may also be host visible on integrated GPUs, but staging is always used for it
+	if (location != BUFFER_LOCATION_DEVICE) {
+		buffer->mapped = buffer->allocation.mapped;
+	}
+	return VK_SUCCESS;
+}
+
+VkResult CreateComputeBuffer(ComputeContext* context, VkDeviceSize size, BufferLocation location, ComputeBuffer* buffer) {
+	return CreateBuffer(context, size, location, UINT32_MAX, buffer);
+}
+
+VkResult CreateComputeBufferOfType(ComputeContext* context, VkDeviceSize size, uint32_t memoryTypeIndex, ComputeBuffer* buffer) {
+	if (context->cpuBackend) {
+		return CreateBuffer(context, size, BUFFER_LOCATION_HOST, UINT32_MAX, buffer);
+	}
+	const VkMemoryPropertyFlags propertyFlags = context->memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+	const BufferLocation location = (propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) ? BUFFER_LOCATION_READBACK : BUFFER_LOCATION_DEVICE;
+	return CreateBuffer(context, size, location, memoryTypeIndex, buffer);
+}
+
+VkResult CreateTypedComputeBuffer(ComputeContext* context, uint64_t elementCount, ElementType elementType,
+	BufferLocation location, ComputeBuffer* buffer) {
+
+	const VkDeviceSize size = (elementCount * GetElementSize(elementType) + 3) / 4 * 4;
+	VkResult result = CreateBuffer(context, size, location, UINT32_MAX, buffer);
+	buffer->elementType = elementType;
+	return result;
+}
+
+void DestroyComputeBuffer(ComputeContext* context, ComputeBuffer* buffer) {
+	if (context->cpuBackend) {
+		FreeCpuMemory(buffer->mapped);
+		memset(buffer, 0, sizeof(*buffer));
+		return;
+	}
+	// A destroyed buffer must not be acquired by the next command buffer
+	for (uint32_t i = 0; i < context->releasedBufferCount; ++i) {
+		if (context->releasedBuffers[i] == buffer->buffer) {
+			context->releasedBuffers[i] = context->releasedBuffers[--context->releasedBufferCount];
+			break;
+		}
+	}
+	vkDestroyBuffer(context->device, buffer->buffer, NULL);
+	if (buffer->imported) {
+		vkFreeMemory(context->device, buffer->allocation.memory, NULL);
+	}
+	else {
+		FreeDeviceMemory(&context->allocator, &buffer->allocation);
+	}
+	memset(buffer, 0, sizeof(*buffer));
+}
+
+VkResult ClearComputeBuffers(ComputeContext* context, const ComputeBuffer* buffers, uint32_t bufferCount) {
+	if (context->cpuBackend) {
+		for (uint32_t i = 0; i < bufferCount; ++i) {
+			memset(buffers[i].mapped, 0, buffers[i].size);
+		}
+		return VK_SUCCESS;
+	}
+
+	VkResult result = BeginComputeCommandBuffer(context);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+	for (uint32_t i = 0; i < bufferCount; ++i) {
+		vkCmdFillBuffer(context->commandBuffer, buffers[i].buffer, 0, VK_WHOLE_SIZE, 0);
+	}
+	result = vkEndCommandBuffer(context->commandBuffer);
+	if (result != VK_SUCCESS) {
+		puts("Failed to end recording command buffer");
+		return result;
+	}
+	return SubmitAndWait(context);
+}
+
+VkResult FlushComputeBuffer(ComputeContext* context, const ComputeBuffer* buffer, VkDeviceSize offset, VkDeviceSize size) {
+	return FlushMemoryAllocation(&context->allocator, &buffer->allocation, offset, size);
+}
+
+VkResult InvalidateComputeBuffer(ComputeContext* context, const ComputeBuffer* buffer, VkDeviceSize offset, VkDeviceSize size) {
+	return InvalidateMemoryAllocation(&context->allocator, &buffer->allocation, offset, size);
+}
+
+// Property flags of the buffer's memory; CPU backend buffers are plain cached host memory
+static VkMemoryPropertyFlags GetBufferMemoryFlags(const ComputeContext* context, const ComputeBuffer* buffer) {
+	if (context->cpuBackend) {
+		return VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+	}
+	return context->memoryProperties.memoryTypes[buffer->allocation.memoryTypeIndex].propertyFlags;
+}
+
+VkResult WriteComputeBuffer(ComputeContext* context, const ComputeBuffer* buffer, VkDeviceSize offset, const void* data,
+	size_t size) {
+
+	if (buffer->mapped == NULL || offset + size > buffer->size) {
+		return VK_ERROR_MEMORY_MAP_FAILED;
+	}
+	CopyToMappedMemory(&context->hostCopier, (char*) buffer->mapped + offset, data, size, GetBufferMemoryFlags(context, buffer));
+	return FlushComputeBuffer(context, buffer, offset, size);
+}
+
+VkResult ReadComputeBuffer(ComputeContext* context, const ComputeBuffer* buffer, VkDeviceSize offset, void* data,
+	size_t size) {
+
+	if (buffer->mapped == NULL || offset + size > buffer->size) {
+		return VK_ERROR_MEMORY_MAP_FAILED;
+	}
+	VkResult result = InvalidateComputeBuffer(context, buffer, offset, size);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+	CopyFromMappedMemory(&context->hostCopier, data, (const char*) buffer->mapped + offset, size, GetBufferMemoryFlags(context, buffer));
+	return VK_SUCCESS;
+}
+
+uint32_t GetElementSize(ElementType elementType) {
+	switch (elementType) {
+	case ELEMENT_TYPE_FLOAT16:
+	case ELEMENT_TYPE_BFLOAT16:
+		return 2;
+	case ELEMENT_TYPE_INT8:
+		return 1;
+	default:
+		return 4;
+	}
+}
+
+const char* GetElementTypeName(ElementType elementType) {
+	switch (elementType) {
+	case ELEMENT_TYPE_FLOAT32:
+		return "fp32";
+	case ELEMENT_TYPE_FLOAT16:
+		return "fp16";
+	case ELEMENT_TYPE_BFLOAT16:
+		return "bf16";
+	case ELEMENT_TYPE_INT8:
+		return "int8";
+	default:
+		return "unknown";
+	}
+}
+
+int IsElementTypeSupported(const ComputeContext* context, ElementType elementType) {
+	switch (elementType) {
+	case ELEMENT_TYPE_FLOAT32:
+		return 1;
+	case ELEMENT_TYPE_FLOAT16:
+	case ELEMENT_TYPE_BFLOAT16:
+		return context->storage16Bit;
+	case ELEMENT_TYPE_INT8:
+		return context->storage8Bit;
+	default:
+		return 0;
+	}
+}
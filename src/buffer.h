@@ -0,0 +1,79 @@
+#include <vulkan/vulkan.h>
+#include "context.h"
+#include "allocator.h"
+
+#ifndef BUFFER_H
+#define BUFFER_H
+
+typedef enum BufferLocation {
+	// Host visible and coherent (MEMORY_USAGE_UPLOAD); the host reads and writes the buffer directly through mapped
+	BUFFER_LOCATION_HOST,
+	// Device local, and not host visible where possible (MEMORY_USAGE_DEVICE); other memory only once device
+	// local memory runs out. Filled and drained through staging copies on the transfer queue, mapped is NULL.
+	BUFFER_LOCATION_DEVICE,
+	// Host visible, in the memory type that scores best for reading results back: host cached where available,
+	// even if not coherent. Call InvalidateComputeBuffer before reading what the device wrote and
+	// FlushComputeBuffer after writing data for the device.
+	BUFFER_LOCATION_READBACK
+} BufferLocation;
+
+// Storage format of buffer elements. Kernels over the reduced precision formats convert to float for their math,
+// so they only move fewer bytes.
+typedef enum ElementType {
+	ELEMENT_TYPE_FLOAT32,
+	// IEEE half precision
+	ELEMENT_TYPE_FLOAT16,
+	// The upper 16 bits of a float: its range with 8 bits of mantissa
+	ELEMENT_TYPE_BFLOAT16,
+	// Signed integers, saturated to [-128, 127]
+	ELEMENT_TYPE_INT8,
+	ELEMENT_TYPE_COUNT
+} ElementType;
+
+// A storage buffer sub-allocated from the context's memory pools. Host located buffers are mapped for their whole lifetime.
+typedef struct ComputeBuffer {
+	VkBuffer buffer;
+	MemoryAllocation allocation;
+	VkDeviceSize size;
+	BufferLocation location;
+	void* mapped;
+	// Address shaders can access the buffer through, or 0 if the context has no bufferDeviceAddress
+	VkDeviceAddress address;
+	// Non-zero if the buffer wraps imported host memory with its own VkDeviceMemory (see src/external.h)
+	int imported;
+	// ELEMENT_TYPE_FLOAT32 unless created by CreateTypedComputeBuffer
+	ElementType elementType;
+} ComputeBuffer;
+
+VkResult CreateComputeBuffer(ComputeContext* context, VkDeviceSize size, BufferLocation location, ComputeBuffer* buffer);
+// Create a buffer in memory type memoryTypeIndex, mapped if it is host visible, e.g. to compare memory types
+VkResult CreateComputeBufferOfType(ComputeContext* context, VkDeviceSize size, uint32_t memoryTypeIndex, ComputeBuffer* buffer);
+// A buffer of elementCount elements of elementType, padded to a multiple of 4 bytes
+VkResult CreateTypedComputeBuffer(ComputeContext* context, uint64_t elementCount, ElementType elementType,
+	BufferLocation location, ComputeBuffer* buffer);
+void DestroyComputeBuffer(ComputeContext* context, ComputeBuffer* buffer);
+
+// Flush the host's writes to size bytes at offset (VK_WHOLE_SIZE for the rest) so the device sees them, or
+// invalidate them so the host sees the device's writes. Only the atoms covering the range are touched, and
+// nothing is done for host coherent memory.
+VkResult FlushComputeBuffer(ComputeContext* context, const ComputeBuffer* buffer, VkDeviceSize offset, VkDeviceSize size);
+VkResult InvalidateComputeBuffer(ComputeContext* context, const ComputeBuffer* buffer, VkDeviceSize offset, VkDeviceSize size);
+
+// Zero bufferCount whole buffers on the device and wait, e.g. so benchmarks all read the same, well-behaved values
+VkResult ClearComputeBuffers(ComputeContext* context, const ComputeBuffer* buffers, uint32_t bufferCount);
+
+// Copy size bytes of data into a mapped buffer at offset with the context's host copier, then flush them.
+// Write-combined memory gets streaming stores.
+VkResult WriteComputeBuffer(ComputeContext* context, const ComputeBuffer* buffer, VkDeviceSize offset, const void* data,
+	size_t size);
+// Invalidate size bytes at offset of a mapped buffer, then copy them to data with the context's host copier
+VkResult ReadComputeBuffer(ComputeContext* context, const ComputeBuffer* buffer, VkDeviceSize offset, void* data,
+	size_t size);
+
+uint32_t GetElementSize(ElementType elementType);
+const char* GetElementTypeName(ElementType elementType);
+// Whether the device can run kernels over buffers of elementType: 16-bit formats need storage16Bit and int8
+// needs storage8Bit
+int IsElementTypeSupported(const ComputeContext* context, ElementType elementType);
+
+#endif
@@ -0,0 +1,812 @@
+#include "context.h"
+#include "timer.h"
+#include <vulkan/vulkan.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+static VkResult CreateInstance(ComputeContext* context) {
+	const char* requestedLayers[] = {
+		"VK_LAYER_KHRONOS_validation"
+	};
+	const uint32_t requestedLayerCount = sizeof(requestedLayers) / sizeof(*requestedLayers);
+
+	// Get supported layer count
+	uint32_t supportedLayerCount = 0;
+	VkResult result = vkEnumerateInstanceLayerProperties(&supportedLayerCount, NULL);
+	if (result != VK_SUCCESS) {
+		puts("Failed to get supported layers");
+		return result;
+	}
+
+	VkLayerProperties* supportedLayers = malloc(sizeof(VkLayerProperties) * supportedLayerCount);
+	if (supportedLayers == NULL && supportedLayerCount > 0) {
+		return VK_ERROR_OUT_OF_HOST_MEMORY;
+	}
+	result = vkEnumerateInstanceLayerProperties(&supportedLayerCount, supportedLayers);
+	if (result != VK_SUCCESS) {
+		puts("Failed to get supported layers");
+		free(supportedLayers);
+		return result;
+	}
+
+	const char* enabledLayers[sizeof(requestedLayers) / sizeof(*requestedLayers)] = { 0 };
+	uint32_t enabledLayerCount = 0;
+	for (uint32_t i = 0; i < requestedLayerCount; ++i) {
+		for (uint32_t j = 0; j < supportedLayerCount; ++j) {
+			if (!strcmp(requestedLayers[i], supportedLayers[j].layerName)) {
+				enabledLayers[enabledLayerCount] = requestedLayers[i];
+				++enabledLayerCount;
+				break;
+			}
+		}
+	}
+
+	free(supportedLayers);
+
+	printf("Enabled layer count: %u\n", enabledLayerCount);
+	for (uint32_t i = 0; i < enabledLayerCount; ++i) {
+		printf("\t%s\n", enabledLayers[i]);
+	}
+
+	// Ask for Vulkan 1.2 (timeline semaphores) when the loader knows it. 1.0 loaders lack vkEnumerateInstanceVersion
+	// and reject any apiVersion above 1.0.
+	context->apiVersion = VK_API_VERSION_1_0;
+	PFN_vkEnumerateInstanceVersion enumerateInstanceVersion =
+		(PFN_vkEnumerateInstanceVersion) vkGetInstanceProcAddr(VK_NULL_HANDLE, "vkEnumerateInstanceVersion");
+	uint32_t loaderVersion = VK_API_VERSION_1_0;
+	if (enumerateInstanceVersion != NULL && enumerateInstanceVersion(&loaderVersion) == VK_SUCCESS) {
+		context->apiVersion = loaderVersion >= VK_API_VERSION_1_2 ? VK_API_VERSION_1_2 : loaderVersion;
+	}
+
+	VkApplicationInfo applicationInfo = { 0 };
+	applicationInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+	applicationInfo.pNext = NULL;
+	applicationInfo.pApplicationName = "vkcompute";
+	applicationInfo.applicationVersion = 0;
+	applicationInfo.pEngineName = NULL;
+	applicationInfo.engineVersion = 0;
+	applicationInfo.apiVersion = context->apiVersion;
+
+	// Create a Vulkan instance
+	VkInstanceCreateInfo instanceInfo = { 0 };
+	instanceInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+	instanceInfo.pNext = NULL;
+	instanceInfo.flags = 0;
+	instanceInfo.pApplicationInfo = &applicationInfo;
+	instanceInfo.enabledLayerCount = enabledLayerCount;
+	instanceInfo.ppEnabledLayerNames = enabledLayers;
+	instanceInfo.enabledExtensionCount = 0;
+	instanceInfo.ppEnabledExtensionNames = NULL;
+
+	result = vkCreateInstance(&instanceInfo, NULL, &context->instance);
+	if (result != VK_SUCCESS) {
+		puts("Failed to create a Vulkan instance");
+		return result;
+	}
+
+	return VK_SUCCESS;
+}
+
+// Return every physical device in malloc'd *physicalDevices, most preferred first: discrete GPUs, then integrated
+// GPUs. Virtual GPUs and CPU implementations such as lavapipe come last, for headless CI machines.
+static VkResult GetPhysicalDevicesByPreference(VkInstance instance, VkPhysicalDevice** physicalDevices, uint32_t* physicalDeviceCount) {
+	// Query the number of physical devices
+	uint32_t deviceCount = 0;
+	VkResult result = vkEnumeratePhysicalDevices(instance, &deviceCount, NULL);
+	if (result != VK_SUCCESS) {
+		puts("Failed to enumerate physical devices");
+		return result;
+	}
+
+	// Get handles to each physical devices
+	VkPhysicalDevice* devices = malloc(sizeof(VkPhysicalDevice) * deviceCount);
+	VkPhysicalDevice* sortedDevices = malloc(sizeof(VkPhysicalDevice) * deviceCount);
+	if ((devices == NULL || sortedDevices == NULL) && deviceCount > 0) {
+		free(devices);
+		free(sortedDevices);
+		return VK_ERROR_OUT_OF_HOST_MEMORY;
+	}
+	result = vkEnumeratePhysicalDevices(instance, &deviceCount, devices);
+	if (result != VK_SUCCESS) {
+		puts("Failed to enumerate physical devices");
+		free(devices);
+		free(sortedDevices);
+		return result;
+	}
+
+	VkPhysicalDeviceType preferredTypes[] = {
+		VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU,
+		VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU,
+		VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU,
+		VK_PHYSICAL_DEVICE_TYPE_CPU
+	};
+	// Query each device once rather than once per preferred type
+	VkPhysicalDeviceType* deviceTypes = malloc(sizeof(VkPhysicalDeviceType) * deviceCount);
+	if (deviceTypes == NULL && deviceCount > 0) {
+		free(devices);
+		free(sortedDevices);
+		return VK_ERROR_OUT_OF_HOST_MEMORY;
+	}
+	for (uint32_t i = 0; i < deviceCount; ++i) {
+		VkPhysicalDeviceProperties deviceProperties = { 0 };
+		vkGetPhysicalDeviceProperties(devices[i], &deviceProperties);
+		deviceTypes[i] = deviceProperties.deviceType;
+	}
+	uint32_t sortedCount = 0;
+	for (uint32_t t = 0; t < 4; ++t) {
+		for (uint32_t i = 0; i < deviceCount; ++i) {
+			if (deviceTypes[i] == preferredTypes[t]) {
+				sortedDevices[sortedCount++] = devices[i];
+			}
+		}
+	}
+
+	free(deviceTypes);
+	free(devices);
+	*physicalDevices = sortedDevices;
+	*physicalDeviceCount = sortedCount;
+	return VK_SUCCESS;
+}
+
+static void UsePhysicalDevice(ComputeContext* context, VkPhysicalDevice physicalDevice) {
+	VkPhysicalDeviceProperties physicalDeviceProperties = { 0 };
+	vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
+
+	if (physicalDeviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
+		printf("Selected discrete GPU: %s\n", physicalDeviceProperties.deviceName);
+	}
+	else if (physicalDeviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU) {
+		printf("Selected integrated GPU: %s\n", physicalDeviceProperties.deviceName);
+	}
+	else if (physicalDeviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU) {
+		printf("Selected virtual GPU: %s\n", physicalDeviceProperties.deviceName);
+	}
+	else {
+		printf("Selected CPU device: %s\n", physicalDeviceProperties.deviceName);
+	}
+
+	context->physicalDevice = physicalDevice;
+	context->physicalDeviceProperties = physicalDeviceProperties;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &context->memoryProperties);
+}
+
+static VkResult SelectPhysicalDevice(ComputeContext* context) {
+	VkPhysicalDevice* physicalDevices = NULL;
+	uint32_t physicalDeviceCount = 0;
+	VkResult result = GetPhysicalDevicesByPreference(context->instance, &physicalDevices, &physicalDeviceCount);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+
+	if (physicalDeviceCount == 0) {
+		puts("No Vulkan devices found!");
+		free(physicalDevices);
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+	UsePhysicalDevice(context, physicalDevices[0]);
+
+	free(physicalDevices);
+	return VK_SUCCESS;
+}
+
+// Check whether the device supports a device extension
+static int HasDeviceExtension(VkPhysicalDevice physicalDevice, const char* name) {
+	uint32_t extensionCount = 0;
+	if (vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &extensionCount, NULL) != VK_SUCCESS) {
+		return 0;
+	}
+	VkExtensionProperties* extensions = malloc(sizeof(VkExtensionProperties) * extensionCount);
+	if (extensions == NULL) {
+		return 0;
+	}
+	int found = 0;
+	if (vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &extensionCount, extensions) == VK_SUCCESS) {
+		for (uint32_t i = 0; i < extensionCount && !found; ++i) {
+			found = !strcmp(extensions[i].extensionName, name);
+		}
+	}
+	free(extensions);
+	return found;
+}
+
+static VkResult CreateDevice(ComputeContext* context) {
+	// Query the number of queue families available for this device
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(context->physicalDevice, &queueFamilyCount, NULL);
+
+	// Get the properties of all available queue families
+	VkQueueFamilyProperties* queueFamilyProperties = malloc(sizeof(VkQueueFamilyProperties) * queueFamilyCount);
+	if (queueFamilyProperties == NULL) {
+		return VK_ERROR_OUT_OF_HOST_MEMORY;
+	}
+	vkGetPhysicalDeviceQueueFamilyProperties(context->physicalDevice, &queueFamilyCount, queueFamilyProperties);
+
+	// Select find queue families that are capable of compute and transfers
+	uint32_t computeQueueIndex = 0;
+	uint32_t transferQueueIndex = 0;
+	for (uint32_t i = 0; i < queueFamilyCount; ++i) {
+		if (queueFamilyProperties[i].queueFlags & VK_QUEUE_COMPUTE_BIT) {
+			computeQueueIndex = i;
+		}
+	}
+	for (uint32_t i = 0; i < queueFamilyCount; ++i) {
+		if (queueFamilyProperties[i].queueFlags & VK_QUEUE_TRANSFER_BIT) {
+			transferQueueIndex = i;
+		}
+	}
+	// Prefer a dedicated transfer family (usually backed by DMA engines) so staging copies overlap with compute
+	for (uint32_t i = 0; i < queueFamilyCount; ++i) {
+		VkQueueFlags flags = queueFamilyProperties[i].queueFlags;
+		if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_COMPUTE_BIT | VK_QUEUE_GRAPHICS_BIT))) {
+			transferQueueIndex = i;
+			break;
+		}
+	}
+
+	uint32_t computeQueueCount = queueFamilyProperties[computeQueueIndex].queueCount;
+	if (computeQueueCount > MAX_COMPUTE_QUEUES) {
+		computeQueueCount = MAX_COMPUTE_QUEUES;
+	}
+
+	free(queueFamilyProperties);
+
+	printf("Using queue family %u for compute (%u queues)\n", computeQueueIndex, computeQueueCount);
+	printf("Using queue family %u for transfers\n", transferQueueIndex);
+
+	// When we create the logical device, we need to tell it how many queues to create from each queue family
+	uint32_t queueCount = 0;
+	if (computeQueueIndex == transferQueueIndex) {
+		queueCount = 1;
+	}
+	else {
+		queueCount = 2;
+	}
+
+	// Create every queue of the compute family so independent work can run on all of them
+	uint32_t queueFamilyIndices[2] = { computeQueueIndex, transferQueueIndex };
+	uint32_t queueFamilyQueueCounts[2] = { computeQueueCount, 1 };
+	float queuePriorities[MAX_COMPUTE_QUEUES];
+	for (uint32_t i = 0; i < MAX_COMPUTE_QUEUES; ++i) {
+		queuePriorities[i] = 1.f;
+	}
+	VkDeviceQueueCreateInfo queueCreateInfo[2] = { 0 };
+	for (uint32_t i = 0; i < queueCount; ++i) {
+		queueCreateInfo[i].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+		queueCreateInfo[i].pNext = NULL;
+		queueCreateInfo[i].flags = 0;
+		queueCreateInfo[i].queueFamilyIndex = queueFamilyIndices[i];
+		queueCreateInfo[i].queueCount = queueFamilyQueueCounts[i];
+		queueCreateInfo[i].pQueuePriorities = queuePriorities;
+	}
+
+	// Enable timeline semaphores, host query reset, buffer device addresses, descriptor indexing and 16-bit and
+	// 8-bit storage if both the instance and the device are Vulkan 1.2, where VK_KHR_16bit_storage,
+	// VK_KHR_8bit_storage and VK_KHR_shader_float16_int8 are core
+	VkPhysicalDeviceHostQueryResetFeatures queryResetFeatures = { 0 };
+	queryResetFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_QUERY_RESET_FEATURES;
+	queryResetFeatures.pNext = NULL;
+
+	VkPhysicalDeviceShaderFloat16Int8Features float16Int8Features = { 0 };
+	float16Int8Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_FLOAT16_INT8_FEATURES;
+	float16Int8Features.pNext = &queryResetFeatures;
+
+	VkPhysicalDevice8BitStorageFeatures storage8BitFeatures = { 0 };
+	storage8BitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_8BIT_STORAGE_FEATURES;
+	storage8BitFeatures.pNext = &float16Int8Features;
+
+	VkPhysicalDevice16BitStorageFeatures storage16BitFeatures = { 0 };
+	storage16BitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_16BIT_STORAGE_FEATURES;
+	storage16BitFeatures.pNext = &storage8BitFeatures;
+
+	VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures = { 0 };
+	indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+	indexingFeatures.pNext = &storage16BitFeatures;
+
+	VkPhysicalDeviceBufferDeviceAddressFeatures addressFeatures = { 0 };
+	addressFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES;
+	addressFeatures.pNext = &indexingFeatures;
+
+	VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures = { 0 };
+	timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+	timelineFeatures.pNext = &addressFeatures;
+	timelineFeatures.timelineSemaphore = VK_FALSE;
+	const int vulkan12 = context->apiVersion >= VK_API_VERSION_1_2 &&
+		context->physicalDeviceProperties.apiVersion >= VK_API_VERSION_1_2;
+	VkPhysicalDeviceFeatures2 features = { 0 };
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features.pNext = &timelineFeatures;
+	if (vulkan12) {
+		vkGetPhysicalDeviceFeatures2(context->physicalDevice, &features);
+	}
+	int timelineSemaphores = timelineFeatures.timelineSemaphore == VK_TRUE;
+	int hostQueryReset = queryResetFeatures.hostQueryReset == VK_TRUE;
+	int bufferDeviceAddress = addressFeatures.bufferDeviceAddress == VK_TRUE;
+	int descriptorIndexing = indexingFeatures.runtimeDescriptorArray == VK_TRUE &&
+		indexingFeatures.descriptorBindingPartiallyBound == VK_TRUE &&
+		indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind == VK_TRUE &&
+		indexingFeatures.descriptorBindingUpdateUnusedWhilePending == VK_TRUE &&
+		features.features.shaderStorageBufferArrayDynamicIndexing == VK_TRUE;
+	int storage16Bit = storage16BitFeatures.storageBuffer16BitAccess == VK_TRUE;
+	int storage8Bit = storage8BitFeatures.storageBuffer8BitAccess == VK_TRUE;
+
+	// Only enable the features that are used
+	addressFeatures.bufferDeviceAddress = bufferDeviceAddress ? VK_TRUE : VK_FALSE;
+	addressFeatures.bufferDeviceAddressCaptureReplay = VK_FALSE;
+	addressFeatures.bufferDeviceAddressMultiDevice = VK_FALSE;
+	VkBool32 indexingEnabled = descriptorIndexing ? VK_TRUE : VK_FALSE;
+	memset(&indexingFeatures, 0, sizeof(indexingFeatures));
+	indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+	indexingFeatures.pNext = &storage16BitFeatures;
+	indexingFeatures.runtimeDescriptorArray = indexingEnabled;
+	indexingFeatures.descriptorBindingPartiallyBound = indexingEnabled;
+	indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind = indexingEnabled;
+	indexingFeatures.descriptorBindingUpdateUnusedWhilePending = indexingEnabled;
+	// The bindless table is indexed with slots from push constants. Core features go at the head of the chain,
+	// in place of pEnabledFeatures.
+	memset(&features.features, 0, sizeof(features.features));
+	features.features.shaderStorageBufferArrayDynamicIndexing = indexingEnabled;
+	// Reduced precision buffers are only read and written as storage buffers, with math in float
+	storage16BitFeatures.uniformAndStorageBuffer16BitAccess = VK_FALSE;
+	storage16BitFeatures.storagePushConstant16 = VK_FALSE;
+	storage16BitFeatures.storageInputOutput16 = VK_FALSE;
+	storage8BitFeatures.uniformAndStorageBuffer8BitAccess = VK_FALSE;
+	storage8BitFeatures.storagePushConstant8 = VK_FALSE;
+	float16Int8Features.shaderFloat16 = VK_FALSE;
+	float16Int8Features.shaderInt8 = VK_FALSE;
+
+	// VK_KHR_push_descriptor needs no features, only the extension
+	const char* extensions[2];
+	uint32_t extensionCount = 0;
+	int pushDescriptors = HasDeviceExtension(context->physicalDevice, VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+	if (pushDescriptors) {
+		extensions[extensionCount++] = VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME;
+	}
+
+	// VK_EXT_external_memory_host builds on external memory, which is core from Vulkan 1.1
+	VkPhysicalDeviceExternalMemoryHostPropertiesEXT hostMemoryProperties = { 0 };
+	hostMemoryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+	hostMemoryProperties.pNext = NULL;
+	int externalMemoryHost = context->apiVersion >= VK_API_VERSION_1_1 &&
+		context->physicalDeviceProperties.apiVersion >= VK_API_VERSION_1_1 &&
+		HasDeviceExtension(context->physicalDevice, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+	if (externalMemoryHost) {
+		VkPhysicalDeviceProperties2 properties = { 0 };
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties.pNext = &hostMemoryProperties;
+		vkGetPhysicalDeviceProperties2(context->physicalDevice, &properties);
+		extensions[extensionCount++] = VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME;
+	}
+
+	// Subgroup operations are core from Vulkan 1.1 and reported per shader stage
+	VkPhysicalDeviceSubgroupProperties subgroupProperties = { 0 };
+	subgroupProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+	subgroupProperties.pNext = NULL;
+	if (context->apiVersion >= VK_API_VERSION_1_1 && context->physicalDeviceProperties.apiVersion >= VK_API_VERSION_1_1) {
+		VkPhysicalDeviceProperties2 properties = { 0 };
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties.pNext = &subgroupProperties;
+		vkGetPhysicalDeviceProperties2(context->physicalDevice, &properties);
+	}
+	const VkSubgroupFeatureFlags subgroupOperations = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT;
+	int subgroupArithmetic = (subgroupProperties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) &&
+		(subgroupProperties.supportedOperations & subgroupOperations) == subgroupOperations;
+
+	// Create the logical device
+	VkDeviceCreateInfo deviceCreateInfo = { 0 };
+	deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	deviceCreateInfo.pNext = vulkan12 ? &features : NULL;
+	deviceCreateInfo.flags = 0;
+	deviceCreateInfo.queueCreateInfoCount = queueCount;
+	deviceCreateInfo.pQueueCreateInfos = queueCreateInfo;
+	deviceCreateInfo.enabledLayerCount = 0;
+	deviceCreateInfo.ppEnabledLayerNames = NULL;
+	deviceCreateInfo.enabledExtensionCount = extensionCount;
+	deviceCreateInfo.ppEnabledExtensionNames = extensionCount > 0 ? extensions : NULL;
+	deviceCreateInfo.pEnabledFeatures = NULL;
+
+	VkResult result = vkCreateDevice(context->physicalDevice, &deviceCreateInfo, NULL, &context->device);
+	if (result != VK_SUCCESS) {
+		puts("Failed to create a logical device!");
+		return result;
+	}
+
+	context->computeQueueIndex = computeQueueIndex;
+	context->transferQueueIndex = transferQueueIndex;
+	vkGetDeviceQueue(context->device, computeQueueIndex, 0, &context->computeQueue);
+	for (uint32_t i = 0; i < computeQueueCount; ++i) {
+		vkGetDeviceQueue(context->device, computeQueueIndex, i, &context->computeQueues[i]);
+	}
+	context->computeQueueCount = computeQueueCount;
+	context->timelineSemaphores = timelineSemaphores;
+	context->hostQueryReset = hostQueryReset;
+	printf("Timeline semaphores %s, host query reset %s\n", timelineSemaphores ? "enabled" : "not supported",
+		hostQueryReset ? "enabled" : "not supported");
+	if (pushDescriptors) {
+		context->vkCmdPushDescriptorSetKHR =
+			(PFN_vkCmdPushDescriptorSetKHR) vkGetDeviceProcAddr(context->device, "vkCmdPushDescriptorSetKHR");
+	}
+	context->pushDescriptors = context->vkCmdPushDescriptorSetKHR != NULL;
+	context->bufferDeviceAddress = bufferDeviceAddress;
+	context->descriptorIndexing = descriptorIndexing;
+	if (externalMemoryHost) {
+		context->vkGetMemoryHostPointerPropertiesEXT = (PFN_vkGetMemoryHostPointerPropertiesEXT)
+			vkGetDeviceProcAddr(context->device, "vkGetMemoryHostPointerPropertiesEXT");
+		context->minImportedHostPointerAlignment = hostMemoryProperties.minImportedHostPointerAlignment;
+	}
+	context->externalMemoryHost = context->vkGetMemoryHostPointerPropertiesEXT != NULL;
+	printf("Push descriptors %s, buffer device address %s, descriptor indexing %s\n",
+		context->pushDescriptors ? "enabled" : "not supported", bufferDeviceAddress ? "enabled" : "not supported",
+		descriptorIndexing ? "enabled" : "not supported");
+	if (context->externalMemoryHost) {
+		printf("Host memory import enabled, %llu byte alignment\n",
+			(unsigned long long) context->minImportedHostPointerAlignment);
+	}
+	context->subgroupSize = subgroupProperties.subgroupSize;
+	context->subgroupArithmetic = subgroupArithmetic;
+	printf("Subgroup size %u, subgroup arithmetic %s\n", subgroupProperties.subgroupSize,
+		subgroupArithmetic ? "supported" : "not supported");
+	context->storage16Bit = storage16Bit;
+	context->storage8Bit = storage8Bit;
+	printf("16-bit storage %s, 8-bit storage %s\n", storage16Bit ? "enabled" : "not supported",
+		storage8Bit ? "enabled" : "not supported");
+	vkGetDeviceQueue(context->device, transferQueueIndex, 0, &context->transferQueue);
+
+	InitMemoryAllocator(&context->allocator, context->device, &context->memoryProperties,
+		context->physicalDeviceProperties.limits.maxMemoryAllocationCount, DEFAULT_MEMORY_BLOCK_SIZE);
+	if (bufferDeviceAddress) {
+		context->allocator.allocateFlags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+	}
+	context->allocator.nonCoherentAtomSize = context->physicalDeviceProperties.limits.nonCoherentAtomSize;
+
+	return VK_SUCCESS;
+}
+
+static VkResult CreateCommandObjects(ComputeContext* context) {
+	// Command buffers are re-recorded for every dispatch, so they must be individually resettable
+	VkCommandPoolCreateInfo commandPoolInfo = { 0 };
+	commandPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	commandPoolInfo.pNext = NULL;
+	commandPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	commandPoolInfo.queueFamilyIndex = context->computeQueueIndex;
+
+	VkResult result = vkCreateCommandPool(context->device, &commandPoolInfo, NULL, &context->commandPool);
+	if (result != VK_SUCCESS) {
+		puts("Failed to create command pool");
+		return result;
+	}
+
+	VkCommandBufferAllocateInfo commandBufferAllocateInfo = { 0 };
+	commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	commandBufferAllocateInfo.pNext = NULL;
+	commandBufferAllocateInfo.commandPool = context->commandPool;
+	commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	commandBufferAllocateInfo.commandBufferCount = 1;
+
+	result = vkAllocateCommandBuffers(context->device, &commandBufferAllocateInfo, &context->commandBuffer);
+	if (result != VK_SUCCESS) {
+		puts("Failed to allocate command buffer");
+		return result;
+	}
+
+	// Create a fence
+	VkFenceCreateInfo fenceInfo = { 0 };
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceInfo.pNext = NULL;
+	fenceInfo.flags = 0;
+
+	result = vkCreateFence(context->device, &fenceInfo, NULL, &context->fence);
+	if (result != VK_SUCCESS) {
+		puts("Failed to create fence");
+		return result;
+	}
+
+	// Create a command pool and command buffers for staging copies on the transfer queue
+	commandPoolInfo.queueFamilyIndex = context->transferQueueIndex;
+	result = vkCreateCommandPool(context->device, &commandPoolInfo, NULL, &context->transferCommandPool);
+	if (result != VK_SUCCESS) {
+		puts("Failed to create transfer command pool");
+		return result;
+	}
+
+	VkCommandBuffer transferCommandBuffers[2] = { VK_NULL_HANDLE };
+	commandBufferAllocateInfo.commandPool = context->transferCommandPool;
+	commandBufferAllocateInfo.commandBufferCount = 2;
+	result = vkAllocateCommandBuffers(context->device, &commandBufferAllocateInfo, transferCommandBuffers);
+	if (result != VK_SUCCESS) {
+		puts("Failed to allocate transfer command buffers");
+		return result;
+	}
+	context->uploadCommandBuffer = transferCommandBuffers[0];
+	context->downloadCommandBuffer = transferCommandBuffers[1];
+
+	// Create semaphores ordering upload -> compute -> download
+	VkSemaphoreCreateInfo semaphoreInfo = { 0 };
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreInfo.pNext = NULL;
+	semaphoreInfo.flags = 0;
+
+	result = vkCreateSemaphore(context->device, &semaphoreInfo, NULL, &context->uploadSemaphore);
+	if (result != VK_SUCCESS) {
+		puts("Failed to create semaphore");
+		return result;
+	}
+	result = vkCreateSemaphore(context->device, &semaphoreInfo, NULL, &context->computeSemaphore);
+	if (result != VK_SUCCESS) {
+		puts("Failed to create semaphore");
+		return result;
+	}
+
+	return VK_SUCCESS;
+}
+
+VkResult CreateComputeContext(ComputeContext* context) {
+	return CreateComputeContextTraced(context, NULL);
+}
+
+VkResult CreateComputeContextTraced(ComputeContext* context, StartupTrace* trace) {
+	memset(context, 0, sizeof(*context));
+
+	uint64_t startTime = GetTimeNs();
+	VkResult result = CreateInstance(context);
+	AddStartupPhase(trace, "create_instance", 0, startTime, GetTimeNs());
+	if (result == VK_SUCCESS) {
+		context->ownsInstance = 1;
+		startTime = GetTimeNs();
+		result = SelectPhysicalDevice(context);
+		AddStartupPhase(trace, "select_device", 0, startTime, GetTimeNs());
+	}
+	if (result == VK_SUCCESS) {
+		startTime = GetTimeNs();
+		result = CreateDevice(context);
+		AddStartupPhase(trace, "create_device", 0, startTime, GetTimeNs());
+	}
+	if (result == VK_SUCCESS) {
+		startTime = GetTimeNs();
+		result = CreateCommandObjects(context);
+		AddStartupPhase(trace, "create_command_objects", 0, startTime, GetTimeNs());
+	}
+	CreateHostCopier(&context->hostCopier, 0);
+
+	if (result != VK_SUCCESS) {
+		DestroyComputeContext(context);
+	}
+	return result;
+}
+
+void CreateCpuComputeContext(ComputeContext* context, uint32_t threadCount) {
+	memset(context, 0, sizeof(*context));
+	context->cpuBackend = 1;
+	CreateCpuBackend(&context->cpu, threadCount);
+	CreateHostCopier(&context->hostCopier, threadCount);
+
+	VkPhysicalDeviceProperties* properties = &context->physicalDeviceProperties;
+	properties->apiVersion = VK_API_VERSION_1_0;
+	properties->deviceType = VK_PHYSICAL_DEVICE_TYPE_CPU;
+	snprintf(properties->deviceName, sizeof(properties->deviceName), "Host CPU (%s, %u threads)",
+		GetCpuIsaName(context->cpu.isa), context->cpu.threadCount);
+	// Workgroups mean nothing to native kernels, so the limits only have to let ComputeDispatchSize cover the
+	// largest element count push constants can carry
+	VkPhysicalDeviceLimits* limits = &properties->limits;
+	limits->maxComputeWorkGroupCount[0] = 65535;
+	limits->maxComputeWorkGroupCount[1] = 65535;
+	limits->maxComputeWorkGroupCount[2] = 65535;
+	limits->maxComputeWorkGroupSize[0] = 1024;
+	limits->maxComputeWorkGroupSize[1] = 1024;
+	limits->maxComputeWorkGroupSize[2] = 64;
+	limits->maxComputeWorkGroupInvocations = 1024;
+	limits->maxPushConstantsSize = 128;
+	limits->maxStorageBufferRange = UINT32_MAX;
+	limits->minStorageBufferOffsetAlignment = 64;
+	limits->nonCoherentAtomSize = 64;
+	printf("Selected host CPU backend: %s\n", properties->deviceName);
+}
+
+void DestroyComputeContext(ComputeContext* context) {
+	if (context->device != VK_NULL_HANDLE) {
+		vkDeviceWaitIdle(context->device);
+		vkDestroyBuffer(context->device, context->stagingBuffer, NULL);
+		FreeDeviceMemory(&context->allocator, &context->stagingAllocation);
+		DestroyMemoryAllocator(&context->allocator);
+		vkDestroySemaphore(context->device, context->uploadSemaphore, NULL);
+		vkDestroySemaphore(context->device, context->computeSemaphore, NULL);
+		vkDestroyCommandPool(context->device, context->transferCommandPool, NULL);
+		vkDestroyPipelineCache(context->device, context->pipelineCache, NULL);
+		vkDestroyFence(context->device, context->fence, NULL);
+		vkDestroyCommandPool(context->device, context->commandPool, NULL);
+		vkDestroyDevice(context->device, NULL);
+	}
+	if (context->instance != VK_NULL_HANDLE && context->ownsInstance) {
+		vkDestroyInstance(context->instance, NULL);
+	}
+	DestroyHostCopier(&context->hostCopier);
+	DestroyCpuBackend(&context->cpu);
+	memset(context, 0, sizeof(*context));
+}
+
+VkResult CreateComputeContexts(ComputeContext* contexts, uint32_t maxContextCount, uint32_t* contextCount) {
+	*contextCount = 0;
+	if (maxContextCount == 0) {
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+
+	// The instance is handed to contexts[0] once it is known which devices could be set up
+	memset(&contexts[0], 0, sizeof(contexts[0]));
+	VkResult result = CreateInstance(&contexts[0]);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+	const VkInstance instance = contexts[0].instance;
+	const uint32_t apiVersion = contexts[0].apiVersion;
+
+	VkPhysicalDevice* physicalDevices = NULL;
+	uint32_t physicalDeviceCount = 0;
+	result = GetPhysicalDevicesByPreference(instance, &physicalDevices, &physicalDeviceCount);
+	if (result == VK_SUCCESS && physicalDeviceCount == 0) {
+		puts("No Vulkan devices found!");
+		result = VK_ERROR_INITIALIZATION_FAILED;
+	}
+	if (result != VK_SUCCESS) {
+		free(physicalDevices);
+		vkDestroyInstance(instance, NULL);
+		memset(&contexts[0], 0, sizeof(contexts[0]));
+		return result;
+	}
+
+	for (uint32_t i = 0; i < physicalDeviceCount && *contextCount < maxContextCount; ++i) {
+		VkPhysicalDeviceProperties deviceProperties = { 0 };
+		vkGetPhysicalDeviceProperties(physicalDevices[i], &deviceProperties);
+		// Devices are sorted, so a CPU device after a created context means there is at least one working GPU
+		if (*contextCount > 0 && deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU) {
+			break;
+		}
+
+		ComputeContext* context = &contexts[*contextCount];
+		memset(context, 0, sizeof(*context));
+		context->instance = instance;
+		context->apiVersion = apiVersion;
+		UsePhysicalDevice(context, physicalDevices[i]);
+		CreateHostCopier(&context->hostCopier, 0);
+		result = CreateDevice(context);
+		if (result == VK_SUCCESS) {
+			result = CreateCommandObjects(context);
+		}
+		if (result != VK_SUCCESS) {
+			// Skip the device and keep the others; the context does not own the instance, so it survives
+			printf("Skipping %s, which could not be set up\n", deviceProperties.deviceName);
+			DestroyComputeContext(context);
+			continue;
+		}
+		++*contextCount;
+	}
+	free(physicalDevices);
+
+	if (*contextCount == 0) {
+		vkDestroyInstance(instance, NULL);
+		return result != VK_SUCCESS ? result : VK_ERROR_INITIALIZATION_FAILED;
+	}
+	contexts[0].ownsInstance = 1;
+	return VK_SUCCESS;
+}
+
+void DestroyComputeContexts(ComputeContext* contexts, uint32_t contextCount) {
+	for (uint32_t i = contextCount; i > 0; --i) {
+		DestroyComputeContext(&contexts[i - 1]);
+	}
+}
+
+int GetDeviceIdentifier(const ComputeContext* context, char* identifier, size_t size) {
+	const VkPhysicalDeviceProperties* properties = &context->physicalDeviceProperties;
+
+	char uuid[2 * VK_UUID_SIZE + 1] = { 0 };
+	for (uint32_t i = 0; i < VK_UUID_SIZE; ++i) {
+		sprintf(uuid + 2 * i, "%02x", properties->pipelineCacheUUID[i]);
+	}
+	int length = snprintf(identifier, size, "%04x_%04x_%08x_%s",
+		properties->vendorID, properties->deviceID, properties->driverVersion, uuid);
+	return length >= 0 && (size_t) length < size;
+}
+
+int GetTempFilePath(const char* path, char* tempPath, size_t size) {
+	// The pid keeps processes apart and the counter keeps threads of one process apart
+	static uint32_t tempFileCounter = 0;
+	const uint32_t counter = __atomic_fetch_add(&tempFileCounter, 1, __ATOMIC_RELAXED);
+	int length = snprintf(tempPath, size, "%s.%ld.%u.tmp", path, (long) getpid(), counter);
+	return length >= 0 && (size_t) length < size;
+}
+
+VkResult SubmitAndWait(ComputeContext* context) {
+	VkSubmitInfo submitInfo = { 0 };
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = NULL;
+	submitInfo.waitSemaphoreCount = 0;
+	submitInfo.pWaitSemaphores = NULL;
+	submitInfo.pWaitDstStageMask = NULL;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &context->commandBuffer;
+	submitInfo.signalSemaphoreCount = 0;
+	submitInfo.pSignalSemaphores = NULL;
+
+	VkResult result = vkQueueSubmit(context->computeQueue, 1, &submitInfo, context->fence);
+	if (result != VK_SUCCESS) {
+		puts("Failed to submit command buffer on compute queue");
+		return result;
+	}
+
+	result = vkWaitForFences(context->device, 1, &context->fence, VK_TRUE, UINT64_MAX);
+	if (result != VK_SUCCESS) {
+		puts("Failed to wait for fence");
+		return result;
+	}
+
+	return vkResetFences(context->device, 1, &context->fence);
+}
+
+VkResult BeginOneTimeCommandBuffer(VkCommandBuffer commandBuffer) {
+	VkCommandBufferBeginInfo commandBufferBeginInfo = { 0 };
+	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	commandBufferBeginInfo.pNext = NULL;
+	commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	commandBufferBeginInfo.pInheritanceInfo = NULL;
+
+	VkResult result = vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+	if (result != VK_SUCCESS) {
+		puts("Failed to begin recording command buffer");
+	}
+	return result;
+}
+
+VkResult BeginComputeCommandBuffer(ComputeContext* context) {
+	VkResult result = BeginOneTimeCommandBuffer(context->commandBuffer);
+	if (result != VK_SUCCESS || context->releasedBufferCount == 0) {
+		return result;
+	}
+
+	// The download that released these buffers completed before its fence was waited on, so the acquire needs no
+	// semaphore
+	VkBufferMemoryBarrier bufferBarriers[MAX_RELEASED_BUFFERS];
+	for (uint32_t i = 0; i < context->releasedBufferCount; ++i) {
+		bufferBarriers[i].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		bufferBarriers[i].pNext = NULL;
+		bufferBarriers[i].srcAccessMask = 0;
+		bufferBarriers[i].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT |
+			VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferBarriers[i].srcQueueFamilyIndex = context->transferQueueIndex;
+		bufferBarriers[i].dstQueueFamilyIndex = context->computeQueueIndex;
+		bufferBarriers[i].buffer = context->releasedBuffers[i];
+		bufferBarriers[i].offset = 0;
+		bufferBarriers[i].size = VK_WHOLE_SIZE;
+	}
+	vkCmdPipelineBarrier(context->commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL,
+		context->releasedBufferCount, bufferBarriers, 0, NULL);
+	context->releasedBufferCount = 0;
+	return VK_SUCCESS;
+}
+
+VkResult SubmitCommandBuffer(VkQueue queue, VkCommandBuffer commandBuffer,
+	VkSemaphore waitSemaphore, VkPipelineStageFlags waitStage, VkSemaphore signalSemaphore, VkFence fence) {
+
+	VkSubmitInfo submitInfo = { 0 };
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = NULL;
+	submitInfo.waitSemaphoreCount = waitSemaphore != VK_NULL_HANDLE ? 1 : 0;
+	submitInfo.pWaitSemaphores = &waitSemaphore;
+	submitInfo.pWaitDstStageMask = &waitStage;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+	submitInfo.signalSemaphoreCount = signalSemaphore != VK_NULL_HANDLE ? 1 : 0;
+	submitInfo.pSignalSemaphores = &signalSemaphore;
+
+	VkResult result = vkQueueSubmit(queue, 1, &submitInfo, fence);
+	if (result != VK_SUCCESS) {
+		puts("Failed to submit command buffer");
+	}
+	return result;
+}
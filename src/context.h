@@ -0,0 +1,126 @@
+#include <vulkan/vulkan.h>
+#include "allocator.h"
+#include "cpu.h"
+#include "hostcopy.h"
+#include "profiler.h"
+#include "startup.h"
+
+#ifndef CONTEXT_H
+#define CONTEXT_H
+
+// Most queues created from the compute queue family
+#define MAX_COMPUTE_QUEUES 16
+// Most buffers one staged dispatch can download
+#define MAX_RELEASED_BUFFERS 16
+
+// Everything needed to submit work to one device. A context is created once and
+// reused for any number of dispatches, so instance/device creation is only paid at startup.
+typedef struct ComputeContext {
+	VkInstance instance;
+	// Zero for contexts sharing the instance of another context created by CreateComputeContexts
+	int ownsInstance;
+	// Vulkan version requested for the instance: 1.2 where the loader supports it, else 1.0
+	uint32_t apiVersion;
+	VkPhysicalDevice physicalDevice;
+	VkPhysicalDeviceProperties physicalDeviceProperties;
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	VkDevice device;
+	uint32_t computeQueueIndex;
+	uint32_t transferQueueIndex;
+	VkQueue computeQueue;
+	VkQueue transferQueue;
+	// Every queue of the compute family; computeQueues[0] is computeQueue
+	VkQueue computeQueues[MAX_COMPUTE_QUEUES];
+	uint32_t computeQueueCount;
+	// Non-zero if the device supports Vulkan 1.2 timeline semaphores and they were enabled
+	int timelineSemaphores;
+	// Non-zero if Vulkan 1.2 hostQueryReset is enabled, so queries can be reset with vkResetQueryPool
+	int hostQueryReset;
+	// Descriptor features enabled when supported; see src/descriptors.h
+	int pushDescriptors;
+	PFN_vkCmdPushDescriptorSetKHR vkCmdPushDescriptorSetKHR;
+	// Buffers get device addresses, memory is allocated with VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT
+	int bufferDeviceAddress;
+	// Update-after-bind, partially bound, dynamically indexed runtime arrays of storage buffers
+	int descriptorIndexing;
+	// VK_EXT_external_memory_host: host allocations aligned to minImportedHostPointerAlignment can be imported
+	// as device memory; see src/external.h
+	int externalMemoryHost;
+	VkDeviceSize minImportedHostPointerAlignment;
+	PFN_vkGetMemoryHostPointerPropertiesEXT vkGetMemoryHostPointerPropertiesEXT;
+	// Subgroup size, 0 before Vulkan 1.1, and whether compute shaders support GL_KHR_shader_subgroup_arithmetic;
+	// see src/primitives.h
+	uint32_t subgroupSize;
+	int subgroupArithmetic;
+	// storageBuffer16BitAccess and storageBuffer8BitAccess, needed by kernels over reduced precision buffers; see
+	// src/convert.h
+	int storage16Bit;
+	int storage8Bit;
+	VkCommandPool commandPool;
+	VkCommandBuffer commandBuffer;
+	VkFence fence;
+	// Staging transfers: uploads and readbacks run on the transfer queue and are ordered against compute with semaphores
+	VkCommandPool transferCommandPool;
+	VkCommandBuffer uploadCommandBuffer;
+	VkCommandBuffer downloadCommandBuffer;
+	VkSemaphore uploadSemaphore;
+	VkSemaphore computeSemaphore;
+	VkBuffer stagingBuffer;
+	MemoryAllocation stagingAllocation;
+	VkDeviceSize stagingSize;
+	// Buffers the last staged dispatch downloaded and released back to the compute family. The next command buffer
+	// begun with BeginComputeCommandBuffer acquires them.
+	VkBuffer releasedBuffers[MAX_RELEASED_BUFFERS];
+	uint32_t releasedBufferCount;
+	MemoryAllocator allocator;
+	VkPipelineCache pipelineCache;
+	char pipelineCachePath[512];
+	// Optional; when set, dispatches and transfers record timestamp scopes into it
+	Profiler* profiler;
+	// Splits large host copies into and out of mapped memory across threads, see src/hostcopy.h
+	HostCopier hostCopier;
+	// Non-zero for contexts created by CreateCpuComputeContext, which have no Vulkan objects at all
+	int cpuBackend;
+	CpuBackend cpu;
+} ComputeContext;
+
+VkResult CreateComputeContext(ComputeContext* context);
+// Same as CreateComputeContext, recording the time spent creating the instance, selecting the physical device,
+// creating the device and creating the command objects into trace
+VkResult CreateComputeContextTraced(ComputeContext* context, StartupTrace* trace);
+void DestroyComputeContext(ComputeContext* context);
+
+// Create a context that runs kernels with native implementations (src/cpu.h) on threadCount host threads, or
+// one per CPU if 0, for hosts without a GPU. Buffers are plain host memory and dispatches run synchronously;
+// only creating buffers and kernels, ComputeDispatchSize, DispatchComputeKernel and TimeComputeKernel are
+// supported. physicalDeviceProperties describes the CPU with limits that suit it.
+void CreateCpuComputeContext(ComputeContext* context, uint32_t threadCount);
+
+// Create one context per GPU, in the same order of preference CreateComputeContext picks from, sharing one
+// instance. CPU implementations are only included when there is no GPU. At most maxContextCount are created.
+// Devices that cannot be set up are skipped; this only fails if no context could be created.
+VkResult CreateComputeContexts(ComputeContext* contexts, uint32_t maxContextCount, uint32_t* contextCount);
+// Destroy contexts created by CreateComputeContexts, the instance owner last
+void DestroyComputeContexts(ComputeContext* contexts, uint32_t contextCount);
+
+// Write "<vendor>_<device>_<driver>_<pipelineCacheUUID>" in hex to identifier. Files keyed by it are only ever
+// reused on the same device with the same driver. Returns 0 if the identifier does not fit.
+int GetDeviceIdentifier(const ComputeContext* context, char* identifier, size_t size);
+// Write a temporary file name in the same directory as path, unique to this process and call, to write a file
+// before renaming it over path. Returns 0 if the name does not fit.
+int GetTempFilePath(const char* path, char* tempPath, size_t size);
+
+// Submit the context's command buffer on the compute queue and block until it completes
+VkResult SubmitAndWait(ComputeContext* context);
+
+// Begin recording a command buffer that will be submitted once
+VkResult BeginOneTimeCommandBuffer(VkCommandBuffer commandBuffer);
+// Begin recording the context's command buffer, first acquiring the buffers released by the last staged
+// download on the compute family. Use this rather than BeginOneTimeCommandBuffer for context->commandBuffer.
+VkResult BeginComputeCommandBuffer(ComputeContext* context);
+
+// Submit one command buffer, optionally waiting on and signalling one semaphore each and signalling a fence
+VkResult SubmitCommandBuffer(VkQueue queue, VkCommandBuffer commandBuffer,
+	VkSemaphore waitSemaphore, VkPipelineStageFlags waitStage, VkSemaphore signalSemaphore, VkFence fence);
+
+#endif
@@ -0,0 +1,378 @@
+#include "convert.h"
+#include <vulkan/vulkan.h>
+#include <string.h>
+
+// Like the native kernels of src/cpu.c, x86 versions are compiled with target attributes and picked at runtime.
+// Every AVX2 CPU also has F16C, but both are checked.
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CONVERT_X86
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define CONVERT_NEON
+#endif
+
+typedef void (*FromFloatFunction)(const float* src, void* dst, uint64_t count);
+typedef void (*ToFloatFunction)(const void* src, float* dst, uint64_t count);
+
+static uint32_t FloatBits(float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+static float BitsToFloat(uint32_t bits) {
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+static uint16_t FloatToHalf(float value) {
+	const uint32_t bits = FloatBits(value);
+	const uint32_t sign = (bits >> 16) & 0x8000;
+	const uint32_t exponent = (bits >> 23) & 0xFF;
+	uint32_t mantissa = bits & 0x7FFFFF;
+	if (exponent == 0xFF) {
+		// Infinity, or a NaN that stays quiet
+		return (uint16_t) (sign | 0x7C00 | (mantissa != 0 ? 0x200 | (mantissa >> 13) : 0));
+	}
+	const int32_t halfExponent = (int32_t) exponent - 127 + 15;
+	if (halfExponent >= 31) {
+		return (uint16_t) (sign | 0x7C00);
+	}
+	if (halfExponent <= 0) {
+		// Subnormal, with the implicit bit shifted in, or too small even for that
+		if (halfExponent < -10) {
+			return (uint16_t) sign;
+		}
+		mantissa |= 0x800000;
+		const uint32_t shift = (uint32_t) (14 - halfExponent);
+		uint32_t half = mantissa >> shift;
+		const uint32_t remainder = mantissa & ((1u << shift) - 1);
+		const uint32_t halfway = 1u << (shift - 1);
+		if (remainder > halfway || (remainder == halfway && (half & 1))) {
+			++half;
+		}
+		return (uint16_t) (sign | half);
+	}
+	// Rounding up may carry into the exponent, which is still correct, up to infinity
+	uint32_t half = ((uint32_t) halfExponent << 10) | (mantissa >> 13);
+	const uint32_t remainder = mantissa & 0x1FFF;
+	if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+		++half;
+	}
+	return (uint16_t) (sign | half);
+}
+
+static float HalfToFloat(uint16_t half) {
+	const uint32_t sign = (uint32_t) (half & 0x8000) << 16;
+	const uint32_t exponent = (half >> 10) & 0x1F;
+	uint32_t mantissa = half & 0x3FF;
+	if (exponent == 0x1F) {
+		return BitsToFloat(sign | 0x7F800000 | (mantissa << 13));
+	}
+	if (exponent == 0) {
+		if (mantissa == 0) {
+			return BitsToFloat(sign);
+		}
+		// Subnormal halves are normal floats
+		uint32_t floatExponent = 127 - 15 + 1;
+		while (!(mantissa & 0x400)) {
+			mantissa <<= 1;
+			--floatExponent;
+		}
+		return BitsToFloat(sign | (floatExponent << 23) | ((mantissa & 0x3FF) << 13));
+	}
+	return BitsToFloat(sign | ((exponent + 127 - 15) << 23) | (mantissa << 13));
+}
+
+static uint16_t FloatToBfloat16(float value) {
+	const uint32_t bits = FloatBits(value);
+	// NaNs keep a set mantissa bit instead of rounding into infinity
+	if (value != value) {
+		return (uint16_t) ((bits >> 16) | 0x40);
+	}
+	return (uint16_t) ((bits + 0x7FFF + ((bits >> 16) & 1)) >> 16);
+}
+
+static int8_t FloatToInt8(float value) {
+	if (value != value) {
+		return 0;
+	}
+	if (value <= -128.f) {
+		return -128;
+	}
+	if (value >= 127.f) {
+		return 127;
+	}
+	int32_t integer = (int32_t) value;
+	const float fraction = value - (float) integer;
+	if (fraction > 0.5f || (fraction == 0.5f && (integer & 1))) {
+		++integer;
+	}
+	else if (fraction < -0.5f || (fraction == -0.5f && (integer & 1))) {
+		--integer;
+	}
+	return (int8_t) integer;
+}
+
+static void FloatToHalfScalar(const float* src, void* dst, uint64_t count) {
+	uint16_t* output = dst;
+	for (uint64_t i = 0; i < count; ++i) {
+		output[i] = FloatToHalf(src[i]);
+	}
+}
+
+static void HalfToFloatScalar(const void* src, float* dst, uint64_t count) {
+	const uint16_t* input = src;
+	for (uint64_t i = 0; i < count; ++i) {
+		dst[i] = HalfToFloat(input[i]);
+	}
+}
+
+static void FloatToBfloat16Scalar(const float* src, void* dst, uint64_t count) {
+	uint16_t* output = dst;
+	for (uint64_t i = 0; i < count; ++i) {
+		output[i] = FloatToBfloat16(src[i]);
+	}
+}
+
+static void Bfloat16ToFloatScalar(const void* src, float* dst, uint64_t count) {
+	const uint16_t* input = src;
+	for (uint64_t i = 0; i < count; ++i) {
+		dst[i] = BitsToFloat((uint32_t) input[i] << 16);
+	}
+}
+
+static void FloatToInt8Scalar(const float* src, void* dst, uint64_t count) {
+	int8_t* output = dst;
+	for (uint64_t i = 0; i < count; ++i) {
+		output[i] = FloatToInt8(src[i]);
+	}
+}
+
+static void Int8ToFloatScalar(const void* src, float* dst, uint64_t count) {
+	const int8_t* input = src;
+	for (uint64_t i = 0; i < count; ++i) {
+		dst[i] = (float) input[i];
+	}
+}
+
+#ifdef CONVERT_X86
+__attribute__((target("avx2,f16c")))
+static void FloatToHalfAvx2(const float* src, void* dst, uint64_t count) {
+	uint16_t* output = dst;
+	uint64_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m128i half = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+		_mm_storeu_si128((__m128i*) (output + i), half);
+	}
+	FloatToHalfScalar(src + i, output + i, count - i);
+}
+
+__attribute__((target("avx2,f16c")))
+static void HalfToFloatAvx2(const void* src, float* dst, uint64_t count) {
+	const uint16_t* input = src;
+	uint64_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		_mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*) (input + i))));
+	}
+	HalfToFloatScalar(input + i, dst + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static __m256i FloatToBfloat16Avx2Bits(__m256 value) {
+	const __m256i bits = _mm256_castps_si256(value);
+	const __m256i upper = _mm256_srli_epi32(bits, 16);
+	const __m256i rounding = _mm256_add_epi32(_mm256_and_si256(upper, _mm256_set1_epi32(1)), _mm256_set1_epi32(0x7FFF));
+	const __m256i rounded = _mm256_srli_epi32(_mm256_add_epi32(bits, rounding), 16);
+	const __m256i quietNan = _mm256_or_si256(upper, _mm256_set1_epi32(0x40));
+	const __m256i isNan = _mm256_castps_si256(_mm256_cmp_ps(value, value, _CMP_UNORD_Q));
+	return _mm256_blendv_epi8(rounded, quietNan, isNan);
+}
+
+__attribute__((target("avx2")))
+static void FloatToBfloat16Avx2(const float* src, void* dst, uint64_t count) {
+	uint16_t* output = dst;
+	uint64_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		const __m256i low = FloatToBfloat16Avx2Bits(_mm256_loadu_ps(src + i));
+		const __m256i high = FloatToBfloat16Avx2Bits(_mm256_loadu_ps(src + i + 8));
+		// Packing works within 128-bit lanes, so put the four 64-bit quarters back in order
+		const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(low, high), 0xD8);
+		_mm256_storeu_si256((__m256i*) (output + i), packed);
+	}
+	FloatToBfloat16Scalar(src + i, output + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void Bfloat16ToFloatAvx2(const void* src, float* dst, uint64_t count) {
+	const uint16_t* input = src;
+	uint64_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m256i bits = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*) (input + i)));
+		_mm256_storeu_ps(dst + i, _mm256_castsi256_ps(_mm256_slli_epi32(bits, 16)));
+	}
+	Bfloat16ToFloatScalar(input + i, dst + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void FloatToInt8Avx2(const float* src, void* dst, uint64_t count) {
+	int8_t* output = dst;
+	uint64_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 value = _mm256_loadu_ps(src + i);
+		value = _mm256_and_ps(value, _mm256_cmp_ps(value, value, _CMP_ORD_Q));
+		value = _mm256_min_ps(_mm256_max_ps(value, _mm256_set1_ps(-128.f)), _mm256_set1_ps(127.f));
+		// Rounds to nearest even in the default rounding mode
+		const __m256i integers = _mm256_cvtps_epi32(value);
+		const __m128i shorts = _mm_packs_epi32(_mm256_castsi256_si128(integers), _mm256_extracti128_si256(integers, 1));
+		_mm_storel_epi64((__m128i*) (output + i), _mm_packs_epi16(shorts, shorts));
+	}
+	FloatToInt8Scalar(src + i, output + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void Int8ToFloatAvx2(const void* src, float* dst, uint64_t count) {
+	const int8_t* input = src;
+	uint64_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m256i integers = _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i*) (input + i)));
+		_mm256_storeu_ps(dst + i, _mm256_cvtepi32_ps(integers));
+	}
+	Int8ToFloatScalar(input + i, dst + i, count - i);
+}
+#endif
+
+#ifdef CONVERT_NEON
+static void FloatToHalfNeon(const float* src, void* dst, uint64_t count) {
+	uint16_t* output = dst;
+	uint64_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		vst1_u16(output + i, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(src + i))));
+	}
+	FloatToHalfScalar(src + i, output + i, count - i);
+}
+
+static void HalfToFloatNeon(const void* src, float* dst, uint64_t count) {
+	const uint16_t* input = src;
+	uint64_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		vst1q_f32(dst + i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(input + i))));
+	}
+	HalfToFloatScalar(input + i, dst + i, count - i);
+}
+
+static void FloatToBfloat16Neon(const float* src, void* dst, uint64_t count) {
+	uint16_t* output = dst;
+	uint64_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const float32x4_t value = vld1q_f32(src + i);
+		const uint32x4_t bits = vreinterpretq_u32_f32(value);
+		const uint32x4_t upper = vshrq_n_u32(bits, 16);
+		const uint32x4_t rounding = vaddq_u32(vandq_u32(upper, vdupq_n_u32(1)), vdupq_n_u32(0x7FFF));
+		const uint32x4_t rounded = vshrq_n_u32(vaddq_u32(bits, rounding), 16);
+		const uint32x4_t quietNan = vorrq_u32(upper, vdupq_n_u32(0x40));
+		vst1_u16(output + i, vmovn_u32(vbslq_u32(vceqq_f32(value, value), rounded, quietNan)));
+	}
+	FloatToBfloat16Scalar(src + i, output + i, count - i);
+}
+
+static void Bfloat16ToFloatNeon(const void* src, float* dst, uint64_t count) {
+	const uint16_t* input = src;
+	uint64_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		vst1q_f32(dst + i, vreinterpretq_f32_u32(vshll_n_u16(vld1_u16(input + i), 16)));
+	}
+	Bfloat16ToFloatScalar(input + i, dst + i, count - i);
+}
+
+static int32x4_t FloatToInt32Neon(float32x4_t value) {
+	value = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(value), vceqq_f32(value, value)));
+	value = vminq_f32(vmaxq_f32(value, vdupq_n_f32(-128.f)), vdupq_n_f32(127.f));
+	return vcvtnq_s32_f32(value);
+}
+
+static void FloatToInt8Neon(const float* src, void* dst, uint64_t count) {
+	int8_t* output = dst;
+	uint64_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const int16x8_t shorts = vcombine_s16(vqmovn_s32(FloatToInt32Neon(vld1q_f32(src + i))),
+			vqmovn_s32(FloatToInt32Neon(vld1q_f32(src + i + 4))));
+		vst1_s8(output + i, vqmovn_s16(shorts));
+	}
+	FloatToInt8Scalar(src + i, output + i, count - i);
+}
+
+static void Int8ToFloatNeon(const void* src, float* dst, uint64_t count) {
+	const int8_t* input = src;
+	uint64_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const int16x8_t shorts = vmovl_s8(vld1_s8(input + i));
+		vst1q_f32(dst + i, vcvtq_f32_s32(vmovl_s16(vget_low_s16(shorts))));
+		vst1q_f32(dst + i + 4, vcvtq_f32_s32(vmovl_s16(vget_high_s16(shorts))));
+	}
+	Int8ToFloatScalar(input + i, dst + i, count - i);
+}
+#endif
+
+// Conversions of each element type, indexed by ElementType; float32 is a plain copy
+typedef struct Conversions {
+	FromFloatFunction fromFloat[ELEMENT_TYPE_COUNT];
+	ToFloatFunction toFloat[ELEMENT_TYPE_COUNT];
+	const char* isaName;
+} Conversions;
+
+static const Conversions scalarConversions = {
+	{ NULL, FloatToHalfScalar, FloatToBfloat16Scalar, FloatToInt8Scalar },
+	{ NULL, HalfToFloatScalar, Bfloat16ToFloatScalar, Int8ToFloatScalar },
+	"scalar"
+};
+
+#if defined(CONVERT_X86)
+static const Conversions simdConversions = {
+	{ NULL, FloatToHalfAvx2, FloatToBfloat16Avx2, FloatToInt8Avx2 },
+	{ NULL, HalfToFloatAvx2, Bfloat16ToFloatAvx2, Int8ToFloatAvx2 },
+	"avx2+f16c"
+};
+#elif defined(CONVERT_NEON)
+static const Conversions simdConversions = {
+	{ NULL, FloatToHalfNeon, FloatToBfloat16Neon, FloatToInt8Neon },
+	{ NULL, HalfToFloatNeon, Bfloat16ToFloatNeon, Int8ToFloatNeon },
+	"neon"
+};
+#endif
+
+static const Conversions* GetConversions(void) {
+#if defined(CONVERT_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c")) {
+		return &simdConversions;
+	}
+	return &scalarConversions;
+#elif defined(CONVERT_NEON)
+	return &simdConversions;
+#else
+	return &scalarConversions;
+#endif
+}
+
+void ConvertFromFloat(ElementType elementType, const float* src, void* dst, uint64_t count) {
+	if (elementType == ELEMENT_TYPE_FLOAT32 || elementType >= ELEMENT_TYPE_COUNT) {
+		memcpy(dst, src, count * sizeof(float));
+		return;
+	}
+	GetConversions()->fromFloat[elementType](src, dst, count);
+}
+
+void ConvertToFloat(ElementType elementType, const void* src, float* dst, uint64_t count) {
+	if (elementType == ELEMENT_TYPE_FLOAT32 || elementType >= ELEMENT_TYPE_COUNT) {
+		memcpy(dst, src, count * sizeof(float));
+		return;
+	}
+	GetConversions()->toFloat[elementType](src, dst, count);
+}
+
+const char* GetConvertIsaName(void) {
+	return GetConversions()->isaName;
+}
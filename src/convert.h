@@ -0,0 +1,17 @@
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include "buffer.h"
+
+#ifndef CONVERT_H
+#define CONVERT_H
+
+// Convert count floats at src to elementType at dst, rounding to nearest even. Half and bfloat16 keep NaNs and
+// overflow to infinity; int8 saturates to [-128, 127] and converts NaN to 0.
+void ConvertFromFloat(ElementType elementType, const float* src, void* dst, uint64_t count);
+// Convert count elements of elementType at src to floats at dst, which is exact for every format
+void ConvertToFloat(ElementType elementType, const void* src, float* dst, uint64_t count);
+
+// Instruction set the conversions run with on this CPU, e.g. "avx2+f16c"
+const char* GetConvertIsaName(void);
+
+#endif
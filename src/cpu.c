@@ -0,0 +1,342 @@
+#define _POSIX_C_SOURCE 200112L
+#include "cpu.h"
+#include <vulkan/vulkan.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// Versions for wider instruction sets are compiled with target attributes and picked at runtime, so one binary
+// runs on every machine of an x86 fleet. NEON is part of the AArch64 baseline.
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CPU_X86
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define CPU_NEON
+#endif
+
+// Slices start on 64 byte boundaries of float buffers, so threads never write the same cache line
+#define CPU_SLICE_ALIGNMENT 16
+#define CPU_MEMORY_ALIGNMENT 64
+
+// double.comp: outputData[i] = inputData[i] * 2
+
+static void DoubleScalar(void* const* buffers, const void* pushConstants, uint64_t begin, uint64_t end) {
+	const float* input = buffers[0];
+	float* output = buffers[1];
+	for (uint64_t i = begin; i < end; ++i) {
+		output[i] = input[i] * 2.f;
+	}
+}
+
+#ifdef CPU_X86
+__attribute__((target("avx2")))
+static void DoubleAvx2(void* const* buffers, const void* pushConstants, uint64_t begin, uint64_t end) {
+	const float* input = buffers[0];
+	float* output = buffers[1];
+	uint64_t i = begin;
+	for (; i + 8 <= end; i += 8) {
+		__m256 x = _mm256_loadu_ps(input + i);
+		_mm256_storeu_ps(output + i, _mm256_add_ps(x, x));
+	}
+	for (; i < end; ++i) {
+		output[i] = input[i] * 2.f;
+	}
+}
+
+__attribute__((target("avx512f")))
+static void DoubleAvx512(void* const* buffers, const void* pushConstants, uint64_t begin, uint64_t end) {
+	const float* input = buffers[0];
+	float* output = buffers[1];
+	uint64_t i = begin;
+	for (; i + 16 <= end; i += 16) {
+		__m512 x = _mm512_loadu_ps(input + i);
+		_mm512_storeu_ps(output + i, _mm512_add_ps(x, x));
+	}
+	// A masked load and store finish the tail without a scalar loop
+	if (i < end) {
+		__mmask16 mask = (__mmask16) ((1u << (end - i)) - 1);
+		__m512 x = _mm512_maskz_loadu_ps(mask, input + i);
+		_mm512_mask_storeu_ps(output + i, mask, _mm512_add_ps(x, x));
+	}
+}
+#endif
+
+#ifdef CPU_NEON
+static void DoubleNeon(void* const* buffers, const void* pushConstants, uint64_t begin, uint64_t end) {
+	const float* input = buffers[0];
+	float* output = buffers[1];
+	uint64_t i = begin;
+	for (; i + 4 <= end; i += 4) {
+		float32x4_t x = vld1q_f32(input + i);
+		vst1q_f32(output + i, vaddq_f32(x, x));
+	}
+	for (; i < end; ++i) {
+		output[i] = input[i] * 2.f;
+	}
+}
+#endif
+
+#if defined(CPU_X86)
+#define DOUBLE_FUNCTIONS { DoubleScalar, NULL, DoubleAvx2, DoubleAvx512 }
+#elif defined(CPU_NEON)
+#define DOUBLE_FUNCTIONS { DoubleScalar, DoubleNeon, NULL, NULL }
+#else
+#define DOUBLE_FUNCTIONS { DoubleScalar, NULL, NULL, NULL }
+#endif
+
+// The vectorised shaders compute the same thing, so they share an implementation
+static const CpuKernel cpuKernels[] = {
+	{ "double.spv", DOUBLE_FUNCTIONS },
+	{ "double_vec4.spv", DOUBLE_FUNCTIONS },
+};
+static const uint32_t cpuKernelCount = sizeof(cpuKernels) / sizeof(cpuKernels[0]);
+
+static CpuIsa DetectCpuIsa(void) {
+#if defined(CPU_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) {
+		return CPU_ISA_AVX512;
+	}
+	if (__builtin_cpu_supports("avx2")) {
+		return CPU_ISA_AVX2;
+	}
+	return CPU_ISA_SCALAR;
+#elif defined(CPU_NEON)
+	return CPU_ISA_NEON;
+#else
+	return CPU_ISA_SCALAR;
+#endif
+}
+
+uint32_t GetOnlineCpuCount(void) {
+#ifdef _WIN32
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo(&systemInfo);
+	long count = (long) systemInfo.dwNumberOfProcessors;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	return count > 0 ? (uint32_t) count : 1;
+}
+
+// Run tasks of the current batch until none are left unclaimed. Called and returns with mutex held.
+static void RunClaimedTasks(WorkerPool* pool) {
+	while (pool->nextTask < pool->taskCount) {
+		const WorkerFunction function = pool->function;
+		char* task = pool->tasks + pool->nextTask * pool->taskSize;
+		++pool->nextTask;
+		pthread_mutex_unlock(&pool->mutex);
+		function(task);
+		pthread_mutex_lock(&pool->mutex);
+		++pool->finishedCount;
+	}
+}
+
+static void* RunWorkerThread(void* argument) {
+	WorkerPool* pool = argument;
+	pthread_mutex_lock(&pool->mutex);
+	while (!pool->stop) {
+		if (pool->nextTask < pool->taskCount) {
+			RunClaimedTasks(pool);
+			if (pool->finishedCount == pool->taskCount) {
+				pthread_cond_signal(&pool->doneCondition);
+			}
+		}
+		else {
+			pthread_cond_wait(&pool->wakeCondition, &pool->mutex);
+		}
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	return NULL;
+}
+
+void CreateWorkerPool(WorkerPool* pool, uint32_t threadCount) {
+	memset(pool, 0, sizeof(*pool));
+	if (threadCount > CPU_MAX_THREADS) {
+		threadCount = CPU_MAX_THREADS;
+	}
+	if (threadCount == 0) {
+		return;
+	}
+	if (pthread_mutex_init(&pool->mutex, NULL) != 0) {
+		puts("Failed to create worker pool, running its tasks on the calling thread");
+		return;
+	}
+	pthread_mutex_init(&pool->batchMutex, NULL);
+	pthread_cond_init(&pool->wakeCondition, NULL);
+	pthread_cond_init(&pool->doneCondition, NULL);
+	for (uint32_t i = 0; i < threadCount; ++i) {
+		if (pthread_create(&pool->threads[i], NULL, RunWorkerThread, pool) != 0) {
+			printf("Failed to start a worker thread, continuing with %u\n", pool->threadCount);
+			break;
+		}
+		++pool->threadCount;
+	}
+	if (pool->threadCount == 0) {
+		pthread_cond_destroy(&pool->doneCondition);
+		pthread_cond_destroy(&pool->wakeCondition);
+		pthread_mutex_destroy(&pool->batchMutex);
+		pthread_mutex_destroy(&pool->mutex);
+	}
+}
+
+void DestroyWorkerPool(WorkerPool* pool) {
+	if (pool->threadCount > 0) {
+		pthread_mutex_lock(&pool->mutex);
+		pool->stop = 1;
+		pthread_cond_broadcast(&pool->wakeCondition);
+		pthread_mutex_unlock(&pool->mutex);
+		for (uint32_t i = 0; i < pool->threadCount; ++i) {
+			pthread_join(pool->threads[i], NULL);
+		}
+		pthread_cond_destroy(&pool->doneCondition);
+		pthread_cond_destroy(&pool->wakeCondition);
+		pthread_mutex_destroy(&pool->batchMutex);
+		pthread_mutex_destroy(&pool->mutex);
+	}
+	memset(pool, 0, sizeof(*pool));
+}
+
+void RunWorkerTasks(WorkerPool* pool, WorkerFunction function, void* tasks, size_t taskSize, uint32_t taskCount) {
+	if (pool->threadCount == 0 || taskCount <= 1 || pthread_mutex_trylock(&pool->batchMutex) != 0) {
+		for (uint32_t i = 0; i < taskCount; ++i) {
+			function((char*) tasks + i * taskSize);
+		}
+		return;
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->function = function;
+	pool->tasks = tasks;
+	pool->taskSize = taskSize;
+	pool->taskCount = taskCount;
+	pool->nextTask = 0;
+	pool->finishedCount = 0;
+	pthread_cond_broadcast(&pool->wakeCondition);
+	// The calling thread claims tasks too instead of waiting idle
+	RunClaimedTasks(pool);
+	while (pool->finishedCount < pool->taskCount) {
+		pthread_cond_wait(&pool->doneCondition, &pool->mutex);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	pthread_mutex_unlock(&pool->batchMutex);
+}
+
+void CreateCpuBackend(CpuBackend* backend, uint32_t threadCount) {
+	memset(backend, 0, sizeof(*backend));
+	backend->isa = DetectCpuIsa();
+	backend->threadCount = threadCount > 0 ? threadCount : GetOnlineCpuCount();
+	if (backend->threadCount > CPU_MAX_THREADS) {
+		backend->threadCount = CPU_MAX_THREADS;
+	}
+	CreateWorkerPool(&backend->workers, backend->threadCount - 1);
+}
+
+void DestroyCpuBackend(CpuBackend* backend) {
+	DestroyWorkerPool(&backend->workers);
+	memset(backend, 0, sizeof(*backend));
+}
+
+const char* GetCpuIsaName(CpuIsa isa) {
+	switch (isa) {
+	case CPU_ISA_SCALAR:
+		return "scalar";
+	case CPU_ISA_NEON:
+		return "neon";
+	case CPU_ISA_AVX2:
+		return "avx2";
+	case CPU_ISA_AVX512:
+		return "avx512";
+	default:
+		return "unknown";
+	}
+}
+
+const CpuKernel* FindCpuKernel(const char* shaderFile) {
+	const char* fileName = strrchr(shaderFile, '/');
+	fileName = fileName != NULL ? fileName + 1 : shaderFile;
+	for (uint32_t i = 0; i < cpuKernelCount; ++i) {
+		if (!strcmp(cpuKernels[i].shaderFile, fileName)) {
+			return &cpuKernels[i];
+		}
+	}
+	return NULL;
+}
+
+CpuKernelFunction GetCpuKernelFunction(const CpuBackend* backend, const CpuKernel* kernel) {
+	for (int isa = backend->isa; isa >= 0; --isa) {
+		if (kernel->functions[isa] != NULL) {
+			return kernel->functions[isa];
+		}
+	}
+	return NULL;
+}
+
+typedef struct CpuSlice {
+	CpuKernelFunction function;
+	void* const* buffers;
+	const void* pushConstants;
+	uint64_t begin;
+	uint64_t end;
+} CpuSlice;
+
+static void RunCpuSlice(void* argument) {
+	const CpuSlice* slice = argument;
+	slice->function(slice->buffers, slice->pushConstants, slice->begin, slice->end);
+}
+
+VkResult RunCpuKernel(CpuBackend* backend, CpuKernelFunction function, void* const* buffers,
+	const void* pushConstants, uint64_t elementCount) {
+
+	uint64_t sliceCount = elementCount / CPU_MIN_ELEMENTS_PER_THREAD;
+	if (sliceCount > backend->threadCount) {
+		sliceCount = backend->threadCount;
+	}
+	if (sliceCount <= 1) {
+		function(buffers, pushConstants, 0, elementCount);
+		return VK_SUCCESS;
+	}
+
+	CpuSlice slices[CPU_MAX_THREADS];
+	for (uint32_t i = 0; i < sliceCount; ++i) {
+		slices[i].function = function;
+		slices[i].buffers = buffers;
+		slices[i].pushConstants = pushConstants;
+		slices[i].begin = elementCount * i / sliceCount / CPU_SLICE_ALIGNMENT * CPU_SLICE_ALIGNMENT;
+		slices[i].end = i + 1 < sliceCount ?
+			elementCount * (i + 1) / sliceCount / CPU_SLICE_ALIGNMENT * CPU_SLICE_ALIGNMENT : elementCount;
+	}
+	RunWorkerTasks(&backend->workers, RunCpuSlice, slices, sizeof(slices[0]), (uint32_t) sliceCount);
+	return VK_SUCCESS;
+}
+
+void* AllocateCpuMemory(size_t size) {
+	// Round up so vector loops may read whole cache lines
+	size = (size + CPU_MEMORY_ALIGNMENT - 1) / CPU_MEMORY_ALIGNMENT * CPU_MEMORY_ALIGNMENT;
+#ifdef _WIN32
+	return _aligned_malloc(size, CPU_MEMORY_ALIGNMENT);
+#else
+	void* pointer = NULL;
+	if (posix_memalign(&pointer, CPU_MEMORY_ALIGNMENT, size) != 0) {
+		return NULL;
+	}
+	return pointer;
+#endif
+}
+
+void FreeCpuMemory(void* pointer) {
+#ifdef _WIN32
+	_aligned_free(pointer);
+#else
+	free(pointer);
+#endif
+}
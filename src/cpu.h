@@ -0,0 +1,94 @@
+#include <vulkan/vulkan.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef CPU_H
+#define CPU_H
+
+// Most buffers a native kernel takes, and most threads a dispatch is split across
+#define CPU_MAX_BINDINGS 8
+#define CPU_MAX_THREADS 256
+// Smaller dispatches, or slices of them, are not worth a thread of their own
+#define CPU_MIN_ELEMENTS_PER_THREAD 65536
+
+// Vector instruction sets native kernels can be written for, in increasing order of preference
+typedef enum CpuIsa {
+	CPU_ISA_SCALAR,
+	CPU_ISA_NEON,
+	CPU_ISA_AVX2,
+	CPU_ISA_AVX512,
+	CPU_ISA_COUNT
+} CpuIsa;
+
+// Process elements [begin, end) of an elementwise kernel. buffers and pushConstants are laid out as for the
+// kernel's shader, so the element count is the first push constant.
+typedef void (*CpuKernelFunction)(void* const* buffers, const void* pushConstants, uint64_t begin, uint64_t end);
+
+// A native implementation of a compute shader
+typedef struct CpuKernel {
+	// The .spv file this implements, matched by file name whatever its directory
+	const char* shaderFile;
+	// One version per instruction set, or NULL where there is none
+	CpuKernelFunction functions[CPU_ISA_COUNT];
+} CpuKernel;
+
+typedef void (*WorkerFunction)(void* task);
+
+// Threads that run batches of tasks alongside the calling thread. They stay alive between batches, sleeping on a
+// condition variable, so a small batch costs a wake-up rather than creating and joining threads.
+typedef struct WorkerPool {
+	pthread_t threads[CPU_MAX_THREADS];
+	// Threads started, not counting the calling thread. The synchronization objects only exist if non-zero.
+	uint32_t threadCount;
+	pthread_mutex_t mutex;
+	pthread_cond_t wakeCondition;
+	pthread_cond_t doneCondition;
+	// Held for the whole of a batch. Another thread that finds it taken runs its own batch alone instead of waiting.
+	pthread_mutex_t batchMutex;
+	// The current batch, guarded by mutex: taskCount tasks taskSize bytes apart, claimed in order
+	WorkerFunction function;
+	char* tasks;
+	size_t taskSize;
+	uint32_t taskCount;
+	uint32_t nextTask;
+	uint32_t finishedCount;
+	int stop;
+} WorkerPool;
+
+// Start threadCount worker threads. If the system starts fewer, or none, the calling thread does their share.
+void CreateWorkerPool(WorkerPool* pool, uint32_t threadCount);
+void DestroyWorkerPool(WorkerPool* pool);
+// Run function on taskCount tasks, laid out taskSize bytes apart from tasks, on the workers and the calling thread,
+// and wait for all of them
+void RunWorkerTasks(WorkerPool* pool, WorkerFunction function, void* tasks, size_t taskSize, uint32_t taskCount);
+
+// Runs native kernels on host threads in place of a Vulkan device
+typedef struct CpuBackend {
+	CpuIsa isa;
+	uint32_t threadCount;
+	// threadCount - 1 workers, as the dispatching thread runs a slice itself
+	WorkerPool workers;
+} CpuBackend;
+
+// Detect the best instruction set of this CPU and start its worker threads. threadCount of 0 uses every online CPU.
+void CreateCpuBackend(CpuBackend* backend, uint32_t threadCount);
+void DestroyCpuBackend(CpuBackend* backend);
+const char* GetCpuIsaName(CpuIsa isa);
+// Number of CPUs online, at least 1
+uint32_t GetOnlineCpuCount(void);
+
+// Returns NULL if shaderFile has no native implementation
+const CpuKernel* FindCpuKernel(const char* shaderFile);
+// The version of kernel for the best instruction set the backend supports
+CpuKernelFunction GetCpuKernelFunction(const CpuBackend* backend, const CpuKernel* kernel);
+
+// Run function over elementCount elements, split into contiguous slices across the backend's threads, and wait
+VkResult RunCpuKernel(CpuBackend* backend, CpuKernelFunction function, void* const* buffers,
+	const void* pushConstants, uint64_t elementCount);
+
+// Host memory for buffers of the CPU backend, aligned for the widest vectors
+void* AllocateCpuMemory(size_t size);
+void FreeCpuMemory(void* pointer);
+
+#endif
@@ -0,0 +1,322 @@
+#include "descriptors.h"
+#include <vulkan/vulkan.h>
+#include <stdio.h>
+#include <string.h>
+
+const char* GetDescriptorStrategyName(DescriptorStrategy strategy) {
+	switch (strategy) {
+	case DESCRIPTOR_STRATEGY_SETS:
+		return "sets";
+	case DESCRIPTOR_STRATEGY_PUSH:
+		return "push";
+	case DESCRIPTOR_STRATEGY_ADDRESS:
+		return "address";
+	case DESCRIPTOR_STRATEGY_BINDLESS:
+		return "bindless";
+	default:
+		return "unknown";
+	}
+}
+
+int IsDescriptorStrategySupported(const ComputeContext* context, DescriptorStrategy strategy) {
+	switch (strategy) {
+	case DESCRIPTOR_STRATEGY_SETS:
+		return 1;
+	case DESCRIPTOR_STRATEGY_PUSH:
+		return context->pushDescriptors;
+	case DESCRIPTOR_STRATEGY_ADDRESS:
+		return context->bufferDeviceAddress;
+	case DESCRIPTOR_STRATEGY_BINDLESS:
+		return context->descriptorIndexing;
+	default:
+		return 0;
+	}
+}
+
+DescriptorStrategy SelectDescriptorStrategy(const ComputeContext* context) {
+	// Addresses only cost push constants; table slots add one descriptor set bind; push descriptors are written
+	// into the command buffer on every dispatch
+	static const DescriptorStrategy preference[] = {
+		DESCRIPTOR_STRATEGY_ADDRESS, DESCRIPTOR_STRATEGY_BINDLESS, DESCRIPTOR_STRATEGY_PUSH
+	};
+	for (uint32_t i = 0; i < sizeof(preference) / sizeof(preference[0]); ++i) {
+		if (IsDescriptorStrategySupported(context, preference[i])) {
+			return preference[i];
+		}
+	}
+	return DESCRIPTOR_STRATEGY_SETS;
+}
+
+static VkResult CreateBinderLayout(DescriptorBinder* binder) {
+	VkDescriptorSetLayoutBinding bindings[DESCRIPTOR_BINDER_MAX_BINDINGS] = { 0 };
+	for (uint32_t i = 0; i < binder->bindingCount; ++i) {
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		bindings[i].pImmutableSamplers = NULL;
+	}
+
+	// The table can be written while dispatches using other slots are pending, and unwritten slots are allowed
+	const VkDescriptorBindingFlags tableFlags = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+		VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+	VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo = { 0 };
+	bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	bindingFlagsInfo.pNext = NULL;
+	bindingFlagsInfo.bindingCount = 1;
+	bindingFlagsInfo.pBindingFlags = &tableFlags;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = { 0 };
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.pNext = NULL;
+	layoutInfo.flags = 0;
+	layoutInfo.bindingCount = binder->bindingCount;
+	layoutInfo.pBindings = bindings;
+
+	switch (binder->strategy) {
+	case DESCRIPTOR_STRATEGY_PUSH:
+		layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+		break;
+	case DESCRIPTOR_STRATEGY_ADDRESS:
+		layoutInfo.bindingCount = 0;
+		break;
+	case DESCRIPTOR_STRATEGY_BINDLESS:
+		bindings[0].descriptorCount = BINDLESS_TABLE_SIZE;
+		layoutInfo.pNext = &bindingFlagsInfo;
+		layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+		layoutInfo.bindingCount = 1;
+		break;
+	default:
+		break;
+	}
+
+	VkResult result = vkCreateDescriptorSetLayout(binder->context->device, &layoutInfo, NULL, &binder->descriptorSetLayout);
+	if (result != VK_SUCCESS) {
+		puts("Failed to create descriptor set layout");
+	}
+	return result;
+}
+
+static VkResult CreateBinderPool(DescriptorBinder* binder) {
+	VkDescriptorPoolSize poolSize = { 0 };
+	poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+
+	VkDescriptorPoolCreateInfo poolInfo = { 0 };
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.pNext = NULL;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+	if (binder->strategy == DESCRIPTOR_STRATEGY_BINDLESS) {
+		poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+		poolInfo.maxSets = 1;
+		poolSize.descriptorCount = BINDLESS_TABLE_SIZE;
+	}
+	else {
+		poolInfo.flags = 0;
+		poolInfo.maxSets = DESCRIPTOR_BINDER_MAX_SETS;
+		poolSize.descriptorCount = DESCRIPTOR_BINDER_MAX_SETS * binder->bindingCount;
+	}
+
+	VkResult result = vkCreateDescriptorPool(binder->context->device, &poolInfo, NULL, &binder->descriptorPool);
+	if (result != VK_SUCCESS) {
+		puts("Failed to create descriptor pool");
+		return result;
+	}
+	if (binder->strategy != DESCRIPTOR_STRATEGY_BINDLESS) {
+		return VK_SUCCESS;
+	}
+
+	VkDescriptorSetAllocateInfo allocateInfo = { 0 };
+	allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocateInfo.pNext = NULL;
+	allocateInfo.descriptorPool = binder->descriptorPool;
+	allocateInfo.descriptorSetCount = 1;
+	allocateInfo.pSetLayouts = &binder->descriptorSetLayout;
+
+	result = vkAllocateDescriptorSets(binder->context->device, &allocateInfo, &binder->table);
+	if (result != VK_SUCCESS) {
+		puts("Failed to allocate bindless table");
+	}
+	return result;
+}
+
+VkResult CreateDescriptorBinder(ComputeContext* context, DescriptorStrategy strategy, uint32_t bindingCount,
+	uint32_t pushConstantSize, DescriptorBinder* binder) {
+
+	memset(binder, 0, sizeof(*binder));
+	binder->context = context;
+	binder->strategy = strategy;
+	binder->bindingCount = bindingCount;
+	binder->pushConstantSize = pushConstantSize;
+	if (!IsDescriptorStrategySupported(context, strategy)) {
+		printf("Descriptor strategy %s is not supported by this device\n", GetDescriptorStrategyName(strategy));
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+	}
+	if (bindingCount == 0 || bindingCount > DESCRIPTOR_BINDER_MAX_BINDINGS) {
+		printf("Descriptor binders support 1 to %u bindings\n", DESCRIPTOR_BINDER_MAX_BINDINGS);
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+	}
+
+	binder->bufferDataOffset = pushConstantSize;
+	binder->totalPushConstantSize = pushConstantSize;
+	if (strategy == DESCRIPTOR_STRATEGY_ADDRESS) {
+		binder->bufferDataOffset = (pushConstantSize + 7) & ~7u;
+		binder->totalPushConstantSize = binder->bufferDataOffset + bindingCount * (uint32_t) sizeof(VkDeviceAddress);
+	}
+	else if (strategy == DESCRIPTOR_STRATEGY_BINDLESS) {
+		binder->totalPushConstantSize = pushConstantSize + bindingCount * (uint32_t) sizeof(uint32_t);
+	}
+	if (binder->totalPushConstantSize > DESCRIPTOR_BINDER_MAX_PUSH_CONSTANT_SIZE) {
+		printf("%u bytes of push constants do not fit in %u\n", binder->totalPushConstantSize,
+			DESCRIPTOR_BINDER_MAX_PUSH_CONSTANT_SIZE);
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+	}
+
+	VkResult result = CreateBinderLayout(binder);
+	if (result == VK_SUCCESS && (strategy == DESCRIPTOR_STRATEGY_SETS || strategy == DESCRIPTOR_STRATEGY_BINDLESS)) {
+		result = CreateBinderPool(binder);
+	}
+	if (result != VK_SUCCESS) {
+		DestroyDescriptorBinder(binder);
+	}
+	return result;
+}
+
+void DestroyDescriptorBinder(DescriptorBinder* binder) {
+	if (binder->context != NULL) {
+		vkDestroyDescriptorPool(binder->context->device, binder->descriptorPool, NULL);
+		vkDestroyDescriptorSetLayout(binder->context->device, binder->descriptorSetLayout, NULL);
+	}
+	memset(binder, 0, sizeof(*binder));
+}
+
+VkResult CreateBinderKernel(DescriptorBinder* binder, const ComputeKernelCreateInfo* kernelInfo, ComputeKernel* kernel) {
+	ComputeKernelCreateInfo binderKernelInfo = *kernelInfo;
+	binderKernelInfo.bindingCount = binder->bindingCount;
+	binderKernelInfo.pushConstantSize = binder->totalPushConstantSize;
+	binderKernelInfo.dynamicRange = 0;
+	binderKernelInfo.descriptorSetLayout = binder->descriptorSetLayout;
+	return CreateComputeKernel(binder->context, &binderKernelInfo, kernel);
+}
+
+VkResult AddBindlessBuffer(DescriptorBinder* binder, const ComputeBuffer* buffer, uint32_t* slot) {
+	if (binder->strategy != DESCRIPTOR_STRATEGY_BINDLESS || binder->tableCount == BINDLESS_TABLE_SIZE) {
+		puts("Bindless table is full");
+		return VK_ERROR_OUT_OF_POOL_MEMORY;
+	}
+
+	VkDescriptorBufferInfo bufferInfo = { 0 };
+	bufferInfo.buffer = buffer->buffer;
+	bufferInfo.offset = 0;
+	bufferInfo.range = VK_WHOLE_SIZE;
+
+	VkWriteDescriptorSet write = { 0 };
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.pNext = NULL;
+	write.dstSet = binder->table;
+	write.dstBinding = 0;
+	write.dstArrayElement = binder->tableCount;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	write.pImageInfo = NULL;
+	write.pBufferInfo = &bufferInfo;
+	write.pTexelBufferView = NULL;
+	vkUpdateDescriptorSets(binder->context->device, 1, &write, 0, NULL);
+
+	*slot = binder->tableCount++;
+	return VK_SUCCESS;
+}
+
+static void FillBufferWrites(const DescriptorBinder* binder, const ComputeBuffer* buffers, VkDescriptorSet set,
+	VkDescriptorBufferInfo* bufferInfos, VkWriteDescriptorSet* writes) {
+
+	for (uint32_t i = 0; i < binder->bindingCount; ++i) {
+		bufferInfos[i].buffer = buffers[i].buffer;
+		bufferInfos[i].offset = 0;
+		bufferInfos[i].range = VK_WHOLE_SIZE;
+
+		writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].pNext = NULL;
+		writes[i].dstSet = set;
+		writes[i].dstBinding = i;
+		writes[i].dstArrayElement = 0;
+		writes[i].descriptorCount = 1;
+		writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writes[i].pImageInfo = NULL;
+		writes[i].pBufferInfo = &bufferInfos[i];
+		writes[i].pTexelBufferView = NULL;
+	}
+}
+
+VkResult CmdDispatchWithBinder(VkCommandBuffer commandBuffer, DescriptorBinder* binder, const ComputeKernel* kernel,
+	const ComputeBuffer* buffers, const uint32_t* slots, const void* pushConstants,
+	uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ) {
+
+	ComputeContext* context = binder->context;
+	uint8_t pushData[DESCRIPTOR_BINDER_MAX_PUSH_CONSTANT_SIZE] = { 0 };
+	if (binder->pushConstantSize > 0) {
+		memcpy(pushData, pushConstants, binder->pushConstantSize);
+	}
+
+	VkDescriptorBufferInfo bufferInfos[DESCRIPTOR_BINDER_MAX_BINDINGS];
+	VkWriteDescriptorSet writes[DESCRIPTOR_BINDER_MAX_BINDINGS];
+	VkDescriptorSet set = VK_NULL_HANDLE;
+	VkResult result = VK_SUCCESS;
+
+	VkDescriptorSetAllocateInfo allocateInfo = { 0 };
+	allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocateInfo.pNext = NULL;
+	allocateInfo.descriptorPool = binder->descriptorPool;
+	allocateInfo.descriptorSetCount = 1;
+	allocateInfo.pSetLayouts = &binder->descriptorSetLayout;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, kernel->pipeline);
+	switch (binder->strategy) {
+	case DESCRIPTOR_STRATEGY_SETS:
+		if (binder->setCount == DESCRIPTOR_BINDER_MAX_SETS) {
+			puts("Descriptor binder is out of sets, reset it after the pending dispatches complete");
+			return VK_ERROR_OUT_OF_POOL_MEMORY;
+		}
+		result = vkAllocateDescriptorSets(context->device, &allocateInfo, &set);
+		if (result != VK_SUCCESS) {
+			puts("Failed to allocate descriptor set");
+			return result;
+		}
+		++binder->setCount;
+		FillBufferWrites(binder, buffers, set, bufferInfos, writes);
+		vkUpdateDescriptorSets(context->device, binder->bindingCount, writes, 0, NULL);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, kernel->pipelineLayout, 0, 1, &set, 0, NULL);
+		break;
+	case DESCRIPTOR_STRATEGY_PUSH:
+		FillBufferWrites(binder, buffers, VK_NULL_HANDLE, bufferInfos, writes);
+		context->vkCmdPushDescriptorSetKHR(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, kernel->pipelineLayout, 0,
+			binder->bindingCount, writes);
+		break;
+	case DESCRIPTOR_STRATEGY_ADDRESS:
+		for (uint32_t i = 0; i < binder->bindingCount; ++i) {
+			memcpy(pushData + binder->bufferDataOffset + i * sizeof(VkDeviceAddress), &buffers[i].address, sizeof(VkDeviceAddress));
+		}
+		break;
+	case DESCRIPTOR_STRATEGY_BINDLESS:
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, kernel->pipelineLayout, 0, 1, &binder->table, 0, NULL);
+		memcpy(pushData + binder->bufferDataOffset, slots, binder->bindingCount * sizeof(uint32_t));
+		break;
+	default:
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+	}
+
+	if (binder->totalPushConstantSize > 0) {
+		vkCmdPushConstants(commandBuffer, kernel->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+			binder->totalPushConstantSize, pushData);
+	}
+	vkCmdDispatch(commandBuffer, groupCountX, groupCountY, groupCountZ);
+	return VK_SUCCESS;
+}
+
+VkResult ResetDescriptorBinder(DescriptorBinder* binder) {
+	if (binder->strategy != DESCRIPTOR_STRATEGY_SETS) {
+		return VK_SUCCESS;
+	}
+	binder->setCount = 0;
+	return vkResetDescriptorPool(binder->context->device, binder->descriptorPool, 0);
+}
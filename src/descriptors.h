@@ -0,0 +1,77 @@
+#include <vulkan/vulkan.h>
+#include "context.h"
+#include "buffer.h"
+#include "kernel.h"
+
+#ifndef DESCRIPTORS_H
+#define DESCRIPTORS_H
+
+#define DESCRIPTOR_BINDER_MAX_BINDINGS 8
+// Descriptor sets allocated per pool by DESCRIPTOR_STRATEGY_SETS before ResetDescriptorBinder must be called
+#define DESCRIPTOR_BINDER_MAX_SETS 1024
+// Slots of the bindless table, far below the 500000 update-after-bind storage buffers devices must support
+#define BINDLESS_TABLE_SIZE 4096
+// The minimum maxPushConstantsSize guaranteed by the spec
+#define DESCRIPTOR_BINDER_MAX_PUSH_CONSTANT_SIZE 128
+
+// How a dispatch tells its kernel which buffers to use. The kernel's own push constants always come first, so
+// elementwise kernels keep the element count at offset 0; the strategies that pass buffers through push
+// constants append them after it.
+typedef enum DescriptorStrategy {
+	// Allocate and write a fresh descriptor set for every dispatch, from a pool reset between submissions
+	DESCRIPTOR_STRATEGY_SETS,
+	// Record the buffers into the command buffer with vkCmdPushDescriptorSetKHR (VK_KHR_push_descriptor)
+	DESCRIPTOR_STRATEGY_PUSH,
+	// Append each buffer's device address, 8-byte aligned; the shader uses GL_EXT_buffer_reference
+	DESCRIPTOR_STRATEGY_ADDRESS,
+	// Write each buffer once into an update-after-bind table and append the uint32_t table slots; the shader
+	// indexes a runtime array of storage buffers at binding 0
+	DESCRIPTOR_STRATEGY_BINDLESS,
+	DESCRIPTOR_STRATEGY_COUNT
+} DescriptorStrategy;
+
+// The descriptor set layout and per-strategy state shared by every kernel with the same interface: bindingCount
+// buffers and pushConstantSize bytes of the kernel's own push constants
+typedef struct DescriptorBinder {
+	ComputeContext* context;
+	DescriptorStrategy strategy;
+	uint32_t bindingCount;
+	uint32_t pushConstantSize;
+	// Offset of the appended addresses or table slots, and the size of the whole push constant block
+	uint32_t bufferDataOffset;
+	uint32_t totalPushConstantSize;
+	VkDescriptorSetLayout descriptorSetLayout;
+	// DESCRIPTOR_STRATEGY_SETS: the pool dispatches allocate from. DESCRIPTOR_STRATEGY_BINDLESS: the table.
+	VkDescriptorPool descriptorPool;
+	uint32_t setCount;
+	VkDescriptorSet table;
+	uint32_t tableCount;
+} DescriptorBinder;
+
+const char* GetDescriptorStrategyName(DescriptorStrategy strategy);
+int IsDescriptorStrategySupported(const ComputeContext* context, DescriptorStrategy strategy);
+// The strategy with the least host work per dispatch the device supports
+DescriptorStrategy SelectDescriptorStrategy(const ComputeContext* context);
+
+VkResult CreateDescriptorBinder(ComputeContext* context, DescriptorStrategy strategy, uint32_t bindingCount,
+	uint32_t pushConstantSize, DescriptorBinder* binder);
+void DestroyDescriptorBinder(DescriptorBinder* binder);
+
+// Create a kernel using the binder's layout. kernelInfo->shaderFile must be written for the binder's strategy;
+// its bindingCount and pushConstantSize are replaced by the binder's.
+VkResult CreateBinderKernel(DescriptorBinder* binder, const ComputeKernelCreateInfo* kernelInfo, ComputeKernel* kernel);
+
+// DESCRIPTOR_STRATEGY_BINDLESS: write buffer into the next slot of the table, returned in slot. Slots stay valid
+// until the binder is destroyed, and may be written while earlier dispatches are pending.
+VkResult AddBindlessBuffer(DescriptorBinder* binder, const ComputeBuffer* buffer, uint32_t* slot);
+
+// Record binding buffers[0..bindingCount-1] (or, for DESCRIPTOR_STRATEGY_BINDLESS, the table slots in slots)
+// and pushing pushConstants, then dispatch the kernel
+VkResult CmdDispatchWithBinder(VkCommandBuffer commandBuffer, DescriptorBinder* binder, const ComputeKernel* kernel,
+	const ComputeBuffer* buffers, const uint32_t* slots, const void* pushConstants,
+	uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ);
+
+// DESCRIPTOR_STRATEGY_SETS: free every descriptor set once the dispatches using them have completed
+VkResult ResetDescriptorBinder(DescriptorBinder* binder);
+
+#endif
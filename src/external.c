@@ -0,0 +1,270 @@
+#define _POSIX_C_SOURCE 200112L
+#define _DEFAULT_SOURCE
+#include "external.h"
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static size_t GetPageSize(void) {
+#ifdef _WIN32
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo(&systemInfo);
+	return systemInfo.dwPageSize;
+#else
+	return (size_t) sysconf(_SC_PAGESIZE);
+#endif
+}
+
+VkDeviceSize GetHostImportAlignment(const ComputeContext* context) {
+	VkDeviceSize pageSize = GetPageSize();
+	if (context->externalMemoryHost && context->minImportedHostPointerAlignment > pageSize) {
+		return context->minImportedHostPointerAlignment;
+	}
+	return pageSize;
+}
+
+void* AllocateImportableMemory(const ComputeContext* context, VkDeviceSize size, VkDeviceSize* allocatedSize) {
+	const VkDeviceSize alignment = GetHostImportAlignment(context);
+	const VkDeviceSize alignedSize = (size + alignment - 1) / alignment * alignment;
+	void* pointer = NULL;
+#ifdef _WIN32
+	pointer = _aligned_malloc(alignedSize, alignment);
+#else
+	if (posix_memalign(&pointer, alignment, alignedSize) != 0) {
+		pointer = NULL;
+	}
+#endif
+	if (pointer == NULL) {
+		return NULL;
+	}
+	memset(pointer, 0, alignedSize);
+	*allocatedSize = alignedSize;
+	return pointer;
+}
+
+void FreeImportableMemory(void* pointer) {
+#ifdef _WIN32
+	_aligned_free(pointer);
+#else
+	free(pointer);
+#endif
+}
+
+// Import pointer as device memory bound to a new buffer. Returns VK_ERROR_FEATURE_NOT_PRESENT if it cannot be
+// imported, so the caller can fall back to a copy.
+static VkResult ImportHostPointer(ComputeContext* context, void* pointer, VkDeviceSize size, ComputeBuffer* buffer) {
+	const VkDeviceSize alignment = context->minImportedHostPointerAlignment;
+	if (!context->externalMemoryHost || alignment == 0 || (uintptr_t) pointer % alignment != 0 || size % alignment != 0) {
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+	}
+
+	VkMemoryHostPointerPropertiesEXT pointerProperties = { 0 };
+	pointerProperties.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+	pointerProperties.pNext = NULL;
+	VkResult result = context->vkGetMemoryHostPointerPropertiesEXT(context->device,
+		VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, pointer, &pointerProperties);
+	if (result != VK_SUCCESS || pointerProperties.memoryTypeBits == 0) {
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+	}
+
+	VkExternalMemoryBufferCreateInfo externalBufferInfo = { 0 };
+	externalBufferInfo.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO;
+	externalBufferInfo.pNext = NULL;
+	externalBufferInfo.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+
+	VkBufferCreateInfo bufferCreateInfo = { 0 };
+	bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferCreateInfo.pNext = &externalBufferInfo;
+	bufferCreateInfo.flags = 0;
+	bufferCreateInfo.size = size;
+	bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	if (context->bufferDeviceAddress) {
+		bufferCreateInfo.usage |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+	}
+	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	bufferCreateInfo.queueFamilyIndexCount = 1;
+	bufferCreateInfo.pQueueFamilyIndices = &context->computeQueueIndex;
+
+	result = vkCreateBuffer(context->device, &bufferCreateInfo, NULL, &buffer->buffer);
+	if (result != VK_SUCCESS) {
+		puts("Failed to create buffer");
+		return result;
+	}
+
+	// The host keeps using the memory directly, so only coherent types avoid flushes
+	VkMemoryRequirements memoryRequirements = { 0 };
+	vkGetBufferMemoryRequirements(context->device, buffer->buffer, &memoryRequirements);
+	const uint32_t memoryTypeIndex = FindMemoryTypeIndex(&context->memoryProperties,
+		memoryRequirements.memoryTypeBits & pointerProperties.memoryTypeBits,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	if (memoryTypeIndex == UINT32_MAX) {
+		vkDestroyBuffer(context->device, buffer->buffer, NULL);
+		buffer->buffer = VK_NULL_HANDLE;
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+	}
+
+	VkMemoryAllocateFlagsInfo allocateFlagsInfo = { 0 };
+	allocateFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+	allocateFlagsInfo.pNext = NULL;
+	allocateFlagsInfo.flags = context->allocator.allocateFlags;
+	allocateFlagsInfo.deviceMask = 0;
+
+	VkImportMemoryHostPointerInfoEXT importInfo = { 0 };
+	importInfo.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT;
+	importInfo.pNext = context->allocator.allocateFlags != 0 ? &allocateFlagsInfo : NULL;
+	importInfo.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+	importInfo.pHostPointer = pointer;
+
+	VkMemoryAllocateInfo memoryAllocateInfo = { 0 };
+	memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memoryAllocateInfo.pNext = &importInfo;
+	memoryAllocateInfo.allocationSize = size;
+	memoryAllocateInfo.memoryTypeIndex = memoryTypeIndex;
+
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	result = vkAllocateMemory(context->device, &memoryAllocateInfo, NULL, &memory);
+	if (result == VK_SUCCESS) {
+		result = vkBindBufferMemory(context->device, buffer->buffer, memory, 0);
+	}
+	if (result != VK_SUCCESS) {
+		// Drivers may refuse memory they cannot pin, e.g. some file mappings
+		vkFreeMemory(context->device, memory, NULL);
+		vkDestroyBuffer(context->device, buffer->buffer, NULL);
+		buffer->buffer = VK_NULL_HANDLE;
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+	}
+
+	buffer->allocation.memory = memory;
+	buffer->allocation.offset = 0;
+	buffer->allocation.size = size;
+	buffer->allocation.memoryTypeIndex = memoryTypeIndex;
+	buffer->allocation.mapped = pointer;
+	buffer->mapped = pointer;
+	buffer->imported = 1;
+	if (context->bufferDeviceAddress) {
+		VkBufferDeviceAddressInfo addressInfo = { 0 };
+		addressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+		addressInfo.pNext = NULL;
+		addressInfo.buffer = buffer->buffer;
+		buffer->address = vkGetBufferDeviceAddress(context->device, &addressInfo);
+	}
+	return VK_SUCCESS;
+}
+
+VkResult CreateHostPointerBuffer(ComputeContext* context, void* pointer, VkDeviceSize size, ComputeBuffer* buffer) {
+	memset(buffer, 0, sizeof(*buffer));
+	buffer->size = size;
+	buffer->location = BUFFER_LOCATION_HOST;
+
+	VkResult result = ImportHostPointer(context, pointer, size, buffer);
+	if (result != VK_ERROR_FEATURE_NOT_PRESENT) {
+		return result;
+	}
+
+	result = CreateComputeBuffer(context, size, BUFFER_LOCATION_HOST, buffer);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+	memcpy(buffer->mapped, pointer, size);
+	return VK_SUCCESS;
+}
+
+VkResult MapHostFile(const ComputeContext* context, const char* filename, HostFileMapping* mapping) {
+	memset(mapping, 0, sizeof(*mapping));
+	const VkDeviceSize alignment = GetHostImportAlignment(context);
+#ifdef _WIN32
+	// Views are only 64 KiB aligned, so read the file into importable memory instead
+	FILE* file = fopen(filename, "rb");
+	if (file == NULL) {
+		printf("Failed to open %s\n", filename);
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+	if (fseek(file, 0, SEEK_END) == -1) {
+		fclose(file);
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+	long fileSize = ftell(file);
+	if (fileSize <= 0 || fseek(file, 0, SEEK_SET) == -1) {
+		printf("Failed to read %s\n", filename);
+		fclose(file);
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+	VkDeviceSize allocatedSize = 0;
+	void* data = AllocateImportableMemory(context, fileSize, &allocatedSize);
+	if (data == NULL || fread(data, 1, fileSize, file) != (size_t) fileSize) {
+		printf("Failed to read %s\n", filename);
+		FreeImportableMemory(data);
+		fclose(file);
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+	fclose(file);
+	mapping->data = data;
+	mapping->size = allocatedSize;
+	mapping->fileSize = fileSize;
+#else
+	int file = open(filename, O_RDONLY);
+	if (file == -1) {
+		printf("Failed to open %s\n", filename);
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+	struct stat fileStat;
+	if (fstat(file, &fileStat) == -1 || fileStat.st_size == 0) {
+		printf("Failed to read %s\n", filename);
+		close(file);
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+	const size_t fileSize = (size_t) fileStat.st_size;
+	const size_t size = (fileSize + alignment - 1) / alignment * alignment;
+
+	// Reserve the whole aligned range as zeroed anonymous memory, then map the file over its start. Pages past
+	// the end of the file would fault if they were part of the file mapping.
+	uint8_t* data = mmap(NULL, size + alignment, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (data == MAP_FAILED) {
+		printf("Failed to map %s\n", filename);
+		close(file);
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+	// mmap only guarantees page alignment, so over-reserve and trim to the import alignment
+	uint8_t* aligned = (uint8_t*) (((uintptr_t) data + alignment - 1) / alignment * alignment);
+	if (aligned > data) {
+		munmap(data, aligned - data);
+	}
+	if (aligned + size < data + size + alignment) {
+		munmap(aligned + size, data + size + alignment - (aligned + size));
+	}
+	void* fileData = mmap(aligned, fileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, file, 0);
+	close(file);
+	if (fileData == MAP_FAILED) {
+		printf("Failed to map %s\n", filename);
+		munmap(aligned, size);
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+	mapping->data = aligned;
+	mapping->size = size;
+	mapping->fileSize = fileSize;
+#endif
+	return VK_SUCCESS;
+}
+
+void UnmapHostFile(HostFileMapping* mapping) {
+	if (mapping->data != NULL) {
+#ifdef _WIN32
+		FreeImportableMemory(mapping->data);
+#else
+		munmap(mapping->data, mapping->size);
+#endif
+	}
+	memset(mapping, 0, sizeof(*mapping));
+}
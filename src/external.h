@@ -0,0 +1,38 @@
+#include <vulkan/vulkan.h>
+#include <stddef.h>
+#include "context.h"
+#include "buffer.h"
+
+#ifndef EXTERNAL_H
+#define EXTERNAL_H
+
+// A file mapped copy-on-write, padded with zeros to a multiple of the import alignment
+typedef struct HostFileMapping {
+	void* data;
+	// Bytes mapped, a multiple of the import alignment, and bytes of file data at the start of them
+	size_t size;
+	size_t fileSize;
+} HostFileMapping;
+
+// Alignment of pointers and sizes that can be imported: minImportedHostPointerAlignment, or a page size if the
+// device cannot import host memory
+VkDeviceSize GetHostImportAlignment(const ComputeContext* context);
+
+// Allocate at least size bytes of zeroed host memory that satisfies the import alignment; allocatedSize receives
+// the rounded size to pass to CreateHostPointerBuffer. Free with FreeImportableMemory.
+void* AllocateImportableMemory(const ComputeContext* context, VkDeviceSize size, VkDeviceSize* allocatedSize);
+void FreeImportableMemory(void* pointer);
+
+// Wrap size bytes of host memory at pointer as a storage buffer, so the GPU reads and writes it in place. The
+// memory must stay valid until the buffer is destroyed. If the device cannot import it (no
+// VK_EXT_external_memory_host, misaligned pointer or size, or no host coherent memory type), a host buffer is
+// created instead and the data copied into it; buffer->imported tells which happened, and buffer->mapped is
+// where results appear in both cases.
+VkResult CreateHostPointerBuffer(ComputeContext* context, void* pointer, VkDeviceSize size, ComputeBuffer* buffer);
+
+// Map filename so it can be imported with CreateHostPointerBuffer(context, mapping->data, mapping->size, ...).
+// The mapping is private: writes by the host or the GPU never reach the file.
+VkResult MapHostFile(const ComputeContext* context, const char* filename, HostFileMapping* mapping);
+void UnmapHostFile(HostFileMapping* mapping);
+
+#endif
@@ -0,0 +1,627 @@
+#include "fusion.h"
+#include "shaders.h"
+#include "timer.h"
+#include <vulkan/vulkan.h>
+#include <stdlib.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define FUSED_DEFAULT_LOCAL_SIZE 256
+
+// Opcodes, decorations and enumerants from the SPIR-V and GLSL.std.450 specifications
+#define OP_EXT_INST_IMPORT 11
+#define OP_EXT_INST 12
+#define OP_MEMORY_MODEL 14
+#define OP_ENTRY_POINT 15
+#define OP_EXECUTION_MODE 16
+#define OP_CAPABILITY 17
+#define OP_TYPE_VOID 19
+#define OP_TYPE_BOOL 20
+#define OP_TYPE_INT 21
+#define OP_TYPE_FLOAT 22
+#define OP_TYPE_VECTOR 23
+#define OP_TYPE_ARRAY 28
+#define OP_TYPE_RUNTIME_ARRAY 29
+#define OP_TYPE_STRUCT 30
+#define OP_TYPE_POINTER 32
+#define OP_TYPE_FUNCTION 33
+#define OP_CONSTANT 43
+#define OP_SPEC_CONSTANT 50
+#define OP_SPEC_CONSTANT_COMPOSITE 51
+#define OP_FUNCTION 54
+#define OP_FUNCTION_END 56
+#define OP_VARIABLE 59
+#define OP_LOAD 61
+#define OP_STORE 62
+#define OP_ACCESS_CHAIN 65
+#define OP_DECORATE 71
+#define OP_MEMBER_DECORATE 72
+#define OP_COMPOSITE_EXTRACT 81
+#define OP_IADD 128
+#define OP_FADD 129
+#define OP_IMUL 132
+#define OP_FMUL 133
+#define OP_ULESS_THAN 176
+#define OP_SELECTION_MERGE 247
+#define OP_LABEL 248
+#define OP_BRANCH 249
+#define OP_BRANCH_CONDITIONAL 250
+#define OP_RETURN 253
+
+#define CAPABILITY_SHADER 1
+#define ADDRESSING_MODEL_LOGICAL 0
+#define MEMORY_MODEL_GLSL450 1
+#define EXECUTION_MODEL_GLCOMPUTE 5
+#define EXECUTION_MODE_LOCAL_SIZE 17
+
+#define DECORATION_SPEC_ID 1
+#define DECORATION_BLOCK 2
+#define DECORATION_BUFFER_BLOCK 3
+#define DECORATION_ARRAY_STRIDE 6
+#define DECORATION_BUILT_IN 11
+#define DECORATION_BINDING 33
+#define DECORATION_DESCRIPTOR_SET 34
+#define DECORATION_OFFSET 35
+
+#define BUILT_IN_NUM_WORKGROUPS 24
+#define BUILT_IN_WORKGROUP_SIZE 25
+#define BUILT_IN_WORKGROUP_ID 26
+#define BUILT_IN_LOCAL_INVOCATION_ID 27
+
+#define STORAGE_CLASS_INPUT 1
+#define STORAGE_CLASS_UNIFORM 2
+#define STORAGE_CLASS_PUSH_CONSTANT 9
+
+#define GLSL_STD_450_FCLAMP 43
+#define GLSL_STD_450_FMA 50
+
+// Result IDs of the parts every fused shader has. Buffer variables, parameter indices and values computed in
+// main are numbered from ID_FIRST_DYNAMIC.
+enum {
+	ID_GLSL_STD_450 = 1,
+	ID_VOID,
+	ID_FUNCTION_VOID,
+	ID_UINT,
+	ID_INT,
+	ID_FLOAT,
+	ID_BOOL,
+	ID_UVEC3,
+	ID_PTR_INPUT_UVEC3,
+	ID_WORKGROUP_ID,
+	ID_NUM_WORKGROUPS,
+	ID_LOCAL_INVOCATION_ID,
+	ID_LOCAL_SIZE_X,
+	ID_UINT_1,
+	ID_WORKGROUP_SIZE,
+	ID_INT_0,
+	ID_INT_1,
+	ID_FLOAT_ARRAY,
+	ID_BUFFER_STRUCT,
+	ID_PTR_BUFFER_STRUCT,
+	ID_PTR_BUFFER_FLOAT,
+	ID_PARAMETER_COUNT,
+	ID_PARAMETER_ARRAY,
+	ID_PUSH_STRUCT,
+	ID_PTR_PUSH_STRUCT,
+	ID_PTR_PUSH_UINT,
+	ID_PTR_PUSH_FLOAT,
+	ID_PUSH_CONSTANTS,
+	ID_MAIN,
+	ID_FIRST_DYNAMIC
+};
+
+typedef struct SpirvWriter {
+	uint32_t* code;
+	uint32_t capacity;
+	uint32_t count;
+	uint32_t nextId;
+	int overflow;
+} SpirvWriter;
+
+static void EmitInstruction(SpirvWriter* writer, uint32_t opcode, const uint32_t* operands, uint32_t operandCount) {
+	if (writer->count + 1 + operandCount > writer->capacity) {
+		writer->overflow = 1;
+		return;
+	}
+	writer->code[writer->count++] = ((1 + operandCount) << 16) | opcode;
+	for (uint32_t i = 0; i < operandCount; ++i) {
+		writer->code[writer->count++] = operands[i];
+	}
+}
+
+#define EMIT(writer, opcode, ...) EmitInstruction(writer, opcode, (const uint32_t[]) { __VA_ARGS__ }, \
+	sizeof((const uint32_t[]) { __VA_ARGS__ }) / sizeof(uint32_t))
+
+// Pack a nul terminated literal string into words, returning how many it takes
+static uint32_t PackString(const char* string, uint32_t* words) {
+	const uint32_t wordCount = (uint32_t) strlen(string) / 4 + 1;
+	memset(words, 0, wordCount * sizeof(uint32_t));
+	memcpy(words, string, strlen(string));
+	return wordCount;
+}
+
+static int UsesInput(FusedOpType type) {
+	return type == FUSED_OP_ADD_INPUT || type == FUSED_OP_MUL_INPUT;
+}
+
+static uint32_t GetOpParameterCount(FusedOpType type) {
+	switch (type) {
+	case FUSED_OP_SCALE:
+	case FUSED_OP_ADD:
+		return 1;
+	case FUSED_OP_FMA:
+	case FUSED_OP_CLAMP:
+		return 2;
+	default:
+		return 0;
+	}
+}
+
+static uint32_t GetParameterCount(const FusedExpression* expression) {
+	uint32_t parameterCount = 0;
+	for (uint32_t i = 0; i < expression->opCount; ++i) {
+		parameterCount += GetOpParameterCount(expression->ops[i].type);
+	}
+	return parameterCount;
+}
+
+void InitFusedExpression(FusedExpression* expression, uint32_t inputCount) {
+	memset(expression, 0, sizeof(*expression));
+	expression->inputCount = inputCount;
+}
+
+VkResult AddFusedOp(FusedExpression* expression, FusedOpType type, uint32_t input, float a, float b) {
+	if (expression->opCount == FUSED_MAX_OPS || type >= FUSED_OP_COUNT ||
+		GetParameterCount(expression) + GetOpParameterCount(type) > FUSED_MAX_PARAMETERS) {
+		printf("Fused expressions take at most %u ops and %u parameters\n", FUSED_MAX_OPS, FUSED_MAX_PARAMETERS);
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+	}
+	if (UsesInput(type) && input >= expression->inputCount) {
+		printf("Fused op reads input %u of an expression with %u inputs\n", input, expression->inputCount);
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+	}
+	FusedOp* op = &expression->ops[expression->opCount++];
+	op->type = type;
+	op->input = UsesInput(type) ? input : 0;
+	op->a = a;
+	op->b = b;
+	return VK_SUCCESS;
+}
+
+const char* GetFusedOpName(FusedOpType type) {
+	switch (type) {
+	case FUSED_OP_SCALE:
+		return "scale";
+	case FUSED_OP_ADD:
+		return "add";
+	case FUSED_OP_ADD_INPUT:
+		return "add_input";
+	case FUSED_OP_MUL_INPUT:
+		return "mul_input";
+	case FUSED_OP_FMA:
+		return "fma";
+	case FUSED_OP_CLAMP:
+		return "clamp";
+	default:
+		return "unknown";
+	}
+}
+
+// FNV-1a over the words that decide the generated shader
+uint64_t HashFusedExpression(const FusedExpression* expression) {
+	uint64_t hash = 14695981039346656037ull;
+	uint32_t words[2 + 2 * FUSED_MAX_OPS];
+	uint32_t wordCount = 0;
+	words[wordCount++] = expression->inputCount;
+	words[wordCount++] = expression->opCount;
+	for (uint32_t i = 0; i < expression->opCount && i < FUSED_MAX_OPS; ++i) {
+		words[wordCount++] = expression->ops[i].type;
+		words[wordCount++] = expression->ops[i].input;
+	}
+	const unsigned char* bytes = (const unsigned char*) words;
+	for (size_t i = 0; i < wordCount * sizeof(uint32_t); ++i) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static int IsSameFusedShader(const FusedExpression* a, const FusedExpression* b) {
+	if (a->inputCount != b->inputCount || a->opCount != b->opCount) {
+		return 0;
+	}
+	for (uint32_t i = 0; i < a->opCount; ++i) {
+		if (a->ops[i].type != b->ops[i].type || a->ops[i].input != b->ops[i].input) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+float EvaluateFusedExpression(const FusedExpression* expression, const float* const* inputs, uint64_t i) {
+	float x = inputs[0][i];
+	for (uint32_t j = 0; j < expression->opCount; ++j) {
+		const FusedOp* op = &expression->ops[j];
+		switch (op->type) {
+		case FUSED_OP_SCALE:
+			x = x * op->a;
+			break;
+		case FUSED_OP_ADD:
+			x = x + op->a;
+			break;
+		case FUSED_OP_ADD_INPUT:
+			x = x + inputs[op->input][i];
+			break;
+		case FUSED_OP_MUL_INPUT:
+			x = x * inputs[op->input][i];
+			break;
+		case FUSED_OP_FMA:
+			// Rounded once, like the fma the kernel emits
+			x = fmaf(x, op->a, op->b);
+			break;
+		case FUSED_OP_CLAMP:
+			x = x < op->a ? op->a : (x > op->b ? op->b : x);
+			break;
+		default:
+			break;
+		}
+	}
+	return x;
+}
+
+// Return the value of element index of an input, loading it the first time it is needed
+static uint32_t LoadFusedInput(SpirvWriter* w, const uint32_t* bufferIds, uint32_t index, uint32_t input, uint32_t* inputValues) {
+	if (inputValues[input] == 0) {
+		const uint32_t pointer = w->nextId++;
+		inputValues[input] = w->nextId++;
+		EMIT(w, OP_ACCESS_CHAIN, ID_PTR_BUFFER_FLOAT, pointer, bufferIds[input], ID_INT_0, index);
+		EMIT(w, OP_LOAD, ID_FLOAT, inputValues[input], pointer);
+	}
+	return inputValues[input];
+}
+
+VkResult GenerateFusedShader(const FusedExpression* expression, uint32_t* code, uint32_t capacity, size_t* size) {
+	const uint32_t inputCount = expression->inputCount;
+	if (inputCount == 0 || inputCount > FUSED_MAX_INPUTS) {
+		printf("Fused expressions read 1 to %u inputs, not %u\n", FUSED_MAX_INPUTS, inputCount);
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+	}
+	if (expression->opCount > FUSED_MAX_OPS) {
+		printf("Fused expressions have at most %u ops, not %u\n", FUSED_MAX_OPS, expression->opCount);
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+	}
+	// Only counted once opCount is known to be in range
+	const uint32_t parameterCount = GetParameterCount(expression);
+	if (parameterCount > FUSED_MAX_PARAMETERS) {
+		printf("Fused expressions take at most %u parameters, not %u\n", FUSED_MAX_PARAMETERS, parameterCount);
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+	}
+
+	SpirvWriter writer = { 0 };
+	writer.code = code;
+	writer.capacity = capacity;
+	writer.count = 5;
+	writer.nextId = ID_FIRST_DYNAMIC;
+	SpirvWriter* w = &writer;
+
+	// Inputs are bound first and the output after them
+	uint32_t bufferIds[FUSED_MAX_INPUTS + 1];
+	for (uint32_t i = 0; i <= inputCount; ++i) {
+		bufferIds[i] = w->nextId++;
+	}
+	uint32_t parameterIndexIds[FUSED_MAX_PARAMETERS];
+	for (uint32_t i = 0; i < parameterCount; ++i) {
+		parameterIndexIds[i] = w->nextId++;
+	}
+
+	uint32_t words[16];
+	EMIT(w, OP_CAPABILITY, CAPABILITY_SHADER);
+	words[0] = ID_GLSL_STD_450;
+	EmitInstruction(w, OP_EXT_INST_IMPORT, words, 1 + PackString("GLSL.std.450", words + 1));
+	EMIT(w, OP_MEMORY_MODEL, ADDRESSING_MODEL_LOGICAL, MEMORY_MODEL_GLSL450);
+	words[0] = EXECUTION_MODEL_GLCOMPUTE;
+	words[1] = ID_MAIN;
+	uint32_t wordCount = 2 + PackString("main", words + 2);
+	words[wordCount++] = ID_WORKGROUP_ID;
+	words[wordCount++] = ID_NUM_WORKGROUPS;
+	words[wordCount++] = ID_LOCAL_INVOCATION_ID;
+	EmitInstruction(w, OP_ENTRY_POINT, words, wordCount);
+	EMIT(w, OP_EXECUTION_MODE, ID_MAIN, EXECUTION_MODE_LOCAL_SIZE, 1, 1, 1);
+
+	// Decorations, as glslc emits them for layout(local_size_x_id = 0) and std430 buffers
+	EMIT(w, OP_DECORATE, ID_WORKGROUP_ID, DECORATION_BUILT_IN, BUILT_IN_WORKGROUP_ID);
+	EMIT(w, OP_DECORATE, ID_NUM_WORKGROUPS, DECORATION_BUILT_IN, BUILT_IN_NUM_WORKGROUPS);
+	EMIT(w, OP_DECORATE, ID_LOCAL_INVOCATION_ID, DECORATION_BUILT_IN, BUILT_IN_LOCAL_INVOCATION_ID);
+	EMIT(w, OP_DECORATE, ID_LOCAL_SIZE_X, DECORATION_SPEC_ID, 0);
+	EMIT(w, OP_DECORATE, ID_WORKGROUP_SIZE, DECORATION_BUILT_IN, BUILT_IN_WORKGROUP_SIZE);
+	EMIT(w, OP_DECORATE, ID_FLOAT_ARRAY, DECORATION_ARRAY_STRIDE, 4);
+	EMIT(w, OP_MEMBER_DECORATE, ID_BUFFER_STRUCT, 0, DECORATION_OFFSET, 0);
+	EMIT(w, OP_DECORATE, ID_BUFFER_STRUCT, DECORATION_BUFFER_BLOCK);
+	for (uint32_t i = 0; i <= inputCount; ++i) {
+		EMIT(w, OP_DECORATE, bufferIds[i], DECORATION_DESCRIPTOR_SET, 0);
+		EMIT(w, OP_DECORATE, bufferIds[i], DECORATION_BINDING, i);
+	}
+	if (parameterCount > 0) {
+		EMIT(w, OP_DECORATE, ID_PARAMETER_ARRAY, DECORATION_ARRAY_STRIDE, 4);
+		EMIT(w, OP_MEMBER_DECORATE, ID_PUSH_STRUCT, 1, DECORATION_OFFSET, 4);
+	}
+	EMIT(w, OP_MEMBER_DECORATE, ID_PUSH_STRUCT, 0, DECORATION_OFFSET, 0);
+	EMIT(w, OP_DECORATE, ID_PUSH_STRUCT, DECORATION_BLOCK);
+
+	// Types, constants and variables
+	EMIT(w, OP_TYPE_VOID, ID_VOID);
+	EMIT(w, OP_TYPE_FUNCTION, ID_FUNCTION_VOID, ID_VOID);
+	EMIT(w, OP_TYPE_INT, ID_UINT, 32, 0);
+	EMIT(w, OP_TYPE_INT, ID_INT, 32, 1);
+	EMIT(w, OP_TYPE_FLOAT, ID_FLOAT, 32);
+	EMIT(w, OP_TYPE_BOOL, ID_BOOL);
+	EMIT(w, OP_TYPE_VECTOR, ID_UVEC3, ID_UINT, 3);
+	EMIT(w, OP_TYPE_POINTER, ID_PTR_INPUT_UVEC3, STORAGE_CLASS_INPUT, ID_UVEC3);
+	EMIT(w, OP_VARIABLE, ID_PTR_INPUT_UVEC3, ID_WORKGROUP_ID, STORAGE_CLASS_INPUT);
+	EMIT(w, OP_VARIABLE, ID_PTR_INPUT_UVEC3, ID_NUM_WORKGROUPS, STORAGE_CLASS_INPUT);
+	EMIT(w, OP_VARIABLE, ID_PTR_INPUT_UVEC3, ID_LOCAL_INVOCATION_ID, STORAGE_CLASS_INPUT);
+	EMIT(w, OP_SPEC_CONSTANT, ID_UINT, ID_LOCAL_SIZE_X, FUSED_DEFAULT_LOCAL_SIZE);
+	EMIT(w, OP_CONSTANT, ID_UINT, ID_UINT_1, 1);
+	EMIT(w, OP_SPEC_CONSTANT_COMPOSITE, ID_UVEC3, ID_WORKGROUP_SIZE, ID_LOCAL_SIZE_X, ID_UINT_1, ID_UINT_1);
+	EMIT(w, OP_CONSTANT, ID_INT, ID_INT_0, 0);
+	EMIT(w, OP_CONSTANT, ID_INT, ID_INT_1, 1);
+	EMIT(w, OP_TYPE_RUNTIME_ARRAY, ID_FLOAT_ARRAY, ID_FLOAT);
+	EMIT(w, OP_TYPE_STRUCT, ID_BUFFER_STRUCT, ID_FLOAT_ARRAY);
+	EMIT(w, OP_TYPE_POINTER, ID_PTR_BUFFER_STRUCT, STORAGE_CLASS_UNIFORM, ID_BUFFER_STRUCT);
+	EMIT(w, OP_TYPE_POINTER, ID_PTR_BUFFER_FLOAT, STORAGE_CLASS_UNIFORM, ID_FLOAT);
+	for (uint32_t i = 0; i <= inputCount; ++i) {
+		EMIT(w, OP_VARIABLE, ID_PTR_BUFFER_STRUCT, bufferIds[i], STORAGE_CLASS_UNIFORM);
+	}
+	if (parameterCount > 0) {
+		EMIT(w, OP_CONSTANT, ID_UINT, ID_PARAMETER_COUNT, parameterCount);
+		EMIT(w, OP_TYPE_ARRAY, ID_PARAMETER_ARRAY, ID_FLOAT, ID_PARAMETER_COUNT);
+		EMIT(w, OP_TYPE_STRUCT, ID_PUSH_STRUCT, ID_UINT, ID_PARAMETER_ARRAY);
+		for (uint32_t i = 0; i < parameterCount; ++i) {
+			EMIT(w, OP_CONSTANT, ID_UINT, parameterIndexIds[i], i);
+		}
+	}
+	else {
+		EMIT(w, OP_TYPE_STRUCT, ID_PUSH_STRUCT, ID_UINT);
+	}
+	EMIT(w, OP_TYPE_POINTER, ID_PTR_PUSH_STRUCT, STORAGE_CLASS_PUSH_CONSTANT, ID_PUSH_STRUCT);
+	EMIT(w, OP_TYPE_POINTER, ID_PTR_PUSH_UINT, STORAGE_CLASS_PUSH_CONSTANT, ID_UINT);
+	EMIT(w, OP_TYPE_POINTER, ID_PTR_PUSH_FLOAT, STORAGE_CLASS_PUSH_CONSTANT, ID_FLOAT);
+	EMIT(w, OP_VARIABLE, ID_PTR_PUSH_STRUCT, ID_PUSH_CONSTANTS, STORAGE_CLASS_PUSH_CONSTANT);
+
+	// main: the flattened workgroup index of the other elementwise shaders, and a bounds check
+	EMIT(w, OP_FUNCTION, ID_VOID, ID_MAIN, 0, ID_FUNCTION_VOID);
+	EMIT(w, OP_LABEL, w->nextId++);
+	const uint32_t workgroupId = w->nextId++;
+	const uint32_t numWorkgroups = w->nextId++;
+	const uint32_t localInvocationId = w->nextId++;
+	EMIT(w, OP_LOAD, ID_UVEC3, workgroupId, ID_WORKGROUP_ID);
+	EMIT(w, OP_LOAD, ID_UVEC3, numWorkgroups, ID_NUM_WORKGROUPS);
+	EMIT(w, OP_LOAD, ID_UVEC3, localInvocationId, ID_LOCAL_INVOCATION_ID);
+	uint32_t components[6];
+	for (uint32_t i = 0; i < 3; ++i) {
+		components[i] = w->nextId++;
+		EMIT(w, OP_COMPOSITE_EXTRACT, ID_UINT, components[i], workgroupId, i);
+	}
+	for (uint32_t i = 0; i < 2; ++i) {
+		components[3 + i] = w->nextId++;
+		EMIT(w, OP_COMPOSITE_EXTRACT, ID_UINT, components[3 + i], numWorkgroups, i);
+	}
+	components[5] = w->nextId++;
+	EMIT(w, OP_COMPOSITE_EXTRACT, ID_UINT, components[5], localInvocationId, 0);
+
+	// groupIndex = id.x + num.x * (id.y + num.y * id.z), index = groupIndex * local_size_x + local.x
+	uint32_t temporaries[4];
+	for (uint32_t i = 0; i < 4; ++i) {
+		temporaries[i] = w->nextId++;
+	}
+	const uint32_t groupIndex = w->nextId++;
+	const uint32_t index = w->nextId++;
+	EMIT(w, OP_IMUL, ID_UINT, temporaries[0], components[4], components[2]);
+	EMIT(w, OP_IADD, ID_UINT, temporaries[1], components[1], temporaries[0]);
+	EMIT(w, OP_IMUL, ID_UINT, temporaries[2], components[3], temporaries[1]);
+	EMIT(w, OP_IADD, ID_UINT, groupIndex, components[0], temporaries[2]);
+	EMIT(w, OP_IMUL, ID_UINT, temporaries[3], groupIndex, ID_LOCAL_SIZE_X);
+	EMIT(w, OP_IADD, ID_UINT, index, temporaries[3], components[5]);
+
+	const uint32_t elementCountPointer = w->nextId++;
+	const uint32_t elementCount = w->nextId++;
+	const uint32_t inBounds = w->nextId++;
+	const uint32_t bodyLabel = w->nextId++;
+	const uint32_t mergeLabel = w->nextId++;
+	EMIT(w, OP_ACCESS_CHAIN, ID_PTR_PUSH_UINT, elementCountPointer, ID_PUSH_CONSTANTS, ID_INT_0);
+	EMIT(w, OP_LOAD, ID_UINT, elementCount, elementCountPointer);
+	EMIT(w, OP_ULESS_THAN, ID_BOOL, inBounds, index, elementCount);
+	EMIT(w, OP_SELECTION_MERGE, mergeLabel, 0);
+	EMIT(w, OP_BRANCH_CONDITIONAL, inBounds, bodyLabel, mergeLabel);
+	EMIT(w, OP_LABEL, bodyLabel);
+
+	// Each input is loaded once, however many ops read it
+	uint32_t inputValues[FUSED_MAX_INPUTS] = { 0 };
+	uint32_t value = LoadFusedInput(w, bufferIds, index, 0, inputValues);
+	uint32_t parameter = 0;
+	for (uint32_t j = 0; j < expression->opCount; ++j) {
+		const FusedOp* op = &expression->ops[j];
+		const uint32_t input = UsesInput(op->type) ? LoadFusedInput(w, bufferIds, index, op->input, inputValues) : 0;
+
+		uint32_t parameters[2] = { 0 };
+		for (uint32_t k = 0; k < GetOpParameterCount(op->type); ++k) {
+			const uint32_t pointer = w->nextId++;
+			parameters[k] = w->nextId++;
+			EMIT(w, OP_ACCESS_CHAIN, ID_PTR_PUSH_FLOAT, pointer, ID_PUSH_CONSTANTS, ID_INT_1, parameterIndexIds[parameter++]);
+			EMIT(w, OP_LOAD, ID_FLOAT, parameters[k], pointer);
+		}
+
+		const uint32_t result = w->nextId++;
+		switch (op->type) {
+		case FUSED_OP_SCALE:
+			EMIT(w, OP_FMUL, ID_FLOAT, result, value, parameters[0]);
+			break;
+		case FUSED_OP_ADD:
+			EMIT(w, OP_FADD, ID_FLOAT, result, value, parameters[0]);
+			break;
+		case FUSED_OP_ADD_INPUT:
+			EMIT(w, OP_FADD, ID_FLOAT, result, value, input);
+			break;
+		case FUSED_OP_MUL_INPUT:
+			EMIT(w, OP_FMUL, ID_FLOAT, result, value, input);
+			break;
+		case FUSED_OP_FMA:
+			EMIT(w, OP_EXT_INST, ID_FLOAT, result, ID_GLSL_STD_450, GLSL_STD_450_FMA, value, parameters[0], parameters[1]);
+			break;
+		case FUSED_OP_CLAMP:
+			EMIT(w, OP_EXT_INST, ID_FLOAT, result, ID_GLSL_STD_450, GLSL_STD_450_FCLAMP, value, parameters[0], parameters[1]);
+			break;
+		default:
+			printf("Unknown fused op %u\n", (uint32_t) op->type);
+			return VK_ERROR_FEATURE_NOT_PRESENT;
+		}
+		value = result;
+	}
+
+	const uint32_t outputPointer = w->nextId++;
+	EMIT(w, OP_ACCESS_CHAIN, ID_PTR_BUFFER_FLOAT, outputPointer, bufferIds[inputCount], ID_INT_0, index);
+	EMIT(w, OP_STORE, outputPointer, value);
+	EMIT(w, OP_BRANCH, mergeLabel);
+	EMIT(w, OP_LABEL, mergeLabel);
+	EmitInstruction(w, OP_RETURN, NULL, 0);
+	EmitInstruction(w, OP_FUNCTION_END, NULL, 0);
+
+	if (writer.overflow || capacity < 5) {
+		puts("Fused shader does not fit in the code buffer");
+		return VK_ERROR_OUT_OF_HOST_MEMORY;
+	}
+	code[0] = SPIRV_MAGIC;
+	code[1] = 0x00010000;
+	code[2] = 0;
+	code[3] = writer.nextId;
+	code[4] = 0;
+	*size = writer.count * sizeof(uint32_t);
+	return VK_SUCCESS;
+}
+
+uint32_t GetFusedPushConstants(const FusedExpression* expression, uint32_t elementCount, uint32_t* pushConstants) {
+	pushConstants[0] = elementCount;
+	uint32_t count = 1;
+	for (uint32_t i = 0; i < expression->opCount; ++i) {
+		const FusedOp* op = &expression->ops[i];
+		const uint32_t parameterCount = GetOpParameterCount(op->type);
+		if (parameterCount > 0) {
+			memcpy(&pushConstants[count++], &op->a, sizeof(float));
+		}
+		if (parameterCount > 1) {
+			memcpy(&pushConstants[count++], &op->b, sizeof(float));
+		}
+	}
+	return count * sizeof(uint32_t);
+}
+
+VkResult CreateFusionCache(ComputeContext* context, uint32_t localSizeX, FusionCache* cache) {
+	memset(cache, 0, sizeof(*cache));
+	if (context->cpuBackend) {
+		puts("Fused kernels need a Vulkan device");
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+	}
+	cache->context = context;
+	cache->localSizeX = localSizeX;
+	if (cache->localSizeX == 0) {
+		const VkPhysicalDeviceLimits* limits = &context->physicalDeviceProperties.limits;
+		cache->localSizeX = FUSED_DEFAULT_LOCAL_SIZE;
+		if (cache->localSizeX > limits->maxComputeWorkGroupSize[0]) {
+			cache->localSizeX = limits->maxComputeWorkGroupSize[0];
+		}
+		if (cache->localSizeX > limits->maxComputeWorkGroupInvocations) {
+			cache->localSizeX = limits->maxComputeWorkGroupInvocations;
+		}
+	}
+	cache->kernels = calloc(FUSED_CACHE_SIZE, sizeof(FusedKernel));
+	if (cache->kernels == NULL) {
+		return VK_ERROR_OUT_OF_HOST_MEMORY;
+	}
+	return VK_SUCCESS;
+}
+
+void DestroyFusionCache(FusionCache* cache) {
+	if (cache->kernels != NULL) {
+		for (uint32_t i = 0; i < cache->kernelCount; ++i) {
+			DestroyComputeKernel(cache->context, &cache->kernels[i].kernel);
+		}
+		free(cache->kernels);
+	}
+	memset(cache, 0, sizeof(*cache));
+}
+
+VkResult GetFusedKernel(FusionCache* cache, const FusedExpression* expression, ComputeKernel** kernel) {
+	const uint64_t hash = HashFusedExpression(expression);
+	for (uint32_t i = 0; i < cache->kernelCount; ++i) {
+		if (cache->kernels[i].hash == hash && IsSameFusedShader(&cache->kernels[i].expression, expression)) {
+			++cache->hits;
+			*kernel = &cache->kernels[i].kernel;
+			return VK_SUCCESS;
+		}
+	}
+	++cache->misses;
+	if (cache->kernelCount == FUSED_CACHE_SIZE) {
+		printf("Cannot cache more than %u fused kernels\n", FUSED_CACHE_SIZE);
+		return VK_ERROR_OUT_OF_HOST_MEMORY;
+	}
+
+	uint64_t startTime = GetTimeNs();
+	uint32_t code[FUSED_MAX_SPIRV_WORDS];
+	size_t codeSize = 0;
+	VkResult result = GenerateFusedShader(expression, code, FUSED_MAX_SPIRV_WORDS, &codeSize);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+
+	char name[32];
+	snprintf(name, sizeof(name), "fused-%016llx", (unsigned long long) hash);
+	ComputeKernelCreateInfo createInfo = { 0 };
+	createInfo.shaderFile = name;
+	createInfo.shaderCode = code;
+	createInfo.shaderCodeSize = codeSize;
+	createInfo.bindingCount = expression->inputCount + 1;
+	createInfo.pushConstantSize = (1 + GetParameterCount(expression)) * sizeof(uint32_t);
+	createInfo.localSizeX = cache->localSizeX;
+	createInfo.elementsPerInvocation = 1;
+
+	FusedKernel* entry = &cache->kernels[cache->kernelCount];
+	result = CreateComputeKernel(cache->context, &createInfo, &entry->kernel);
+	if (result != VK_SUCCESS) {
+		printf("Failed to create fused kernel %s\n", name);
+		return result;
+	}
+	entry->hash = hash;
+	entry->expression = *expression;
+	entry->createNs = GetTimeNs() - startTime;
+	++cache->kernelCount;
+	*kernel = &entry->kernel;
+	return VK_SUCCESS;
+}
+
+VkResult DispatchFusedExpression(FusionCache* cache, const FusedExpression* expression, const ComputeBuffer* inputs,
+	const ComputeBuffer* output, uint32_t elementCount) {
+
+	ComputeKernel* kernel = NULL;
+	VkResult result = GetFusedKernel(cache, expression, &kernel);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+
+	ComputeBuffer buffers[FUSED_MAX_INPUTS + 1];
+	for (uint32_t i = 0; i < expression->inputCount; ++i) {
+		buffers[i] = inputs[i];
+	}
+	buffers[expression->inputCount] = *output;
+	uint32_t pushConstants[1 + FUSED_MAX_PARAMETERS];
+	GetFusedPushConstants(expression, elementCount, pushConstants);
+
+	uint32_t groupCountX = 0;
+	uint32_t groupCountY = 0;
+	uint32_t groupCountZ = 0;
+	result = ComputeDispatchSize(cache->context, kernel, elementCount, &groupCountX, &groupCountY, &groupCountZ);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+	return DispatchComputeKernel(cache->context, kernel, buffers, pushConstants, groupCountX, groupCountY, groupCountZ);
+}
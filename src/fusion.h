@@ -0,0 +1,97 @@
+#include <vulkan/vulkan.h>
+#include "context.h"
+#include "buffer.h"
+#include "kernel.h"
+
+#ifndef FUSION_H
+#define FUSION_H
+
+#define FUSED_MAX_OPS 16
+#define FUSED_MAX_INPUTS 4
+// Push constants are the element count followed by the parameters of every op, within the 128 bytes every
+// device supports
+#define FUSED_MAX_PARAMETERS 31
+#define FUSED_CACHE_SIZE 64
+// Generated modules stay far below this for FUSED_MAX_OPS ops
+#define FUSED_MAX_SPIRV_WORDS 2048
+
+// One step of an elementwise chain, applied to the running value x
+typedef enum FusedOpType {
+	// x * a
+	FUSED_OP_SCALE,
+	// x + a
+	FUSED_OP_ADD,
+	// x + inputs[input][i]
+	FUSED_OP_ADD_INPUT,
+	// x * inputs[input][i]
+	FUSED_OP_MUL_INPUT,
+	// fma(x, a, b)
+	FUSED_OP_FMA,
+	// clamp(x, a, b)
+	FUSED_OP_CLAMP,
+	FUSED_OP_COUNT
+} FusedOpType;
+
+typedef struct FusedOp {
+	FusedOpType type;
+	uint32_t input;
+	float a;
+	float b;
+} FusedOp;
+
+// output[i] = ops[opCount - 1](... ops[0](inputs[0][i])), over float buffers. The ops and inputs they read
+// decide the generated shader; a and b are passed as push constants, so changing them reuses the pipeline.
+typedef struct FusedExpression {
+	uint32_t inputCount;
+	uint32_t opCount;
+	FusedOp ops[FUSED_MAX_OPS];
+} FusedExpression;
+
+typedef struct FusedKernel {
+	uint64_t hash;
+	FusedExpression expression;
+	ComputeKernel kernel;
+	uint64_t createNs;
+} FusedKernel;
+
+// Fused kernels generated so far, looked up by a hash of their expression. Pipelines go through the context's
+// pipeline cache, so a later run only pays for generating the SPIR-V.
+typedef struct FusionCache {
+	ComputeContext* context;
+	uint32_t localSizeX;
+	// FUSED_CACHE_SIZE entries, so pointers to cached kernels stay valid
+	FusedKernel* kernels;
+	uint32_t kernelCount;
+	uint64_t hits;
+	uint64_t misses;
+} FusionCache;
+
+// An expression reading inputCount buffers, with no ops yet
+void InitFusedExpression(FusedExpression* expression, uint32_t inputCount);
+// Append an op. input is only used by FUSED_OP_ADD_INPUT and FUSED_OP_MUL_INPUT, a and b only by the others.
+VkResult AddFusedOp(FusedExpression* expression, FusedOpType type, uint32_t input, float a, float b);
+const char* GetFusedOpName(FusedOpType type);
+
+// Hash of the ops and inputs of expression, ignoring its parameters
+uint64_t HashFusedExpression(const FusedExpression* expression);
+// Evaluate expression for element i on the host, e.g. to check device results
+float EvaluateFusedExpression(const FusedExpression* expression, const float* const* inputs, uint64_t i);
+
+// Write the SPIR-V of a compute shader evaluating expression to code, of capacity words, and its size in bytes
+// to size. The shader takes its workgroup size from specialization constant 0 and binds the inputs at bindings
+// 0..inputCount-1 and the output at binding inputCount, which may be the same buffer as an input.
+VkResult GenerateFusedShader(const FusedExpression* expression, uint32_t* code, uint32_t capacity, size_t* size);
+// Push constants for running expression over elementCount elements. Returns their size in bytes.
+uint32_t GetFusedPushConstants(const FusedExpression* expression, uint32_t elementCount, uint32_t* pushConstants);
+
+// localSizeX of 0 uses 256, clamped to the device's limits
+VkResult CreateFusionCache(ComputeContext* context, uint32_t localSizeX, FusionCache* cache);
+void DestroyFusionCache(FusionCache* cache);
+
+// Return the kernel for expression, generating its shader and pipeline on first use
+VkResult GetFusedKernel(FusionCache* cache, const FusedExpression* expression, ComputeKernel** kernel);
+// Run expression over elementCount elements of inputs into output, and wait
+VkResult DispatchFusedExpression(FusionCache* cache, const FusedExpression* expression, const ComputeBuffer* inputs,
+	const ComputeBuffer* output, uint32_t elementCount);
+
+#endif
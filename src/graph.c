@@ -0,0 +1,651 @@
+#include "graph.h"
+#include <vulkan/vulkan.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NO_SEGMENT UINT32_MAX
+
+VkResult CreateComputeGraph(ComputeContext* context, ComputeGraph* graph) {
+	memset(graph, 0, sizeof(*graph));
+	graph->context = context;
+
+	// Lanes are queues of the one compute family, so buffers never change queue family ownership
+	graph->laneCount = 1;
+	if (context->timelineSemaphores) {
+		graph->laneCount = context->computeQueueCount < GRAPH_MAX_LANES ? context->computeQueueCount : GRAPH_MAX_LANES;
+		if (graph->laneCount == 0) {
+			graph->laneCount = 1;
+		}
+	}
+
+	VkSemaphoreTypeCreateInfo semaphoreTypeInfo = { 0 };
+	semaphoreTypeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	semaphoreTypeInfo.pNext = NULL;
+	semaphoreTypeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	semaphoreTypeInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphoreInfo = { 0 };
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreInfo.pNext = &semaphoreTypeInfo;
+	semaphoreInfo.flags = 0;
+
+	for (uint32_t i = 0; i < graph->laneCount; ++i) {
+		graph->lanes[i].queue = context->computeQueues[i];
+		if (context->timelineSemaphores) {
+			VkResult result = vkCreateSemaphore(context->device, &semaphoreInfo, NULL, &graph->lanes[i].timeline);
+			if (result != VK_SUCCESS) {
+				puts("Failed to create timeline semaphore");
+				DestroyComputeGraph(graph);
+				return result;
+			}
+		}
+	}
+
+	if (!context->timelineSemaphores) {
+		VkFenceCreateInfo fenceInfo = { 0 };
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		fenceInfo.pNext = NULL;
+		fenceInfo.flags = 0;
+
+		VkResult result = vkCreateFence(context->device, &fenceInfo, NULL, &graph->fence);
+		if (result != VK_SUCCESS) {
+			puts("Failed to create graph fence");
+			DestroyComputeGraph(graph);
+			return result;
+		}
+	}
+
+	VkCommandPoolCreateInfo commandPoolInfo = { 0 };
+	commandPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	commandPoolInfo.pNext = NULL;
+	commandPoolInfo.flags = 0;
+	commandPoolInfo.queueFamilyIndex = context->computeQueueIndex;
+
+	VkResult result = vkCreateCommandPool(context->device, &commandPoolInfo, NULL, &graph->commandPool);
+	if (result != VK_SUCCESS) {
+		puts("Failed to create graph command pool");
+		DestroyComputeGraph(graph);
+		return result;
+	}
+
+	return VK_SUCCESS;
+}
+
+void DestroyComputeGraph(ComputeGraph* graph) {
+	VkDevice device = graph->context->device;
+	if (graph->submitted) {
+		WaitComputeGraph(graph);
+	}
+	for (uint32_t i = 0; i < graph->laneCount; ++i) {
+		vkDestroySemaphore(device, graph->lanes[i].timeline, NULL);
+	}
+	vkDestroyFence(device, graph->fence, NULL);
+	// Destroying the pools frees the segments' command buffers and the tasks' descriptor sets
+	vkDestroyCommandPool(device, graph->commandPool, NULL);
+	vkDestroyDescriptorPool(device, graph->descriptorPool, NULL);
+	free(graph->tasks);
+	free(graph->segments);
+	memset(graph, 0, sizeof(*graph));
+}
+
+static GraphTask* AddGraphTask(ComputeGraph* graph) {
+	if (graph->built) {
+		return NULL;
+	}
+	if (graph->taskCount == graph->taskCapacity) {
+		uint32_t capacity = graph->taskCapacity > 0 ? 2 * graph->taskCapacity : 16;
+		GraphTask* tasks = realloc(graph->tasks, capacity * sizeof(GraphTask));
+		if (tasks == NULL) {
+			return NULL;
+		}
+		graph->tasks = tasks;
+		graph->taskCapacity = capacity;
+	}
+	GraphTask* task = &graph->tasks[graph->taskCount++];
+	memset(task, 0, sizeof(*task));
+	return task;
+}
+
+uint32_t AddGraphDispatch(ComputeGraph* graph, const ComputeKernel* kernel, const ComputeBuffer* buffers,
+	const GraphAccess* access, const void* pushConstants, uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ) {
+
+	if (kernel->bindingCount > GRAPH_MAX_BINDINGS || kernel->pushConstantSize > GRAPH_MAX_PUSH_CONSTANT_SIZE ||
+		kernel->dynamicRange > 0) {
+		return UINT32_MAX;
+	}
+	GraphTask* task = AddGraphTask(graph);
+	if (task == NULL) {
+		return UINT32_MAX;
+	}
+
+	task->type = GRAPH_TASK_DISPATCH;
+	task->kernel = kernel;
+	task->bufferCount = kernel->bindingCount;
+	for (uint32_t i = 0; i < kernel->bindingCount; ++i) {
+		task->buffers[i] = &buffers[i];
+		task->access[i] = access[i];
+	}
+	if (kernel->pushConstantSize > 0) {
+		memcpy(task->pushConstants, pushConstants, kernel->pushConstantSize);
+	}
+	task->groupCountX = groupCountX;
+	task->groupCountY = groupCountY;
+	task->groupCountZ = groupCountZ;
+	return graph->taskCount - 1;
+}
+
+uint32_t AddGraphCopy(ComputeGraph* graph, const ComputeBuffer* src, const ComputeBuffer* dst, VkDeviceSize size) {
+	GraphTask* task = AddGraphTask(graph);
+	if (task == NULL) {
+		return UINT32_MAX;
+	}
+
+	task->type = GRAPH_TASK_COPY;
+	task->bufferCount = 2;
+	task->buffers[0] = src;
+	task->access[0] = GRAPH_ACCESS_READ;
+	task->buffers[1] = dst;
+	task->access[1] = GRAPH_ACCESS_WRITE;
+	task->copySize = size;
+	return graph->taskCount - 1;
+}
+
+// Two tasks conflict if they use the same buffer and at least one of them writes it
+static int TasksConflict(const GraphTask* a, const GraphTask* b) {
+	for (uint32_t i = 0; i < a->bufferCount; ++i) {
+		for (uint32_t j = 0; j < b->bufferCount; ++j) {
+			if (a->buffers[i]->buffer == b->buffers[j]->buffer && ((a->access[i] | b->access[j]) & GRAPH_ACCESS_WRITE)) {
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+static VkPipelineStageFlags TaskStage(const GraphTask* task) {
+	return task->type == GRAPH_TASK_COPY ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+}
+
+static VkAccessFlags TaskAccess(const GraphTask* task) {
+	return task->type == GRAPH_TASK_COPY ? VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT :
+		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+}
+
+static VkAccessFlags TaskWriteAccess(const GraphTask* task) {
+	return task->type == GRAPH_TASK_COPY ? VK_ACCESS_TRANSFER_WRITE_BIT : VK_ACCESS_SHADER_WRITE_BIT;
+}
+
+static VkResult CreateTaskDescriptorSets(ComputeGraph* graph) {
+	VkDevice device = graph->context->device;
+	uint32_t setCount = 0;
+	uint32_t descriptorCount = 0;
+	for (uint32_t i = 0; i < graph->taskCount; ++i) {
+		if (graph->tasks[i].type == GRAPH_TASK_DISPATCH) {
+			++setCount;
+			descriptorCount += graph->tasks[i].bufferCount;
+		}
+	}
+	if (setCount == 0) {
+		return VK_SUCCESS;
+	}
+
+	// Every dispatch gets its own set, so one kernel can appear in the graph with different buffers
+	VkDescriptorPoolSize descriptorPoolSize = { 0 };
+	descriptorPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	descriptorPoolSize.descriptorCount = descriptorCount > 0 ? descriptorCount : 1;
+
+	VkDescriptorPoolCreateInfo descriptorPoolInfo = { 0 };
+	descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptorPoolInfo.pNext = NULL;
+	descriptorPoolInfo.flags = 0;
+	descriptorPoolInfo.maxSets = setCount;
+	descriptorPoolInfo.poolSizeCount = 1;
+	descriptorPoolInfo.pPoolSizes = &descriptorPoolSize;
+
+	VkResult result = vkCreateDescriptorPool(device, &descriptorPoolInfo, NULL, &graph->descriptorPool);
+	if (result != VK_SUCCESS) {
+		puts("Failed to create graph descriptor pool");
+		return result;
+	}
+
+	for (uint32_t i = 0; i < graph->taskCount; ++i) {
+		GraphTask* task = &graph->tasks[i];
+		if (task->type != GRAPH_TASK_DISPATCH) {
+			continue;
+		}
+
+		VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = { 0 };
+		descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		descriptorSetAllocateInfo.pNext = NULL;
+		descriptorSetAllocateInfo.descriptorPool = graph->descriptorPool;
+		descriptorSetAllocateInfo.descriptorSetCount = 1;
+		descriptorSetAllocateInfo.pSetLayouts = &task->kernel->descriptorSetLayout;
+
+		result = vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo, &task->descriptorSet);
+		if (result != VK_SUCCESS) {
+			puts("Failed to allocate graph descriptor set");
+			return result;
+		}
+
+		VkDescriptorBufferInfo bufferInfos[GRAPH_MAX_BINDINGS] = { { 0 } };
+		VkWriteDescriptorSet writeDescriptorSets[GRAPH_MAX_BINDINGS] = { { 0 } };
+		for (uint32_t j = 0; j < task->bufferCount; ++j) {
+			bufferInfos[j].buffer = task->buffers[j]->buffer;
+			bufferInfos[j].offset = 0;
+			bufferInfos[j].range = VK_WHOLE_SIZE;
+
+			writeDescriptorSets[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writeDescriptorSets[j].pNext = NULL;
+			writeDescriptorSets[j].dstSet = task->descriptorSet;
+			writeDescriptorSets[j].dstBinding = j;
+			writeDescriptorSets[j].dstArrayElement = 0;
+			writeDescriptorSets[j].descriptorCount = 1;
+			writeDescriptorSets[j].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writeDescriptorSets[j].pImageInfo = NULL;
+			writeDescriptorSets[j].pBufferInfo = &bufferInfos[j];
+			writeDescriptorSets[j].pTexelBufferView = NULL;
+		}
+		vkUpdateDescriptorSets(device, task->bufferCount, writeDescriptorSets, 0, NULL);
+	}
+
+	return VK_SUCCESS;
+}
+
+// Put each task on the lane whose last task it depends on, so chains stay on one queue and only need barriers.
+// Tasks without dependencies start on the least loaded lane, which is how independent branches overlap.
+static void AssignLanes(ComputeGraph* graph) {
+	uint32_t laneTail[GRAPH_MAX_LANES];
+	for (uint32_t l = 0; l < GRAPH_MAX_LANES; ++l) {
+		laneTail[l] = UINT32_MAX;
+	}
+
+	for (uint32_t t = 0; t < graph->taskCount; ++t) {
+		GraphTask* task = &graph->tasks[t];
+		uint32_t lane = UINT32_MAX;
+		uint32_t latestDependency = UINT32_MAX;
+		for (uint32_t u = 0; u < t; ++u) {
+			if (TasksConflict(task, &graph->tasks[u])) {
+				latestDependency = u;
+				if (lane == UINT32_MAX && laneTail[graph->tasks[u].lane] == u) {
+					lane = graph->tasks[u].lane;
+				}
+			}
+		}
+		if (lane == UINT32_MAX && latestDependency != UINT32_MAX) {
+			lane = graph->tasks[latestDependency].lane;
+		}
+		if (lane == UINT32_MAX) {
+			lane = 0;
+			for (uint32_t l = 1; l < graph->laneCount; ++l) {
+				if (graph->lanes[l].taskCount < graph->lanes[lane].taskCount) {
+					lane = l;
+				}
+			}
+		}
+
+		task->lane = lane;
+		laneTail[lane] = t;
+		graph->lanes[lane].taskCount++;
+		for (uint32_t u = 0; u < t; ++u) {
+			if (graph->tasks[u].lane != lane && TasksConflict(task, &graph->tasks[u])) {
+				graph->tasks[u].hasCrossLaneDependents = 1;
+			}
+		}
+	}
+}
+
+static VkResult BeginSegment(ComputeGraph* graph, uint32_t lane, uint32_t* segmentIndex) {
+	GraphSegment* segment = &graph->segments[graph->segmentCount];
+	memset(segment, 0, sizeof(*segment));
+	segment->lane = lane;
+	segment->signalValue = ++graph->lanes[lane].segmentCount;
+
+	VkCommandBufferAllocateInfo commandBufferAllocateInfo = { 0 };
+	commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	commandBufferAllocateInfo.pNext = NULL;
+	commandBufferAllocateInfo.commandPool = graph->commandPool;
+	commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	commandBufferAllocateInfo.commandBufferCount = 1;
+
+	VkResult result = vkAllocateCommandBuffers(graph->context->device, &commandBufferAllocateInfo, &segment->commandBuffer);
+	if (result != VK_SUCCESS) {
+		puts("Failed to allocate graph command buffer");
+		return result;
+	}
+
+	// No ONE_TIME_SUBMIT flag: the graph can be submitted again
+	VkCommandBufferBeginInfo commandBufferBeginInfo = { 0 };
+	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	commandBufferBeginInfo.pNext = NULL;
+	commandBufferBeginInfo.flags = 0;
+	commandBufferBeginInfo.pInheritanceInfo = NULL;
+
+	result = vkBeginCommandBuffer(segment->commandBuffer, &commandBufferBeginInfo);
+	if (result != VK_SUCCESS) {
+		puts("Failed to begin recording command buffer");
+		return result;
+	}
+
+	*segmentIndex = graph->segmentCount++;
+	return VK_SUCCESS;
+}
+
+static VkResult EndSegment(ComputeGraph* graph, uint32_t segmentIndex) {
+	VkCommandBuffer commandBuffer = graph->segments[segmentIndex].commandBuffer;
+
+	// Make the segment's writes visible to the host once its timeline value (or the fence) is signalled
+	VkMemoryBarrier memoryBarrier = { 0 };
+	memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memoryBarrier.pNext = NULL;
+	memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+
+	VkResult result = vkEndCommandBuffer(commandBuffer);
+	if (result != VK_SUCCESS) {
+		puts("Failed to end recording command buffer");
+	}
+	return result;
+}
+
+static void RecordTask(VkCommandBuffer commandBuffer, const GraphTask* task) {
+	if (task->type == GRAPH_TASK_COPY) {
+		VkBufferCopy region = { 0 };
+		region.srcOffset = 0;
+		region.dstOffset = 0;
+		region.size = task->copySize;
+		vkCmdCopyBuffer(commandBuffer, task->buffers[0]->buffer, task->buffers[1]->buffer, 1, &region);
+		return;
+	}
+
+	const ComputeKernel* kernel = task->kernel;
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, kernel->pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, kernel->pipelineLayout, 0, 1, &task->descriptorSet, 0, NULL);
+	if (kernel->pushConstantSize > 0) {
+		vkCmdPushConstants(commandBuffer, kernel->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, kernel->pushConstantSize, task->pushConstants);
+	}
+	vkCmdDispatch(commandBuffer, task->groupCountX, task->groupCountY, task->groupCountZ);
+}
+
+VkResult BuildComputeGraph(ComputeGraph* graph) {
+	if (graph->built) {
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+	graph->built = 1;
+
+	// Each task starts at most one segment
+	graph->segments = calloc(graph->taskCount > 0 ? graph->taskCount : 1, sizeof(GraphSegment));
+	if (graph->segments == NULL) {
+		return VK_ERROR_OUT_OF_HOST_MEMORY;
+	}
+	VkResult result = CreateTaskDescriptorSets(graph);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+	AssignLanes(graph);
+
+	uint32_t openSegment[GRAPH_MAX_LANES];
+	uint32_t laneEpoch[GRAPH_MAX_LANES] = { 0 };
+	VkPipelineStageFlags pendingStages[GRAPH_MAX_LANES] = { 0 };
+	VkAccessFlags pendingAccess[GRAPH_MAX_LANES] = { 0 };
+	// waited[l][m]: highest value of lane m's timeline that lane l has already waited for
+	uint64_t waited[GRAPH_MAX_LANES][GRAPH_MAX_LANES] = { { 0 } };
+	for (uint32_t l = 0; l < GRAPH_MAX_LANES; ++l) {
+		openSegment[l] = NO_SEGMENT;
+	}
+
+	for (uint32_t t = 0; t < graph->taskCount; ++t) {
+		GraphTask* task = &graph->tasks[t];
+		const uint32_t lane = task->lane;
+		const VkPipelineStageFlags stage = TaskStage(task);
+
+		// Dependencies on other lanes become timeline waits; ones on work recorded on this lane since its last
+		// barrier need a barrier. Anything older is already ordered by an earlier barrier or wait.
+		uint64_t needed[GRAPH_MAX_LANES] = { 0 };
+		int needWait = 0;
+		int needBarrier = 0;
+		for (uint32_t u = 0; u < t; ++u) {
+			const GraphTask* dependency = &graph->tasks[u];
+			if (!TasksConflict(task, dependency)) {
+				continue;
+			}
+			if (dependency->lane != lane) {
+				uint64_t value = graph->segments[dependency->segment].signalValue;
+				if (value > waited[lane][dependency->lane] && value > needed[dependency->lane]) {
+					needed[dependency->lane] = value;
+					needWait = 1;
+				}
+			}
+			else if (dependency->epoch == laneEpoch[lane]) {
+				needBarrier = 1;
+			}
+		}
+
+		// A wait applies to the whole submission, so it starts a new segment rather than stalling earlier tasks
+		if (needWait && openSegment[lane] != NO_SEGMENT) {
+			result = EndSegment(graph, openSegment[lane]);
+			openSegment[lane] = NO_SEGMENT;
+			if (result != VK_SUCCESS) {
+				return result;
+			}
+		}
+		if (openSegment[lane] == NO_SEGMENT) {
+			result = BeginSegment(graph, lane, &openSegment[lane]);
+			if (result != VK_SUCCESS) {
+				return result;
+			}
+		}
+		GraphSegment* segment = &graph->segments[openSegment[lane]];
+
+		for (uint32_t m = 0; m < graph->laneCount; ++m) {
+			if (needed[m] == 0) {
+				continue;
+			}
+			segment->waitLanes[segment->waitCount] = m;
+			segment->waitValues[segment->waitCount] = needed[m];
+			segment->waitStages[segment->waitCount] = stage;
+			segment->waitCount++;
+			waited[lane][m] = needed[m];
+			graph->semaphoreWaitCount++;
+		}
+
+		if (needBarrier) {
+			VkMemoryBarrier memoryBarrier = { 0 };
+			memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			memoryBarrier.pNext = NULL;
+			memoryBarrier.srcAccessMask = pendingAccess[lane];
+			memoryBarrier.dstAccessMask = TaskAccess(task);
+			vkCmdPipelineBarrier(segment->commandBuffer, pendingStages[lane], stage, 0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+			laneEpoch[lane]++;
+			pendingStages[lane] = 0;
+			pendingAccess[lane] = 0;
+			graph->barrierCount++;
+		}
+
+		RecordTask(segment->commandBuffer, task);
+		task->segment = openSegment[lane];
+		task->epoch = laneEpoch[lane];
+		pendingStages[lane] |= stage;
+		pendingAccess[lane] |= TaskWriteAccess(task);
+
+		// Dependents on other lanes wait for this segment's signal, so end it here rather than make them wait
+		// for unrelated later tasks
+		if (task->hasCrossLaneDependents) {
+			result = EndSegment(graph, openSegment[lane]);
+			openSegment[lane] = NO_SEGMENT;
+			if (result != VK_SUCCESS) {
+				return result;
+			}
+		}
+	}
+
+	for (uint32_t l = 0; l < graph->laneCount; ++l) {
+		if (openSegment[l] != NO_SEGMENT) {
+			result = EndSegment(graph, openSegment[l]);
+			if (result != VK_SUCCESS) {
+				return result;
+			}
+		}
+	}
+
+	return VK_SUCCESS;
+}
+
+static VkResult SubmitLane(ComputeGraph* graph, uint32_t lane, const uint64_t* baseValues) {
+	const uint32_t count = graph->lanes[lane].segmentCount;
+	VkSubmitInfo* submitInfos = calloc(count, sizeof(VkSubmitInfo));
+	VkTimelineSemaphoreSubmitInfo* timelineInfos = calloc(count, sizeof(VkTimelineSemaphoreSubmitInfo));
+	VkSemaphore* waitSemaphores = calloc(count * GRAPH_MAX_LANES, sizeof(VkSemaphore));
+	uint64_t* waitValues = calloc(count * GRAPH_MAX_LANES, sizeof(uint64_t));
+	uint64_t* signalValues = calloc(count, sizeof(uint64_t));
+	if (submitInfos == NULL || timelineInfos == NULL || waitSemaphores == NULL || waitValues == NULL || signalValues == NULL) {
+		free(submitInfos);
+		free(timelineInfos);
+		free(waitSemaphores);
+		free(waitValues);
+		free(signalValues);
+		return VK_ERROR_OUT_OF_HOST_MEMORY;
+	}
+
+	// Segments were created in dependency order, so within a lane they are submitted in that order too
+	uint32_t submitCount = 0;
+	for (uint32_t s = 0; s < graph->segmentCount; ++s) {
+		const GraphSegment* segment = &graph->segments[s];
+		if (segment->lane != lane) {
+			continue;
+		}
+
+		VkSemaphore* segmentWaitSemaphores = &waitSemaphores[submitCount * GRAPH_MAX_LANES];
+		uint64_t* segmentWaitValues = &waitValues[submitCount * GRAPH_MAX_LANES];
+		for (uint32_t w = 0; w < segment->waitCount; ++w) {
+			segmentWaitSemaphores[w] = graph->lanes[segment->waitLanes[w]].timeline;
+			segmentWaitValues[w] = baseValues[segment->waitLanes[w]] + segment->waitValues[w];
+		}
+		signalValues[submitCount] = baseValues[lane] + segment->signalValue;
+
+		VkTimelineSemaphoreSubmitInfo* timelineInfo = &timelineInfos[submitCount];
+		timelineInfo->sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineInfo->pNext = NULL;
+		timelineInfo->waitSemaphoreValueCount = segment->waitCount;
+		timelineInfo->pWaitSemaphoreValues = segmentWaitValues;
+		timelineInfo->signalSemaphoreValueCount = 1;
+		timelineInfo->pSignalSemaphoreValues = &signalValues[submitCount];
+
+		VkSubmitInfo* submitInfo = &submitInfos[submitCount];
+		submitInfo->sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo->pNext = timelineInfo;
+		submitInfo->waitSemaphoreCount = segment->waitCount;
+		submitInfo->pWaitSemaphores = segmentWaitSemaphores;
+		submitInfo->pWaitDstStageMask = segment->waitStages;
+		submitInfo->commandBufferCount = 1;
+		submitInfo->pCommandBuffers = &segment->commandBuffer;
+		submitInfo->signalSemaphoreCount = 1;
+		submitInfo->pSignalSemaphores = &graph->lanes[lane].timeline;
+		++submitCount;
+	}
+
+	// Timeline waits may be submitted before their signals, so lanes can be submitted in any order
+	VkResult result = vkQueueSubmit(graph->lanes[lane].queue, submitCount, submitInfos, VK_NULL_HANDLE);
+	if (result != VK_SUCCESS) {
+		puts("Failed to submit graph");
+	}
+
+	free(submitInfos);
+	free(timelineInfos);
+	free(waitSemaphores);
+	free(waitValues);
+	free(signalValues);
+	return result;
+}
+
+VkResult SubmitComputeGraph(ComputeGraph* graph) {
+	if (!graph->built || graph->submitted) {
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+	if (graph->segmentCount == 0) {
+		return VK_SUCCESS;
+	}
+
+	if (!graph->context->timelineSemaphores) {
+		// One lane, and one segment since nothing crosses lanes
+		VkSubmitInfo submitInfo = { 0 };
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.pNext = NULL;
+		submitInfo.waitSemaphoreCount = 0;
+		submitInfo.pWaitSemaphores = NULL;
+		submitInfo.pWaitDstStageMask = NULL;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &graph->segments[0].commandBuffer;
+		submitInfo.signalSemaphoreCount = 0;
+		submitInfo.pSignalSemaphores = NULL;
+
+		VkResult result = vkQueueSubmit(graph->lanes[0].queue, 1, &submitInfo, graph->fence);
+		if (result != VK_SUCCESS) {
+			puts("Failed to submit graph");
+			return result;
+		}
+		graph->submitted = 1;
+		return VK_SUCCESS;
+	}
+
+	uint64_t baseValues[GRAPH_MAX_LANES] = { 0 };
+	for (uint32_t l = 0; l < graph->laneCount; ++l) {
+		baseValues[l] = graph->lanes[l].value;
+	}
+	for (uint32_t l = 0; l < graph->laneCount; ++l) {
+		if (graph->lanes[l].segmentCount == 0) {
+			continue;
+		}
+		VkResult result = SubmitLane(graph, l, baseValues);
+		if (result != VK_SUCCESS) {
+			return result;
+		}
+		graph->lanes[l].value += graph->lanes[l].segmentCount;
+	}
+	graph->submitted = 1;
+	return VK_SUCCESS;
+}
+
+VkResult WaitComputeGraph(ComputeGraph* graph) {
+	if (!graph->submitted) {
+		return VK_SUCCESS;
+	}
+	VkDevice device = graph->context->device;
+	graph->submitted = 0;
+
+	if (!graph->context->timelineSemaphores) {
+		VkResult result = vkWaitForFences(device, 1, &graph->fence, VK_TRUE, UINT64_MAX);
+		if (result != VK_SUCCESS) {
+			puts("Failed to wait for fence");
+			return result;
+		}
+		return vkResetFences(device, 1, &graph->fence);
+	}
+
+	VkSemaphore semaphores[GRAPH_MAX_LANES];
+	uint64_t values[GRAPH_MAX_LANES];
+	uint32_t semaphoreCount = 0;
+	for (uint32_t l = 0; l < graph->laneCount; ++l) {
+		if (graph->lanes[l].segmentCount > 0) {
+			semaphores[semaphoreCount] = graph->lanes[l].timeline;
+			values[semaphoreCount] = graph->lanes[l].value;
+			++semaphoreCount;
+		}
+	}
+
+	VkSemaphoreWaitInfo waitInfo = { 0 };
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.pNext = NULL;
+	waitInfo.flags = 0;
+	waitInfo.semaphoreCount = semaphoreCount;
+	waitInfo.pSemaphores = semaphores;
+	waitInfo.pValues = values;
+
+	VkResult result = vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
+	if (result != VK_SUCCESS) {
+		puts("Failed to wait for timeline semaphores");
+	}
+	return result;
+}
@@ -0,0 +1,111 @@
+#include <vulkan/vulkan.h>
+#include "context.h"
+#include "buffer.h"
+#include "kernel.h"
+
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#define GRAPH_MAX_BINDINGS 8
+#define GRAPH_MAX_LANES 4
+// The minimum maxPushConstantsSize guaranteed by the spec
+#define GRAPH_MAX_PUSH_CONSTANT_SIZE 128
+
+typedef enum GraphAccess {
+	GRAPH_ACCESS_READ = 1,
+	GRAPH_ACCESS_WRITE = 2,
+	GRAPH_ACCESS_READ_WRITE = 3
+} GraphAccess;
+
+typedef enum GraphTaskType {
+	GRAPH_TASK_DISPATCH,
+	// Copy of copySize bytes from buffers[0] to buffers[1]
+	GRAPH_TASK_COPY
+} GraphTaskType;
+
+typedef struct GraphTask {
+	GraphTaskType type;
+	const ComputeKernel* kernel;
+	const ComputeBuffer* buffers[GRAPH_MAX_BINDINGS];
+	GraphAccess access[GRAPH_MAX_BINDINGS];
+	uint32_t bufferCount;
+	uint8_t pushConstants[GRAPH_MAX_PUSH_CONSTANT_SIZE];
+	uint32_t groupCountX;
+	uint32_t groupCountY;
+	uint32_t groupCountZ;
+	VkDeviceSize copySize;
+	VkDescriptorSet descriptorSet;
+	// Assigned by BuildComputeGraph: the lane (queue) that runs the task, the segment of that lane it was recorded
+	// into, and the lane's barrier epoch it was recorded in
+	uint32_t lane;
+	uint32_t segment;
+	uint32_t epoch;
+	int hasCrossLaneDependents;
+} GraphTask;
+
+// A command buffer submitted as one VkSubmitInfo on its lane's queue. It waits on other lanes' timelines before
+// it starts and signals its own lane's timeline with its value when it finishes.
+typedef struct GraphSegment {
+	uint32_t lane;
+	VkCommandBuffer commandBuffer;
+	// Values are relative to the lane's timeline value when the graph is submitted
+	uint64_t signalValue;
+	uint32_t waitCount;
+	uint32_t waitLanes[GRAPH_MAX_LANES];
+	uint64_t waitValues[GRAPH_MAX_LANES];
+	VkPipelineStageFlags waitStages[GRAPH_MAX_LANES];
+} GraphSegment;
+
+typedef struct GraphLane {
+	VkQueue queue;
+	VkSemaphore timeline;
+	// Timeline value reached once the last submission of the graph has finished on this lane
+	uint64_t value;
+	uint32_t segmentCount;
+	uint32_t taskCount;
+} GraphLane;
+
+// Kernels and copies declaring which buffers they read and write. Building the graph orders conflicting tasks
+// and spreads independent branches over up to GRAPH_MAX_LANES compute queues. Within a lane a pipeline barrier
+// is only recorded when a task depends on work recorded since the lane's last barrier; across lanes tasks wait
+// on timeline semaphores instead. The whole graph is then submitted at once and can be resubmitted any number
+// of times. Without timeline semaphore support every task runs on one lane and completion uses a fence.
+typedef struct ComputeGraph {
+	ComputeContext* context;
+	GraphTask* tasks;
+	uint32_t taskCount;
+	uint32_t taskCapacity;
+	GraphSegment* segments;
+	uint32_t segmentCount;
+	GraphLane lanes[GRAPH_MAX_LANES];
+	uint32_t laneCount;
+	VkCommandPool commandPool;
+	VkDescriptorPool descriptorPool;
+	VkFence fence;
+	int built;
+	// Non-zero from SubmitComputeGraph until WaitComputeGraph
+	int submitted;
+	// Statistics from BuildComputeGraph
+	uint32_t barrierCount;
+	uint32_t semaphoreWaitCount;
+} ComputeGraph;
+
+VkResult CreateComputeGraph(ComputeContext* context, ComputeGraph* graph);
+void DestroyComputeGraph(ComputeGraph* graph);
+
+// Add a dispatch of kernel over buffers[0..bindingCount-1], each accessed as access[binding]. pushConstants is
+// copied; the kernel and buffers are referenced and must outlive the graph. Returns the task index, or UINT32_MAX
+// if the graph is already built or the kernel is not supported.
+uint32_t AddGraphDispatch(ComputeGraph* graph, const ComputeKernel* kernel, const ComputeBuffer* buffers,
+	const GraphAccess* access, const void* pushConstants, uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ);
+// Add a copy of size bytes from the start of src to the start of dst
+uint32_t AddGraphCopy(ComputeGraph* graph, const ComputeBuffer* src, const ComputeBuffer* dst, VkDeviceSize size);
+
+// Work out dependencies, assign lanes and record every segment. No tasks can be added afterwards.
+VkResult BuildComputeGraph(ComputeGraph* graph);
+// Submit every segment of a built graph without waiting. The previous submission must have completed.
+VkResult SubmitComputeGraph(ComputeGraph* graph);
+// Block until the last submission has completed. Results written by the graph are then visible to the host.
+VkResult WaitComputeGraph(ComputeGraph* graph);
+
+#endif
@@ -0,0 +1,189 @@
+#include "hostcopy.h"
+#include "cpu.h"
+#include <vulkan/vulkan.h>
+#include <stdio.h>
+#include <string.h>
+
+// SSE2 streaming stores are part of the x86-64 baseline; SSE4.1 streaming loads are compiled with a target
+// attribute and picked at runtime, like the native kernels of src/cpu.c. Elsewhere copies fall back to memcpy.
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define HOST_COPY_X86
+#endif
+
+// Slices start on cache line boundaries, so threads never write the same line
+#define HOST_COPY_SLICE_ALIGNMENT 64
+
+typedef void (*HostCopyFunction)(char* dst, const char* src, uint32_t value, size_t size);
+
+static void CopyCached(char* dst, const char* src, uint32_t value, size_t size) {
+	(void) value;
+	memcpy(dst, src, size);
+}
+
+static void FillCached(char* dst, const char* src, uint32_t value, size_t size) {
+	(void) src;
+	uint32_t* words = (uint32_t*) dst;
+	for (size_t i = 0; i < size / sizeof(uint32_t); ++i) {
+		words[i] = value;
+	}
+}
+
+#ifdef HOST_COPY_X86
+// Bytes up to the next 16 byte boundary of pointer, at most size
+static size_t GetHeadSize(const void* pointer, size_t size) {
+	const size_t head = (16 - ((uintptr_t) pointer & 15)) & 15;
+	return head < size ? head : size;
+}
+
+static void CopyStreaming(char* dst, const char* src, uint32_t value, size_t size) {
+	(void) value;
+	const size_t head = GetHeadSize(dst, size);
+	memcpy(dst, src, head);
+	size_t i = head;
+	// Four stores per iteration fill a whole 64 byte write-combining buffer
+	for (; i + 64 <= size; i += 64) {
+		const __m128i a = _mm_loadu_si128((const __m128i*) (src + i));
+		const __m128i b = _mm_loadu_si128((const __m128i*) (src + i + 16));
+		const __m128i c = _mm_loadu_si128((const __m128i*) (src + i + 32));
+		const __m128i d = _mm_loadu_si128((const __m128i*) (src + i + 48));
+		_mm_stream_si128((__m128i*) (dst + i), a);
+		_mm_stream_si128((__m128i*) (dst + i + 16), b);
+		_mm_stream_si128((__m128i*) (dst + i + 32), c);
+		_mm_stream_si128((__m128i*) (dst + i + 48), d);
+	}
+	memcpy(dst + i, src + i, size - i);
+	// Streaming stores are weakly ordered, so make them visible before the device is told to read them
+	_mm_sfence();
+}
+
+static void FillStreaming(char* dst, const char* src, uint32_t value, size_t size) {
+	// dst is 4-byte aligned, so the head is whole words
+	const size_t head = GetHeadSize(dst, size);
+	FillCached(dst, src, value, head);
+	const __m128i pattern = _mm_set1_epi32((int) value);
+	size_t i = head;
+	for (; i + 64 <= size; i += 64) {
+		_mm_stream_si128((__m128i*) (dst + i), pattern);
+		_mm_stream_si128((__m128i*) (dst + i + 16), pattern);
+		_mm_stream_si128((__m128i*) (dst + i + 32), pattern);
+		_mm_stream_si128((__m128i*) (dst + i + 48), pattern);
+	}
+	FillCached(dst + i, src, value, size - i);
+	_mm_sfence();
+}
+
+// MOVNTDQA reads a whole line of uncached memory into a streaming load buffer, instead of one uncached read per load
+__attribute__((target("sse4.1")))
+static void CopyStreamingLoads(char* dst, const char* src, uint32_t value, size_t size) {
+	(void) value;
+	const size_t head = GetHeadSize(src, size);
+	memcpy(dst, src, head);
+	size_t i = head;
+	for (; i + 64 <= size; i += 64) {
+		const __m128i a = _mm_stream_load_si128((__m128i*) (src + i));
+		const __m128i b = _mm_stream_load_si128((__m128i*) (src + i + 16));
+		const __m128i c = _mm_stream_load_si128((__m128i*) (src + i + 32));
+		const __m128i d = _mm_stream_load_si128((__m128i*) (src + i + 48));
+		_mm_storeu_si128((__m128i*) (dst + i), a);
+		_mm_storeu_si128((__m128i*) (dst + i + 16), b);
+		_mm_storeu_si128((__m128i*) (dst + i + 32), c);
+		_mm_storeu_si128((__m128i*) (dst + i + 48), d);
+	}
+	memcpy(dst + i, src + i, size - i);
+}
+#endif
+
+typedef struct HostCopySlice {
+	HostCopyFunction function;
+	char* dst;
+	const char* src;
+	uint32_t value;
+	size_t size;
+} HostCopySlice;
+
+static void RunHostCopySlice(void* argument) {
+	const HostCopySlice* slice = argument;
+	slice->function(slice->dst, slice->src, slice->value, slice->size);
+}
+
+// Run function over size bytes, split into contiguous slices across the copier's threads, and wait. src may be
+// NULL for fills.
+static void RunHostCopy(HostCopier* copier, HostCopyFunction function, void* dst, const void* src, uint32_t value,
+	size_t size) {
+
+	size_t sliceCount = size / HOST_COPY_MIN_BYTES_PER_THREAD;
+	if (sliceCount > copier->threadCount) {
+		sliceCount = copier->threadCount;
+	}
+	if (sliceCount <= 1) {
+		function(dst, src, value, size);
+		return;
+	}
+
+	HostCopySlice slices[HOST_COPY_MAX_THREADS];
+	for (uint32_t i = 0; i < sliceCount; ++i) {
+		const size_t begin = size * i / sliceCount / HOST_COPY_SLICE_ALIGNMENT * HOST_COPY_SLICE_ALIGNMENT;
+		const size_t end = i + 1 < sliceCount ?
+			size * (i + 1) / sliceCount / HOST_COPY_SLICE_ALIGNMENT * HOST_COPY_SLICE_ALIGNMENT : size;
+		slices[i].function = function;
+		slices[i].dst = (char*) dst + begin;
+		slices[i].src = src != NULL ? (const char*) src + begin : NULL;
+		slices[i].value = value;
+		slices[i].size = end - begin;
+	}
+	RunWorkerTasks(&copier->workers, RunHostCopySlice, slices, sizeof(slices[0]), (uint32_t) sliceCount);
+}
+
+void CreateHostCopier(HostCopier* copier, uint32_t threadCount) {
+	memset(copier, 0, sizeof(*copier));
+	copier->threadCount = threadCount > 0 ? threadCount : GetOnlineCpuCount();
+	if (copier->threadCount > HOST_COPY_MAX_THREADS) {
+		copier->threadCount = HOST_COPY_MAX_THREADS;
+	}
+#ifdef HOST_COPY_X86
+	__builtin_cpu_init();
+	copier->streamingStores = 1;
+	copier->streamingLoads = __builtin_cpu_supports("sse4.1") != 0;
+#endif
+	CreateWorkerPool(&copier->workers, copier->threadCount - 1);
+}
+
+void DestroyHostCopier(HostCopier* copier) {
+	DestroyWorkerPool(&copier->workers);
+	memset(copier, 0, sizeof(*copier));
+}
+
+int IsWriteCombinedMemory(VkMemoryPropertyFlags flags) {
+	return (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+}
+
+void CopyToMappedMemory(HostCopier* copier, void* dst, const void* src, size_t size, VkMemoryPropertyFlags flags) {
+	HostCopyFunction function = CopyCached;
+#ifdef HOST_COPY_X86
+	if (copier->streamingStores && IsWriteCombinedMemory(flags)) {
+		function = CopyStreaming;
+	}
+#endif
+	RunHostCopy(copier, function, dst, src, 0, size);
+}
+
+void CopyFromMappedMemory(HostCopier* copier, void* dst, const void* src, size_t size, VkMemoryPropertyFlags flags) {
+	HostCopyFunction function = CopyCached;
+#ifdef HOST_COPY_X86
+	if (copier->streamingLoads && IsWriteCombinedMemory(flags)) {
+		function = CopyStreamingLoads;
+	}
+#endif
+	RunHostCopy(copier, function, dst, src, 0, size);
+}
+
+void FillMappedMemory(HostCopier* copier, void* dst, uint32_t value, size_t size, VkMemoryPropertyFlags flags) {
+	HostCopyFunction function = FillCached;
+#ifdef HOST_COPY_X86
+	if (copier->streamingStores && IsWriteCombinedMemory(flags)) {
+		function = FillStreaming;
+	}
+#endif
+	RunHostCopy(copier, function, dst, NULL, value, size);
+}
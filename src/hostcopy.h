@@ -0,0 +1,41 @@
+#include <vulkan/vulkan.h>
+#include "cpu.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef HOSTCOPY_H
+#define HOSTCOPY_H
+
+#define HOST_COPY_MAX_THREADS 64
+// Smaller copies, or slices of them, are not worth a thread of their own
+#define HOST_COPY_MIN_BYTES_PER_THREAD (4 * 1024 * 1024)
+
+// Copies between host memory and mapped buffers, split across threads and using the stores and loads that suit
+// the memory type. Writes to write-combined memory bypass the cache with streaming stores, which fill whole
+// write-combining buffers and never read the destination. Reads from uncached memory use streaming loads where
+// the CPU has them; reads from cached memory are ordinary cached loads.
+typedef struct HostCopier {
+	uint32_t threadCount;
+	// Non-zero if the CPU has streaming stores, and streaming loads (SSE4.1 MOVNTDQA)
+	int streamingStores;
+	int streamingLoads;
+	// threadCount - 1 workers, as the copying thread copies a slice itself
+	WorkerPool workers;
+} HostCopier;
+
+// Start the copier's worker threads. threadCount of 0 uses every online CPU.
+void CreateHostCopier(HostCopier* copier, uint32_t threadCount);
+void DestroyHostCopier(HostCopier* copier);
+
+// Whether memory of this type is write-combined for the host: host visible but not cached, like device local
+// memory behind the PCIe BAR or uncached system memory
+int IsWriteCombinedMemory(VkMemoryPropertyFlags flags);
+
+// Copy size bytes from src to dst, a mapping of memory with flags. Does not flush non-coherent memory.
+void CopyToMappedMemory(HostCopier* copier, void* dst, const void* src, size_t size, VkMemoryPropertyFlags flags);
+// Copy size bytes from src, a mapping of memory with flags, to dst. Does not invalidate non-coherent memory.
+void CopyFromMappedMemory(HostCopier* copier, void* dst, const void* src, size_t size, VkMemoryPropertyFlags flags);
+// Fill size bytes of dst, a multiple of 4 starting 4-byte aligned, with value
+void FillMappedMemory(HostCopier* copier, void* dst, uint32_t value, size_t size, VkMemoryPropertyFlags flags);
+
+#endif
@@ -0,0 +1,141 @@
+#include "jobs.h"
+#include <vulkan/vulkan.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+VkResult RecordComputeJobs(ComputeContext* context, ComputeKernel* kernel, const ComputeJob* jobs, uint32_t jobCount,
+	ComputeJobSet* jobSet) {
+
+	memset(jobSet, 0, sizeof(*jobSet));
+	jobSet->kernel = kernel;
+
+	jobSet->commandBuffers = calloc(jobCount, sizeof(VkCommandBuffer));
+	jobSet->submitCommandBuffers = calloc(jobCount, sizeof(VkCommandBuffer));
+	if (jobSet->commandBuffers == NULL || jobSet->submitCommandBuffers == NULL) {
+		DestroyComputeJobSet(context, jobSet);
+		return VK_ERROR_OUT_OF_HOST_MEMORY;
+	}
+
+	VkCommandBufferAllocateInfo commandBufferAllocateInfo = { 0 };
+	commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	commandBufferAllocateInfo.pNext = NULL;
+	commandBufferAllocateInfo.commandPool = context->commandPool;
+	commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	commandBufferAllocateInfo.commandBufferCount = jobCount;
+
+	VkResult result = vkAllocateCommandBuffers(context->device, &commandBufferAllocateInfo, jobSet->commandBuffers);
+	if (result != VK_SUCCESS) {
+		puts("Failed to allocate job command buffers");
+		memset(jobSet->commandBuffers, 0, jobCount * sizeof(VkCommandBuffer));
+		DestroyComputeJobSet(context, jobSet);
+		return result;
+	}
+	jobSet->jobCount = jobCount;
+
+	VkFenceCreateInfo fenceInfo = { 0 };
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceInfo.pNext = NULL;
+	fenceInfo.flags = 0;
+
+	result = vkCreateFence(context->device, &fenceInfo, NULL, &jobSet->fence);
+	if (result != VK_SUCCESS) {
+		puts("Failed to create job fence");
+		DestroyComputeJobSet(context, jobSet);
+		return result;
+	}
+
+	// No ONE_TIME_SUBMIT flag: the command buffers are replayed until the set is destroyed
+	VkCommandBufferBeginInfo commandBufferBeginInfo = { 0 };
+	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	commandBufferBeginInfo.pNext = NULL;
+	commandBufferBeginInfo.flags = 0;
+	commandBufferBeginInfo.pInheritanceInfo = NULL;
+
+	VkMemoryBarrier memoryBarrier = { 0 };
+	memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memoryBarrier.pNext = NULL;
+	memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+
+	for (uint32_t i = 0; i < jobCount; ++i) {
+		VkCommandBuffer commandBuffer = jobSet->commandBuffers[i];
+		result = vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+		if (result != VK_SUCCESS) {
+			puts("Failed to begin recording command buffer");
+			DestroyComputeJobSet(context, jobSet);
+			return result;
+		}
+
+		CmdDispatchComputeKernelOffsets(commandBuffer, kernel, jobs[i].dynamicOffsets, jobs[i].pushConstants,
+			jobs[i].groupCountX, jobs[i].groupCountY, jobs[i].groupCountZ);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+			0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+
+		result = vkEndCommandBuffer(commandBuffer);
+		if (result != VK_SUCCESS) {
+			puts("Failed to end recording command buffer");
+			DestroyComputeJobSet(context, jobSet);
+			return result;
+		}
+	}
+
+	return VK_SUCCESS;
+}
+
+void DestroyComputeJobSet(ComputeContext* context, ComputeJobSet* jobSet) {
+	if (jobSet->jobCount > 0) {
+		vkFreeCommandBuffers(context->device, context->commandPool, jobSet->jobCount, jobSet->commandBuffers);
+	}
+	vkDestroyFence(context->device, jobSet->fence, NULL);
+	free(jobSet->commandBuffers);
+	free(jobSet->submitCommandBuffers);
+	memset(jobSet, 0, sizeof(*jobSet));
+}
+
+VkResult SubmitComputeJobs(ComputeContext* context, ComputeJobSet* jobSet, const uint32_t* jobIndices, uint32_t count) {
+	if (count > jobSet->jobCount) {
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+	if (count == 0) {
+		return VK_SUCCESS;
+	}
+
+	const VkCommandBuffer* commandBuffers = jobSet->commandBuffers;
+	if (jobIndices != NULL) {
+		for (uint32_t i = 0; i < count; ++i) {
+			if (jobIndices[i] >= jobSet->jobCount) {
+				return VK_ERROR_INITIALIZATION_FAILED;
+			}
+			jobSet->submitCommandBuffers[i] = jobSet->commandBuffers[jobIndices[i]];
+		}
+		commandBuffers = jobSet->submitCommandBuffers;
+	}
+
+	VkSubmitInfo submitInfo = { 0 };
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = NULL;
+	submitInfo.waitSemaphoreCount = 0;
+	submitInfo.pWaitSemaphores = NULL;
+	submitInfo.pWaitDstStageMask = NULL;
+	submitInfo.commandBufferCount = count;
+	submitInfo.pCommandBuffers = commandBuffers;
+	submitInfo.signalSemaphoreCount = 0;
+	submitInfo.pSignalSemaphores = NULL;
+
+	uint32_t batch = SubmitProfileBatch(context->profiler, "jobs");
+	VkResult result = vkQueueSubmit(context->computeQueue, 1, &submitInfo, jobSet->fence);
+	if (result != VK_SUCCESS) {
+		puts("Failed to submit jobs");
+		return result;
+	}
+
+	result = vkWaitForFences(context->device, 1, &jobSet->fence, VK_TRUE, UINT64_MAX);
+	if (result != VK_SUCCESS) {
+		puts("Failed to wait for fence");
+		return result;
+	}
+	CompleteProfileBatch(context->profiler, batch);
+
+	return vkResetFences(context->device, 1, &jobSet->fence);
+}
@@ -0,0 +1,42 @@
+#include <vulkan/vulkan.h>
+#include "context.h"
+#include "kernel.h"
+
+#ifndef JOBS_H
+#define JOBS_H
+
+// One dispatch of a job set's kernel
+typedef struct ComputeJob {
+	// pushConstantSize bytes, copied at record time
+	const void* pushConstants;
+	// One offset per binding if the kernel has a dynamicRange, NULL otherwise
+	const uint32_t* dynamicOffsets;
+	uint32_t groupCountX;
+	uint32_t groupCountY;
+	uint32_t groupCountZ;
+} ComputeJob;
+
+// A fixed set of jobs recorded once into reusable command buffers, one per job, so running a job costs a queue
+// submission instead of descriptor updates and command recording. The kernel's buffers must stay bound for the
+// lifetime of the set, and jobs differ only in their push constants and dynamic offsets.
+typedef struct ComputeJobSet {
+	ComputeKernel* kernel;
+	uint32_t jobCount;
+	VkCommandBuffer* commandBuffers;
+	// Scratch list of the command buffers of one submission
+	VkCommandBuffer* submitCommandBuffers;
+	VkFence fence;
+} ComputeJobSet;
+
+// Record each job into its own command buffer from the context's command pool. Bind the kernel's buffers with
+// BindComputeBuffers first. Each command buffer ends with a barrier making shader writes visible to the host.
+VkResult RecordComputeJobs(ComputeContext* context, ComputeKernel* kernel, const ComputeJob* jobs, uint32_t jobCount,
+	ComputeJobSet* jobSet);
+void DestroyComputeJobSet(ComputeContext* context, ComputeJobSet* jobSet);
+
+// Run the jobs listed in jobIndices (or jobs 0..count-1 if jobIndices is NULL) with a single vkQueueSubmit on
+// the compute queue and wait for all of them. Jobs in one submission may execute concurrently, so they must not
+// write memory another of them accesses, and each job may only be listed once.
+VkResult SubmitComputeJobs(ComputeContext* context, ComputeJobSet* jobSet, const uint32_t* jobIndices, uint32_t count);
+
+#endif
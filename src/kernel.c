@@ -0,0 +1,459 @@
+#include "kernel.h"
+#include "shaders.h"
+#include "timer.h"
+#include <vulkan/vulkan.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Create everything a kernel's pipeline needs: its shader module, descriptor set layout and pipeline layout.
+// CPU backend kernels only look up their native implementation.
+static VkResult CreateKernelLayout(ComputeContext* context, const ComputeKernelCreateInfo* createInfo, ComputeKernel* kernel) {
+	memset(kernel, 0, sizeof(*kernel));
+	const uint32_t bindingCount = createInfo->bindingCount;
+	kernel->bindingCount = bindingCount;
+	kernel->pushConstantSize = createInfo->pushConstantSize;
+	kernel->localSizeX = createInfo->localSizeX;
+	kernel->elementsPerInvocation = createInfo->elementsPerInvocation > 0 ? createInfo->elementsPerInvocation : 1;
+	kernel->vectorWidth = createInfo->vectorWidth > 0 ? createInfo->vectorWidth : 1;
+	kernel->maxGroupCount = createInfo->maxGroupCount;
+	kernel->dynamicRange = createInfo->dynamicRange;
+	const VkDescriptorType descriptorType = kernel->dynamicRange > 0 ?
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+
+	const VkPhysicalDeviceLimits* limits = &context->physicalDeviceProperties.limits;
+	if (kernel->localSizeX == 0 || kernel->localSizeX > limits->maxComputeWorkGroupSize[0] ||
+		kernel->localSizeX > limits->maxComputeWorkGroupInvocations) {
+		printf("Workgroup size %u is not supported by this device\n", kernel->localSizeX);
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+	}
+
+	// The CPU backend runs the shader's native implementation instead
+	if (context->cpuBackend) {
+		const CpuKernel* cpuKernel = FindCpuKernel(createInfo->shaderFile);
+		if (cpuKernel == NULL || bindingCount > CPU_MAX_BINDINGS) {
+			printf("No native implementation of %s for the CPU backend\n", createInfo->shaderFile);
+			return VK_ERROR_FEATURE_NOT_PRESENT;
+		}
+		kernel->cpuFunction = GetCpuKernelFunction(&context->cpu, cpuKernel);
+		return VK_SUCCESS;
+	}
+
+	// Load shader
+	VkResult result = createInfo->shaderCode != NULL ?
+		CreateShaderModule(context->device, createInfo->shaderCode, createInfo->shaderCodeSize, &kernel->shaderModule) :
+		LoadShader(context->device, createInfo->shaderFile, &kernel->shaderModule);
+	if (result != VK_SUCCESS) {
+		printf("Failed to load shader from file %s\n", createInfo->shaderFile);
+		return result;
+	}
+
+	// Create descriptor set layout with one storage buffer per binding, unless the caller provides one
+	VkDescriptorSetLayout setLayout = createInfo->descriptorSetLayout;
+	if (setLayout == VK_NULL_HANDLE) {
+		VkDescriptorSetLayoutBinding* descriptorSetLayoutBindings = calloc(bindingCount, sizeof(VkDescriptorSetLayoutBinding));
+		if (descriptorSetLayoutBindings == NULL) {
+			DestroyComputeKernel(context, kernel);
+			return VK_ERROR_OUT_OF_HOST_MEMORY;
+		}
+		for (uint32_t i = 0; i < bindingCount; ++i) {
+			descriptorSetLayoutBindings[i].binding = i;
+			descriptorSetLayoutBindings[i].descriptorType = descriptorType;
+			descriptorSetLayoutBindings[i].descriptorCount = 1;
+			descriptorSetLayoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+			descriptorSetLayoutBindings[i].pImmutableSamplers = NULL;
+		}
+
+		VkDescriptorSetLayoutCreateInfo descriptorSetLayoutInfo = { 0 };
+		descriptorSetLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		descriptorSetLayoutInfo.pNext = NULL;
+		descriptorSetLayoutInfo.flags = 0;
+		descriptorSetLayoutInfo.bindingCount = bindingCount;
+		descriptorSetLayoutInfo.pBindings = descriptorSetLayoutBindings;
+
+		result = vkCreateDescriptorSetLayout(context->device, &descriptorSetLayoutInfo, NULL, &kernel->descriptorSetLayout);
+		free(descriptorSetLayoutBindings);
+		if (result != VK_SUCCESS) {
+			puts("Failed to create descriptor set layout");
+			DestroyComputeKernel(context, kernel);
+			return result;
+		}
+		setLayout = kernel->descriptorSetLayout;
+	}
+
+	// Create pipeline layout
+	VkPushConstantRange pushConstantRange = { 0 };
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = kernel->pushConstantSize;
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = { 0 };
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.pNext = NULL;
+	pipelineLayoutInfo.flags = 0;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &setLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = kernel->pushConstantSize > 0 ? 1 : 0;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	result = vkCreatePipelineLayout(context->device, &pipelineLayoutInfo, NULL, &kernel->pipelineLayout);
+	if (result != VK_SUCCESS) {
+		puts("Failed to create pipeline layout");
+		DestroyComputeKernel(context, kernel);
+		return result;
+	}
+	return VK_SUCCESS;
+}
+
+// Create the descriptor pool and set of a kernel with its own set layout
+static VkResult CreateKernelDescriptorSet(ComputeContext* context, ComputeKernel* kernel) {
+	const VkDescriptorType descriptorType = kernel->dynamicRange > 0 ?
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+
+	// Create a descriptor pool
+	VkDescriptorPoolSize descriptorPoolSize = { 0 };
+	descriptorPoolSize.type = descriptorType;
+	descriptorPoolSize.descriptorCount = kernel->bindingCount;
+
+	VkDescriptorPoolCreateInfo descriptorPoolInfo = { 0 };
+	descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptorPoolInfo.pNext = NULL;
+	descriptorPoolInfo.flags = 0;
+	descriptorPoolInfo.maxSets = 1;
+	descriptorPoolInfo.poolSizeCount = 1;
+	descriptorPoolInfo.pPoolSizes = &descriptorPoolSize;
+
+	VkResult result = vkCreateDescriptorPool(context->device, &descriptorPoolInfo, NULL, &kernel->descriptorPool);
+	if (result != VK_SUCCESS) {
+		puts("Failed to create descriptor pool");
+		DestroyComputeKernel(context, kernel);
+		return result;
+	}
+
+	// Allocate a descriptor set from the descriptor pool
+	VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = { 0 };
+	descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	descriptorSetAllocateInfo.pNext = NULL;
+	descriptorSetAllocateInfo.descriptorPool = kernel->descriptorPool;
+	descriptorSetAllocateInfo.descriptorSetCount = 1;
+	descriptorSetAllocateInfo.pSetLayouts = &kernel->descriptorSetLayout;
+
+	result = vkAllocateDescriptorSets(context->device, &descriptorSetAllocateInfo, &kernel->descriptorSet);
+	if (result != VK_SUCCESS) {
+		puts("Failed to allocate descriptor set");
+		DestroyComputeKernel(context, kernel);
+		return result;
+	}
+
+	return VK_SUCCESS;
+}
+
+VkResult CreateComputeKernels(ComputeContext* context, const ComputeKernelCreateInfo* createInfos, uint32_t kernelCount,
+	ComputeKernel* kernels) {
+
+	for (uint32_t i = 0; i < kernelCount; ++i) {
+		VkResult result = CreateKernelLayout(context, &createInfos[i], &kernels[i]);
+		if (result != VK_SUCCESS) {
+			DestroyComputeKernels(context, kernels, i);
+			return result;
+		}
+	}
+	if (context->cpuBackend || kernelCount == 0) {
+		return VK_SUCCESS;
+	}
+
+	VkComputePipelineCreateInfo* computePipelineInfos = calloc(kernelCount, sizeof(VkComputePipelineCreateInfo));
+	VkSpecializationInfo* specializationInfos = calloc(kernelCount, sizeof(VkSpecializationInfo));
+	uint32_t* specializationData = calloc(2 * kernelCount, sizeof(uint32_t));
+	VkPipeline* pipelines = calloc(kernelCount, sizeof(VkPipeline));
+	if (computePipelineInfos == NULL || specializationInfos == NULL || specializationData == NULL || pipelines == NULL) {
+		free(computePipelineInfos);
+		free(specializationInfos);
+		free(specializationData);
+		free(pipelines);
+		DestroyComputeKernels(context, kernels, kernelCount);
+		return VK_ERROR_OUT_OF_HOST_MEMORY;
+	}
+
+	// Every pipeline specializes the workgroup size and elements per invocation
+	VkSpecializationMapEntry specializationEntries[2] = { 0 };
+	for (uint32_t i = 0; i < 2; ++i) {
+		specializationEntries[i].constantID = i;
+		specializationEntries[i].offset = i * sizeof(uint32_t);
+		specializationEntries[i].size = sizeof(uint32_t);
+	}
+
+	for (uint32_t i = 0; i < kernelCount; ++i) {
+		specializationData[2 * i] = kernels[i].localSizeX;
+		specializationData[2 * i + 1] = kernels[i].elementsPerInvocation;
+		specializationInfos[i].mapEntryCount = 2;
+		specializationInfos[i].pMapEntries = specializationEntries;
+		specializationInfos[i].dataSize = 2 * sizeof(uint32_t);
+		specializationInfos[i].pData = &specializationData[2 * i];
+
+		VkPipelineShaderStageCreateInfo pipelineShaderStageInfo = { 0 };
+		pipelineShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineShaderStageInfo.pNext = NULL;
+		pipelineShaderStageInfo.flags = 0;
+		pipelineShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineShaderStageInfo.module = kernels[i].shaderModule;
+		pipelineShaderStageInfo.pName = "main";
+		pipelineShaderStageInfo.pSpecializationInfo = &specializationInfos[i];
+
+		computePipelineInfos[i].sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		computePipelineInfos[i].pNext = NULL;
+		computePipelineInfos[i].flags = 0;
+		computePipelineInfos[i].stage = pipelineShaderStageInfo;
+		computePipelineInfos[i].layout = kernels[i].pipelineLayout;
+		computePipelineInfos[i].basePipelineHandle = VK_NULL_HANDLE;
+		computePipelineInfos[i].basePipelineIndex = -1;
+	}
+
+	// One call for the whole batch, which drivers may compile in parallel. Pipelines that fail are left
+	// VK_NULL_HANDLE, the others are still created and destroyed with their kernels below.
+	VkResult result = vkCreateComputePipelines(context->device, context->pipelineCache, kernelCount, computePipelineInfos,
+		NULL, pipelines);
+	for (uint32_t i = 0; i < kernelCount; ++i) {
+		kernels[i].pipeline = pipelines[i];
+	}
+	free(computePipelineInfos);
+	free(specializationInfos);
+	free(specializationData);
+	free(pipelines);
+	if (result != VK_SUCCESS) {
+		puts("Failed to create compute pipelines");
+		DestroyComputeKernels(context, kernels, kernelCount);
+		return result;
+	}
+
+	for (uint32_t i = 0; i < kernelCount; ++i) {
+		if (createInfos[i].descriptorSetLayout != VK_NULL_HANDLE) {
+			continue;
+		}
+		result = CreateKernelDescriptorSet(context, &kernels[i]);
+		if (result != VK_SUCCESS) {
+			DestroyComputeKernels(context, kernels, kernelCount);
+			return result;
+		}
+	}
+	return VK_SUCCESS;
+}
+
+VkResult CreateComputeKernel(ComputeContext* context, const ComputeKernelCreateInfo* createInfo, ComputeKernel* kernel) {
+	return CreateComputeKernels(context, createInfo, 1, kernel);
+}
+
+void DestroyComputeKernel(ComputeContext* context, ComputeKernel* kernel) {
+	if (context->cpuBackend) {
+		memset(kernel, 0, sizeof(*kernel));
+		return;
+	}
+	vkDestroyDescriptorPool(context->device, kernel->descriptorPool, NULL);
+	vkDestroyPipeline(context->device, kernel->pipeline, NULL);
+	vkDestroyPipelineLayout(context->device, kernel->pipelineLayout, NULL);
+	vkDestroyDescriptorSetLayout(context->device, kernel->descriptorSetLayout, NULL);
+	vkDestroyShaderModule(context->device, kernel->shaderModule, NULL);
+	memset(kernel, 0, sizeof(*kernel));
+}
+
+void DestroyComputeKernels(ComputeContext* context, ComputeKernel* kernels, uint32_t kernelCount) {
+	for (uint32_t i = 0; i < kernelCount; ++i) {
+		DestroyComputeKernel(context, &kernels[i]);
+	}
+}
+
+VkResult BindComputeBuffers(ComputeContext* context, ComputeKernel* kernel, const ComputeBuffer* buffers) {
+	if (context->cpuBackend) {
+		for (uint32_t i = 0; i < kernel->bindingCount; ++i) {
+			kernel->cpuBuffers[i] = buffers[i].mapped;
+		}
+		return VK_SUCCESS;
+	}
+
+	VkDescriptorBufferInfo* bufferInfos = calloc(kernel->bindingCount, sizeof(VkDescriptorBufferInfo));
+	VkWriteDescriptorSet* writeDescriptorSets = calloc(kernel->bindingCount, sizeof(VkWriteDescriptorSet));
+	if (bufferInfos == NULL || writeDescriptorSets == NULL) {
+		free(bufferInfos);
+		free(writeDescriptorSets);
+		return VK_ERROR_OUT_OF_HOST_MEMORY;
+	}
+	for (uint32_t i = 0; i < kernel->bindingCount; ++i) {
+		bufferInfos[i].buffer = buffers[i].buffer;
+		bufferInfos[i].offset = 0;
+		bufferInfos[i].range = kernel->dynamicRange > 0 ? kernel->dynamicRange : VK_WHOLE_SIZE;
+
+		writeDescriptorSets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeDescriptorSets[i].pNext = NULL;
+		writeDescriptorSets[i].dstSet = kernel->descriptorSet;
+		writeDescriptorSets[i].dstBinding = i;
+		writeDescriptorSets[i].dstArrayElement = 0;
+		writeDescriptorSets[i].descriptorCount = 1;
+		writeDescriptorSets[i].descriptorType = kernel->dynamicRange > 0 ?
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writeDescriptorSets[i].pImageInfo = NULL;
+		writeDescriptorSets[i].pBufferInfo = &bufferInfos[i];
+		writeDescriptorSets[i].pTexelBufferView = NULL;
+	}
+	vkUpdateDescriptorSets(context->device, kernel->bindingCount, writeDescriptorSets, 0, NULL);
+	free(bufferInfos);
+	free(writeDescriptorSets);
+
+	return VK_SUCCESS;
+}
+
+VkResult ComputeDispatchSize(const ComputeContext* context, const ComputeKernel* kernel, uint64_t elementCount,
+	uint32_t* groupCountX, uint32_t* groupCountY, uint32_t* groupCountZ) {
+
+	const uint32_t* maxGroupCount = context->physicalDeviceProperties.limits.maxComputeWorkGroupCount;
+	const uint64_t elementsPerGroup = (uint64_t) kernel->localSizeX * kernel->elementsPerInvocation * kernel->vectorWidth;
+	uint64_t groupCount = (elementCount + elementsPerGroup - 1) / elementsPerGroup;
+	if (groupCount == 0) {
+		groupCount = 1;
+	}
+	// Shaders index elements in 32 bits, so the launched workgroups may cover at most 2^32 elements
+	const uint64_t maxTotalGroups = ((uint64_t) UINT32_MAX + 1) / elementsPerGroup;
+	if (groupCount > maxTotalGroups) {
+		printf("Cannot dispatch %llu elements in one dispatch\n", (unsigned long long) elementCount);
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+	}
+	// Grid-stride kernels loop over whatever the capped dispatch does not cover
+	if (kernel->maxGroupCount > 0 && groupCount > kernel->maxGroupCount) {
+		groupCount = kernel->maxGroupCount;
+	}
+
+	// Spread the groups over as few dimensions as possible, keeping the rectangle close to the exact count
+	uint64_t z = 1;
+	uint64_t y = 1;
+	const uint64_t maxPlane = (uint64_t) maxGroupCount[0] * maxGroupCount[1];
+	if (groupCount > maxPlane) {
+		z = (groupCount + maxPlane - 1) / maxPlane;
+	}
+	uint64_t planeGroups = (groupCount + z - 1) / z;
+	if (planeGroups > maxGroupCount[0]) {
+		y = (planeGroups + maxGroupCount[0] - 1) / maxGroupCount[0];
+	}
+	uint64_t x = (planeGroups + y - 1) / y;
+	// Near 2^32 elements the rounded up rectangle can overshoot; taller ones waste fewer groups, e.g. 2^24 groups
+	// with a limit of 65535 only fit exactly as 32768 x 512
+	while (x * y * z > maxTotalGroups && y < maxGroupCount[1]) {
+		++y;
+		x = (planeGroups + y - 1) / y;
+	}
+
+	if (x > maxGroupCount[0] || y > maxGroupCount[1] || z > maxGroupCount[2] || x * y * z > maxTotalGroups) {
+		printf("Cannot dispatch %llu elements in one dispatch\n", (unsigned long long) elementCount);
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+	}
+
+	*groupCountX = (uint32_t) x;
+	*groupCountY = (uint32_t) y;
+	*groupCountZ = (uint32_t) z;
+	return VK_SUCCESS;
+}
+
+void CmdDispatchComputeKernel(VkCommandBuffer commandBuffer, const ComputeKernel* kernel, const void* pushConstants,
+	uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ) {
+
+	CmdDispatchComputeKernelOffsets(commandBuffer, kernel, NULL, pushConstants, groupCountX, groupCountY, groupCountZ);
+}
+
+void CmdDispatchComputeKernelOffsets(VkCommandBuffer commandBuffer, const ComputeKernel* kernel, const uint32_t* dynamicOffsets,
+	const void* pushConstants, uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ) {
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, kernel->pipeline);
+	if (kernel->descriptorSet != VK_NULL_HANDLE) {
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, kernel->pipelineLayout, 0, 1, &kernel->descriptorSet,
+			kernel->dynamicRange > 0 ? kernel->bindingCount : 0, dynamicOffsets);
+	}
+	if (kernel->pushConstantSize > 0) {
+		vkCmdPushConstants(commandBuffer, kernel->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, kernel->pushConstantSize, pushConstants);
+	}
+	vkCmdDispatch(commandBuffer, groupCountX, groupCountY, groupCountZ);
+}
+
+VkResult DispatchComputeKernel(ComputeContext* context, ComputeKernel* kernel, const ComputeBuffer* buffers,
+	const void* pushConstants, uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ) {
+
+	// The previous dispatch has already completed, so the descriptor set is not in use
+	VkResult result = BindComputeBuffers(context, kernel, buffers);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+	// Elementwise kernels take the element count as their first push constant
+	if (context->cpuBackend) {
+		return RunCpuKernel(&context->cpu, kernel->cpuFunction, kernel->cpuBuffers, pushConstants, *(const uint32_t*) pushConstants);
+	}
+
+	// Record commands
+	result = BeginComputeCommandBuffer(context);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+
+	uint32_t scope = CmdBeginProfileScope(context->profiler, context->commandBuffer, context->computeQueueIndex, "dispatch");
+	CmdDispatchComputeKernel(context->commandBuffer, kernel, pushConstants, groupCountX, groupCountY, groupCountZ);
+	CmdEndProfileScope(context->profiler, context->commandBuffer, scope);
+
+	// Make shader writes visible to the host once the fence is signalled
+	VkMemoryBarrier memoryBarrier = { 0 };
+	memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memoryBarrier.pNext = NULL;
+	memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(context->commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+		0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+
+	result = vkEndCommandBuffer(context->commandBuffer);
+	if (result != VK_SUCCESS) {
+		puts("Failed to end recording command buffer");
+		return result;
+	}
+
+	uint32_t batch = SubmitProfileBatch(context->profiler, "dispatch");
+	result = SubmitAndWait(context);
+	CompleteProfileBatch(context->profiler, batch);
+	return result;
+}
+
+VkResult TimeComputeKernel(ComputeContext* context, const ComputeKernel* kernel, const void* pushConstants,
+	uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ, uint32_t dispatchCount, uint64_t* elapsedNs) {
+
+	if (context->cpuBackend) {
+		uint64_t startTime = GetTimeNs();
+		for (uint32_t i = 0; i < dispatchCount; ++i) {
+			RunCpuKernel(&context->cpu, kernel->cpuFunction, kernel->cpuBuffers, pushConstants, *(const uint32_t*) pushConstants);
+		}
+		*elapsedNs = GetTimeNs() - startTime;
+		return VK_SUCCESS;
+	}
+
+	VkResult result = BeginComputeCommandBuffer(context);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+
+	// Serialize the dispatches so each one is measured in full rather than overlapping the next
+	VkMemoryBarrier memoryBarrier = { 0 };
+	memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memoryBarrier.pNext = NULL;
+	memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	for (uint32_t i = 0; i < dispatchCount; ++i) {
+		if (i > 0) {
+			vkCmdPipelineBarrier(context->commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+		}
+		CmdDispatchComputeKernel(context->commandBuffer, kernel, pushConstants, groupCountX, groupCountY, groupCountZ);
+	}
+
+	result = vkEndCommandBuffer(context->commandBuffer);
+	if (result != VK_SUCCESS) {
+		puts("Failed to end recording command buffer");
+		return result;
+	}
+
+	uint64_t startTime = GetTimeNs();
+	result = SubmitAndWait(context);
+	*elapsedNs = GetTimeNs() - startTime;
+	return result;
+}
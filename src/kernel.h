@@ -0,0 +1,102 @@
+#include <vulkan/vulkan.h>
+#include "context.h"
+#include "buffer.h"
+
+#ifndef KERNEL_H
+#define KERNEL_H
+
+typedef struct ComputeKernelCreateInfo {
+	const char* shaderFile;
+	// If not NULL, shaderCodeSize bytes of SPIR-V used instead of loading shaderFile, which then only names the
+	// kernel in messages
+	const uint32_t* shaderCode;
+	size_t shaderCodeSize;
+	// The shader reads and writes bindingCount storage buffers at bindings 0..bindingCount-1 of set 0
+	uint32_t bindingCount;
+	// Size in bytes of the shader's push constant block, or 0 if it has none
+	uint32_t pushConstantSize;
+	// Workgroup size, passed as specialization constant 0 (layout(local_size_x_id = 0) in the shader)
+	uint32_t localSizeX;
+	// Elements each invocation processes, passed as specialization constant 1. 0 is treated as 1.
+	uint32_t elementsPerInvocation;
+	// Elements per load and store, e.g. 4 for a shader that accesses the buffers as vec4. 0 is treated as 1.
+	uint32_t vectorWidth;
+	// Caps the workgroups launched per dispatch, or 0 for no cap. Shaders loop over the rest of the elements
+	// with a grid-stride loop, so a small resident grid covers any element count.
+	uint32_t maxGroupCount;
+	// If non-zero, every binding is a dynamic storage buffer covering this many bytes, positioned per dispatch by
+	// dynamic offsets (multiples of minStorageBufferOffsetAlignment). Lets pre-recorded jobs address different
+	// slices of the same buffers through one descriptor set.
+	VkDeviceSize dynamicRange;
+	// If not VK_NULL_HANDLE, the pipeline uses this set layout, owned by the caller, instead of one with
+	// bindingCount storage buffers, and the kernel has no descriptor set of its own (see src/descriptors.h)
+	VkDescriptorSetLayout descriptorSetLayout;
+} ComputeKernelCreateInfo;
+
+// A compute pipeline with its descriptor set. Elementwise kernels take the element count as their first
+// push constant and ignore invocations past it, so they can be dispatched with ComputeDispatchSize.
+typedef struct ComputeKernel {
+	VkShaderModule shaderModule;
+	VkDescriptorSetLayout descriptorSetLayout;
+	VkPipelineLayout pipelineLayout;
+	VkPipeline pipeline;
+	VkDescriptorPool descriptorPool;
+	VkDescriptorSet descriptorSet;
+	uint32_t bindingCount;
+	uint32_t pushConstantSize;
+	uint32_t localSizeX;
+	uint32_t elementsPerInvocation;
+	uint32_t vectorWidth;
+	uint32_t maxGroupCount;
+	VkDeviceSize dynamicRange;
+	// CPU backend contexts: the native implementation and the buffers last bound to it
+	CpuKernelFunction cpuFunction;
+	void* cpuBuffers[CPU_MAX_BINDINGS];
+} ComputeKernel;
+
+VkResult CreateComputeKernel(ComputeContext* context, const ComputeKernelCreateInfo* createInfo, ComputeKernel* kernel);
+// Create kernelCount kernels with one vkCreateComputePipelines call, which costs less than one call per kernel
+// and lets the driver compile the pipelines in parallel. On failure none of the kernels are left created.
+// Safe to call from several threads at once, as the pipeline cache is internally synchronized.
+VkResult CreateComputeKernels(ComputeContext* context, const ComputeKernelCreateInfo* createInfos, uint32_t kernelCount,
+	ComputeKernel* kernels);
+void DestroyComputeKernel(ComputeContext* context, ComputeKernel* kernel);
+void DestroyComputeKernels(ComputeContext* context, ComputeKernel* kernels, uint32_t kernelCount);
+
+// Write buffers[0..bindingCount-1] into the kernel's descriptor set. The set must not be in use by pending work.
+VkResult BindComputeBuffers(ComputeContext* context, ComputeKernel* kernel, const ComputeBuffer* buffers);
+
+// Compute the workgroup counts that cover elementCount elements, localSizeX * elementsPerInvocation * vectorWidth
+// per workgroup and at most maxGroupCount workgroups if the kernel has a cap. Dispatches larger than
+// maxComputeWorkGroupCount[0] are folded into Y and then Z, which can launch a few workgroups past the end.
+// Shaders therefore flatten gl_WorkGroupID to groupIndex = x + numX * (y + numY * z) and skip groups past the
+// last element. Each workgroup covers a contiguous span of localSizeX * elementsPerInvocation elements (or vectors),
+// and its invocations stride by localSizeX within the span so neighbouring invocations touch neighbouring elements.
+// Grid-stride shaders then advance by the number of launched workgroups until every span is covered, which is
+// how a capped dispatch handles any element count. Shaders index in 32 bits, so the launched workgroups cover at
+// most 2^32 elements and shaders count spans rather than elements, which keeps the arithmetic from wrapping.
+// elementCount may be anything up to UINT32_MAX when the elements per workgroup are a power of two (otherwise up to
+// the last whole workgroup below 2^32). Returns VK_ERROR_FEATURE_NOT_PRESENT if the count cannot be covered by one
+// dispatch on this device.
+VkResult ComputeDispatchSize(const ComputeContext* context, const ComputeKernel* kernel, uint64_t elementCount,
+	uint32_t* groupCountX, uint32_t* groupCountY, uint32_t* groupCountZ);
+
+// Record binding the kernel's pipeline and descriptor set (if it has one), pushing pushConstantSize bytes of pushConstants
+// (if the kernel has any) and dispatching it into commandBuffer
+void CmdDispatchComputeKernel(VkCommandBuffer commandBuffer, const ComputeKernel* kernel, const void* pushConstants,
+	uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ);
+
+// Same as CmdDispatchComputeKernel for kernels with a dynamicRange, binding each buffer at dynamicOffsets[binding]
+void CmdDispatchComputeKernelOffsets(VkCommandBuffer commandBuffer, const ComputeKernel* kernel, const uint32_t* dynamicOffsets,
+	const void* pushConstants, uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ);
+
+// Bind buffers[0..bindingCount-1] to the kernel, dispatch the given number of workgroups and wait for completion
+VkResult DispatchComputeKernel(ComputeContext* context, ComputeKernel* kernel, const ComputeBuffer* buffers,
+	const void* pushConstants, uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ);
+
+// Record dispatchCount back to back dispatches, separated by barriers, submit them and wait. elapsedNs receives the
+// host time from submission to completion. Buffers must already be bound.
+VkResult TimeComputeKernel(ComputeContext* context, const ComputeKernel* kernel, const void* pushConstants,
+	uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ, uint32_t dispatchCount, uint64_t* elapsedNs);
+
+#endif
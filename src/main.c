@@ -2,624 +2,1858 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
+
+#include "autotune.h"
+#include "bandwidth.h"
+#include "context.h"
+#include "buffer.h"
+#include "convert.h"
+#include "descriptors.h"
+#include "external.h"
+#include "fusion.h"
+#include "graph.h"
+#include "hostcopy.h"
+#include "jobs.h"
+#include "kernel.h"
+#include "pipeline_cache.h"
+#include "primitives.h"
+#include "registry.h"
+#include "scheduler.h"
+#include "startup.h"
+#include "staging.h"
+#include "stream.h"
+#include "submitter.h"
+#include "timer.h"
+#include "variants.h"
+
+// Streaming input is the sequence 0, 1, 2, ... as floats, generated chunk by chunk
+static void FillStreamChunk(void* userData, void* dst, VkDeviceSize offset, VkDeviceSize size) {
+	(void) userData;
+	float* data = dst;
+	uint64_t first = offset / sizeof(float);
+	for (uint64_t i = 0; i < size / sizeof(float); ++i) {
+		data[i] = (float) (first + i);
+	}
+}
 
-#include "shaders.h"
+static void DrainStreamChunk(void* userData, const void* src, VkDeviceSize offset, VkDeviceSize size) {
+	uint64_t* mismatches = userData;
+	const float* data = src;
+	uint64_t first = offset / sizeof(float);
+	for (uint64_t i = 0; i < size / sizeof(float); ++i) {
+		if (data[i] != (float) (first + i) * 2.f) {
+			++*mismatches;
+		}
+	}
+}
 
-int main() {
+// Compare the memory throughput of every kernel variant with a buffer copy and, if known, the device's peak
+static void RunBandwidthBenchmark(ComputeContext* context, VkDeviceSize size, double peakGBs, int retune) {
+	const uint64_t elementCount = size / sizeof(float);
+	ComputeBuffer buffers[2] = { 0 };
+	if (CreateComputeBuffer(context, size, BUFFER_LOCATION_DEVICE, &buffers[0]) != VK_SUCCESS ||
+		CreateComputeBuffer(context, size, BUFFER_LOCATION_DEVICE, &buffers[1]) != VK_SUCCESS) {
+		puts("Failed to create bandwidth benchmark buffers");
+		exit(1);
+	}
 
-	const char* requestedLayers[] = {
-		"VK_LAYER_KHRONOS_validation"
-	};
-	const uint32_t requestedLayerCount = sizeof(requestedLayers) / sizeof(*requestedLayers);
+	BandwidthResult copy = { 0 };
+	if (MeasureCopyBandwidth(context, &buffers[0], &buffers[1], size, &copy) != VK_SUCCESS) {
+		puts("Failed to measure copy bandwidth");
+		exit(1);
+	}
+	printf("%-12s %10.3f ms %8.2f GB/s\n", "copy", NsToMs(copy.passNs), copy.throughputGBs);
+
+	uint32_t elementCount32 = (uint32_t) elementCount;
+	for (uint32_t i = 0; i < kernelVariantCount; ++i) {
+		ComputeKernelCreateInfo kernelInfo = { 0 };
+		GetKernelVariantCreateInfo(&kernelVariants[i], &kernelInfo);
+
+		AutotuneResult autotune = { 0 };
+		ComputeKernel kernel = { 0 };
+		BandwidthResult bandwidth = { 0 };
+		if (AutotuneComputeKernel(context, ".", &kernelInfo, DEFAULT_AUTOTUNE_ELEMENT_COUNT, sizeof(float), retune, &autotune) != VK_SUCCESS) {
+			printf("Failed to autotune %s\n", kernelVariants[i].name);
+			exit(1);
+		}
+		kernelInfo.localSizeX = autotune.localSizeX;
+		kernelInfo.elementsPerInvocation = autotune.elementsPerInvocation;
+		if (CreateComputeKernel(context, &kernelInfo, &kernel) != VK_SUCCESS ||
+			MeasureKernelBandwidth(context, &kernel, buffers, elementCount, 2 * sizeof(float), &elementCount32, &bandwidth) != VK_SUCCESS) {
+			printf("Failed to measure %s bandwidth\n", kernelVariants[i].name);
+			exit(1);
+		}
+		DestroyComputeKernel(context, &kernel);
 
-	// Get supported layer count
-	uint32_t supportedLayerCount = 0;
-	VkResult result = vkEnumerateInstanceLayerProperties(&supportedLayerCount, NULL);
-	if (result != VK_SUCCESS) {
-		puts("Failed to get supported layers");
+		printf("%-12s %10.3f ms %8.2f GB/s %6.1f%% of copy", kernelVariants[i].name, NsToMs(bandwidth.passNs),
+			bandwidth.throughputGBs, 100.0 * bandwidth.throughputGBs / copy.throughputGBs);
+		if (peakGBs > 0.0) {
+			printf(" %6.1f%% of peak", 100.0 * bandwidth.throughputGBs / peakGBs);
+		}
+		printf(" (local size %u, %u per invocation)\n", autotune.localSizeX, autotune.elementsPerInvocation);
+	}
+
+	DestroyComputeBuffer(context, &buffers[0]);
+	DestroyComputeBuffer(context, &buffers[1]);
+}
+
+// Elements processed by each job of the job overhead benchmark; small enough that CPU overhead dominates
+#define JOB_ELEMENTS 4096
+
+typedef enum JobMode {
+	// Record a command buffer, submit it and wait, for every job
+	JOB_MODE_RECORD,
+	// Replay each pre-recorded job with its own submission
+	JOB_MODE_REPLAY,
+	// Replay all pre-recorded jobs with one submission
+	JOB_MODE_BATCH
+} JobMode;
+
+static VkResult RunJobs(ComputeContext* context, ComputeKernel* kernel, ComputeJobSet* jobSet, const ComputeJob* jobs,
+	uint32_t jobCount, JobMode mode) {
+
+	VkResult result = VK_SUCCESS;
+	if (mode == JOB_MODE_BATCH) {
+		return SubmitComputeJobs(context, jobSet, NULL, jobCount);
+	}
+	for (uint32_t i = 0; i < jobCount && result == VK_SUCCESS; ++i) {
+		if (mode == JOB_MODE_REPLAY) {
+			result = SubmitComputeJobs(context, jobSet, &i, 1);
+			continue;
+		}
+
+		result = BeginComputeCommandBuffer(context);
+		if (result != VK_SUCCESS) {
+			break;
+		}
+		CmdDispatchComputeKernelOffsets(context->commandBuffer, kernel, jobs[i].dynamicOffsets, jobs[i].pushConstants,
+			jobs[i].groupCountX, jobs[i].groupCountY, jobs[i].groupCountZ);
+		VkMemoryBarrier memoryBarrier = { 0 };
+		memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		memoryBarrier.pNext = NULL;
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(context->commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+			0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+		result = vkEndCommandBuffer(context->commandBuffer);
+		if (result == VK_SUCCESS) {
+			result = SubmitAndWait(context);
+		}
+	}
+	return result;
+}
+
+// Compare the host cost per job of recording every job, replaying pre-recorded jobs one submission at a time
+// and replaying them all in one submission. Each job doubles its own JOB_ELEMENTS slice of a pair of buffers.
+static void RunJobOverheadBenchmark(ComputeContext* context, const ComputeKernelCreateInfo* kernelInfo, uint32_t jobCount) {
+	// Slices are addressed with dynamic offsets, which must be aligned
+	const VkDeviceSize alignment = context->physicalDeviceProperties.limits.minStorageBufferOffsetAlignment;
+	const VkDeviceSize sliceSize = (JOB_ELEMENTS * sizeof(float) + alignment - 1) / alignment * alignment;
+
+	ComputeKernelCreateInfo jobKernelInfo = *kernelInfo;
+	jobKernelInfo.dynamicRange = JOB_ELEMENTS * sizeof(float);
+	ComputeKernel kernel = { 0 };
+	ComputeBuffer buffers[2] = { 0 };
+	if (CreateComputeKernel(context, &jobKernelInfo, &kernel) != VK_SUCCESS ||
+		CreateComputeBuffer(context, sliceSize * jobCount, BUFFER_LOCATION_HOST, &buffers[0]) != VK_SUCCESS ||
+		CreateComputeBuffer(context, sliceSize * jobCount, BUFFER_LOCATION_HOST, &buffers[1]) != VK_SUCCESS ||
+		BindComputeBuffers(context, &kernel, buffers) != VK_SUCCESS) {
+		puts("Failed to set up job benchmark");
 		exit(1);
 	}
 
-	VkLayerProperties* supportedLayers = malloc(sizeof(VkLayerProperties) * supportedLayerCount);
-	result = vkEnumerateInstanceLayerProperties(&supportedLayerCount, supportedLayers);
-	if (result != VK_SUCCESS) {
-		puts("Failed to get supported layers");
+	uint32_t groupCountX = 0;
+	uint32_t groupCountY = 0;
+	uint32_t groupCountZ = 0;
+	uint32_t elementCount = JOB_ELEMENTS;
+	ComputeJob* jobs = calloc(jobCount, sizeof(ComputeJob));
+	uint32_t* offsets = calloc(2 * jobCount, sizeof(uint32_t));
+	if (jobs == NULL || offsets == NULL ||
+		ComputeDispatchSize(context, &kernel, JOB_ELEMENTS, &groupCountX, &groupCountY, &groupCountZ) != VK_SUCCESS) {
+		puts("Failed to set up job benchmark");
 		exit(1);
 	}
+	for (uint32_t i = 0; i < jobCount; ++i) {
+		offsets[2 * i] = (uint32_t) (i * sliceSize);
+		offsets[2 * i + 1] = (uint32_t) (i * sliceSize);
+		jobs[i].pushConstants = &elementCount;
+		jobs[i].dynamicOffsets = &offsets[2 * i];
+		jobs[i].groupCountX = groupCountX;
+		jobs[i].groupCountY = groupCountY;
+		jobs[i].groupCountZ = groupCountZ;
+	}
 
-	const char** enabledLayers = malloc(sizeof(char*) * requestedLayerCount);
-	uint32_t enabledLayerCount = 0;
-	for (uint32_t i = 0; i < requestedLayerCount; ++i) {
-		for (uint32_t j = 0; j < supportedLayerCount; ++j) {
-			if (!strcmp(requestedLayers[i], supportedLayers[j].layerName)) {
-				enabledLayers[enabledLayerCount] = requestedLayers[i];
-				++enabledLayerCount;
-				break;
+	uint64_t startTime = GetTimeNs();
+	ComputeJobSet jobSet = { 0 };
+	if (RecordComputeJobs(context, &kernel, jobs, jobCount, &jobSet) != VK_SUCCESS) {
+		puts("Failed to record jobs");
+		exit(1);
+	}
+	printf("Recorded %u jobs in %.3f ms\n", jobCount, NsToMs(GetTimeNs() - startTime));
+
+	const char* modeNames[] = { "record each job", "replay each job", "replay batched" };
+	for (uint32_t mode = JOB_MODE_RECORD; mode <= JOB_MODE_BATCH; ++mode) {
+		float* input = buffers[0].mapped;
+		float* output = buffers[1].mapped;
+		for (uint64_t i = 0; i < sliceSize / sizeof(float) * jobCount; ++i) {
+			input[i] = (float) i;
+			output[i] = 0.f;
+		}
+
+		clock_t cpuStart = clock();
+		startTime = GetTimeNs();
+		if (RunJobs(context, &kernel, &jobSet, jobs, jobCount, (JobMode) mode) != VK_SUCCESS) {
+			puts("Failed to run jobs");
+			exit(1);
+		}
+		uint64_t elapsedNs = GetTimeNs() - startTime;
+		double cpuNs = (double) (clock() - cpuStart) * 1e9 / CLOCKS_PER_SEC;
+
+		uint64_t mismatches = 0;
+		for (uint32_t job = 0; job < jobCount; ++job) {
+			const uint64_t first = job * (sliceSize / sizeof(float));
+			for (uint64_t i = first; i < first + JOB_ELEMENTS; ++i) {
+				if (output[i] != input[i] * 2.f) {
+					++mismatches;
+				}
 			}
 		}
+		printf("%-16s %9.2f us per job wall, %9.2f us per job CPU, %llu mismatches\n", modeNames[mode],
+			elapsedNs / 1000.0 / jobCount, cpuNs / 1000.0 / jobCount, (unsigned long long) mismatches);
 	}
 
-	free(supportedLayers);
+	DestroyComputeJobSet(context, &jobSet);
+	free(jobs);
+	free(offsets);
+	DestroyComputeBuffer(context, &buffers[0]);
+	DestroyComputeBuffer(context, &buffers[1]);
+	DestroyComputeKernel(context, &kernel);
+}
+
+// Dispatches recorded per submission by the binding benchmark, and the buffer pairs they cycle through
+#define BINDING_BATCH 256
+#define BINDING_BUFFER_PAIRS 16
 
-	printf("Enabled layer count: %u\n", enabledLayerCount);
-	for (uint32_t i = 0; i < enabledLayerCount; ++i) {
-		printf("\t%s\n", enabledLayers[i]);
+// Compare the host cost per dispatch of every descriptor strategy the device supports. Consecutive dispatches
+// use different pairs of JOB_ELEMENTS buffers, so the buffers bound change on every dispatch.
+static void RunBindingBenchmark(ComputeContext* context, const ComputeKernelCreateInfo* kernelInfo, uint32_t dispatchCount) {
+	static const char* const shaderFiles[DESCRIPTOR_STRATEGY_COUNT] = {
+		"shaders/double.spv", "shaders/double.spv", "shaders/double_address.spv", "shaders/double_bindless.spv"
+	};
+
+	ComputeBuffer buffers[BINDING_BUFFER_PAIRS][2] = { 0 };
+	for (uint32_t pair = 0; pair < BINDING_BUFFER_PAIRS; ++pair) {
+		if (CreateComputeBuffer(context, JOB_ELEMENTS * sizeof(float), BUFFER_LOCATION_HOST, &buffers[pair][0]) != VK_SUCCESS ||
+			CreateComputeBuffer(context, JOB_ELEMENTS * sizeof(float), BUFFER_LOCATION_HOST, &buffers[pair][1]) != VK_SUCCESS) {
+			puts("Failed to set up binding benchmark");
+			exit(1);
+		}
+		float* input = buffers[pair][0].mapped;
+		for (uint32_t i = 0; i < JOB_ELEMENTS; ++i) {
+			input[i] = (float) (pair * JOB_ELEMENTS + i);
+		}
 	}
 
-	// Create a Vulkan instance
-	VkInstanceCreateInfo instanceInfo = { 0 };
-	instanceInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-	instanceInfo.pNext = NULL;
-	instanceInfo.flags = 0;
-	instanceInfo.pApplicationInfo = NULL;
-	instanceInfo.enabledLayerCount = enabledLayerCount;
-	instanceInfo.ppEnabledLayerNames = enabledLayers;
-	instanceInfo.enabledExtensionCount = 0;
-	instanceInfo.ppEnabledExtensionNames = NULL;
+	for (uint32_t strategy = 0; strategy < DESCRIPTOR_STRATEGY_COUNT; ++strategy) {
+		const char* name = GetDescriptorStrategyName((DescriptorStrategy) strategy);
+		if (!IsDescriptorStrategySupported(context, (DescriptorStrategy) strategy)) {
+			printf("%-9s not supported\n", name);
+			continue;
+		}
 
-	VkInstance instance = VK_NULL_HANDLE;
-	result = vkCreateInstance(&instanceInfo, NULL, &instance);
-	if (result != VK_SUCCESS) {
-		puts("Failed to create a Vulkan instance");
-		exit(1);
+		// Every strategy runs the scalar kernel written for it, with the tuned workgroup configuration
+		ComputeKernelCreateInfo binderKernelInfo = *kernelInfo;
+		binderKernelInfo.shaderFile = shaderFiles[strategy];
+		binderKernelInfo.vectorWidth = 1;
+		binderKernelInfo.maxGroupCount = 0;
+
+		DescriptorBinder binder = { 0 };
+		ComputeKernel kernel = { 0 };
+		uint32_t slots[BINDING_BUFFER_PAIRS][2] = { 0 };
+		uint32_t groupCountX = 0;
+		uint32_t groupCountY = 0;
+		uint32_t groupCountZ = 0;
+		if (CreateDescriptorBinder(context, (DescriptorStrategy) strategy, 2, sizeof(uint32_t), &binder) != VK_SUCCESS ||
+			CreateBinderKernel(&binder, &binderKernelInfo, &kernel) != VK_SUCCESS ||
+			ComputeDispatchSize(context, &kernel, JOB_ELEMENTS, &groupCountX, &groupCountY, &groupCountZ) != VK_SUCCESS) {
+			printf("Failed to set up %s binding\n", name);
+			exit(1);
+		}
+		// Bindless buffers are written into the table once, outside the timed loop
+		for (uint32_t pair = 0; pair < BINDING_BUFFER_PAIRS && strategy == DESCRIPTOR_STRATEGY_BINDLESS; ++pair) {
+			if (AddBindlessBuffer(&binder, &buffers[pair][0], &slots[pair][0]) != VK_SUCCESS ||
+				AddBindlessBuffer(&binder, &buffers[pair][1], &slots[pair][1]) != VK_SUCCESS) {
+				exit(1);
+			}
+		}
+		for (uint32_t pair = 0; pair < BINDING_BUFFER_PAIRS; ++pair) {
+			memset(buffers[pair][1].mapped, 0, JOB_ELEMENTS * sizeof(float));
+		}
+
+		uint32_t elementCount = JOB_ELEMENTS;
+		uint64_t recordNs = 0;
+		uint64_t startTime = GetTimeNs();
+		for (uint32_t first = 0; first < dispatchCount; first += BINDING_BATCH) {
+			const uint32_t batch = dispatchCount - first < BINDING_BATCH ? dispatchCount - first : BINDING_BATCH;
+			VkResult result = BeginComputeCommandBuffer(context);
+			uint64_t recordStart = GetTimeNs();
+			for (uint32_t i = 0; i < batch && result == VK_SUCCESS; ++i) {
+				const uint32_t pair = (first + i) % BINDING_BUFFER_PAIRS;
+				result = CmdDispatchWithBinder(context->commandBuffer, &binder, &kernel, buffers[pair], slots[pair],
+					&elementCount, groupCountX, groupCountY, groupCountZ);
+			}
+			recordNs += GetTimeNs() - recordStart;
+
+			VkMemoryBarrier memoryBarrier = { 0 };
+			memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			memoryBarrier.pNext = NULL;
+			memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+			vkCmdPipelineBarrier(context->commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+				0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+			if (result == VK_SUCCESS) {
+				result = vkEndCommandBuffer(context->commandBuffer);
+			}
+			if (result == VK_SUCCESS) {
+				result = SubmitAndWait(context);
+			}
+			if (result == VK_SUCCESS) {
+				result = ResetDescriptorBinder(&binder);
+			}
+			if (result != VK_SUCCESS) {
+				printf("Failed to run %s binding\n", name);
+				exit(1);
+			}
+		}
+		uint64_t elapsedNs = GetTimeNs() - startTime;
+
+		uint64_t mismatches = 0;
+		for (uint32_t pair = 0; pair < BINDING_BUFFER_PAIRS && pair < dispatchCount; ++pair) {
+			const float* input = buffers[pair][0].mapped;
+			const float* output = buffers[pair][1].mapped;
+			for (uint32_t i = 0; i < JOB_ELEMENTS; ++i) {
+				if (output[i] != input[i] * 2.f) {
+					++mismatches;
+				}
+			}
+		}
+		printf("%-9s %9.1f ns per dispatch recorded, %9.2f us per dispatch wall, %llu mismatches\n", name,
+			(double) recordNs / dispatchCount, elapsedNs / 1000.0 / dispatchCount, (unsigned long long) mismatches);
+
+		DestroyComputeKernel(context, &kernel);
+		DestroyDescriptorBinder(&binder);
 	}
-	puts("Created a Vulkan instance");
+	printf("Preferred descriptor strategy: %s\n", GetDescriptorStrategyName(SelectDescriptorStrategy(context)));
 
-	free(enabledLayers);
+	for (uint32_t pair = 0; pair < BINDING_BUFFER_PAIRS; ++pair) {
+		DestroyComputeBuffer(context, &buffers[pair][0]);
+		DestroyComputeBuffer(context, &buffers[pair][1]);
+	}
+}
 
-	// Query the number of physical devices
-	uint32_t physicalDeviceCount = 0;
-	result = vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, NULL);
-	if (result != VK_SUCCESS) {
-		puts("Failed to enumerate physical devices");
+// Jobs each producer thread keeps in flight, each over its own pair of buffers
+#define PRODUCER_IN_FLIGHT 8
+// Jobs per thread when --threads is given without --jobs
+#define THREADED_JOBS 1024
+
+typedef struct ProducerArgs {
+	ComputeSubmitter* submitter;
+	const ComputeKernel* kernel;
+	ComputeBuffer* buffers;
+	uint32_t jobCount;
+	uint32_t groupCountX;
+	uint32_t groupCountY;
+	uint32_t groupCountZ;
+	VkResult result;
+} ProducerArgs;
+
+static void* ProduceJobs(void* argument) {
+	ProducerArgs* args = argument;
+	SubmitWorker worker;
+	args->result = CreateSubmitWorker(args->submitter, &worker);
+	if (args->result != VK_SUCCESS) {
+		return NULL;
+	}
+
+	uint32_t elementCount = JOB_ELEMENTS;
+	ComputeFuture futures[PRODUCER_IN_FLIGHT] = { 0 };
+	for (uint32_t i = 0; i < args->jobCount && args->result == VK_SUCCESS; ++i) {
+		const uint32_t slot = i % PRODUCER_IN_FLIGHT;
+		if (i >= PRODUCER_IN_FLIGHT) {
+			args->result = WaitComputeFuture(args->submitter, &futures[slot]);
+			if (args->result != VK_SUCCESS) {
+				break;
+			}
+		}
+		args->result = SubmitComputeKernelAsync(&worker, args->kernel, &args->buffers[2 * slot], &elementCount,
+			args->groupCountX, args->groupCountY, args->groupCountZ, NULL, NULL, &futures[slot]);
+	}
+
+	// Destroying the worker waits for its remaining jobs
+	DestroySubmitWorker(&worker);
+	for (uint32_t i = 0; i < PRODUCER_IN_FLIGHT && i < args->jobCount && args->result == VK_SUCCESS; ++i) {
+		args->result = futures[i].result;
+	}
+	return NULL;
+}
+
+// Submit jobsPerThread small jobs from 1, 2, 4, ... maxThreads producer threads through one submitter on the
+// compute queue and report jobs per second, to show how submission throughput scales with threads
+static void RunThreadedSubmitBenchmark(ComputeContext* context, const ComputeKernelCreateInfo* kernelInfo,
+	uint32_t maxThreads, uint32_t jobsPerThread) {
+
+	ComputeKernelCreateInfo jobKernelInfo = *kernelInfo;
+	jobKernelInfo.dynamicRange = 0;
+	ComputeKernel kernel = { 0 };
+	uint32_t groupCountX = 0;
+	uint32_t groupCountY = 0;
+	uint32_t groupCountZ = 0;
+	ComputeBuffer* buffers = calloc(2 * PRODUCER_IN_FLIGHT * maxThreads, sizeof(ComputeBuffer));
+	ProducerArgs* args = calloc(maxThreads, sizeof(ProducerArgs));
+	pthread_t* threads = calloc(maxThreads, sizeof(pthread_t));
+	if (buffers == NULL || args == NULL || threads == NULL ||
+		CreateComputeKernel(context, &jobKernelInfo, &kernel) != VK_SUCCESS ||
+		ComputeDispatchSize(context, &kernel, JOB_ELEMENTS, &groupCountX, &groupCountY, &groupCountZ) != VK_SUCCESS) {
+		puts("Failed to set up threaded submission benchmark");
 		exit(1);
 	}
+	// The allocator is not thread-safe, so every thread's buffers are created up front
+	for (uint32_t i = 0; i < 2 * PRODUCER_IN_FLIGHT * maxThreads; ++i) {
+		if (CreateComputeBuffer(context, JOB_ELEMENTS * sizeof(float), BUFFER_LOCATION_HOST, &buffers[i]) != VK_SUCCESS) {
+			puts("Failed to set up threaded submission benchmark");
+			exit(1);
+		}
+	}
 
-	// Get handles to each physical devices
-	VkPhysicalDevice* physicalDevices = malloc(sizeof(VkPhysicalDevice) * physicalDeviceCount);
-	result = vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, physicalDevices);
-	if (result != VK_SUCCESS) {
-		puts("Failed to enumerate physical devices");
+	ComputeSubmitter submitter;
+	if (CreateComputeSubmitter(context, context->computeQueue, context->computeQueueIndex, &submitter) != VK_SUCCESS) {
+		puts("Failed to create submitter");
 		exit(1);
 	}
-	
-	// Get the properties of each physical device
-	puts("Available devices:");
-	for (uint32_t i = 0; i < physicalDeviceCount; ++i) {
-		VkPhysicalDeviceProperties deviceProperties = { 0 };
-		vkGetPhysicalDeviceProperties(physicalDevices[i], &deviceProperties);
-		printf("\tGPU %u: %s\n", i, deviceProperties.deviceName);
-	}
-
-	// Select a discrete GPU
-	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
-	VkPhysicalDeviceProperties physicalDeviceProperties = { 0 };
-	for (uint32_t i = 0; i < physicalDeviceCount; ++i) {
-		vkGetPhysicalDeviceProperties(physicalDevices[i], &physicalDeviceProperties);
-		if (physicalDeviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
-			physicalDevice = physicalDevices[i];
+
+	for (uint32_t threadCount = 1;; threadCount = threadCount * 2 < maxThreads ? threadCount * 2 : maxThreads) {
+		for (uint32_t i = 0; i < 2 * PRODUCER_IN_FLIGHT * threadCount; i += 2) {
+			float* input = buffers[i].mapped;
+			float* output = buffers[i + 1].mapped;
+			for (uint32_t j = 0; j < JOB_ELEMENTS; ++j) {
+				input[j] = (float) (i + j);
+				output[j] = 0.f;
+			}
+		}
+
+		const uint64_t submitCount = submitter.submitCount;
+		const uint64_t startTime = GetTimeNs();
+		for (uint32_t i = 0; i < threadCount; ++i) {
+			args[i].submitter = &submitter;
+			args[i].kernel = &kernel;
+			args[i].buffers = &buffers[2 * PRODUCER_IN_FLIGHT * i];
+			args[i].jobCount = jobsPerThread;
+			args[i].groupCountX = groupCountX;
+			args[i].groupCountY = groupCountY;
+			args[i].groupCountZ = groupCountZ;
+			args[i].result = VK_SUCCESS;
+			if (pthread_create(&threads[i], NULL, ProduceJobs, &args[i]) != 0) {
+				puts("Failed to start producer thread");
+				exit(1);
+			}
+		}
+		VkResult result = VK_SUCCESS;
+		for (uint32_t i = 0; i < threadCount; ++i) {
+			pthread_join(threads[i], NULL);
+			if (args[i].result != VK_SUCCESS) {
+				result = args[i].result;
+			}
+		}
+		const uint64_t elapsedNs = GetTimeNs() - startTime;
+		if (result != VK_SUCCESS) {
+			puts("Failed to run threaded jobs");
+			exit(1);
+		}
+
+		uint64_t mismatches = 0;
+		for (uint32_t i = 0; i < 2 * PRODUCER_IN_FLIGHT * threadCount; i += 2) {
+			const float* input = buffers[i].mapped;
+			const float* output = buffers[i + 1].mapped;
+			for (uint32_t j = 0; j < JOB_ELEMENTS && i / 2 % PRODUCER_IN_FLIGHT < jobsPerThread; ++j) {
+				if (output[j] != input[j] * 2.f) {
+					++mismatches;
+				}
+			}
+		}
+		const uint64_t totalJobs = (uint64_t) threadCount * jobsPerThread;
+		printf("%2u threads: %10.0f jobs/s, %6.1f jobs per submit, %llu mismatches\n", threadCount,
+			totalJobs * 1e9 / elapsedNs, (double) totalJobs / (submitter.submitCount - submitCount),
+			(unsigned long long) mismatches);
+
+		if (threadCount == maxThreads) {
 			break;
 		}
 	}
 
-	// Default to integrated GPU if discrete GPU is not available
-	if (physicalDevice == VK_NULL_HANDLE) {
-		for (uint32_t i = 0; i < physicalDeviceCount; ++i) {
-			VkPhysicalDeviceProperties deviceProperties = { 0 };
-			vkGetPhysicalDeviceProperties(physicalDevices[i], &deviceProperties);
-			if (physicalDeviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU) {
-				physicalDevice = physicalDevices[i];
-				physicalDeviceProperties = deviceProperties;
-				break;
+	DestroyComputeSubmitter(&submitter);
+	for (uint32_t i = 0; i < 2 * PRODUCER_IN_FLIGHT * maxThreads; ++i) {
+		DestroyComputeBuffer(context, &buffers[i]);
+	}
+	DestroyComputeKernel(context, &kernel);
+	free(threads);
+	free(args);
+	free(buffers);
+}
+
+// Dispatches over which the scheduler's throughput estimates converge
+#define SCHEDULE_ROUNDS 5
+
+// Double size bytes of floats split across every compute queue of every GPU, printing how the shares settle
+// as the scheduler measures each queue's throughput
+static void RunScheduleBenchmark(const ComputeKernelCreateInfo* kernelInfo, uint64_t size) {
+	const uint64_t elementCount = size / sizeof(float);
+	float* input = malloc(elementCount * sizeof(float));
+	float* output = malloc(elementCount * sizeof(float));
+	ComputeContext* contexts = calloc(SCHEDULER_MAX_DEVICES, sizeof(ComputeContext));
+	ComputeScheduler* scheduler = calloc(1, sizeof(ComputeScheduler));
+	uint32_t contextCount = 0;
+	if (input == NULL || output == NULL || contexts == NULL || scheduler == NULL ||
+		CreateComputeContexts(contexts, SCHEDULER_MAX_DEVICES, &contextCount) != VK_SUCCESS ||
+		CreateComputeScheduler(contexts, contextCount, kernelInfo, sizeof(float), scheduler) != VK_SUCCESS) {
+		puts("Failed to set up scheduler");
+		exit(1);
+	}
+	printf("Scheduling over %u devices, %u queues\n", scheduler->deviceCount, scheduler->queueCount);
+
+	for (uint64_t i = 0; i < elementCount; ++i) {
+		input[i] = (float) i;
+	}
+	for (uint32_t round = 0; round < SCHEDULE_ROUNDS; ++round) {
+		memset(output, 0, elementCount * sizeof(float));
+		uint64_t startTime = GetTimeNs();
+		if (ScheduleComputeKernel(scheduler, input, output, elementCount) != VK_SUCCESS) {
+			puts("Failed to run scheduled dispatch");
+			exit(1);
+		}
+		uint64_t elapsedNs = GetTimeNs() - startTime;
+
+		uint64_t mismatches = 0;
+		for (uint64_t i = 0; i < elementCount; ++i) {
+			if (output[i] != input[i] * 2.f) {
+				++mismatches;
 			}
 		}
+		printf("Round %u: %.3f ms, %.2f GB/s, %llu mismatches\n", round, NsToMs(elapsedNs),
+			2.0 * size / elapsedNs, (unsigned long long) mismatches);
 	}
 
-	free(physicalDevices);
+	for (uint32_t i = 0; i < scheduler->queueCount; ++i) {
+		const ScheduledQueue* queue = &scheduler->queues[i];
+		printf("\tdevice %u queue %2u: %5.1f%% of elements, %.3f ms, %.2f Gelements/s\n", queue->deviceIndex,
+			queue->queueIndex, 100.0 * queue->elementCount / elementCount, NsToMs(queue->elapsedNs), queue->throughput / 1e9);
+	}
+
+	DestroyComputeScheduler(scheduler);
+	DestroyComputeContexts(contexts, contextCount);
+	free(scheduler);
+	free(contexts);
+	free(input);
+	free(output);
+}
+
+// Elements per buffer of the graph demo and the number of times the graph is submitted
+#define GRAPH_ELEMENTS (1u << 20)
+#define GRAPH_RUNS 10
+
+// Build a small diamond: two independent dispatches read the same input, then one doubles its result again
+// while the other's result is copied. Both branches can run on separate queues.
+static void RunGraphDemo(ComputeContext* context, ComputeKernel* kernel) {
+	enum { INPUT, A, B, C, D, GRAPH_BUFFER_COUNT };
+	ComputeBuffer buffers[GRAPH_BUFFER_COUNT] = { 0 };
+	for (uint32_t i = 0; i < GRAPH_BUFFER_COUNT; ++i) {
+		if (CreateComputeBuffer(context, GRAPH_ELEMENTS * sizeof(float), BUFFER_LOCATION_HOST, &buffers[i]) != VK_SUCCESS) {
+			puts("Failed to create graph buffers");
+			exit(1);
+		}
+	}
 
-	if (physicalDevice == VK_NULL_HANDLE) {
-		puts("No GPUs found!");
+	uint32_t groupCountX = 0;
+	uint32_t groupCountY = 0;
+	uint32_t groupCountZ = 0;
+	uint32_t elementCount = GRAPH_ELEMENTS;
+	ComputeGraph graph;
+	if (ComputeDispatchSize(context, kernel, GRAPH_ELEMENTS, &groupCountX, &groupCountY, &groupCountZ) != VK_SUCCESS ||
+		CreateComputeGraph(context, &graph) != VK_SUCCESS) {
+		puts("Failed to set up graph");
 		exit(1);
 	}
-	else if (physicalDeviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
-		printf("Selected discrete GPU: %s\n", physicalDeviceProperties.deviceName);
+
+	const GraphAccess access[2] = { GRAPH_ACCESS_READ, GRAPH_ACCESS_WRITE };
+	const ComputeBuffer inputToA[2] = { buffers[INPUT], buffers[A] };
+	const ComputeBuffer inputToB[2] = { buffers[INPUT], buffers[B] };
+	const ComputeBuffer aToC[2] = { buffers[A], buffers[C] };
+	if (AddGraphDispatch(&graph, kernel, inputToA, access, &elementCount, groupCountX, groupCountY, groupCountZ) == UINT32_MAX ||
+		AddGraphDispatch(&graph, kernel, inputToB, access, &elementCount, groupCountX, groupCountY, groupCountZ) == UINT32_MAX ||
+		AddGraphDispatch(&graph, kernel, aToC, access, &elementCount, groupCountX, groupCountY, groupCountZ) == UINT32_MAX ||
+		AddGraphCopy(&graph, &buffers[B], &buffers[D], GRAPH_ELEMENTS * sizeof(float)) == UINT32_MAX ||
+		BuildComputeGraph(&graph) != VK_SUCCESS) {
+		puts("Failed to build graph");
+		exit(1);
 	}
-	else {
-		printf("Selected integrated GPU: %s\n", physicalDeviceProperties.deviceName);
+	printf("Graph: %u tasks on %u lanes, %u segments, %u barriers, %u semaphore waits\n", graph.taskCount,
+		graph.laneCount, graph.segmentCount, graph.barrierCount, graph.semaphoreWaitCount);
+
+	float* input = buffers[INPUT].mapped;
+	for (uint32_t i = 0; i < GRAPH_ELEMENTS; ++i) {
+		input[i] = (float) i;
 	}
 
-	// Query the number of queue families available for this device
-	uint32_t queueFamilyCount = 0;
-	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, NULL);
-	
-	// Get the properties of all available queue families
-	VkQueueFamilyProperties* queueFamilyProperties = malloc(sizeof(VkQueueFamilyProperties) * queueFamilyCount);
-	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilyProperties);
-	
-	// Select find queue families that are capable of compute and transfers
-	uint32_t computeQueueIndex = 0;
-	uint32_t transferQueueIndex = 0;
-	for (uint32_t i = 0; i < queueFamilyCount; ++i) {
-		if (queueFamilyProperties[i].queueFlags & VK_QUEUE_COMPUTE_BIT) {
-			computeQueueIndex = i;
+	uint64_t startTime = GetTimeNs();
+	for (uint32_t run = 0; run < GRAPH_RUNS; ++run) {
+		if (SubmitComputeGraph(&graph) != VK_SUCCESS || WaitComputeGraph(&graph) != VK_SUCCESS) {
+			puts("Failed to run graph");
+			exit(1);
 		}
 	}
-	for (uint32_t i = 0; i < queueFamilyCount; ++i) {
-		if (queueFamilyProperties[i].queueFlags & VK_QUEUE_TRANSFER_BIT) {
-			transferQueueIndex = i;
+	uint64_t elapsedNs = GetTimeNs() - startTime;
+
+	const float* c = buffers[C].mapped;
+	const float* d = buffers[D].mapped;
+	uint64_t mismatches = 0;
+	for (uint32_t i = 0; i < GRAPH_ELEMENTS; ++i) {
+		if (c[i] != input[i] * 4.f || d[i] != input[i] * 2.f) {
+			++mismatches;
 		}
 	}
+	printf("Graph: %.3f ms per run, %llu mismatches\n", NsToMs(elapsedNs) / GRAPH_RUNS, (unsigned long long) mismatches);
+
+	DestroyComputeGraph(&graph);
+	for (uint32_t i = 0; i < GRAPH_BUFFER_COUNT; ++i) {
+		DestroyComputeBuffer(context, &buffers[i]);
+	}
+}
 
-	free(queueFamilyProperties);
+// Kernels of --kernels get their pipelines created by this many threads while the rest of startup goes on
+#define STARTUP_PIPELINE_THREADS 4
 
-	printf("Using queue family %u for compute\n", computeQueueIndex);
-	printf("Using queue family %u for transfers\n", transferQueueIndex);
+// Register every kernel in directory and start creating their pipelines in the background
+static void StartKernelRegistry(ComputeContext* context, const char* directory, KernelRegistry* registry,
+	StartupTrace* trace) {
 
-	// When we create the logical device, we need to tell it how many queues to create from each queue family
-	uint32_t queueCount = 0;
-	if (computeQueueIndex == transferQueueIndex) {
-		queueCount = 1;
-	}
-	else {
-		queueCount = 2;
-	}
-
-	uint32_t queueFamilyIndices[2] = { computeQueueIndex, transferQueueIndex };
-	float queuePriorities[] = { 1.f };
-	VkDeviceQueueCreateInfo queueCreateInfo[2] = { 0 };
-	for (uint32_t i = 0; i < queueCount; ++i) {
-		queueCreateInfo[i].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-		queueCreateInfo[i].pNext = NULL;
-		queueCreateInfo[i].flags = 0;
-		queueCreateInfo[i].queueFamilyIndex = queueFamilyIndices[i];
-		queueCreateInfo[i].queueCount = 1;
-		queueCreateInfo[i].pQueuePriorities = queuePriorities;
-	}
-
-	// Create the logical device
-	VkDeviceCreateInfo deviceCreateInfo = { 0 };
-	deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-	deviceCreateInfo.pNext = NULL;
-	deviceCreateInfo.flags = 0;
-	deviceCreateInfo.queueCreateInfoCount = queueCount;
-	deviceCreateInfo.pQueueCreateInfos = queueCreateInfo;
-	deviceCreateInfo.enabledLayerCount = 0;
-	deviceCreateInfo.ppEnabledLayerNames = NULL;
-	deviceCreateInfo.enabledExtensionCount = 0;
-	deviceCreateInfo.ppEnabledExtensionNames = NULL;
-	deviceCreateInfo.pEnabledFeatures = NULL;
-
-	VkDevice device = VK_NULL_HANDLE;
-	result = vkCreateDevice(physicalDevice, &deviceCreateInfo, NULL, &device);
-	if (result != VK_SUCCESS) {
-		puts("Failed to create a logical device!");
+	uint32_t registeredCount = 0;
+	uint64_t startTime = GetTimeNs();
+	if (CreateKernelRegistry(context, registry) != VK_SUCCESS ||
+		RegisterKernelDirectory(registry, directory, &registeredCount) != VK_SUCCESS) {
+		puts("Failed to register kernels");
 		exit(1);
 	}
+	AddStartupPhase(trace, "register_kernels", 0, startTime, GetTimeNs());
+	printf("Registered %u kernels from %s\n", registeredCount, directory);
+	if (StartRegisteredKernels(registry, STARTUP_PIPELINE_THREADS, trace) != VK_SUCCESS) {
+		puts("Failed to start creating pipelines, creating them on first use");
+	}
+}
+
+// Print the interface reflected from the SPIR-V of every registered kernel, and when its pipeline was ready
+static void RunKernelRegistry(KernelRegistry* registry, const StartupTrace* trace) {
+	for (uint32_t i = 0; i < registry->kernelCount; ++i) {
+		RegisteredKernel* entry = &registry->kernels[i];
+		if (GetRegisteredKernel(registry, entry->name) == NULL) {
+			continue;
+		}
+		printf("%-16s %u storage buffers, %3u bytes of push constants, local size %u%s, created in %.3f ms, ready at %.3f ms\n",
+			entry->name, entry->reflection.bindingCount, entry->reflection.pushConstantSize, entry->localSizeX,
+			entry->reflection.localSizeXSpecId == REFLECT_NO_SPEC_ID ? " (fixed)" : "", NsToMs(entry->createNs),
+			NsToMs(entry->readyNs - trace->originNs));
+	}
+
+	DestroyKernelRegistry(registry);
+}
+
+#define IMPORT_RUNS 10
+
+// Double size bytes of floats in place of host memory: once imported as buffers the GPU reads and writes
+// directly, once copied into and out of host buffers. With a file, its contents are the input.
+static void RunImportBenchmark(ComputeContext* context, ComputeKernel* kernel, VkDeviceSize size, const char* filename) {
+	HostFileMapping mapping = { 0 };
+	float* input = NULL;
+	VkDeviceSize importSize = 0;
+	if (filename != NULL) {
+		if (MapHostFile(context, filename, &mapping) != VK_SUCCESS) {
+			exit(1);
+		}
+		input = mapping.data;
+		importSize = mapping.size;
+		size = mapping.fileSize / sizeof(float) * sizeof(float);
+	}
 	else {
-		puts("Created a logical device");
+		input = AllocateImportableMemory(context, size, &importSize);
+		if (input == NULL) {
+			puts("Failed to allocate import memory");
+			exit(1);
+		}
+		for (uint64_t i = 0; i < size / sizeof(float); ++i) {
+			input[i] = (float) i;
+		}
+	}
+	VkDeviceSize outputSize = 0;
+	float* output = AllocateImportableMemory(context, importSize, &outputSize);
+	const uint64_t numElements = size / sizeof(float);
+	uint32_t elementCount = (uint32_t) numElements;
+	uint32_t groupCountX = 0;
+	uint32_t groupCountY = 0;
+	uint32_t groupCountZ = 0;
+	if (output == NULL || numElements == 0 || numElements > UINT32_MAX ||
+		ComputeDispatchSize(context, kernel, numElements, &groupCountX, &groupCountY, &groupCountZ) != VK_SUCCESS) {
+		puts("Failed to set up import benchmark");
+		exit(1);
 	}
 
-	VkQueue computeQueue = VK_NULL_HANDLE;
-	VkQueue transferQueue = VK_NULL_HANDLE;
-	vkGetDeviceQueue(device, computeQueueIndex, 0, &computeQueue);
-	vkGetDeviceQueue(device, transferQueueIndex, 0, &transferQueue);
- 
-	// Create buffers
-	const uint64_t numElements = 256;
-	const uint64_t bufferSize = numElements * sizeof(float);
-	VkBufferCreateInfo bufferCreateInfo = { 0 };
-	bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	bufferCreateInfo.pNext = NULL;
-	bufferCreateInfo.flags = 0;
-	bufferCreateInfo.size = bufferSize;
-	bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
-	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	bufferCreateInfo.queueFamilyIndexCount = 1;
-	bufferCreateInfo.pQueueFamilyIndices = &computeQueueIndex;
-	
-	VkBuffer inputBuffer = VK_NULL_HANDLE;
-	VkBuffer outputBuffer = VK_NULL_HANDLE;
-
-	result = vkCreateBuffer(device, &bufferCreateInfo, NULL, &inputBuffer);
-	if (result != VK_SUCCESS) {
-		puts("Failed to create input buffer");
+	// Imported: creating the buffers is the whole upload, and results land in output
+	uint64_t startTime = GetTimeNs();
+	ComputeBuffer imported[2] = { 0 };
+	if (CreateHostPointerBuffer(context, input, importSize, &imported[0]) != VK_SUCCESS ||
+		CreateHostPointerBuffer(context, output, outputSize, &imported[1]) != VK_SUCCESS) {
+		puts("Failed to create import buffers");
 		exit(1);
 	}
-	result = vkCreateBuffer(device, &bufferCreateInfo, NULL, &outputBuffer);
-	if (result != VK_SUCCESS) {
-		puts("Failed to create input buffer");
+	uint64_t setupNs = GetTimeNs() - startTime;
+	startTime = GetTimeNs();
+	for (uint32_t run = 0; run < IMPORT_RUNS; ++run) {
+		if (DispatchComputeKernel(context, kernel, imported, &elementCount, groupCountX, groupCountY, groupCountZ) != VK_SUCCESS) {
+			puts("Failed to dispatch kernel");
+			exit(1);
+		}
+		// A fallback buffer is a copy, so its results still have to be copied out
+		if (!imported[1].imported) {
+			memcpy(output, imported[1].mapped, size);
+		}
+	}
+	uint64_t importNs = GetTimeNs() - startTime;
+	uint64_t mismatches = 0;
+	for (uint64_t i = 0; i < numElements; ++i) {
+		if (output[i] != input[i] * 2.f) {
+			++mismatches;
+		}
+	}
+	printf("Import: %s input, %s output, set up in %.3f ms, %.3f ms per run, %llu mismatches\n",
+		imported[0].imported ? "imported" : "copied", imported[1].imported ? "imported" : "copied",
+		NsToMs(setupNs), NsToMs(importNs) / IMPORT_RUNS, (unsigned long long) mismatches);
+	DestroyComputeBuffer(context, &imported[0]);
+	DestroyComputeBuffer(context, &imported[1]);
+
+	// Copied: the same work through host buffers the library allocates
+	ComputeBuffer copied[2] = { 0 };
+	startTime = GetTimeNs();
+	if (CreateComputeBuffer(context, size, BUFFER_LOCATION_HOST, &copied[0]) != VK_SUCCESS ||
+		CreateComputeBuffer(context, size, BUFFER_LOCATION_HOST, &copied[1]) != VK_SUCCESS) {
+		puts("Failed to create copy buffers");
 		exit(1);
 	}
-	printf("Created input and output buffers of size %lu\n", bufferSize);
-
-	// Select a memory heap to allocate from
-	VkMemoryRequirements inputBufferMemoryRequirements = { 0 };
-	VkMemoryRequirements outputBufferMemoryRequirements = { 0 };
-	vkGetBufferMemoryRequirements(device, inputBuffer, &inputBufferMemoryRequirements);
-	vkGetBufferMemoryRequirements(device, outputBuffer, &outputBufferMemoryRequirements);
-
-	VkPhysicalDeviceMemoryProperties deviceMemoryProperties = { 0 };
-	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &deviceMemoryProperties);
-	
-	uint32_t memoryTypeIndex = 0;
-	uint64_t memoryHeapSize = 0;
-	for (uint32_t i = 0; i < deviceMemoryProperties.memoryTypeCount; ++i) {
-		VkMemoryType memoryType = deviceMemoryProperties.memoryTypes[i];
-		if (memoryType.propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT &&
-			memoryType.propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) {
-			
-			memoryTypeIndex = i;
-			memoryHeapSize = deviceMemoryProperties.memoryHeaps[memoryType.heapIndex].size;
-			break;
+	setupNs = GetTimeNs() - startTime;
+	startTime = GetTimeNs();
+	for (uint32_t run = 0; run < IMPORT_RUNS; ++run) {
+		memcpy(copied[0].mapped, input, size);
+		if (DispatchComputeKernel(context, kernel, copied, &elementCount, groupCountX, groupCountY, groupCountZ) != VK_SUCCESS) {
+			puts("Failed to dispatch kernel");
+			exit(1);
 		}
+		memcpy(output, copied[1].mapped, size);
 	}
-	printf("Selected memory heap %u (%lu bytes)\n", memoryTypeIndex, memoryHeapSize);
+	uint64_t copyNs = GetTimeNs() - startTime;
+	printf("Copy:   set up in %.3f ms, %.3f ms per run (%.2fx the import time)\n", NsToMs(setupNs),
+		NsToMs(copyNs) / IMPORT_RUNS, importNs > 0 ? (double) copyNs / importNs : 0.0);
+	DestroyComputeBuffer(context, &copied[0]);
+	DestroyComputeBuffer(context, &copied[1]);
+
+	FreeImportableMemory(output);
+	if (filename != NULL) {
+		UnmapHostFile(&mapping);
+	}
+	else {
+		FreeImportableMemory(input);
+	}
+}
 
-	// Allocate memory for each buffer
-	VkMemoryAllocateInfo inputBufferMemoryAllocateInfo = { 0 };
-	VkMemoryAllocateInfo outputBufferMemoryAllocateInfo = { 0 };
+#define READBACK_ROUNDS 5
 
-	inputBufferMemoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	inputBufferMemoryAllocateInfo.pNext = NULL;
-	inputBufferMemoryAllocateInfo.memoryTypeIndex = memoryTypeIndex;
-	inputBufferMemoryAllocateInfo.allocationSize = inputBufferMemoryRequirements.size;
+// Host read throughput of size bytes, summing them as 64-bit words so the reads cannot be optimised away
+static double ReadHostMemory(const void* data, VkDeviceSize size, uint64_t* sum) {
+	const uint64_t* words = data;
+	uint64_t total = 0;
+	uint64_t startTime = GetTimeNs();
+	for (VkDeviceSize i = 0; i < size / sizeof(uint64_t); ++i) {
+		total += words[i];
+	}
+	uint64_t elapsedNs = GetTimeNs() - startTime;
+	*sum += total;
+	return elapsedNs > 0 ? (double) size / (double) elapsedNs : 0.0;
+}
 
-	outputBufferMemoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	outputBufferMemoryAllocateInfo.pNext = NULL;
-	outputBufferMemoryAllocateInfo.memoryTypeIndex = memoryTypeIndex;
-	outputBufferMemoryAllocateInfo.allocationSize = outputBufferMemoryRequirements.size;
+// For every host visible memory type, have the device fill a buffer and time the invalidate and the host reading
+// it back, whole and as one dirty sixteenth
+static void RunReadbackBenchmark(ComputeContext* context, VkDeviceSize size) {
+	size = size / 64 * 64;
+	const uint32_t selected = SelectMemoryTypeIndex(&context->memoryProperties, UINT32_MAX, MEMORY_USAGE_READBACK);
+	printf("%-6s %-28s %5s %13s %12s %13s %12s\n", "Type", "Flags", "Score",
+		"Invalidate ms", "Read GB/s", "Partial inv ms", "Partial GB/s");
+	uint64_t sum = 0;
+	for (uint32_t i = 0; i < context->memoryProperties.memoryTypeCount; ++i) {
+		const VkMemoryPropertyFlags flags = context->memoryProperties.memoryTypes[i].propertyFlags;
+		if (!(flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) || ScoreMemoryType(flags, MEMORY_USAGE_READBACK) < 0) {
+			continue;
+		}
+		ComputeBuffer buffer = { 0 };
+		if (CreateComputeBufferOfType(context, size, i, &buffer) != VK_SUCCESS) {
+			printf("%-6u skipped, storage buffers cannot use it or it is full\n", i);
+			continue;
+		}
 
-	VkDeviceMemory inputBufferMemory = VK_NULL_HANDLE;
-	VkDeviceMemory outputBufferMemory = VK_NULL_HANDLE;
+		char flagNames[64];
+		snprintf(flagNames, sizeof(flagNames), "%s%s%s%s",
+			(flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) ? "device " : "",
+			"visible ",
+			(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) ? "coherent " : "",
+			(flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) ? "cached" : "");
+
+		uint64_t invalidateNs = 0;
+		uint64_t partialInvalidateNs = 0;
+		double readGBs = 0.0;
+		double partialGBs = 0.0;
+		const VkDeviceSize partialSize = size / 16;
+		for (uint32_t round = 0; round < READBACK_ROUNDS; ++round) {
+			// A device write each round, so cached lines are really stale and reads miss
+			if (BeginComputeCommandBuffer(context) != VK_SUCCESS) {
+				puts("Failed to begin recording command buffer");
+				exit(1);
+			}
+			vkCmdFillBuffer(context->commandBuffer, buffer.buffer, 0, size, round);
+			VkMemoryBarrier memoryBarrier = { 0 };
+			memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			memoryBarrier.pNext = NULL;
+			memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+			vkCmdPipelineBarrier(context->commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+				0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+			if (vkEndCommandBuffer(context->commandBuffer) != VK_SUCCESS || SubmitAndWait(context) != VK_SUCCESS) {
+				puts("Failed to fill readback buffer");
+				exit(1);
+			}
 
-	result = vkAllocateMemory(device, &inputBufferMemoryAllocateInfo, NULL, &inputBufferMemory);
-	if (result != VK_SUCCESS) {
-		puts("Failed to allocate memory for input buffer");
-		exit(1);
+			// Only the sixteenth the host reads is invalidated, as a caller that knows its dirty range would
+			uint64_t startTime = GetTimeNs();
+			InvalidateComputeBuffer(context, &buffer, size - partialSize, partialSize);
+			partialInvalidateNs += GetTimeNs() - startTime;
+			partialGBs += ReadHostMemory((const char*) buffer.mapped + size - partialSize, partialSize, &sum);
+
+			startTime = GetTimeNs();
+			InvalidateComputeBuffer(context, &buffer, 0, VK_WHOLE_SIZE);
+			invalidateNs += GetTimeNs() - startTime;
+			readGBs += ReadHostMemory(buffer.mapped, size, &sum);
+		}
+		printf("%-6u %-28s %5d %13.3f %12.2f %13.3f %12.2f%s\n", i, flagNames, ScoreMemoryType(flags, MEMORY_USAGE_READBACK),
+			NsToMs(invalidateNs) / READBACK_ROUNDS, readGBs / READBACK_ROUNDS,
+			NsToMs(partialInvalidateNs) / READBACK_ROUNDS, partialGBs / READBACK_ROUNDS,
+			i == selected ? " (selected)" : "");
+		DestroyComputeBuffer(context, &buffer);
 	}
-	result = vkAllocateMemory(device, &outputBufferMemoryAllocateInfo, NULL, &outputBufferMemory);
-	if (result != VK_SUCCESS) {
-		puts("Failed to allocate memory for output buffer");
+	printf("Readback checksum %llu\n", (unsigned long long) sum);
+}
+
+#define HOST_COPY_ROUNDS 3
+
+// Best throughput of size bytes moved between host memory and a mapping of memory with flags. A NULL copier
+// times plain memcpy; fill writes a constant to the mapping instead of copying host.
+static double TimeHostCopy(HostCopier* copier, int toMapped, int fill, void* mapped, void* host, size_t size,
+	VkMemoryPropertyFlags flags) {
+
+	uint64_t bestNs = UINT64_MAX;
+	for (uint32_t round = 0; round < HOST_COPY_ROUNDS; ++round) {
+		const uint64_t startTime = GetTimeNs();
+		if (fill) {
+			FillMappedMemory(copier, mapped, round, size, flags);
+		}
+		else if (copier == NULL) {
+			memcpy(toMapped ? mapped : host, toMapped ? host : mapped, size);
+		}
+		else if (toMapped) {
+			CopyToMappedMemory(copier, mapped, host, size, flags);
+		}
+		else {
+			CopyFromMappedMemory(copier, host, mapped, size, flags);
+		}
+		const uint64_t elapsedNs = GetTimeNs() - startTime;
+		bestNs = elapsedNs < bestNs ? elapsedNs : bestNs;
+	}
+	return bestNs > 0 ? (double) size / bestNs : 0.0;
+}
+
+// For every host visible memory type, time the host writing and reading a mapped buffer with memcpy and with the
+// host copy helpers: on one thread to see the effect of streaming stores alone, and on every thread
+static void RunHostCopyBenchmark(ComputeContext* context, VkDeviceSize size) {
+	size = size / 64 * 64;
+	char* source = malloc(size);
+	char* destination = malloc(size);
+	if (size == 0 || source == NULL || destination == NULL) {
+		puts("Failed to allocate host copy buffers");
 		exit(1);
 	}
+	for (VkDeviceSize i = 0; i < size; ++i) {
+		source[i] = (char) (i * 7);
+	}
+	HostCopier singleThread = { 0 };
+	CreateHostCopier(&singleThread, 1);
+	HostCopier* copier = &context->hostCopier;
+	printf("Host copies of %llu bytes, helpers on up to %u threads, streaming stores %s, streaming loads %s\n",
+		(unsigned long long) size, copier->threadCount, copier->streamingStores ? "yes" : "no",
+		copier->streamingLoads ? "yes" : "no");
+	printf("%-6s %-28s %3s %11s %11s %11s %11s %11s %11s %8s\n", "Type", "Flags", "WC", "memcpy W", "1 thread W",
+		"Write GB/s", "Fill GB/s", "memcpy R", "Read GB/s", "Checked");
+	for (uint32_t i = 0; i < context->memoryProperties.memoryTypeCount; ++i) {
+		const VkMemoryPropertyFlags flags = context->memoryProperties.memoryTypes[i].propertyFlags;
+		if (!(flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) {
+			continue;
+		}
+		ComputeBuffer buffer = { 0 };
+		if (CreateComputeBufferOfType(context, size, i, &buffer) != VK_SUCCESS) {
+			printf("%-6u skipped, storage buffers cannot use it or it is full\n", i);
+			continue;
+		}
 
-	// Get pointers mapped to device memory
-	float* inputBufferMappedPtr = NULL;
-	float* outputBufferMappedPtr = NULL;
-	result = vkMapMemory(device, inputBufferMemory, 0, bufferSize, 0, (void**) &inputBufferMappedPtr);
-	if (result != VK_SUCCESS) {
-		puts("Failed to map input buffer memory");
+		char flagNames[64];
+		snprintf(flagNames, sizeof(flagNames), "%s%s%s%s",
+			(flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) ? "device " : "",
+			"visible ",
+			(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) ? "coherent " : "",
+			(flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) ? "cached" : "");
+
+		const double memcpyWriteGBs = TimeHostCopy(NULL, 1, 0, buffer.mapped, source, size, flags);
+		const double singleWriteGBs = TimeHostCopy(&singleThread, 1, 0, buffer.mapped, source, size, flags);
+		const double fillGBs = TimeHostCopy(copier, 1, 1, buffer.mapped, source, size, flags);
+		const double writeGBs = TimeHostCopy(copier, 1, 0, buffer.mapped, source, size, flags);
+		const double memcpyReadGBs = TimeHostCopy(NULL, 0, 0, buffer.mapped, destination, size, flags);
+		memset(destination, 0, size);
+		const double readGBs = TimeHostCopy(copier, 0, 0, buffer.mapped, destination, size, flags);
+		const int matched = memcmp(source, destination, size) == 0;
+		printf("%-6u %-28s %3s %11.2f %11.2f %11.2f %11.2f %11.2f %11.2f %8s\n", i, flagNames,
+			IsWriteCombinedMemory(flags) ? "yes" : "no", memcpyWriteGBs, singleWriteGBs, writeGBs, fillGBs,
+			memcpyReadGBs, readGBs, matched ? "ok" : "MISMATCH");
+		DestroyComputeBuffer(context, &buffer);
+	}
+
+	DestroyHostCopier(&singleThread);
+	free(source);
+	free(destination);
+}
+
+#define PRIMITIVE_ROUNDS 5
+
+// Reduce, argmax and scan on the device against single threaded loops on the host. Sums are accumulated in a
+// different order, so only they may differ slightly; the inputs are small whole numbers to keep that rare.
+static void RunPrimitivesBenchmark(ComputeContext* context, VkDeviceSize size) {
+	const uint64_t count = size / sizeof(float);
+	ComputePrimitives primitives = { 0 };
+	ComputeBuffer values = { 0 };
+	ComputeBuffer counts = { 0 };
+	if (count == 0 || count > UINT32_MAX) {
+		puts("Primitives benchmark needs 1 to 2^32 - 1 elements");
 		exit(1);
 	}
-	result = vkMapMemory(device, outputBufferMemory, 0, bufferSize, 0, (void**) &outputBufferMappedPtr);
-	if (result != VK_SUCCESS) {
-		puts("Failed to map output buffer memory");
+	if (CreateComputePrimitives(context, &primitives) != VK_SUCCESS ||
+		CreateComputeBuffer(context, count * sizeof(float), BUFFER_LOCATION_HOST, &values) != VK_SUCCESS ||
+		CreateComputeBuffer(context, count * sizeof(uint32_t), BUFFER_LOCATION_HOST, &counts) != VK_SUCCESS) {
+		puts("Failed to set up primitives");
 		exit(1);
 	}
-
-	// Bind memory to buffers
-	result = vkBindBufferMemory(device, inputBuffer, inputBufferMemory, 0);
-	if (result != VK_SUCCESS) {
-		puts("Failed to bind memory to input buffer");
+	printf("Primitives over %llu elements, %s, block of %u elements\n", (unsigned long long) count,
+		primitives.subgroups ? "subgroup arithmetic" : "shared memory trees", primitives.blockSize);
+
+	float* valueData = values.mapped;
+	uint32_t* countData = counts.mapped;
+	uint32_t* expectedScan = malloc(count * sizeof(uint32_t));
+	if (expectedScan == NULL) {
+		puts("Failed to allocate host memory");
 		exit(1);
 	}
-	result = vkBindBufferMemory(device, outputBuffer, outputBufferMemory, 0);
-	if (result != VK_SUCCESS) {
-		puts("Failed to bind memory to output buffer");
+	for (uint64_t i = 0; i < count; ++i) {
+		valueData[i] = (float) ((i * 7919) % 1021) - 510.f;
+	}
+
+	// Host baselines
+	uint64_t startTime = GetTimeNs();
+	float expectedSum = 0.f;
+	for (uint64_t i = 0; i < count; ++i) {
+		expectedSum += valueData[i];
+	}
+	const uint64_t cpuSumNs = GetTimeNs() - startTime;
+	startTime = GetTimeNs();
+	uint32_t expectedIndex = 0;
+	for (uint64_t i = 1; i < count; ++i) {
+		if (valueData[i] > valueData[expectedIndex]) {
+			expectedIndex = (uint32_t) i;
+		}
+	}
+	const uint64_t cpuArgmaxNs = GetTimeNs() - startTime;
+	for (uint64_t i = 0; i < count; ++i) {
+		countData[i] = (uint32_t) (i % 3);
+	}
+	startTime = GetTimeNs();
+	uint32_t expectedTotal = 0;
+	for (uint64_t i = 0; i < count; ++i) {
+		expectedScan[i] = expectedTotal;
+		expectedTotal += countData[i];
+	}
+	const uint64_t cpuScanNs = GetTimeNs() - startTime;
+
+	// Each device time includes recording, submitting and waiting for every pass
+	float sum = 0.f;
+	float maxValue = 0.f;
+	uint32_t index = 0;
+	uint32_t total = 0;
+	uint64_t sumNs = 0;
+	uint64_t argmaxNs = 0;
+	uint64_t scanNs = 0;
+	uint64_t scanMismatches = 0;
+	for (uint32_t round = 0; round < PRIMITIVE_ROUNDS; ++round) {
+		startTime = GetTimeNs();
+		VkResult result = ReduceComputeBuffer(&primitives, &values, count, REDUCE_OP_SUM, &sum);
+		sumNs += GetTimeNs() - startTime;
+		if (result == VK_SUCCESS) {
+			startTime = GetTimeNs();
+			result = ArgmaxComputeBuffer(&primitives, &values, count, &index, &maxValue);
+			argmaxNs += GetTimeNs() - startTime;
+		}
+		if (result == VK_SUCCESS) {
+			// In place, so the input is written again every round
+			for (uint64_t i = 0; i < count; ++i) {
+				countData[i] = (uint32_t) (i % 3);
+			}
+			startTime = GetTimeNs();
+			result = ScanComputeBuffer(&primitives, &counts, &counts, count, &total);
+			scanNs += GetTimeNs() - startTime;
+		}
+		if (result != VK_SUCCESS) {
+			puts("Failed to run primitives");
+			exit(1);
+		}
+	}
+	for (uint64_t i = 0; i < count; ++i) {
+		if (countData[i] != expectedScan[i]) {
+			++scanMismatches;
+		}
+	}
+
+	const double gigabytes = (double) size / 1e9;
+	printf("%-7s %12s %10s %12s %10s  %s\n", "", "Device ms", "GB/s", "Host ms", "GB/s", "Result");
+	printf("%-7s %12.3f %10.2f %12.3f %10.2f  %g, host %g\n", "sum",
+		NsToMs(sumNs) / PRIMITIVE_ROUNDS, gigabytes * PRIMITIVE_ROUNDS * 1e9 / sumNs,
+		NsToMs(cpuSumNs), gigabytes * 1e9 / cpuSumNs, sum, expectedSum);
+	printf("%-7s %12.3f %10.2f %12.3f %10.2f  %u (%g), host %u (%g)\n", "argmax",
+		NsToMs(argmaxNs) / PRIMITIVE_ROUNDS, gigabytes * PRIMITIVE_ROUNDS * 1e9 / argmaxNs,
+		NsToMs(cpuArgmaxNs), gigabytes * 1e9 / cpuArgmaxNs, index, maxValue, expectedIndex, valueData[expectedIndex]);
+	printf("%-7s %12.3f %10.2f %12.3f %10.2f  total %u, host %u, %llu mismatches\n", "scan",
+		NsToMs(scanNs) / PRIMITIVE_ROUNDS, gigabytes * PRIMITIVE_ROUNDS * 1e9 / scanNs,
+		NsToMs(cpuScanNs), gigabytes * 1e9 / cpuScanNs, total, expectedTotal, (unsigned long long) scanMismatches);
+
+	free(expectedScan);
+	DestroyComputeBuffer(context, &values);
+	DestroyComputeBuffer(context, &counts);
+	DestroyComputePrimitives(&primitives);
+}
+
+// Elements of the host buffers the fused and unfused chains are checked over
+#define FUSION_CHECK_ELEMENTS 65536
+
+// The same op as a chain of its own, reading the running value from input 0 and any other input from input 1
+static void GetUnfusedOp(const FusedOp* op, FusedExpression* single) {
+	const int usesInput = op->type == FUSED_OP_ADD_INPUT || op->type == FUSED_OP_MUL_INPUT;
+	InitFusedExpression(single, usesInput ? 2 : 1);
+	AddFusedOp(single, op->type, 1, op->a, op->b);
+}
+
+// Time a chain of elementwise ops as one generated kernel against one kernel per op. Every op of the unfused
+// chain reads and writes the whole intermediate buffer, so it moves several times the bytes of the fused one.
+static void RunFusionBenchmark(ComputeContext* context, VkDeviceSize size) {
+	const uint64_t elementCount = size / sizeof(float);
+	FusionCache cache = { 0 };
+	if (elementCount == 0 || elementCount > UINT32_MAX || CreateFusionCache(context, 0, &cache) != VK_SUCCESS) {
+		puts("Failed to set up fusion benchmark");
 		exit(1);
 	}
 
-	// Load shader
-	const char* shaderFile = "shaders/double.spv";
-	VkShaderModule shaderModule = VK_NULL_HANDLE;
-	result = LoadShader(device, shaderFile, &shaderModule);
-	if (result != VK_SUCCESS) {
-		printf("Failed to load shader from file %s\n", shaderFile);
+	// output = clamp(fma(a * 2 + b, 0.5, 0.25) * b, -100, 100)
+	FusedExpression expression = { 0 };
+	InitFusedExpression(&expression, 2);
+	AddFusedOp(&expression, FUSED_OP_SCALE, 0, 2.f, 0.f);
+	AddFusedOp(&expression, FUSED_OP_ADD_INPUT, 1, 0.f, 0.f);
+	AddFusedOp(&expression, FUSED_OP_FMA, 0, 0.5f, 0.25f);
+	AddFusedOp(&expression, FUSED_OP_MUL_INPUT, 1, 0.f, 0.f);
+	AddFusedOp(&expression, FUSED_OP_CLAMP, 0, -100.f, 100.f);
+	printf("Fused chain:");
+	for (uint32_t i = 0; i < expression.opCount; ++i) {
+		printf(" %s", GetFusedOpName(expression.ops[i].type));
+	}
+	printf(", hash %016llx\n", (unsigned long long) HashFusedExpression(&expression));
+
+	// Check both chains on the host
+	ComputeBuffer checkBuffers[3] = { 0 };
+	for (uint32_t i = 0; i < 3; ++i) {
+		if (CreateComputeBuffer(context, FUSION_CHECK_ELEMENTS * sizeof(float), BUFFER_LOCATION_HOST, &checkBuffers[i]) != VK_SUCCESS) {
+			puts("Failed to create fusion check buffers");
+			exit(1);
+		}
+	}
+	float* a = checkBuffers[0].mapped;
+	float* b = checkBuffers[1].mapped;
+	for (uint32_t i = 0; i < FUSION_CHECK_ELEMENTS; ++i) {
+		a[i] = (float) (i % 1000) * 0.125f - 60.f;
+		b[i] = (float) (i % 7) - 3.f;
+	}
+	const float* inputs[2] = { a, b };
+	uint64_t fusedMismatches = 0;
+	uint64_t unfusedMismatches = 0;
+	for (uint32_t fused = 0; fused < 2; ++fused) {
+		VkResult result = VK_SUCCESS;
+		if (fused) {
+			result = DispatchFusedExpression(&cache, &expression, checkBuffers, &checkBuffers[2], FUSION_CHECK_ELEMENTS);
+		}
+		else {
+			memcpy(checkBuffers[2].mapped, a, FUSION_CHECK_ELEMENTS * sizeof(float));
+			for (uint32_t i = 0; i < expression.opCount && result == VK_SUCCESS; ++i) {
+				FusedExpression single = { 0 };
+				GetUnfusedOp(&expression.ops[i], &single);
+				const ComputeBuffer singleInputs[2] = { checkBuffers[2], checkBuffers[1] };
+				result = DispatchFusedExpression(&cache, &single, singleInputs, &checkBuffers[2], FUSION_CHECK_ELEMENTS);
+			}
+		}
+		if (result != VK_SUCCESS) {
+			puts("Failed to run fused expression");
+			exit(1);
+		}
+		// The device may round fma once instead of twice
+		const float* output = checkBuffers[2].mapped;
+		for (uint32_t i = 0; i < FUSION_CHECK_ELEMENTS; ++i) {
+			const float expected = EvaluateFusedExpression(&expression, inputs, i);
+			float difference = output[i] - expected;
+			difference = difference < 0.f ? -difference : difference;
+			if (difference > 1e-5f * (expected < 0.f ? -expected : expected) + 1e-6f) {
+				if (fused) {
+					++fusedMismatches;
+				}
+				else {
+					++unfusedMismatches;
+				}
+			}
+		}
+	}
+
+	// New parameters reuse the fused pipeline
+	const uint64_t misses = cache.misses;
+	FusedExpression rescaled = expression;
+	rescaled.ops[0].a = 3.f;
+	ComputeKernel* fusedKernel = NULL;
+	if (GetFusedKernel(&cache, &rescaled, &fusedKernel) != VK_SUCCESS) {
 		exit(1);
 	}
-	printf("Loaded shader from file %s\n", shaderFile);
-
-	// Create descriptor set layout
-	VkDescriptorSetLayoutBinding descriptorSetLayoutBindings[2] = { 0 };
-	descriptorSetLayoutBindings[0].binding = 0;
-	descriptorSetLayoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-	descriptorSetLayoutBindings[0].descriptorCount = 1;
-	descriptorSetLayoutBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-	descriptorSetLayoutBindings[0].pImmutableSamplers = NULL;
-	descriptorSetLayoutBindings[1].binding = 1;
-	descriptorSetLayoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-	descriptorSetLayoutBindings[1].descriptorCount = 1;
-	descriptorSetLayoutBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-	descriptorSetLayoutBindings[1].pImmutableSamplers = NULL;
-
-	VkDescriptorSetLayoutCreateInfo descriptorSetLayoutInfo = { 0 };
-	descriptorSetLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	descriptorSetLayoutInfo.pNext = NULL;
-	descriptorSetLayoutInfo.flags = 0;
-	descriptorSetLayoutInfo.bindingCount = 2;
-	descriptorSetLayoutInfo.pBindings = descriptorSetLayoutBindings;
-
-	VkDescriptorSetLayout descriptorSetLayout = { 0 };
-	result = vkCreateDescriptorSetLayout(device, &descriptorSetLayoutInfo, NULL, &descriptorSetLayout);
-	if (result != VK_SUCCESS) {
-		puts("Failed to create descriptor set layout");
+	printf("Generated %u kernels, %llu lookups hit, changing a parameter %s\n", cache.kernelCount,
+		(unsigned long long) cache.hits, cache.misses == misses ? "reused the pipeline" : "generated a new one");
+
+	// Time both chains over device local buffers
+	ComputeBuffer buffers[3] = { 0 };
+	for (uint32_t i = 0; i < 3; ++i) {
+		if (CreateComputeBuffer(context, size, BUFFER_LOCATION_DEVICE, &buffers[i]) != VK_SUCCESS) {
+			puts("Failed to create fusion buffers");
+			exit(1);
+		}
+	}
+	uint32_t pushConstants[1 + FUSED_MAX_PARAMETERS];
+	GetFusedPushConstants(&expression, (uint32_t) elementCount, pushConstants);
+	BandwidthResult fusedResult = { 0 };
+	if (MeasureKernelBandwidth(context, fusedKernel, buffers, elementCount,
+		(expression.inputCount + 1) * sizeof(float), pushConstants, &fusedResult) != VK_SUCCESS) {
+		puts("Failed to time fused kernel");
 		exit(1);
 	}
-	puts("Created descriptor set layout");
+	uint64_t unfusedNs = 0;
+	uint64_t unfusedBytes = 0;
+	for (uint32_t i = 0; i < expression.opCount; ++i) {
+		FusedExpression single = { 0 };
+		GetUnfusedOp(&expression.ops[i], &single);
+		ComputeKernel* kernel = NULL;
+		BandwidthResult singleResult = { 0 };
+		GetFusedPushConstants(&single, (uint32_t) elementCount, pushConstants);
+		// The intermediate buffer is updated in place, with b as the second input of ops that take one
+		const ComputeBuffer twoInputs[3] = { buffers[2], buffers[1], buffers[2] };
+		const ComputeBuffer oneInput[2] = { buffers[2], buffers[2] };
+		if (GetFusedKernel(&cache, &single, &kernel) != VK_SUCCESS ||
+			MeasureKernelBandwidth(context, kernel, single.inputCount == 2 ? twoInputs : oneInput, elementCount,
+				(single.inputCount + 1) * sizeof(float), pushConstants, &singleResult) != VK_SUCCESS) {
+			puts("Failed to time unfused kernel");
+			exit(1);
+		}
+		unfusedNs += singleResult.passNs;
+		unfusedBytes += singleResult.bytesMoved;
+	}
 
-	// Create pipeline layout
-	VkPipelineLayoutCreateInfo pipelineLayoutInfo = { 0 };
-	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.pNext = NULL;
-	pipelineLayoutInfo.flags = 0;
-	pipelineLayoutInfo.setLayoutCount = 1;
-	pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
-	pipelineLayoutInfo.pushConstantRangeCount = 0;
-	pipelineLayoutInfo.pPushConstantRanges = NULL;
+	printf("%-8s %10s %12s %10s %10s\n", "Chain", "ms", "Bytes/elem", "GB/s", "Checked");
+	printf("%-8s %10.3f %12llu %10.2f %10s\n", "fused", NsToMs(fusedResult.passNs),
+		(unsigned long long) (fusedResult.bytesMoved / elementCount), fusedResult.throughputGBs,
+		fusedMismatches == 0 ? "ok" : "MISMATCH");
+	printf("%-8s %10.3f %12llu %10.2f %10s\n", "unfused", NsToMs(unfusedNs),
+		(unsigned long long) (unfusedBytes / elementCount), unfusedNs > 0 ? (double) unfusedBytes / unfusedNs : 0.0,
+		unfusedMismatches == 0 ? "ok" : "MISMATCH");
+	printf("Fusion speedup %.2fx\n", fusedResult.passNs > 0 ? (double) unfusedNs / fusedResult.passNs : 0.0);
+
+	for (uint32_t i = 0; i < 3; ++i) {
+		DestroyComputeBuffer(context, &checkBuffers[i]);
+		DestroyComputeBuffer(context, &buffers[i]);
+	}
+	DestroyFusionCache(&cache);
+}
 
-	VkPipelineLayout pipelineLayout = { 0 };
-	result = vkCreatePipelineLayout(device, &pipelineLayoutInfo, NULL, &pipelineLayout);
-	if (result != VK_SUCCESS) {
-		puts("Failed to create pipeline layout");
+#define PRECISION_CHECK_ELEMENTS 65536
+#define PRECISION_ROUNDS 5
+
+// double.comp and its variants over reduced precision storage, indexed by ElementType
+static const char* const precisionShaderFiles[ELEMENT_TYPE_COUNT] = {
+	"shaders/double.spv",
+	"shaders/double_f16.spv",
+	"shaders/double_bf16.spv",
+	"shaders/double_i8.spv",
+};
+
+// Time the doubling kernel over the same element count stored as each type the device supports. The math stays
+// in fp32, so narrower types only cut the bytes moved, and a memory bound kernel speeds up by about as much.
+static void RunPrecisionBenchmark(ComputeContext* context, const ComputeKernelCreateInfo* kernelInfo, VkDeviceSize size) {
+	const uint64_t elementCount = size / sizeof(float);
+	float* values = malloc(elementCount * sizeof(float));
+	// Holds the converted input, or the expected and actual outputs of the check
+	const uint64_t convertedCount = elementCount > 2 * PRECISION_CHECK_ELEMENTS ? elementCount : 2 * PRECISION_CHECK_ELEMENTS;
+	void* converted = malloc(convertedCount * sizeof(float));
+	if (elementCount == 0 || elementCount > UINT32_MAX || values == NULL || converted == NULL) {
+		puts("Failed to set up precision benchmark");
 		exit(1);
 	}
-	puts("Created pipeline layout");
-
-	// Create the compute pipeline
-	VkPipelineShaderStageCreateInfo pipelineShaderStageInfo = { 0 };
-	pipelineShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	pipelineShaderStageInfo.pNext = NULL;
-	pipelineShaderStageInfo.flags = 0;
-	pipelineShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
-	pipelineShaderStageInfo.module = shaderModule;
-	pipelineShaderStageInfo.pName = "main";
-	pipelineShaderStageInfo.pSpecializationInfo = NULL;
-
-	VkComputePipelineCreateInfo computePipelineInfo = { 0 };
-	computePipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-	computePipelineInfo.pNext = NULL;
-	computePipelineInfo.flags = 0;
-	computePipelineInfo.stage = pipelineShaderStageInfo;
-	computePipelineInfo.layout = pipelineLayout;
-	computePipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-	computePipelineInfo.basePipelineIndex = -1;
-
-	VkPipeline computePipeline = { 0 };
-	result = vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &computePipelineInfo, NULL, &computePipeline);
-	if (result != VK_SUCCESS) {
-		puts("Failed to create compute pipeline");
-		exit(1);
+	// Small enough that doubling fits every type, int8 included
+	for (uint64_t i = 0; i < elementCount; ++i) {
+		values[i] = (float) ((int32_t) (i % 101) - 50) * 0.75f;
 	}
-	puts("Created compute pipeline");
+	printf("Host conversions use %s\n", GetConvertIsaName());
+
+	printf("%-6s %10s %12s %10s %12s %12s %10s\n", "Type", "ms", "Bytes/elem", "GB/s", "Gelem/s", "Host GB/s", "Checked");
+	double baselineNs = 0.0;
+	for (uint32_t type = 0; type < ELEMENT_TYPE_COUNT; ++type) {
+		const ElementType elementType = (ElementType) type;
+		const uint32_t elementSize = GetElementSize(elementType);
+		if (!IsElementTypeSupported(context, elementType)) {
+			printf("%-6s not supported by this device\n", GetElementTypeName(elementType));
+			continue;
+		}
 
-	// Create a descriptor pool
-	VkDescriptorPoolSize descriptorPoolSize = { 0 };
-	descriptorPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-	descriptorPoolSize.descriptorCount = 2;
+		// The scalar variant with the tuned workgroup configuration, reading and writing elementType
+		ComputeKernelCreateInfo typedKernelInfo = { 0 };
+		GetKernelVariantCreateInfo(&kernelVariants[0], &typedKernelInfo);
+		typedKernelInfo.shaderFile = precisionShaderFiles[type];
+		typedKernelInfo.localSizeX = kernelInfo->localSizeX;
+		typedKernelInfo.elementsPerInvocation = kernelInfo->elementsPerInvocation;
+		ComputeKernel kernel = { 0 };
+		if (CreateComputeKernel(context, &typedKernelInfo, &kernel) != VK_SUCCESS) {
+			printf("Failed to create kernel from file %s\n", typedKernelInfo.shaderFile);
+			exit(1);
+		}
+
+		// Check against the host conversions, rounding the doubled value the same way
+		ComputeBuffer checkBuffers[2] = { 0 };
+		for (uint32_t i = 0; i < 2; ++i) {
+			if (CreateTypedComputeBuffer(context, PRECISION_CHECK_ELEMENTS, elementType, BUFFER_LOCATION_HOST, &checkBuffers[i]) != VK_SUCCESS) {
+				puts("Failed to create precision check buffers");
+				exit(1);
+			}
+		}
+		const uint32_t checkCount = elementCount < PRECISION_CHECK_ELEMENTS ? (uint32_t) elementCount : PRECISION_CHECK_ELEMENTS;
+		ConvertFromFloat(elementType, values, checkBuffers[0].mapped, checkCount);
+		uint32_t groupCountX = 0;
+		uint32_t groupCountY = 0;
+		uint32_t groupCountZ = 0;
+		if (ComputeDispatchSize(context, &kernel, checkCount, &groupCountX, &groupCountY, &groupCountZ) != VK_SUCCESS ||
+			DispatchComputeKernel(context, &kernel, checkBuffers, &checkCount, groupCountX, groupCountY, groupCountZ) != VK_SUCCESS) {
+			puts("Failed to run precision check");
+			exit(1);
+		}
+		float* expected = converted;
+		float* output = (float*) converted + checkCount;
+		ConvertToFloat(elementType, checkBuffers[0].mapped, expected, checkCount);
+		for (uint32_t i = 0; i < checkCount; ++i) {
+			expected[i] *= 2.f;
+		}
+		ConvertFromFloat(elementType, expected, checkBuffers[0].mapped, checkCount);
+		ConvertToFloat(elementType, checkBuffers[0].mapped, expected, checkCount);
+		ConvertToFloat(elementType, checkBuffers[1].mapped, output, checkCount);
+		// GLSL leaves the rounding of narrowing conversions to the device, so allow one unit in the last place
+		const float tolerance = elementType == ELEMENT_TYPE_FLOAT16 ? 1.f / 1024.f :
+			elementType == ELEMENT_TYPE_BFLOAT16 ? 1.f / 128.f : 0.f;
+		uint64_t mismatches = 0;
+		for (uint32_t i = 0; i < checkCount; ++i) {
+			float difference = output[i] - expected[i];
+			difference = difference < 0.f ? -difference : difference;
+			const float magnitude = expected[i] < 0.f ? -expected[i] : expected[i];
+			if (difference > tolerance * magnitude + (elementType == ELEMENT_TYPE_INT8 ? 1.f : 0.f)) {
+				++mismatches;
+			}
+		}
+		DestroyComputeBuffer(context, &checkBuffers[0]);
+		DestroyComputeBuffer(context, &checkBuffers[1]);
+
+		// Converting the input on the host reads floats and writes elementType
+		uint64_t hostNs = UINT64_MAX;
+		for (uint32_t round = 0; round < PRECISION_ROUNDS; ++round) {
+			const uint64_t startTime = GetTimeNs();
+			ConvertFromFloat(elementType, values, converted, elementCount);
+			const uint64_t elapsedNs = GetTimeNs() - startTime;
+			hostNs = elapsedNs < hostNs ? elapsedNs : hostNs;
+		}
 
-	VkDescriptorPoolCreateInfo descriptorPoolInfo = { 0 };
-	descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	descriptorPoolInfo.pNext = NULL;
-	descriptorPoolInfo.flags = 0;
-	descriptorPoolInfo.maxSets = 1;
-	descriptorPoolInfo.poolSizeCount = 1;
-	descriptorPoolInfo.pPoolSizes = &descriptorPoolSize;
+		ComputeBuffer buffers[2] = { 0 };
+		for (uint32_t i = 0; i < 2; ++i) {
+			if (CreateTypedComputeBuffer(context, elementCount, elementType, BUFFER_LOCATION_DEVICE, &buffers[i]) != VK_SUCCESS) {
+				puts("Failed to create precision buffers");
+				exit(1);
+			}
+		}
+		const uint32_t count = (uint32_t) elementCount;
+		BandwidthResult bandwidth = { 0 };
+		if (MeasureKernelBandwidth(context, &kernel, buffers, elementCount, 2 * elementSize, &count, &bandwidth) != VK_SUCCESS) {
+			puts("Failed to time precision kernel");
+			exit(1);
+		}
+		if (elementType == ELEMENT_TYPE_FLOAT32) {
+			baselineNs = (double) bandwidth.passNs;
+		}
+		printf("%-6s %10.3f %12u %10.2f %12.2f %12.2f %10s", GetElementTypeName(elementType), NsToMs(bandwidth.passNs),
+			2 * elementSize, bandwidth.throughputGBs, bandwidth.passNs > 0 ? (double) elementCount / bandwidth.passNs : 0.0,
+			hostNs > 0 ? (double) elementCount * (sizeof(float) + elementSize) / hostNs : 0.0,
+			mismatches == 0 ? "ok" : "MISMATCH");
+		if (elementType != ELEMENT_TYPE_FLOAT32 && baselineNs > 0.0 && bandwidth.passNs > 0) {
+			printf(" %.2fx fp32", baselineNs / bandwidth.passNs);
+		}
+		printf("\n");
 
-	VkDescriptorPool descriptorPool = { 0 };
-	vkCreateDescriptorPool(device, &descriptorPoolInfo, NULL, &descriptorPool);
-	if (result != VK_SUCCESS) {
-		puts("Failed to create descriptor pool");
-		exit(1);
+		DestroyComputeBuffer(context, &buffers[0]);
+		DestroyComputeBuffer(context, &buffers[1]);
+		DestroyComputeKernel(context, &kernel);
 	}
-	puts("Created descriptor pool");
 
-	// Allocate a descriptor set from the descriptor pool
-	VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = { 0 };
-	descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	descriptorSetAllocateInfo.pNext = NULL;
-	descriptorSetAllocateInfo.descriptorPool = descriptorPool;
-	descriptorSetAllocateInfo.descriptorSetCount = 1;
-	descriptorSetAllocateInfo.pSetLayouts = &descriptorSetLayout;
+	free(values);
+	free(converted);
+}
 
-	VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
-	result = vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo, &descriptorSet);
-	if (result != VK_SUCCESS) {
-		puts("Failed to allocate descriptor set");
+// Run the kernel over input on the CPU backend and compare with the output of the Vulkan device. Native kernels
+// compute in IEEE single precision like SPIR-V, so elementwise results are expected to match exactly.
+static void RunCrossCheck(const ComputeKernelCreateInfo* kernelInfo, const float* input, const float* deviceOutput,
+	uint64_t numElements, uint32_t cpuThreadCount) {
+
+	ComputeContext cpuContext = { 0 };
+	CreateCpuComputeContext(&cpuContext, cpuThreadCount);
+	ComputeKernel kernel = { 0 };
+	ComputeBuffer buffers[2] = { 0 };
+	if (CreateComputeKernel(&cpuContext, kernelInfo, &kernel) != VK_SUCCESS ||
+		CreateComputeBuffer(&cpuContext, numElements * sizeof(float), BUFFER_LOCATION_HOST, &buffers[0]) != VK_SUCCESS ||
+		CreateComputeBuffer(&cpuContext, numElements * sizeof(float), BUFFER_LOCATION_HOST, &buffers[1]) != VK_SUCCESS) {
+		puts("Failed to set up cross-check");
 		exit(1);
 	}
-	puts("Allocated descriptor set");
-
-	// Write to the descriptor set
-	VkDescriptorBufferInfo inputBufferDescriptorInfo = { 0 };
-	inputBufferDescriptorInfo.buffer = inputBuffer;
-	inputBufferDescriptorInfo.offset = 0;
-	inputBufferDescriptorInfo.range = bufferSize;
-
-	VkDescriptorBufferInfo outputBufferDescriptorInfo = { 0 };
-	outputBufferDescriptorInfo.buffer = outputBuffer;
-	outputBufferDescriptorInfo.offset = 0;
-	outputBufferDescriptorInfo.range = bufferSize;
-	
-	VkWriteDescriptorSet writeDescriptorSets[2] = { 0 };
-	writeDescriptorSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	writeDescriptorSets[0].pNext = NULL;
-	writeDescriptorSets[0].dstSet = descriptorSet;
-	writeDescriptorSets[0].dstBinding = 0;
-	writeDescriptorSets[0].dstArrayElement = 0;
-	writeDescriptorSets[0].descriptorCount = 1;
-	writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-	writeDescriptorSets[0].pImageInfo = NULL;
-	writeDescriptorSets[0].pBufferInfo = &inputBufferDescriptorInfo;
-	writeDescriptorSets[0].pTexelBufferView = NULL;
-	writeDescriptorSets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	writeDescriptorSets[1].pNext = NULL;
-	writeDescriptorSets[1].dstSet = descriptorSet;
-	writeDescriptorSets[1].dstBinding = 1;
-	writeDescriptorSets[1].dstArrayElement = 0;
-	writeDescriptorSets[1].descriptorCount = 1;
-	writeDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-	writeDescriptorSets[1].pImageInfo = NULL;
-	writeDescriptorSets[1].pBufferInfo = &outputBufferDescriptorInfo;
-	writeDescriptorSets[1].pTexelBufferView = NULL;
-
-	vkUpdateDescriptorSets(device, 2, writeDescriptorSets, 0, NULL);
-	puts("Wrote to descriptor set");
-
-	// Create a command pool
-	VkCommandPoolCreateInfo commandPoolInfo = { 0 };
-	commandPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	commandPoolInfo.pNext = NULL;
-	commandPoolInfo.flags = 0;
-	commandPoolInfo.queueFamilyIndex = computeQueueIndex;
-
-	VkCommandPool commandPool = VK_NULL_HANDLE;
-	result = vkCreateCommandPool(device, &commandPoolInfo, NULL, &commandPool);
-	if (result != VK_SUCCESS) {
-		puts("Failed to create command pool");
+	memcpy(buffers[0].mapped, input, numElements * sizeof(float));
+
+	uint32_t elementCount = (uint32_t) numElements;
+	uint64_t startTime = GetTimeNs();
+	if (DispatchComputeKernel(&cpuContext, &kernel, buffers, &elementCount, 1, 1, 1) != VK_SUCCESS) {
+		puts("Failed to dispatch kernel on the CPU backend");
 		exit(1);
 	}
-	puts("Created command pool");
+	uint64_t elapsedNs = GetTimeNs() - startTime;
+
+	const float* cpuOutput = buffers[1].mapped;
+	uint64_t mismatches = 0;
+	uint64_t firstMismatch = 0;
+	double maxDifference = 0.0;
+	for (uint64_t i = 0; i < numElements; ++i) {
+		double difference = (double) cpuOutput[i] - (double) deviceOutput[i];
+		if (difference < 0.0) {
+			difference = -difference;
+		}
+		if (cpuOutput[i] != deviceOutput[i]) {
+			if (mismatches == 0) {
+				firstMismatch = i;
+			}
+			++mismatches;
+		}
+		if (difference > maxDifference) {
+			maxDifference = difference;
+		}
+	}
+	printf("Cross-check on %s: %.3f ms, %llu of %llu elements differ, max difference %g\n",
+		cpuContext.physicalDeviceProperties.deviceName, NsToMs(elapsedNs), (unsigned long long) mismatches,
+		(unsigned long long) numElements, maxDifference);
+	if (mismatches > 0) {
+		printf("First difference at %llu: CPU %f, device %f\n", (unsigned long long) firstMismatch,
+			cpuOutput[firstMismatch], deviceOutput[firstMismatch]);
+	}
 
-	VkCommandBufferAllocateInfo commandBufferAllocateInfo = { 0 };
-	commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	commandBufferAllocateInfo.pNext = NULL;
-	commandBufferAllocateInfo.commandPool = commandPool;
-	commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	commandBufferAllocateInfo.commandBufferCount = 1;
+	DestroyComputeBuffer(&cpuContext, &buffers[0]);
+	DestroyComputeBuffer(&cpuContext, &buffers[1]);
+	DestroyComputeKernel(&cpuContext, &kernel);
+	DestroyComputeContext(&cpuContext);
+}
 
-	VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
-	result = vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, &commandBuffer);
-	if (result != VK_SUCCESS) {
-		puts("Failed to allocate command buffer");
+int main(int argc, char** argv) {
+
+	// --device-local keeps the working buffers in device local memory and stages them through the transfer queue
+	// --elements <N> sets the number of elements doubled by the one-shot dispatch
+	// --stream <MiB> streams that much data through the kernel in chunks, keeping --slots chunks in flight
+	// --retune benchmarks the kernel variants again instead of using the stored autotune result
+	// --variant <name> picks the kernel variant: scalar, vec4, scalar-grid or vec4-grid
+	// --bandwidth <MiB> measures every variant over buffers of that size, against --peak <GB/s> if given
+	// --jobs <N> measures the host overhead per job of N small jobs, recorded each time or replayed
+	// --binding <N> times N dispatches with every descriptor strategy the device supports
+	// --graph runs a small task graph whose independent branches overlap on separate queues
+	// --schedule <MiB> splits that much data across all compute queues of all GPUs by measured throughput
+	// --threads <N> submits small jobs from up to N threads through a submitter thread, --jobs per thread
+	// --import <MiB> doubles host memory imported as buffers in place, against copying it through host buffers
+	// --import-file <file> does the same for the floats in a file mapped into memory
+	// --readback <MiB> times the host reading device writes back from each host visible memory type
+	// --host-copy <MiB> times host writes, fills and reads of each host visible memory type, memcpy against the
+	// threaded helpers with streaming stores and loads
+	// --primitives <MiB> times reduce, argmax and scan over that much data against loops on the host
+	// --fusion <MiB> times a chain of elementwise ops as one generated kernel against one kernel per op
+	// --precision <MiB> times the doubling kernel over fp32, fp16, bf16 and int8 buffers of as many elements
+	// --cpu runs the one-shot dispatch on the native CPU backend, which is also used when no Vulkan device is found
+	// --cpu-threads <N> splits CPU backend dispatches across N threads instead of one per CPU
+	// --cross-check runs the one-shot dispatch on the CPU backend as well and compares the outputs
+	// --kernels <dir> registers every .spv kernel in dir, reflecting its layout, and creates the pipelines on
+	// background threads during startup
+	// --profile <file> writes GPU timestamps and host timings to a JSON report, or CSV if file ends in .csv
+	BufferLocation location = BUFFER_LOCATION_HOST;
+	const KernelVariant* variant = &kernelVariants[0];
+	uint64_t bandwidthSize = 0;
+	double peakGBs = 0.0;
+	uint64_t numElements = 256;
+	uint64_t streamSize = 0;
+	uint32_t streamSlots = 3;
+	int retune = 0;
+	const char* profilePath = NULL;
+	uint32_t jobCount = 0;
+	uint32_t threadCount = 0;
+	uint32_t bindingCount = 0;
+	uint64_t scheduleSize = 0;
+	int graphDemo = 0;
+	const char* kernelDirectory = NULL;
+	uint64_t importSize = 0;
+	uint64_t readbackSize = 0;
+	uint64_t hostCopySize = 0;
+	uint64_t primitivesSize = 0;
+	uint64_t fusionSize = 0;
+	uint64_t precisionSize = 0;
+	int forceCpu = 0;
+	uint32_t cpuThreadCount = 0;
+	int crossCheck = 0;
+	const char* importFile = NULL;
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--device-local")) {
+			location = BUFFER_LOCATION_DEVICE;
+		}
+		else if (!strcmp(argv[i], "--elements") && i + 1 < argc) {
+			numElements = strtoull(argv[++i], NULL, 10);
+		}
+		else if (!strcmp(argv[i], "--stream") && i + 1 < argc) {
+			streamSize = strtoull(argv[++i], NULL, 10) * 1024 * 1024;
+		}
+		else if (!strcmp(argv[i], "--slots") && i + 1 < argc) {
+			streamSlots = (uint32_t) strtoul(argv[++i], NULL, 10);
+		}
+		else if (!strcmp(argv[i], "--retune")) {
+			retune = 1;
+		}
+		else if (!strcmp(argv[i], "--variant") && i + 1 < argc) {
+			variant = FindKernelVariant(argv[++i]);
+			if (variant == NULL) {
+				printf("Unknown kernel variant %s\n", argv[i]);
+				exit(1);
+			}
+		}
+		else if (!strcmp(argv[i], "--bandwidth") && i + 1 < argc) {
+			bandwidthSize = strtoull(argv[++i], NULL, 10) * 1024 * 1024;
+		}
+		else if (!strcmp(argv[i], "--jobs") && i + 1 < argc) {
+			jobCount = (uint32_t) strtoul(argv[++i], NULL, 10);
+		}
+		else if (!strcmp(argv[i], "--binding") && i + 1 < argc) {
+			bindingCount = (uint32_t) strtoul(argv[++i], NULL, 10);
+		}
+		else if (!strcmp(argv[i], "--graph")) {
+			graphDemo = 1;
+		}
+		else if (!strcmp(argv[i], "--schedule") && i + 1 < argc) {
+			scheduleSize = strtoull(argv[++i], NULL, 10) * 1024 * 1024;
+		}
+		else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+			threadCount = (uint32_t) strtoul(argv[++i], NULL, 10);
+		}
+		else if (!strcmp(argv[i], "--import") && i + 1 < argc) {
+			importSize = strtoull(argv[++i], NULL, 10) * 1024 * 1024;
+		}
+		else if (!strcmp(argv[i], "--import-file") && i + 1 < argc) {
+			importFile = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--readback") && i + 1 < argc) {
+			readbackSize = strtoull(argv[++i], NULL, 10) * 1024 * 1024;
+		}
+		else if (!strcmp(argv[i], "--host-copy") && i + 1 < argc) {
+			hostCopySize = strtoull(argv[++i], NULL, 10) * 1024 * 1024;
+		}
+		else if (!strcmp(argv[i], "--primitives") && i + 1 < argc) {
+			primitivesSize = strtoull(argv[++i], NULL, 10) * 1024 * 1024;
+		}
+		else if (!strcmp(argv[i], "--fusion") && i + 1 < argc) {
+			fusionSize = strtoull(argv[++i], NULL, 10) * 1024 * 1024;
+		}
+		else if (!strcmp(argv[i], "--precision") && i + 1 < argc) {
+			precisionSize = strtoull(argv[++i], NULL, 10) * 1024 * 1024;
+		}
+		else if (!strcmp(argv[i], "--cpu")) {
+			forceCpu = 1;
+		}
+		else if (!strcmp(argv[i], "--cpu-threads") && i + 1 < argc) {
+			cpuThreadCount = (uint32_t) strtoul(argv[++i], NULL, 10);
+		}
+		else if (!strcmp(argv[i], "--cross-check")) {
+			crossCheck = 1;
+		}
+		else if (!strcmp(argv[i], "--kernels") && i + 1 < argc) {
+			kernelDirectory = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--profile") && i + 1 < argc) {
+			profilePath = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--peak") && i + 1 < argc) {
+			peakGBs = strtod(argv[++i], NULL);
+		}
+		else {
+			printf("Unknown option %s\n", argv[i]);
+			exit(1);
+		}
+	}
+	// The one-shot dispatch takes a 32-bit element count, and buffers must not be empty
+	if (numElements == 0 || numElements > UINT32_MAX) {
+		printf("Cannot dispatch %llu elements, use 1 to %u\n", (unsigned long long) numElements, UINT32_MAX);
 		exit(1);
 	}
-	puts("Allocated command buffer");
 
-	// Create a fence
-	VkFenceCreateInfo fenceInfo = { 0 };
-	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceInfo.pNext = NULL;
-	fenceInfo.flags = 0;
+	// Everything up to the first dispatch is on the startup trace
+	StartupTrace startupTrace = { 0 };
+	InitStartupTrace(&startupTrace);
+	uint64_t startTime = GetTimeNs();
+	ComputeContext context = { 0 };
+	VkResult result = VK_SUCCESS;
+	if (forceCpu) {
+		CreateCpuComputeContext(&context, cpuThreadCount);
+	}
+	else {
+		result = CreateComputeContextTraced(&context, &startupTrace);
+		if (result != VK_SUCCESS) {
+			puts("Failed to create compute context, falling back to the CPU backend");
+			const uint64_t cpuStartTime = GetTimeNs();
+			CreateCpuComputeContext(&context, cpuThreadCount);
+			AddStartupPhase(&startupTrace, "create_cpu_context", 0, cpuStartTime, GetTimeNs());
+		}
+	}
+	uint64_t endTime = GetTimeNs();
+	if (forceCpu) {
+		AddStartupPhase(&startupTrace, "create_cpu_context", 0, startTime, endTime);
+	}
+	printf("Created compute context in %.3f ms\n", NsToMs(endTime - startTime));
+
+	// Everything past the one-shot dispatch records Vulkan commands
+	if (context.cpuBackend) {
+		if (streamSize > 0 || jobCount > 0 || bindingCount > 0 || threadCount > 0 || graphDemo || scheduleSize > 0 ||
+			importSize > 0 || importFile != NULL || readbackSize > 0 || hostCopySize > 0 || primitivesSize > 0 || fusionSize > 0 ||
+			precisionSize > 0 || kernelDirectory != NULL || bandwidthSize > 0 || profilePath != NULL || crossCheck) {
+			puts("Skipping benchmarks, demos and profiling, which need a Vulkan device");
+		}
+		streamSize = jobCount = bindingCount = threadCount = 0;
+		scheduleSize = importSize = readbackSize = hostCopySize = primitivesSize = fusionSize = precisionSize = bandwidthSize = 0;
+		graphDemo = crossCheck = 0;
+		importFile = kernelDirectory = profilePath = NULL;
+		location = BUFFER_LOCATION_HOST;
+	}
 
-	VkFence fence = VK_NULL_HANDLE;
-	result = vkCreateFence(device, &fenceInfo, NULL, &fence);
-	if (result != VK_SUCCESS) {
-		puts("Failed to create fence");
-		exit(1);
+	Profiler profiler = { 0 };
+	if (profilePath != NULL) {
+		result = CreateProfiler(context.physicalDevice, context.device, context.hostQueryReset, &profiler);
+		if (result != VK_SUCCESS) {
+			puts("Failed to create profiler");
+			exit(1);
+		}
+		context.profiler = &profiler;
+		AddProfileCpuEvent(context.profiler, "create_context", startTime, endTime);
 	}
-	puts("Created fence");
 
-	// Finally time to do some GPU computing
+	startTime = GetTimeNs();
+	size_t pipelineCacheSize = 0;
+	if (!context.cpuBackend) {
+		result = LoadPipelineCache(&context, ".", &pipelineCacheSize);
+		if (result != VK_SUCCESS) {
+			puts("Failed to load pipeline cache");
+			exit(1);
+		}
+		if (pipelineCacheSize > 0) {
+			printf("Loaded %zu bytes of pipeline cache from %s\n", pipelineCacheSize, context.pipelineCachePath);
+		}
+		else {
+			printf("No usable pipeline cache at %s, starting cold\n", context.pipelineCachePath);
+		}
+		AddProfileCpuEvent(context.profiler, "load_pipeline_cache", startTime, GetTimeNs());
+		AddStartupPhase(&startupTrace, "load_pipeline_cache", 0, startTime, GetTimeNs());
+	}
 
-	// Write some values into the input buffer
-	for (uint32_t i = 0; i < numElements; ++i) {
-		inputBufferMappedPtr[i] = (float) i;
+	// Registered kernels only need the device and the pipeline cache, so their pipelines are created on
+	// background threads while the one-shot kernel is set up and run
+	KernelRegistry registry = { 0 };
+	if (kernelDirectory != NULL) {
+		StartKernelRegistry(&context, kernelDirectory, &registry, &startupTrace);
 	}
 
-	// Record commands
-	VkCommandBufferBeginInfo commandBufferBeginInfo = { 0 };
-	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	commandBufferBeginInfo.pNext = NULL;
-	commandBufferBeginInfo.flags = 0;
-	commandBufferBeginInfo.pInheritanceInfo = NULL;
+	// Create buffers
+	startTime = GetTimeNs();
+	const uint64_t bufferSize = numElements * sizeof(float);
 
-	result = vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+	ComputeBuffer buffers[2] = { 0 };
+	result = CreateComputeBuffer(&context, bufferSize, location, &buffers[0]);
 	if (result != VK_SUCCESS) {
-		puts("Failed to begin recording command buffer");
+		puts("Failed to create input buffer");
 		exit(1);
 	}
-	puts("Began recording command buffer");
-
-	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
-	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
-	vkCmdDispatch(commandBuffer, 1, 1, 1);
-	result = vkEndCommandBuffer(commandBuffer);
+	// Results are read back by the host, so host cached memory suits the output better than coherent memory
+	result = CreateComputeBuffer(&context, bufferSize, location == BUFFER_LOCATION_HOST ? BUFFER_LOCATION_READBACK : location, &buffers[1]);
+	if (result != VK_SUCCESS) {
+		puts("Failed to create output buffer");
+		exit(1);
+	}
+	AddProfileCpuEvent(context.profiler, "create_buffers", startTime, GetTimeNs());
+	AddStartupPhase(&startupTrace, "create_buffers", 0, startTime, GetTimeNs());
+	printf("Created input and output buffers of size %lu\n", bufferSize);
+	PrintMemoryAllocatorStats(&context.allocator);
+
+	// Load shader and create the compute pipeline
+	const char* shaderFile = variant->shaderFile;
+	ComputeKernelCreateInfo kernelInfo = { 0 };
+	GetKernelVariantCreateInfo(variant, &kernelInfo);
+
+	// Use the fastest workgroup configuration for this device, benchmarking the variants on first run. Native
+	// kernels ignore the workgroup size, so the CPU backend skips the search.
+	AutotuneResult autotune = { 0 };
+	autotune.localSizeX = REGISTRY_DEFAULT_LOCAL_SIZE;
+	autotune.elementsPerInvocation = 1;
+	autotune.loaded = 1;
+	startTime = GetTimeNs();
+	if (!context.cpuBackend) {
+		result = AutotuneComputeKernel(&context, ".", &kernelInfo, DEFAULT_AUTOTUNE_ELEMENT_COUNT, sizeof(float), retune, &autotune);
+	}
+	if (result != VK_SUCCESS) {
+		puts("Failed to autotune kernel");
+		exit(1);
+	}
+	AddProfileCpuEvent(context.profiler, "autotune", startTime, GetTimeNs());
+	AddStartupPhase(&startupTrace, "autotune", 0, startTime, GetTimeNs());
+	printf("%s local size %u with %u elements per invocation (%.3f ms per %u elements) in %.3f ms\n",
+		autotune.loaded ? "Loaded" : "Autotuned", autotune.localSizeX, autotune.elementsPerInvocation,
+		NsToMs(autotune.dispatchNs), DEFAULT_AUTOTUNE_ELEMENT_COUNT, NsToMs(GetTimeNs() - startTime));
+	kernelInfo.localSizeX = autotune.localSizeX;
+	kernelInfo.elementsPerInvocation = autotune.elementsPerInvocation;
+
+	ComputeKernel kernel = { 0 };
+	startTime = GetTimeNs();
+	result = CreateComputeKernel(&context, &kernelInfo, &kernel);
 	if (result != VK_SUCCESS) {
-		puts("Failed to end recording command buffer");
+		printf("Failed to create kernel from file %s\n", shaderFile);
 		exit(1);
 	}
-	puts("Ended recording command buffer");
-
-	// Submit the command buffer on the compute queue
-	VkSubmitInfo submitInfo = { 0 };
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.pNext = NULL;
-	submitInfo.waitSemaphoreCount = 0;
-	submitInfo.pWaitSemaphores = NULL;
-	submitInfo.pWaitDstStageMask = NULL;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
-	submitInfo.signalSemaphoreCount = 0;
-	submitInfo.pSignalSemaphores = NULL;
-
-	result = vkQueueSubmit(computeQueue, 1, &submitInfo, fence);
+	AddProfileCpuEvent(context.profiler, "create_kernel", startTime, GetTimeNs());
+	AddStartupPhase(&startupTrace, "create_kernel", 0, startTime, GetTimeNs());
+	printf("Created kernel from file %s in %.3f ms (%s pipeline cache)\n", shaderFile,
+		NsToMs(GetTimeNs() - startTime), pipelineCacheSize > 0 ? "warm" : "cold");
+
+	if (!context.cpuBackend && SavePipelineCache(&context) != VK_SUCCESS) {
+		puts("Failed to save pipeline cache");
+	}
+
+	// Finally time to do some GPU computing
+
+	// Write some values into the input buffer, directly if it is mapped or through staging otherwise
+	float* inputData = buffers[0].mapped;
+	float* outputData = buffers[1].mapped;
+	if (location == BUFFER_LOCATION_DEVICE) {
+		inputData = malloc(bufferSize);
+		outputData = malloc(bufferSize);
+		if (inputData == NULL || outputData == NULL) {
+			puts("Failed to allocate host buffers");
+			exit(1);
+		}
+	}
+	for (uint64_t i = 0; i < numElements; ++i) {
+		inputData[i] = (float) i;
+	}
+
+	// Size the dispatch from the element count; the shader ignores invocations past elementCount
+	uint32_t elementCount = (uint32_t) numElements;
+	uint32_t groupCountX = 0;
+	uint32_t groupCountY = 0;
+	uint32_t groupCountZ = 0;
+	result = ComputeDispatchSize(&context, &kernel, numElements, &groupCountX, &groupCountY, &groupCountZ);
 	if (result != VK_SUCCESS) {
-		puts("Failed to submit command buffer on compute queue");
+		printf("Cannot dispatch %llu elements\n", (unsigned long long) numElements);
 		exit(1);
 	}
-	puts("Submitted command buffer on compute queue");
 
-	result = vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+	startTime = GetTimeNs();
+	if (location == BUFFER_LOCATION_DEVICE) {
+		StagingCopy upload = { 0, inputData, bufferSize };
+		StagingCopy download = { 1, outputData, bufferSize };
+		result = DispatchComputeKernelStaged(&context, &kernel, buffers, &upload, 1, &download, 1,
+			&elementCount, groupCountX, groupCountY, groupCountZ);
+	}
+	else {
+		result = DispatchComputeKernel(&context, &kernel, buffers, &elementCount, groupCountX, groupCountY, groupCountZ);
+		if (result == VK_SUCCESS) {
+			result = InvalidateComputeBuffer(&context, &buffers[1], 0, bufferSize);
+		}
+	}
 	if (result != VK_SUCCESS) {
-		puts("Failed to wait for fence");
+		puts("Failed to dispatch kernel");
 		exit(1);
 	}
-	puts("Waited for fence");
+	endTime = GetTimeNs();
+	AddProfileCpuEvent(context.profiler, "dispatch", startTime, endTime);
+	AddStartupPhase(&startupTrace, "first_dispatch", 0, startTime, endTime);
+	printf("Dispatched %u x %u x %u workgroups in %.3f ms\n", groupCountX, groupCountY, groupCountZ,
+		NsToMs(endTime - startTime));
+	PrintStartupTrace(&startupTrace);
+
+	// Print the first results and check all of them
+	for (uint32_t i = 0; i < 16 && i < numElements; ++i) {
+		printf("%f * 2 = %f\n", inputData[i], outputData[i]);
+	}
+	uint64_t mismatches = 0;
+	for (uint64_t i = 0; i < numElements; ++i) {
+		if (outputData[i] != inputData[i] * 2.f) {
+			++mismatches;
+		}
+	}
+	printf("%llu of %llu elements mismatched\n", (unsigned long long) mismatches, (unsigned long long) numElements);
+
+	if (crossCheck) {
+		RunCrossCheck(&kernelInfo, inputData, outputData, numElements, cpuThreadCount);
+	}
+
+	if (location == BUFFER_LOCATION_DEVICE) {
+		free(inputData);
+		free(outputData);
+	}
+
+	if (streamSize > 0) {
+		const VkDeviceSize chunkSize = 16 * 1024 * 1024;
+		ComputeStream stream = { 0 };
+		result = CreateComputeStream(&context, &kernel, streamSlots, chunkSize, sizeof(float), &stream);
+		if (result != VK_SUCCESS) {
+			puts("Failed to create compute stream");
+			exit(1);
+		}
+
+		uint64_t mismatches = 0;
+		ComputeStreamStats stats = { 0 };
+		startTime = GetTimeNs();
+		result = RunComputeStream(&context, &stream, streamSize, FillStreamChunk, DrainStreamChunk, &mismatches, &stats);
+		if (result != VK_SUCCESS) {
+			puts("Failed to run compute stream");
+			exit(1);
+		}
+		AddProfileCpuEvent(context.profiler, "stream", startTime, GetTimeNs());
+		printf("Streamed %llu bytes in %u chunks over %u slots: %.3f ms, %.2f GB/s, %llu mismatches\n",
+			(unsigned long long) stats.bytesProcessed, stats.chunkCount, streamSlots,
+			NsToMs(stats.elapsedNs), stats.throughputGBs, (unsigned long long) mismatches);
+
+		DestroyComputeStream(&context, &stream);
+	}
+
+	if (jobCount > 0) {
+		RunJobOverheadBenchmark(&context, &kernelInfo, jobCount);
+	}
+
+	if (bindingCount > 0) {
+		RunBindingBenchmark(&context, &kernelInfo, bindingCount);
+	}
+
+	if (threadCount > 0) {
+		RunThreadedSubmitBenchmark(&context, &kernelInfo, threadCount, jobCount > 0 ? jobCount : THREADED_JOBS);
+	}
+
+	if (graphDemo) {
+		RunGraphDemo(&context, &kernel);
+	}
 
-	// Print the results
-	for (uint32_t i = 0; i < 16; ++i) {
-		printf("%f * 2 = %f\n", inputBufferMappedPtr[i], outputBufferMappedPtr[i]);
+	if (scheduleSize > 0) {
+		RunScheduleBenchmark(&kernelInfo, scheduleSize);
 	}
 
-	// Destroy fence
-	vkDestroyFence(device, fence, NULL);
-	puts("Destroyed fence");
+	if (importSize > 0 || importFile != NULL) {
+		RunImportBenchmark(&context, &kernel, importSize, importFile);
+	}
 
-	// Destroy descriptor set layout
-	vkDestroyDescriptorSetLayout(device, descriptorSetLayout, NULL);
-	puts("Destroyed descriptor set layout");
+	if (readbackSize > 0) {
+		RunReadbackBenchmark(&context, readbackSize);
+	}
 
-	// Destroy pipeline layout
-	vkDestroyPipelineLayout(device, pipelineLayout, NULL);
-	puts("Destroyed pipeline layout");
+	if (hostCopySize > 0) {
+		RunHostCopyBenchmark(&context, hostCopySize);
+	}
 
-	// Unload shader
-	vkDestroyShaderModule(device, shaderModule, NULL);
-	puts("Destroyed shader module");
+	if (primitivesSize > 0) {
+		RunPrimitivesBenchmark(&context, primitivesSize);
+	}
 
-	vkDestroyPipeline(device, computePipeline, NULL);
-	puts("Destroyed compute pipeline");
+	if (fusionSize > 0) {
+		RunFusionBenchmark(&context, fusionSize);
+		SavePipelineCache(&context);
+	}
 
-	// Destroy descriptor pool
-	vkDestroyDescriptorPool(device, descriptorPool, NULL);
-	puts("Destroyed descriptor pool");
+	if (precisionSize > 0) {
+		RunPrecisionBenchmark(&context, &kernelInfo, precisionSize);
+		SavePipelineCache(&context);
+	}
 
-	// Destroy command pool
-	vkDestroyCommandPool(device, commandPool, NULL);
-	puts("Destroyed command pool");
+	if (kernelDirectory != NULL) {
+		RunKernelRegistry(&registry, &startupTrace);
+		SavePipelineCache(&context);
+	}
 
-	// Unmap memory
-	vkUnmapMemory(device, inputBufferMemory);
-	vkUnmapMemory(device, outputBufferMemory);
-	puts("Unmapped buffer memory");
+	if (bandwidthSize > 0) {
+		RunBandwidthBenchmark(&context, bandwidthSize, peakGBs, retune);
+		SavePipelineCache(&context);
+	}
 
-	// Free buffer memory
-	vkFreeMemory(device, inputBufferMemory, NULL);
-	vkFreeMemory(device, outputBufferMemory, NULL);
-	puts("Freed buffer memory");
+	DestroyComputeKernel(&context, &kernel);
+	puts("Destroyed kernel");
 
-	// Destroy buffers
-	vkDestroyBuffer(device, inputBuffer, NULL);
-	vkDestroyBuffer(device, outputBuffer, NULL);
+	DestroyComputeBuffer(&context, &buffers[0]);
+	DestroyComputeBuffer(&context, &buffers[1]);
 	puts("Destroyed input and output buffers");
 
-	// Destroy the logical device
-	vkDeviceWaitIdle(device);
-	vkDestroyDevice(device, NULL);
-	puts("Destroyed the logical device");
+	if (profilePath != NULL) {
+		if (WriteProfileReport(context.profiler, profilePath) == VK_SUCCESS) {
+			printf("Wrote profile report to %s\n", profilePath);
+		}
+		context.profiler = NULL;
+		DestroyProfiler(&profiler);
+	}
 
-	vkDestroyInstance(instance, NULL);
-	puts("Destroyed the Vulkan instance");
+	DestroyComputeContext(&context);
+	puts("Destroyed compute context");
+	DestroyStartupTrace(&startupTrace);
 
 	return 0;
 }
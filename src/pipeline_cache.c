@@ -0,0 +1,171 @@
+#include "pipeline_cache.h"
+#include <vulkan/vulkan.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Read a whole file into a malloc'd buffer. Returns NULL if the file does not exist or cannot be read.
+static void* ReadFile(const char* filename, size_t* size) {
+	FILE* file = fopen(filename, "rb");
+	if (file == NULL) {
+		return NULL;
+	}
+
+	if (fseek(file, 0, SEEK_END) == -1) {
+		fclose(file);
+		return NULL;
+	}
+	long file_size = ftell(file);
+	if (file_size <= 0 || fseek(file, 0, SEEK_SET) == -1) {
+		fclose(file);
+		return NULL;
+	}
+
+	void* buffer = malloc(file_size);
+	if (buffer == NULL) {
+		fclose(file);
+		return NULL;
+	}
+
+	size_t bytes_read = fread(buffer, 1, file_size, file);
+	fclose(file);
+	if (bytes_read != (size_t) file_size) {
+		free(buffer);
+		return NULL;
+	}
+
+	*size = bytes_read;
+	return buffer;
+}
+
+// Check that cache data was produced by this device and driver, as described by VkPipelineCacheHeaderVersionOne
+static int ValidatePipelineCacheHeader(const ComputeContext* context, const void* data, size_t size) {
+	if (size < sizeof(VkPipelineCacheHeaderVersionOne)) {
+		return 0;
+	}
+
+	const uint8_t* bytes = data;
+	uint32_t headerSize = 0;
+	uint32_t headerVersion = 0;
+	uint32_t vendorID = 0;
+	uint32_t deviceID = 0;
+	memcpy(&headerSize, bytes + 0, sizeof(uint32_t));
+	memcpy(&headerVersion, bytes + 4, sizeof(uint32_t));
+	memcpy(&vendorID, bytes + 8, sizeof(uint32_t));
+	memcpy(&deviceID, bytes + 12, sizeof(uint32_t));
+
+	const VkPhysicalDeviceProperties* properties = &context->physicalDeviceProperties;
+	return headerSize >= sizeof(VkPipelineCacheHeaderVersionOne) &&
+		headerSize <= size &&
+		headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+		vendorID == properties->vendorID &&
+		deviceID == properties->deviceID &&
+		memcmp(bytes + 16, properties->pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+VkResult LoadPipelineCache(ComputeContext* context, const char* directory, size_t* loadedSize) {
+	char identifier[64];
+	GetDeviceIdentifier(context, identifier, sizeof(identifier));
+	int length = snprintf(context->pipelineCachePath, sizeof(context->pipelineCachePath),
+		"%s/pipeline_cache_%s.bin", directory, identifier);
+	if (length < 0 || (size_t) length >= sizeof(context->pipelineCachePath)) {
+		puts("Pipeline cache path is too long");
+		context->pipelineCachePath[0] = '\0';
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+
+	size_t dataSize = 0;
+	void* data = ReadFile(context->pipelineCachePath, &dataSize);
+	if (data != NULL && !ValidatePipelineCacheHeader(context, data, dataSize)) {
+		printf("Ignoring stale pipeline cache %s\n", context->pipelineCachePath);
+		free(data);
+		data = NULL;
+		dataSize = 0;
+	}
+
+	VkPipelineCacheCreateInfo pipelineCacheInfo = { 0 };
+	pipelineCacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	pipelineCacheInfo.pNext = NULL;
+	pipelineCacheInfo.flags = 0;
+	pipelineCacheInfo.initialDataSize = dataSize;
+	pipelineCacheInfo.pInitialData = data;
+
+	VkResult result = vkCreatePipelineCache(context->device, &pipelineCacheInfo, NULL, &context->pipelineCache);
+	if (result != VK_SUCCESS && data != NULL) {
+		// The driver rejected the data despite a matching header; fall back to an empty cache
+		pipelineCacheInfo.initialDataSize = 0;
+		pipelineCacheInfo.pInitialData = NULL;
+		dataSize = 0;
+		result = vkCreatePipelineCache(context->device, &pipelineCacheInfo, NULL, &context->pipelineCache);
+	}
+	free(data);
+
+	if (result != VK_SUCCESS) {
+		puts("Failed to create pipeline cache");
+		return result;
+	}
+
+	if (loadedSize != NULL) {
+		*loadedSize = dataSize;
+	}
+	return VK_SUCCESS;
+}
+
+VkResult SavePipelineCache(ComputeContext* context) {
+	if (context->pipelineCache == VK_NULL_HANDLE || context->pipelineCachePath[0] == '\0') {
+		return VK_SUCCESS;
+	}
+
+	size_t dataSize = 0;
+	VkResult result = vkGetPipelineCacheData(context->device, context->pipelineCache, &dataSize, NULL);
+	if (result != VK_SUCCESS) {
+		puts("Failed to get pipeline cache size");
+		return result;
+	}
+
+	void* data = malloc(dataSize);
+	if (data == NULL) {
+		return VK_ERROR_OUT_OF_HOST_MEMORY;
+	}
+	result = vkGetPipelineCacheData(context->device, context->pipelineCache, &dataSize, data);
+	if (result != VK_SUCCESS) {
+		puts("Failed to get pipeline cache data");
+		free(data);
+		return result;
+	}
+
+	// Write to a temporary file and rename it into place so concurrent workers never read a partial cache. Each
+	// writer has its own temporary file, so two saves cannot interleave into one.
+	char tempPath[sizeof(context->pipelineCachePath) + 32];
+	if (!GetTempFilePath(context->pipelineCachePath, tempPath, sizeof(tempPath))) {
+		free(data);
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+
+	FILE* file = fopen(tempPath, "wb");
+	if (file == NULL) {
+		printf("Failed to open pipeline cache file %s\n", tempPath);
+		free(data);
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+	size_t bytes_written = fwrite(data, 1, dataSize, file);
+	int closeResult = fclose(file);
+	free(data);
+	if (bytes_written != dataSize || closeResult != 0) {
+		printf("Failed to write pipeline cache file %s\n", tempPath);
+		remove(tempPath);
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+
+	if (rename(tempPath, context->pipelineCachePath) != 0) {
+		// rename does not replace an existing file on Windows
+		remove(context->pipelineCachePath);
+		if (rename(tempPath, context->pipelineCachePath) != 0) {
+			printf("Failed to write pipeline cache file %s\n", context->pipelineCachePath);
+			remove(tempPath);
+			return VK_ERROR_INITIALIZATION_FAILED;
+		}
+	}
+
+	return VK_SUCCESS;
+}
@@ -0,0 +1,16 @@
+#include <vulkan/vulkan.h>
+#include "context.h"
+
+#ifndef PIPELINE_CACHE_H
+#define PIPELINE_CACHE_H
+
+// Create context->pipelineCache, seeded from a file in directory if one exists for this exact device and driver.
+// The file name is derived from the vendor/device IDs, driver version and pipelineCacheUUID, so caches from
+// other devices or driver versions are never picked up. On return *loadedSize holds the number of bytes of
+// cache data that were accepted (0 on a cold start).
+VkResult LoadPipelineCache(ComputeContext* context, const char* directory, size_t* loadedSize);
+
+// Write the current contents of context->pipelineCache back to the file it was loaded from
+VkResult SavePipelineCache(ComputeContext* context);
+
+#endif
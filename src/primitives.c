@@ -0,0 +1,281 @@
+#include "primitives.h"
+#include <vulkan/vulkan.h>
+#include <stdio.h>
+#include <string.h>
+
+static VkResult CreatePrimitiveKernel(ComputePrimitives* primitives, const char* name, uint32_t localSizeX, ComputeKernel* kernel) {
+	char shaderFile[128];
+	snprintf(shaderFile, sizeof(shaderFile), "shaders/%s%s.spv", name, primitives->subgroups ? "_subgroup" : "");
+
+	ComputeKernelCreateInfo kernelInfo = { 0 };
+	kernelInfo.shaderFile = shaderFile;
+	kernelInfo.localSizeX = localSizeX;
+	kernelInfo.elementsPerInvocation = PRIMITIVE_ELEMENTS_PER_INVOCATION;
+	kernelInfo.vectorWidth = 1;
+	kernelInfo.maxGroupCount = 0;
+	VkResult result = CreateBinderKernel(&primitives->binder, &kernelInfo, kernel);
+	if (result != VK_SUCCESS) {
+		printf("Failed to create kernel from file %s\n", shaderFile);
+	}
+	return result;
+}
+
+VkResult CreateComputePrimitives(ComputeContext* context, ComputePrimitives* primitives) {
+	memset(primitives, 0, sizeof(*primitives));
+	primitives->context = context;
+
+	// The shared memory trees need a power of two workgroup size
+	const VkPhysicalDeviceLimits* limits = &context->physicalDeviceProperties.limits;
+	uint32_t localSizeX = PRIMITIVE_LOCAL_SIZE;
+	while (localSizeX > limits->maxComputeWorkGroupSize[0] || localSizeX > limits->maxComputeWorkGroupInvocations) {
+		localSizeX /= 2;
+	}
+	primitives->blockSize = localSizeX * PRIMITIVE_ELEMENTS_PER_INVOCATION;
+
+	// The scan orders invocations by subgroup, which needs whole subgroups
+	primitives->subgroups = context->subgroupArithmetic && context->subgroupSize > 0 &&
+		localSizeX % context->subgroupSize == 0;
+
+	// Every kernel takes at most four buffers and two uint push constants. Each pass binds different buffers, so
+	// descriptors are pushed into the command buffer, or written to a fresh set per pass.
+	DescriptorStrategy strategy = IsDescriptorStrategySupported(context, DESCRIPTOR_STRATEGY_PUSH) ?
+		DESCRIPTOR_STRATEGY_PUSH : DESCRIPTOR_STRATEGY_SETS;
+	VkResult result = CreateDescriptorBinder(context, strategy, 4, 2 * sizeof(uint32_t), &primitives->binder);
+	if (result == VK_SUCCESS) {
+		result = CreatePrimitiveKernel(primitives, "reduce", localSizeX, &primitives->reduceKernel);
+	}
+	if (result == VK_SUCCESS) {
+		result = CreatePrimitiveKernel(primitives, "argmax", localSizeX, &primitives->argmaxKernel);
+	}
+	if (result == VK_SUCCESS) {
+		result = CreatePrimitiveKernel(primitives, "scan", localSizeX, &primitives->scanKernel);
+	}
+	if (result == VK_SUCCESS) {
+		// Only the multi-pass primitives come in a subgroup version
+		const int subgroups = primitives->subgroups;
+		primitives->subgroups = 0;
+		result = CreatePrimitiveKernel(primitives, "scan_add", localSizeX, &primitives->scanAddKernel);
+		primitives->subgroups = subgroups;
+	}
+	if (result != VK_SUCCESS) {
+		DestroyComputePrimitives(primitives);
+	}
+	return result;
+}
+
+static void DestroyLevels(ComputePrimitives* primitives) {
+	for (uint32_t i = 0; i < PRIMITIVE_MAX_LEVELS; ++i) {
+		if (primitives->levels[i].buffer != VK_NULL_HANDLE) {
+			DestroyComputeBuffer(primitives->context, &primitives->levels[i]);
+		}
+		if (primitives->levelIndices[i].buffer != VK_NULL_HANDLE) {
+			DestroyComputeBuffer(primitives->context, &primitives->levelIndices[i]);
+		}
+	}
+	primitives->capacity = 0;
+}
+
+void DestroyComputePrimitives(ComputePrimitives* primitives) {
+	ComputeContext* context = primitives->context;
+	if (context == NULL) {
+		return;
+	}
+	DestroyLevels(primitives);
+	DestroyComputeKernel(context, &primitives->reduceKernel);
+	DestroyComputeKernel(context, &primitives->argmaxKernel);
+	DestroyComputeKernel(context, &primitives->scanKernel);
+	DestroyComputeKernel(context, &primitives->scanAddKernel);
+	DestroyDescriptorBinder(&primitives->binder);
+	memset(primitives, 0, sizeof(*primitives));
+}
+
+// Make sure there is a level buffer for every pass over elementCount elements. Levels are host visible, since
+// they are small and the last one holds the result.
+static VkResult EnsureLevels(ComputePrimitives* primitives, uint64_t elementCount) {
+	if (elementCount == 0 || elementCount > UINT32_MAX) {
+		printf("Primitives support 1 to %u elements\n", UINT32_MAX);
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+	}
+	if (elementCount <= primitives->capacity) {
+		return VK_SUCCESS;
+	}
+	DestroyLevels(primitives);
+
+	uint64_t count = elementCount;
+	for (uint32_t i = 0; i < PRIMITIVE_MAX_LEVELS && (i == 0 || count > 1); ++i) {
+		count = (count + primitives->blockSize - 1) / primitives->blockSize;
+		// The host reads results back from the last level, so every level goes in host cached memory
+		VkResult result = CreateComputeBuffer(primitives->context, count * sizeof(uint32_t), BUFFER_LOCATION_READBACK,
+			&primitives->levels[i]);
+		if (result == VK_SUCCESS) {
+			result = CreateComputeBuffer(primitives->context, count * sizeof(uint32_t), BUFFER_LOCATION_READBACK,
+				&primitives->levelIndices[i]);
+		}
+		if (result != VK_SUCCESS) {
+			DestroyLevels(primitives);
+			return result;
+		}
+	}
+	primitives->capacity = elementCount;
+	return VK_SUCCESS;
+}
+
+// Record one pass over elementCount elements, followed by a barrier for the next pass or the host
+static VkResult CmdPrimitivePass(ComputePrimitives* primitives, const ComputeKernel* kernel, const ComputeBuffer* buffers,
+	uint64_t elementCount, uint32_t parameter) {
+
+	ComputeContext* context = primitives->context;
+	uint32_t groupCountX = 0;
+	uint32_t groupCountY = 0;
+	uint32_t groupCountZ = 0;
+	VkResult result = ComputeDispatchSize(context, kernel, elementCount, &groupCountX, &groupCountY, &groupCountZ);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+	const uint32_t pushConstants[2] = { (uint32_t) elementCount, parameter };
+	result = CmdDispatchWithBinder(context->commandBuffer, &primitives->binder, kernel, buffers, NULL, pushConstants,
+		groupCountX, groupCountY, groupCountZ);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+
+	VkMemoryBarrier memoryBarrier = { 0 };
+	memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memoryBarrier.pNext = NULL;
+	memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(context->commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+	return VK_SUCCESS;
+}
+
+static VkResult SubmitPrimitivePasses(ComputePrimitives* primitives) {
+	ComputeContext* context = primitives->context;
+	VkResult result = vkEndCommandBuffer(context->commandBuffer);
+	if (result != VK_SUCCESS) {
+		puts("Failed to end recording command buffer");
+		return result;
+	}
+	result = SubmitAndWait(context);
+	if (result == VK_SUCCESS) {
+		result = ResetDescriptorBinder(&primitives->binder);
+	}
+	return result;
+}
+
+VkResult ReduceComputeBuffer(ComputePrimitives* primitives, const ComputeBuffer* input, uint64_t elementCount,
+	ReduceOp op, float* result) {
+
+	VkResult vkResult = EnsureLevels(primitives, elementCount);
+	if (vkResult == VK_SUCCESS) {
+		vkResult = BeginComputeCommandBuffer(primitives->context);
+	}
+	if (vkResult != VK_SUCCESS) {
+		return vkResult;
+	}
+
+	// Each pass reduces its input to one value per block, until one block is left
+	const ComputeBuffer* source = input;
+	uint64_t count = elementCount;
+	for (uint32_t level = 0; level == 0 || count > 1; ++level) {
+		const ComputeBuffer buffers[4] = { *source, primitives->levels[level], *source, primitives->levels[level] };
+		vkResult = CmdPrimitivePass(primitives, &primitives->reduceKernel, buffers, count, op);
+		if (vkResult != VK_SUCCESS) {
+			vkEndCommandBuffer(primitives->context->commandBuffer);
+			return vkResult;
+		}
+		count = (count + primitives->blockSize - 1) / primitives->blockSize;
+		source = &primitives->levels[level];
+	}
+
+	vkResult = SubmitPrimitivePasses(primitives);
+	if (vkResult == VK_SUCCESS) {
+		vkResult = ReadComputeBuffer(primitives->context, source, 0, result, sizeof(*result));
+	}
+	return vkResult;
+}
+
+VkResult ArgmaxComputeBuffer(ComputePrimitives* primitives, const ComputeBuffer* input, uint64_t elementCount,
+	uint32_t* index, float* value) {
+
+	VkResult result = EnsureLevels(primitives, elementCount);
+	if (result == VK_SUCCESS) {
+		result = BeginComputeCommandBuffer(primitives->context);
+	}
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+
+	// The first pass numbers the elements itself and ignores the index binding
+	const ComputeBuffer* sourceValues = input;
+	const ComputeBuffer* sourceIndices = input;
+	uint64_t count = elementCount;
+	for (uint32_t level = 0; level == 0 || count > 1; ++level) {
+		const ComputeBuffer buffers[4] = { *sourceValues, *sourceIndices, primitives->levels[level], primitives->levelIndices[level] };
+		result = CmdPrimitivePass(primitives, &primitives->argmaxKernel, buffers, count, level == 0);
+		if (result != VK_SUCCESS) {
+			vkEndCommandBuffer(primitives->context->commandBuffer);
+			return result;
+		}
+		count = (count + primitives->blockSize - 1) / primitives->blockSize;
+		sourceValues = &primitives->levels[level];
+		sourceIndices = &primitives->levelIndices[level];
+	}
+
+	result = SubmitPrimitivePasses(primitives);
+	if (result == VK_SUCCESS) {
+		result = ReadComputeBuffer(primitives->context, sourceValues, 0, value, sizeof(*value));
+	}
+	if (result == VK_SUCCESS) {
+		result = ReadComputeBuffer(primitives->context, sourceIndices, 0, index, sizeof(*index));
+	}
+	return result;
+}
+
+VkResult ScanComputeBuffer(ComputePrimitives* primitives, const ComputeBuffer* input, const ComputeBuffer* output,
+	uint64_t elementCount, uint32_t* total) {
+
+	VkResult result = EnsureLevels(primitives, elementCount);
+	if (result == VK_SUCCESS) {
+		result = BeginComputeCommandBuffer(primitives->context);
+	}
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+
+	// Scan each block of the data and write block totals to level 0, then scan level 0 in place into level 1
+	// and so on, until a level fits in one block. The last level written then holds the grand total.
+	uint64_t counts[PRIMITIVE_MAX_LEVELS];
+	counts[0] = elementCount;
+	uint32_t top = 0;
+	ComputeBuffer buffers[4] = { *input, *output, primitives->levels[0], primitives->levels[0] };
+	result = CmdPrimitivePass(primitives, &primitives->scanKernel, buffers, counts[0], 0);
+	while (result == VK_SUCCESS && counts[top] > primitives->blockSize) {
+		counts[top + 1] = (counts[top] + primitives->blockSize - 1) / primitives->blockSize;
+		++top;
+		buffers[0] = primitives->levels[top - 1];
+		buffers[1] = primitives->levels[top - 1];
+		buffers[2] = primitives->levels[top];
+		buffers[3] = primitives->levels[top];
+		result = CmdPrimitivePass(primitives, &primitives->scanKernel, buffers, counts[top], 0);
+	}
+
+	// Then add each scanned level of block totals into the level below, top down
+	for (uint32_t i = top; i > 0 && result == VK_SUCCESS; --i) {
+		buffers[0] = i > 1 ? primitives->levels[i - 2] : *output;
+		buffers[1] = primitives->levels[i - 1];
+		buffers[2] = buffers[0];
+		buffers[3] = buffers[1];
+		result = CmdPrimitivePass(primitives, &primitives->scanAddKernel, buffers, counts[i - 1], primitives->blockSize);
+	}
+	if (result != VK_SUCCESS) {
+		vkEndCommandBuffer(primitives->context->commandBuffer);
+		return result;
+	}
+
+	result = SubmitPrimitivePasses(primitives);
+	if (result == VK_SUCCESS) {
+		result = ReadComputeBuffer(primitives->context, &primitives->levels[top], 0, total, sizeof(*total));
+	}
+	return result;
+}
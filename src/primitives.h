@@ -0,0 +1,55 @@
+#include <vulkan/vulkan.h>
+#include "context.h"
+#include "buffer.h"
+#include "descriptors.h"
+#include "kernel.h"
+
+#ifndef PRIMITIVES_H
+#define PRIMITIVES_H
+
+// Each pass shrinks the data by PRIMITIVE_LOCAL_SIZE * PRIMITIVE_ELEMENTS_PER_INVOCATION, so four passes cover
+// any element count that fits in a uint32_t
+#define PRIMITIVE_LOCAL_SIZE 256
+#define PRIMITIVE_ELEMENTS_PER_INVOCATION 4
+#define PRIMITIVE_MAX_LEVELS 4
+
+typedef enum ReduceOp {
+	REDUCE_OP_SUM,
+	REDUCE_OP_MIN,
+	REDUCE_OP_MAX
+} ReduceOp;
+
+// Reduction and scan kernels, and the scratch buffers their passes hand partial results through. Every
+// kernel is built twice: with GL_KHR_shader_subgroup_arithmetic, used when the device supports it in compute
+// shaders (VkPhysicalDeviceSubgroupProperties), and with shared memory trees alone.
+typedef struct ComputePrimitives {
+	ComputeContext* context;
+	int subgroups;
+	// Elements each workgroup reduces or scans
+	uint32_t blockSize;
+	DescriptorBinder binder;
+	ComputeKernel reduceKernel;
+	ComputeKernel argmaxKernel;
+	ComputeKernel scanKernel;
+	ComputeKernel scanAddKernel;
+	// Level i holds one value (and for argmax, one index) per block of level i - 1, level 0 one per block of the input
+	ComputeBuffer levels[PRIMITIVE_MAX_LEVELS];
+	ComputeBuffer levelIndices[PRIMITIVE_MAX_LEVELS];
+	uint64_t capacity;
+} ComputePrimitives;
+
+VkResult CreateComputePrimitives(ComputeContext* context, ComputePrimitives* primitives);
+void DestroyComputePrimitives(ComputePrimitives* primitives);
+
+// Reduce the first elementCount floats of input with op, dispatching and waiting for every pass
+VkResult ReduceComputeBuffer(ComputePrimitives* primitives, const ComputeBuffer* input, uint64_t elementCount,
+	ReduceOp op, float* result);
+// Index and value of the largest of the first elementCount floats of input, the first one on ties
+VkResult ArgmaxComputeBuffer(ComputePrimitives* primitives, const ComputeBuffer* input, uint64_t elementCount,
+	uint32_t* index, float* value);
+// Exclusive prefix sum of the first elementCount uint32_t of input into output, which may be input itself. total
+// receives the sum of all of them, e.g. the output size of a stream compaction.
+VkResult ScanComputeBuffer(ComputePrimitives* primitives, const ComputeBuffer* input, const ComputeBuffer* output,
+	uint64_t elementCount, uint32_t* total);
+
+#endif
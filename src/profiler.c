@@ -0,0 +1,351 @@
+#include "profiler.h"
+#include "timer.h"
+#include <vulkan/vulkan.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+VkResult CreateProfiler(VkPhysicalDevice physicalDevice, VkDevice device, int hostQueryReset, Profiler* profiler) {
+	memset(profiler, 0, sizeof(*profiler));
+	profiler->device = device;
+	profiler->hostQueryReset = hostQueryReset;
+
+	VkPhysicalDeviceProperties properties = { 0 };
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	profiler->timestampPeriod = properties.limits.timestampPeriod;
+
+	// Queues report timestampValidBits == 0 when they cannot write timestamps; scopes on them are skipped
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, NULL);
+	VkQueueFamilyProperties* queueFamilies = calloc(queueFamilyCount, sizeof(VkQueueFamilyProperties));
+	if (queueFamilies == NULL) {
+		return VK_ERROR_OUT_OF_HOST_MEMORY;
+	}
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies);
+	profiler->queueFamilyCount = queueFamilyCount < PROFILER_MAX_QUEUE_FAMILIES ? queueFamilyCount : PROFILER_MAX_QUEUE_FAMILIES;
+	for (uint32_t i = 0; i < profiler->queueFamilyCount; ++i) {
+		profiler->timestampValidBits[i] = queueFamilies[i].timestampValidBits;
+		profiler->queueFlags[i] = queueFamilies[i].queueFlags;
+	}
+	free(queueFamilies);
+
+	VkQueryPoolCreateInfo queryPoolInfo = { 0 };
+	queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolInfo.pNext = NULL;
+	queryPoolInfo.flags = 0;
+	queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	queryPoolInfo.queryCount = 2 * PROFILER_MAX_SCOPES;
+	queryPoolInfo.pipelineStatistics = 0;
+
+	VkResult result = vkCreateQueryPool(device, &queryPoolInfo, NULL, &profiler->queryPool);
+	if (result != VK_SUCCESS) {
+		puts("Failed to create timestamp query pool");
+		return result;
+	}
+
+	profiler->batches[0].inUse = 1;
+	return VK_SUCCESS;
+}
+
+void DestroyProfiler(Profiler* profiler) {
+	if (profiler == NULL) {
+		return;
+	}
+	vkDestroyQueryPool(profiler->device, profiler->queryPool, NULL);
+	free(profiler->events);
+	memset(profiler, 0, sizeof(*profiler));
+}
+
+static void CopyName(char* dst, const char* src) {
+	strncpy(dst, src, PROFILER_NAME_SIZE - 1);
+	dst[PROFILER_NAME_SIZE - 1] = '\0';
+}
+
+static ProfileEvent* AddProfileEvent(Profiler* profiler, const char* name, ProfileEventType type) {
+	if (profiler->eventCount == profiler->eventCapacity) {
+		uint32_t capacity = profiler->eventCapacity > 0 ? 2 * profiler->eventCapacity : 64;
+		ProfileEvent* events = realloc(profiler->events, capacity * sizeof(ProfileEvent));
+		if (events == NULL) {
+			return NULL;
+		}
+		profiler->events = events;
+		profiler->eventCapacity = capacity;
+	}
+
+	ProfileEvent* event = &profiler->events[profiler->eventCount++];
+	memset(event, 0, sizeof(*event));
+	CopyName(event->name, name);
+	event->type = type;
+	event->queueFamilyIndex = UINT32_MAX;
+	return event;
+}
+
+uint32_t CmdBeginProfileScope(Profiler* profiler, VkCommandBuffer commandBuffer, uint32_t queueFamilyIndex, const char* name) {
+	if (profiler == NULL || queueFamilyIndex >= profiler->queueFamilyCount || profiler->timestampValidBits[queueFamilyIndex] == 0) {
+		return PROFILE_SCOPE_NONE;
+	}
+	// vkCmdResetQueryPool needs a graphics or compute queue
+	const VkQueueFlags resetFlags = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT;
+	if (!profiler->hostQueryReset && !(profiler->queueFlags[queueFamilyIndex] & resetFlags)) {
+		return PROFILE_SCOPE_NONE;
+	}
+
+	// Take the next free scope; if every scope is still in flight this one goes unmeasured
+	uint32_t scope = PROFILE_SCOPE_NONE;
+	for (uint32_t i = 0; i < PROFILER_MAX_SCOPES; ++i) {
+		uint32_t candidate = (profiler->nextScope + i) % PROFILER_MAX_SCOPES;
+		if (!profiler->scopes[candidate].inUse) {
+			scope = candidate;
+			break;
+		}
+	}
+	if (scope == PROFILE_SCOPE_NONE) {
+		return PROFILE_SCOPE_NONE;
+	}
+	profiler->nextScope = (scope + 1) % PROFILER_MAX_SCOPES;
+
+	ProfileScope* profileScope = &profiler->scopes[scope];
+	CopyName(profileScope->name, name);
+	profileScope->queueFamilyIndex = queueFamilyIndex;
+	profileScope->batch = profiler->openBatch;
+	profileScope->inUse = 1;
+	profileScope->ended = 0;
+
+	// A free scope's queries are not used by any pending command buffer, so the host can reset them right away
+	if (profiler->hostQueryReset) {
+		vkResetQueryPool(profiler->device, profiler->queryPool, 2 * scope, 2);
+	}
+	else {
+		vkCmdResetQueryPool(commandBuffer, profiler->queryPool, 2 * scope, 2);
+	}
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, profiler->queryPool, 2 * scope);
+	return scope;
+}
+
+void CmdEndProfileScope(Profiler* profiler, VkCommandBuffer commandBuffer, uint32_t scope) {
+	if (profiler == NULL || scope == PROFILE_SCOPE_NONE) {
+		return;
+	}
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, profiler->queryPool, 2 * scope + 1);
+	profiler->scopes[scope].ended = 1;
+}
+
+uint32_t SubmitProfileBatch(Profiler* profiler, const char* name) {
+	if (profiler == NULL) {
+		return PROFILE_SCOPE_NONE;
+	}
+
+	uint32_t batch = profiler->openBatch;
+	CopyName(profiler->batches[batch].name, name);
+	profiler->batches[batch].submitNs = GetTimeNs();
+
+	// Open the next free batch for the scopes recorded from now on. Batches are as limited as scopes, and each
+	// holds at least one scope or submission, so a free one exists unless the caller never completes batches.
+	for (uint32_t i = 1; i < PROFILER_MAX_SCOPES; ++i) {
+		uint32_t candidate = (batch + i) % PROFILER_MAX_SCOPES;
+		if (!profiler->batches[candidate].inUse) {
+			profiler->batches[candidate].inUse = 1;
+			profiler->openBatch = candidate;
+			break;
+		}
+	}
+	return batch;
+}
+
+void CompleteProfileBatch(Profiler* profiler, uint32_t batch) {
+	if (profiler == NULL || batch == PROFILE_SCOPE_NONE || batch == profiler->openBatch) {
+		return;
+	}
+	const uint64_t completeNs = GetTimeNs();
+
+	uint64_t gpuNs = 0;
+	for (uint32_t scope = 0; scope < PROFILER_MAX_SCOPES; ++scope) {
+		ProfileScope* profileScope = &profiler->scopes[scope];
+		if (!profileScope->inUse || profileScope->batch != batch) {
+			continue;
+		}
+		profileScope->inUse = 0;
+		if (!profileScope->ended) {
+			continue;
+		}
+
+		uint64_t timestamps[2] = { 0 };
+		VkResult result = vkGetQueryPoolResults(profiler->device, profiler->queryPool, 2 * scope, 2, sizeof(timestamps),
+			timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+		if (result != VK_SUCCESS) {
+			continue;
+		}
+
+		// Only the low timestampValidBits bits count, so take the difference modulo that width
+		uint32_t validBits = profiler->timestampValidBits[profileScope->queueFamilyIndex];
+		uint64_t mask = validBits >= 64 ? UINT64_MAX : ((uint64_t) 1 << validBits) - 1;
+		uint64_t ticks = (timestamps[1] - timestamps[0]) & mask;
+
+		ProfileEvent* event = AddProfileEvent(profiler, profileScope->name, PROFILE_EVENT_GPU);
+		if (event != NULL) {
+			event->queueFamilyIndex = profileScope->queueFamilyIndex;
+			event->startNs = (uint64_t) ((double) (timestamps[0] & mask) * profiler->timestampPeriod);
+			event->durationNs = (uint64_t) ((double) ticks * profiler->timestampPeriod);
+			gpuNs += event->durationNs;
+		}
+	}
+
+	ProfileBatch* profileBatch = &profiler->batches[batch];
+	ProfileEvent* event = AddProfileEvent(profiler, profileBatch->name, PROFILE_EVENT_SUBMIT);
+	if (event != NULL) {
+		event->startNs = profileBatch->submitNs;
+		event->durationNs = completeNs - profileBatch->submitNs;
+		event->latencyNs = event->durationNs > gpuNs ? event->durationNs - gpuNs : 0;
+	}
+	profileBatch->inUse = 0;
+}
+
+void AddProfileCpuEvent(Profiler* profiler, const char* name, uint64_t startNs, uint64_t endNs) {
+	if (profiler == NULL) {
+		return;
+	}
+	ProfileEvent* event = AddProfileEvent(profiler, name, PROFILE_EVENT_CPU);
+	if (event != NULL) {
+		event->startNs = startNs;
+		event->durationNs = endNs - startNs;
+	}
+}
+
+void ClearProfileEvents(Profiler* profiler) {
+	if (profiler != NULL) {
+		profiler->eventCount = 0;
+	}
+}
+
+static const char* GetProfileEventTypeName(ProfileEventType type) {
+	switch (type) {
+	case PROFILE_EVENT_CPU:
+		return "cpu";
+	case PROFILE_EVENT_GPU:
+		return "gpu";
+	case PROFILE_EVENT_SUBMIT:
+		return "submit";
+	}
+	return "unknown";
+}
+
+typedef struct ProfileSummary {
+	const char* name;
+	ProfileEventType type;
+	uint32_t count;
+	uint64_t totalNs;
+	uint64_t minNs;
+	uint64_t maxNs;
+	uint64_t totalLatencyNs;
+} ProfileSummary;
+
+// Aggregate events by name and type, in order of first appearance. Returns the number of summaries.
+static uint32_t SummarizeProfileEvents(const Profiler* profiler, ProfileSummary* summaries) {
+	uint32_t summaryCount = 0;
+	for (uint32_t i = 0; i < profiler->eventCount; ++i) {
+		const ProfileEvent* event = &profiler->events[i];
+		ProfileSummary* summary = NULL;
+		for (uint32_t j = 0; j < summaryCount; ++j) {
+			if (summaries[j].type == event->type && !strcmp(summaries[j].name, event->name)) {
+				summary = &summaries[j];
+				break;
+			}
+		}
+		if (summary == NULL) {
+			summary = &summaries[summaryCount++];
+			summary->name = event->name;
+			summary->type = event->type;
+			summary->minNs = UINT64_MAX;
+		}
+		summary->count++;
+		summary->totalNs += event->durationNs;
+		summary->totalLatencyNs += event->latencyNs;
+		if (event->durationNs < summary->minNs) {
+			summary->minNs = event->durationNs;
+		}
+		if (event->durationNs > summary->maxNs) {
+			summary->maxNs = event->durationNs;
+		}
+	}
+	return summaryCount;
+}
+
+static void WriteProfileCsv(const Profiler* profiler, const ProfileSummary* summaries, uint32_t summaryCount, FILE* file) {
+	fputs("name,type,queue_family,start_ns,duration_ns,latency_ns\n", file);
+	for (uint32_t i = 0; i < profiler->eventCount; ++i) {
+		const ProfileEvent* event = &profiler->events[i];
+		fprintf(file, "%s,%s,%d,%llu,%llu,%llu\n", event->name, GetProfileEventTypeName(event->type),
+			event->queueFamilyIndex == UINT32_MAX ? -1 : (int) event->queueFamilyIndex,
+			(unsigned long long) event->startNs, (unsigned long long) event->durationNs,
+			(unsigned long long) event->latencyNs);
+	}
+
+	// Summary rows follow the events after a blank line, so a dashboard can read either table
+	fputs("\nname,type,count,total_ns,mean_ns,min_ns,max_ns,mean_latency_ns\n", file);
+	for (uint32_t i = 0; i < summaryCount; ++i) {
+		const ProfileSummary* summary = &summaries[i];
+		fprintf(file, "%s,%s,%u,%llu,%llu,%llu,%llu,%llu\n", summary->name, GetProfileEventTypeName(summary->type),
+			summary->count, (unsigned long long) summary->totalNs, (unsigned long long) (summary->totalNs / summary->count),
+			(unsigned long long) summary->minNs, (unsigned long long) summary->maxNs,
+			(unsigned long long) (summary->totalLatencyNs / summary->count));
+	}
+}
+
+static void WriteProfileJson(const Profiler* profiler, const ProfileSummary* summaries, uint32_t summaryCount, FILE* file) {
+	// Names are identifiers chosen by the instrumented code, so they are written without escaping
+	fprintf(file, "{\n\t\"timestampPeriod\": %f,\n\t\"events\": [", profiler->timestampPeriod);
+	for (uint32_t i = 0; i < profiler->eventCount; ++i) {
+		const ProfileEvent* event = &profiler->events[i];
+		fprintf(file, "%s\n\t\t{ \"name\": \"%s\", \"type\": \"%s\", \"queueFamily\": %d, "
+			"\"startNs\": %llu, \"durationNs\": %llu, \"latencyNs\": %llu }",
+			i > 0 ? "," : "", event->name, GetProfileEventTypeName(event->type),
+			event->queueFamilyIndex == UINT32_MAX ? -1 : (int) event->queueFamilyIndex,
+			(unsigned long long) event->startNs, (unsigned long long) event->durationNs,
+			(unsigned long long) event->latencyNs);
+	}
+	fputs("\n\t],\n\t\"summary\": [", file);
+	for (uint32_t i = 0; i < summaryCount; ++i) {
+		const ProfileSummary* summary = &summaries[i];
+		fprintf(file, "%s\n\t\t{ \"name\": \"%s\", \"type\": \"%s\", \"count\": %u, \"totalNs\": %llu, "
+			"\"meanNs\": %llu, \"minNs\": %llu, \"maxNs\": %llu, \"meanLatencyNs\": %llu }",
+			i > 0 ? "," : "", summary->name, GetProfileEventTypeName(summary->type), summary->count,
+			(unsigned long long) summary->totalNs, (unsigned long long) (summary->totalNs / summary->count),
+			(unsigned long long) summary->minNs, (unsigned long long) summary->maxNs,
+			(unsigned long long) (summary->totalLatencyNs / summary->count));
+	}
+	fputs("\n\t]\n}\n", file);
+}
+
+VkResult WriteProfileReport(const Profiler* profiler, const char* path) {
+	if (profiler == NULL) {
+		return VK_SUCCESS;
+	}
+
+	ProfileSummary* summaries = calloc(profiler->eventCount > 0 ? profiler->eventCount : 1, sizeof(ProfileSummary));
+	if (summaries == NULL) {
+		return VK_ERROR_OUT_OF_HOST_MEMORY;
+	}
+	uint32_t summaryCount = SummarizeProfileEvents(profiler, summaries);
+
+	FILE* file = fopen(path, "w");
+	if (file == NULL) {
+		printf("Failed to open profile report %s\n", path);
+		free(summaries);
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+
+	size_t length = strlen(path);
+	if (length >= 4 && !strcmp(path + length - 4, ".csv")) {
+		WriteProfileCsv(profiler, summaries, summaryCount, file);
+	}
+	else {
+		WriteProfileJson(profiler, summaries, summaryCount, file);
+	}
+	free(summaries);
+
+	if (fclose(file) != 0) {
+		printf("Failed to write profile report %s\n", path);
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+	return VK_SUCCESS;
+}
@@ -0,0 +1,98 @@
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// Scopes that can be recorded but not yet completed at once; each uses two timestamp queries
+#define PROFILER_MAX_SCOPES 256
+#define PROFILER_MAX_QUEUE_FAMILIES 16
+#define PROFILER_NAME_SIZE 48
+// Returned for scopes that are not measured, e.g. on queues without timestamp support or with no profiler
+#define PROFILE_SCOPE_NONE UINT32_MAX
+
+typedef enum ProfileEventType {
+	// A host-side phase timed with GetTimeNs
+	PROFILE_EVENT_CPU,
+	// Commands timed with timestamp queries on the device
+	PROFILE_EVENT_GPU,
+	// One submission timed on the host from just before vkQueueSubmit until its fence wait returned
+	PROFILE_EVENT_SUBMIT
+} ProfileEventType;
+
+typedef struct ProfileEvent {
+	char name[PROFILER_NAME_SIZE];
+	ProfileEventType type;
+	// Queue family of GPU events, UINT32_MAX otherwise
+	uint32_t queueFamilyIndex;
+	// Host clock for CPU and submit events, device timestamp clock for GPU events
+	uint64_t startNs;
+	uint64_t durationNs;
+	// Submit events only: host time not covered by the batch's GPU scopes, i.e. submission, scheduling,
+	// semaphore hand-off between queues and wakeup
+	uint64_t latencyNs;
+} ProfileEvent;
+
+typedef struct ProfileScope {
+	char name[PROFILER_NAME_SIZE];
+	uint32_t queueFamilyIndex;
+	uint32_t batch;
+	int inUse;
+	int ended;
+} ProfileScope;
+
+typedef struct ProfileBatch {
+	char name[PROFILER_NAME_SIZE];
+	uint64_t submitNs;
+	int inUse;
+} ProfileBatch;
+
+// Collects GPU timestamps around recorded commands and host timings of setup phases into one list of events.
+// Every function accepts a NULL profiler and then does nothing, so instrumented code needs no checks.
+typedef struct Profiler {
+	VkDevice device;
+	VkQueryPool queryPool;
+	// Nanoseconds per timestamp tick
+	float timestampPeriod;
+	uint32_t queueFamilyCount;
+	uint32_t timestampValidBits[PROFILER_MAX_QUEUE_FAMILIES];
+	VkQueueFlags queueFlags[PROFILER_MAX_QUEUE_FAMILIES];
+	// Queries are reset on the host with vkResetQueryPool instead of in the command buffer, which transfer-only
+	// queue families cannot do
+	int hostQueryReset;
+	ProfileScope scopes[PROFILER_MAX_SCOPES];
+	uint32_t nextScope;
+	// Scopes recorded since the last SubmitProfileBatch belong to openBatch
+	ProfileBatch batches[PROFILER_MAX_SCOPES];
+	uint32_t openBatch;
+	ProfileEvent* events;
+	uint32_t eventCount;
+	uint32_t eventCapacity;
+} Profiler;
+
+// hostQueryReset is non-zero if the device was created with the Vulkan 1.2 hostQueryReset feature. Without it,
+// scopes on queue families without graphics or compute support are not measured.
+VkResult CreateProfiler(VkPhysicalDevice physicalDevice, VkDevice device, int hostQueryReset, Profiler* profiler);
+void DestroyProfiler(Profiler* profiler);
+
+// Record a timestamp at the start of a scope of commands executed on a queue of queueFamilyIndex
+uint32_t CmdBeginProfileScope(Profiler* profiler, VkCommandBuffer commandBuffer, uint32_t queueFamilyIndex, const char* name);
+// Record a timestamp once all commands recorded since the matching CmdBeginProfileScope have completed
+void CmdEndProfileScope(Profiler* profiler, VkCommandBuffer commandBuffer, uint32_t scope);
+
+// Call immediately before submitting the command buffers holding the scopes recorded since the last call.
+// Returns the batch to pass to CompleteProfileBatch.
+uint32_t SubmitProfileBatch(Profiler* profiler, const char* name);
+// Call as soon as the fence of the batch's last submission has been waited on. Reads back its timestamps
+// and adds a GPU event per scope and a submit event for the batch.
+void CompleteProfileBatch(Profiler* profiler, uint32_t batch);
+
+void AddProfileCpuEvent(Profiler* profiler, const char* name, uint64_t startNs, uint64_t endNs);
+
+// Drop all events collected so far, e.g. between benchmark configurations. Scopes in flight are kept.
+void ClearProfileEvents(Profiler* profiler);
+
+// Write every event and a per-name summary. The format is CSV if path ends in ".csv" and JSON otherwise.
+VkResult WriteProfileReport(const Profiler* profiler, const char* path);
+
+#endif
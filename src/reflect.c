@@ -0,0 +1,487 @@
+#include "reflect.h"
+#include "shaders.h"
+#include <vulkan/vulkan.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define SPIRV_HEADER_WORDS 5
+
+// Opcodes, decorations and enumerants from the SPIR-V specification
+#define OP_EXECUTION_MODE 16
+#define OP_TYPE_VOID 19
+#define OP_TYPE_BOOL 20
+#define OP_TYPE_INT 21
+#define OP_TYPE_FLOAT 22
+#define OP_TYPE_VECTOR 23
+#define OP_TYPE_MATRIX 24
+#define OP_TYPE_IMAGE 25
+#define OP_TYPE_SAMPLER 26
+#define OP_TYPE_SAMPLED_IMAGE 27
+#define OP_TYPE_ARRAY 28
+#define OP_TYPE_RUNTIME_ARRAY 29
+#define OP_TYPE_STRUCT 30
+#define OP_TYPE_POINTER 32
+#define OP_TYPE_FORWARD_POINTER 39
+#define OP_CONSTANT_TRUE 41
+#define OP_CONSTANT 43
+#define OP_SPEC_CONSTANT 50
+#define OP_SPEC_CONSTANT_OP 52
+#define OP_VARIABLE 59
+#define OP_DECORATE 71
+#define OP_MEMBER_DECORATE 72
+#define OP_EXECUTION_MODE_ID 331
+
+#define DECORATION_SPEC_ID 1
+#define DECORATION_BUFFER_BLOCK 3
+#define DECORATION_ARRAY_STRIDE 6
+#define DECORATION_MATRIX_STRIDE 7
+#define DECORATION_BUILT_IN 11
+#define DECORATION_BINDING 33
+#define DECORATION_DESCRIPTOR_SET 34
+#define DECORATION_OFFSET 35
+
+#define BUILT_IN_WORKGROUP_SIZE 25
+#define EXECUTION_MODE_LOCAL_SIZE 17
+#define EXECUTION_MODE_LOCAL_SIZE_ID 38
+#define DIM_BUFFER 5
+
+#define STORAGE_CLASS_UNIFORM_CONSTANT 0
+#define STORAGE_CLASS_UNIFORM 2
+#define STORAGE_CLASS_PUSH_CONSTANT 9
+#define STORAGE_CLASS_STORAGE_BUFFER 12
+#define STORAGE_CLASS_PHYSICAL_STORAGE_BUFFER 5349
+
+// Struct members whose offsets are tracked when sizing the push constant block
+#define MAX_STRUCT_MEMBERS 64
+// Nesting depth of types followed when computing sizes
+#define MAX_TYPE_DEPTH 16
+
+#define ID_HAS_SET 0x1
+#define ID_HAS_BINDING 0x2
+#define ID_BUFFER_BLOCK 0x4
+#define ID_WORKGROUP_SIZE 0x8
+#define ID_HAS_SPEC_ID 0x10
+
+// Where each result ID is defined and the decorations applied to it
+typedef struct SpirvId {
+	uint32_t opcode;
+	// Word offset of the defining instruction, or 0 if the ID is not defined by a type, constant or variable
+	uint32_t offset;
+	uint32_t flags;
+	uint32_t set;
+	uint32_t binding;
+	uint32_t arrayStride;
+	uint32_t specId;
+} SpirvId;
+
+typedef struct SpirvModule {
+	const uint32_t* code;
+	uint32_t wordCount;
+	SpirvId* ids;
+	uint32_t bound;
+} SpirvModule;
+
+// Return the ID's defining instruction if it exists and is one of the expected opcodes (0 accepts any)
+static const uint32_t* GetIdInstruction(const SpirvModule* module, uint32_t id, uint32_t opcode) {
+	if (id >= module->bound || module->ids[id].offset == 0) {
+		return NULL;
+	}
+	if (opcode != 0 && module->ids[id].opcode != opcode) {
+		return NULL;
+	}
+	return module->code + module->ids[id].offset;
+}
+
+// Value of a 32-bit integer constant or the default of a specialization constant
+static int GetConstantValue(const SpirvModule* module, uint32_t id, uint32_t* value) {
+	if (id >= module->bound || module->ids[id].offset == 0) {
+		return 0;
+	}
+	const uint32_t opcode = module->ids[id].opcode;
+	if (opcode != OP_CONSTANT && opcode != OP_SPEC_CONSTANT) {
+		return 0;
+	}
+	*value = module->code[module->ids[id].offset + 3];
+	return 1;
+}
+
+static uint32_t GetTypeSize(const SpirvModule* module, uint32_t typeId, uint32_t matrixStride, uint32_t depth);
+
+// Size of a struct as laid out by its member Offset decorations: the end of the member that ends last
+static uint32_t GetStructSize(const SpirvModule* module, uint32_t structId, uint32_t depth) {
+	const uint32_t* instruction = GetIdInstruction(module, structId, OP_TYPE_STRUCT);
+	if (instruction == NULL) {
+		return 0;
+	}
+	uint32_t memberCount = (instruction[0] >> 16) - 2;
+	if (memberCount > MAX_STRUCT_MEMBERS) {
+		memberCount = MAX_STRUCT_MEMBERS;
+	}
+
+	uint32_t offsets[MAX_STRUCT_MEMBERS] = { 0 };
+	uint32_t matrixStrides[MAX_STRUCT_MEMBERS] = { 0 };
+	for (uint32_t word = SPIRV_HEADER_WORDS; word < module->wordCount; word += module->code[word] >> 16) {
+		const uint32_t* decorate = module->code + word;
+		if ((decorate[0] & 0xffff) != OP_MEMBER_DECORATE || (decorate[0] >> 16) < 5 ||
+			decorate[1] != structId || decorate[2] >= memberCount) {
+			continue;
+		}
+		if (decorate[3] == DECORATION_OFFSET) {
+			offsets[decorate[2]] = decorate[4];
+		}
+		else if (decorate[3] == DECORATION_MATRIX_STRIDE) {
+			matrixStrides[decorate[2]] = decorate[4];
+		}
+	}
+
+	uint32_t size = 0;
+	for (uint32_t i = 0; i < memberCount; ++i) {
+		uint32_t end = offsets[i] + GetTypeSize(module, instruction[2 + i], matrixStrides[i], depth + 1);
+		if (end > size) {
+			size = end;
+		}
+	}
+	return size;
+}
+
+// Size in bytes of a type in an explicitly laid out block. matrixStride applies if the type is a matrix member.
+static uint32_t GetTypeSize(const SpirvModule* module, uint32_t typeId, uint32_t matrixStride, uint32_t depth) {
+	const uint32_t* instruction = GetIdInstruction(module, typeId, 0);
+	if (instruction == NULL || depth > MAX_TYPE_DEPTH) {
+		return 0;
+	}
+
+	uint32_t length = 0;
+	switch (module->ids[typeId].opcode) {
+	case OP_TYPE_BOOL:
+		return 4;
+	case OP_TYPE_INT:
+	case OP_TYPE_FLOAT:
+		return instruction[2] / 8;
+	case OP_TYPE_VECTOR:
+		return instruction[3] * GetTypeSize(module, instruction[2], 0, depth + 1);
+	case OP_TYPE_MATRIX:
+		return instruction[3] * (matrixStride > 0 ? matrixStride : GetTypeSize(module, instruction[2], 0, depth + 1));
+	case OP_TYPE_ARRAY:
+		if (!GetConstantValue(module, instruction[3], &length)) {
+			return 0;
+		}
+		if (module->ids[typeId].arrayStride > 0) {
+			return length * module->ids[typeId].arrayStride;
+		}
+		return length * GetTypeSize(module, instruction[2], matrixStride, depth + 1);
+	case OP_TYPE_STRUCT:
+		return GetStructSize(module, typeId, depth);
+	case OP_TYPE_POINTER:
+		// Buffer references are 64-bit device addresses
+		return instruction[2] == STORAGE_CLASS_PHYSICAL_STORAGE_BUFFER ? 8 : 0;
+	default:
+		return 0;
+	}
+}
+
+// Work out the descriptor type and count of a resource variable from its storage class and pointee type
+static VkResult GetDescriptorType(const SpirvModule* module, uint32_t storageClass, uint32_t typeId,
+	VkDescriptorType* descriptorType, uint32_t* descriptorCount) {
+
+	*descriptorCount = 1;
+	const uint32_t* type = GetIdInstruction(module, typeId, 0);
+	if (type != NULL && module->ids[typeId].opcode == OP_TYPE_ARRAY) {
+		if (!GetConstantValue(module, type[3], descriptorCount)) {
+			return VK_ERROR_INITIALIZATION_FAILED;
+		}
+		typeId = type[2];
+		type = GetIdInstruction(module, typeId, 0);
+	}
+	else if (type != NULL && module->ids[typeId].opcode == OP_TYPE_RUNTIME_ARRAY) {
+		*descriptorCount = 0;
+		typeId = type[2];
+		type = GetIdInstruction(module, typeId, 0);
+	}
+	if (type == NULL) {
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+
+	const uint32_t opcode = module->ids[typeId].opcode;
+	if (storageClass == STORAGE_CLASS_STORAGE_BUFFER && opcode == OP_TYPE_STRUCT) {
+		*descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		return VK_SUCCESS;
+	}
+	if (storageClass == STORAGE_CLASS_UNIFORM && opcode == OP_TYPE_STRUCT) {
+		// Before SPIR-V 1.3 storage buffers are Uniform blocks decorated BufferBlock
+		*descriptorType = (module->ids[typeId].flags & ID_BUFFER_BLOCK) ?
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		return VK_SUCCESS;
+	}
+	if (storageClass != STORAGE_CLASS_UNIFORM_CONSTANT) {
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+
+	switch (opcode) {
+	case OP_TYPE_IMAGE:
+		if (type[3] == DIM_BUFFER) {
+			*descriptorType = type[7] == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+		}
+		else {
+			*descriptorType = type[7] == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+		}
+		return VK_SUCCESS;
+	case OP_TYPE_SAMPLER:
+		*descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+		return VK_SUCCESS;
+	case OP_TYPE_SAMPLED_IMAGE:
+		*descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		return VK_SUCCESS;
+	default:
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+}
+
+// Fewest words an instruction defining an ID can have, counting every operand reflection reads from it
+static uint32_t GetMinimumWordCount(uint32_t opcode) {
+	switch (opcode) {
+	case OP_TYPE_INT:
+	case OP_TYPE_VECTOR:
+	case OP_TYPE_MATRIX:
+	case OP_TYPE_ARRAY:
+	case OP_TYPE_POINTER:
+	case OP_CONSTANT:
+	case OP_SPEC_CONSTANT:
+	case OP_VARIABLE:
+		return 4;
+	case OP_TYPE_FLOAT:
+	case OP_TYPE_RUNTIME_ARRAY:
+	case OP_TYPE_SAMPLED_IMAGE:
+		return 3;
+	case OP_TYPE_IMAGE:
+		return 9;
+	default:
+		return 0;
+	}
+}
+
+// Record the defining instruction and decorations of every ID, and the execution modes of the module
+static VkResult IndexSpirvModule(SpirvModule* module, ShaderReflection* reflection) {
+	const uint32_t* code = module->code;
+	for (uint32_t word = SPIRV_HEADER_WORDS; word < module->wordCount; ) {
+		const uint32_t opcode = code[word] & 0xffff;
+		const uint32_t length = code[word] >> 16;
+		if (length == 0 || word + length > module->wordCount) {
+			return VK_ERROR_INITIALIZATION_FAILED;
+		}
+		const uint32_t* instruction = code + word;
+
+		// Types define their result at word 1, constants and variables at word 2 after the result type
+		uint32_t resultWord = 0;
+		if (opcode >= OP_TYPE_VOID && opcode < OP_TYPE_FORWARD_POINTER) {
+			resultWord = 1;
+		}
+		else if ((opcode >= OP_CONSTANT_TRUE && opcode <= OP_SPEC_CONSTANT_OP) || opcode == OP_VARIABLE) {
+			resultWord = 2;
+		}
+		if (resultWord > 0) {
+			// A short instruction would have its operands read from past its end, or past the module
+			if (length <= resultWord || length < GetMinimumWordCount(opcode)) {
+				return VK_ERROR_INITIALIZATION_FAILED;
+			}
+			uint32_t id = instruction[resultWord];
+			if (id >= module->bound) {
+				return VK_ERROR_INITIALIZATION_FAILED;
+			}
+			module->ids[id].opcode = opcode;
+			module->ids[id].offset = word;
+		}
+
+		if (opcode == OP_DECORATE) {
+			const int hasLiteral = length >= 3 && (instruction[2] == DECORATION_SPEC_ID ||
+				instruction[2] == DECORATION_ARRAY_STRIDE || instruction[2] == DECORATION_BUILT_IN ||
+				instruction[2] == DECORATION_BINDING || instruction[2] == DECORATION_DESCRIPTOR_SET);
+			if (length < 3 || (hasLiteral && length < 4)) {
+				return VK_ERROR_INITIALIZATION_FAILED;
+			}
+			uint32_t id = instruction[1];
+			if (id >= module->bound) {
+				return VK_ERROR_INITIALIZATION_FAILED;
+			}
+			SpirvId* target = &module->ids[id];
+			const uint32_t literal = hasLiteral ? instruction[3] : 0;
+			switch (instruction[2]) {
+			case DECORATION_SPEC_ID:
+				target->flags |= ID_HAS_SPEC_ID;
+				target->specId = literal;
+				if (literal < 32) {
+					reflection->specConstantMask |= 1u << literal;
+				}
+				break;
+			case DECORATION_BUFFER_BLOCK:
+				target->flags |= ID_BUFFER_BLOCK;
+				break;
+			case DECORATION_ARRAY_STRIDE:
+				target->arrayStride = literal;
+				break;
+			case DECORATION_BUILT_IN:
+				if (literal == BUILT_IN_WORKGROUP_SIZE) {
+					target->flags |= ID_WORKGROUP_SIZE;
+				}
+				break;
+			case DECORATION_BINDING:
+				target->flags |= ID_HAS_BINDING;
+				target->binding = literal;
+				break;
+			case DECORATION_DESCRIPTOR_SET:
+				target->flags |= ID_HAS_SET;
+				target->set = literal;
+				break;
+			}
+		}
+		else if (opcode == OP_EXECUTION_MODE && length >= 6 && instruction[2] == EXECUTION_MODE_LOCAL_SIZE) {
+			reflection->localSize[0] = instruction[3];
+			reflection->localSize[1] = instruction[4];
+			reflection->localSize[2] = instruction[5];
+		}
+
+		word += length;
+	}
+	return VK_SUCCESS;
+}
+
+// A WorkgroupSize built-in overrides LocalSize, and with specialization constants is how local_size_x_id is
+// expressed. LocalSizeId refers to constants rather than literals.
+static void ReflectWorkgroupSize(const SpirvModule* module, ShaderReflection* reflection) {
+	const uint32_t* code = module->code;
+	const uint32_t* sizeIds = NULL;
+	for (uint32_t id = 0; id < module->bound && sizeIds == NULL; ++id) {
+		const uint32_t* instruction = GetIdInstruction(module, id, 0);
+		if (instruction != NULL && (module->ids[id].flags & ID_WORKGROUP_SIZE) && (instruction[0] >> 16) >= 6) {
+			sizeIds = instruction + 3;
+		}
+	}
+	for (uint32_t word = SPIRV_HEADER_WORDS; word < module->wordCount && sizeIds == NULL; word += code[word] >> 16) {
+		if ((code[word] & 0xffff) == OP_EXECUTION_MODE_ID && (code[word] >> 16) >= 6 &&
+			code[word + 2] == EXECUTION_MODE_LOCAL_SIZE_ID) {
+			sizeIds = code + word + 3;
+		}
+	}
+	if (sizeIds == NULL) {
+		return;
+	}
+
+	for (uint32_t i = 0; i < 3; ++i) {
+		GetConstantValue(module, sizeIds[i], &reflection->localSize[i]);
+	}
+	if (sizeIds[0] < module->bound && module->ids[sizeIds[0]].opcode == OP_SPEC_CONSTANT &&
+		(module->ids[sizeIds[0]].flags & ID_HAS_SPEC_ID)) {
+		reflection->localSizeXSpecId = module->ids[sizeIds[0]].specId;
+	}
+}
+
+VkResult ReflectShaderModule(const uint32_t* code, size_t size, ShaderReflection* reflection) {
+	memset(reflection, 0, sizeof(*reflection));
+	reflection->localSizeXSpecId = REFLECT_NO_SPEC_ID;
+	if (size % 4 != 0 || size < SPIRV_HEADER_WORDS * 4 || code[0] != SPIRV_MAGIC) {
+		puts("Shader is not a SPIR-V module");
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+
+	SpirvModule module = { 0 };
+	module.code = code;
+	module.wordCount = (uint32_t) (size / 4);
+	module.bound = code[3];
+	module.ids = calloc(module.bound, sizeof(SpirvId));
+	if (module.ids == NULL) {
+		return VK_ERROR_OUT_OF_HOST_MEMORY;
+	}
+
+	VkResult result = IndexSpirvModule(&module, reflection);
+	if (result != VK_SUCCESS) {
+		puts("Malformed SPIR-V module");
+		free(module.ids);
+		return result;
+	}
+	ReflectWorkgroupSize(&module, reflection);
+
+	for (uint32_t id = 0; id < module.bound && result == VK_SUCCESS; ++id) {
+		const uint32_t* variable = GetIdInstruction(&module, id, OP_VARIABLE);
+		if (variable == NULL || (variable[0] >> 16) < 4) {
+			continue;
+		}
+		const uint32_t* pointer = GetIdInstruction(&module, variable[1], OP_TYPE_POINTER);
+		if (pointer == NULL) {
+			continue;
+		}
+		const uint32_t storageClass = variable[3];
+
+		if (storageClass == STORAGE_CLASS_PUSH_CONSTANT) {
+			reflection->pushConstantSize = GetStructSize(&module, pointer[3], 0);
+			continue;
+		}
+		if (!(module.ids[id].flags & ID_HAS_BINDING)) {
+			continue;
+		}
+		if (reflection->bindingCount == REFLECT_MAX_BINDINGS) {
+			printf("Shader uses more than %u bindings\n", REFLECT_MAX_BINDINGS);
+			result = VK_ERROR_INITIALIZATION_FAILED;
+			break;
+		}
+
+		ReflectedBinding* binding = &reflection->bindings[reflection->bindingCount];
+		binding->set = module.ids[id].set;
+		binding->binding = module.ids[id].binding;
+		result = GetDescriptorType(&module, storageClass, pointer[3], &binding->descriptorType, &binding->descriptorCount);
+		if (result != VK_SUCCESS) {
+			printf("Unsupported resource at set %u binding %u\n", binding->set, binding->binding);
+			break;
+		}
+
+		// Keep the bindings sorted by set, then binding
+		uint32_t i = reflection->bindingCount++;
+		ReflectedBinding reflected = *binding;
+		while (i > 0 && (reflection->bindings[i - 1].set > reflected.set ||
+			(reflection->bindings[i - 1].set == reflected.set && reflection->bindings[i - 1].binding > reflected.binding))) {
+			reflection->bindings[i] = reflection->bindings[i - 1];
+			--i;
+		}
+		reflection->bindings[i] = reflected;
+	}
+
+	free(module.ids);
+	return result;
+}
+
+VkResult ReflectShaderFile(const char* filename, ShaderReflection* reflection) {
+	ShaderCode code = { 0 };
+	VkResult result = GetShaderCode(filename, &code);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+	result = ReflectShaderModule(code.code, code.size, reflection);
+	if (result != VK_SUCCESS) {
+		printf("Failed to reflect shader file %s\n", filename);
+	}
+	ReleaseShaderCode(&code);
+	return result;
+}
+
+const char* GetDescriptorTypeName(VkDescriptorType descriptorType) {
+	switch (descriptorType) {
+	case VK_DESCRIPTOR_TYPE_SAMPLER:
+		return "sampler";
+	case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+		return "combined image sampler";
+	case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+		return "sampled image";
+	case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+		return "storage image";
+	case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+		return "uniform texel buffer";
+	case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+		return "storage texel buffer";
+	case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+		return "uniform buffer";
+	case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+		return "storage buffer";
+	default:
+		return "unknown";
+	}
+}
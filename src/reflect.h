@@ -0,0 +1,41 @@
+#include <vulkan/vulkan.h>
+#include <stddef.h>
+
+#ifndef REFLECT_H
+#define REFLECT_H
+
+#define REFLECT_MAX_BINDINGS 16
+// No specialization constant sets the workgroup size
+#define REFLECT_NO_SPEC_ID UINT32_MAX
+
+typedef struct ReflectedBinding {
+	uint32_t set;
+	uint32_t binding;
+	VkDescriptorType descriptorType;
+	// Array length of the descriptor, or 0 for a runtime sized array
+	uint32_t descriptorCount;
+} ReflectedBinding;
+
+// The resource interface of a compute shader, read from its SPIR-V
+typedef struct ShaderReflection {
+	ReflectedBinding bindings[REFLECT_MAX_BINDINGS];
+	uint32_t bindingCount;
+	// Bytes up to the end of the last member of the push constant block, or 0 if there is none
+	uint32_t pushConstantSize;
+	// Workgroup size declared by the shader. If a specialization constant sets local_size_x, localSize[0] is its
+	// default value and localSizeXSpecId its constant ID.
+	uint32_t localSize[3];
+	uint32_t localSizeXSpecId;
+	// Bit i is set if the shader declares specialization constant i, for IDs below 32
+	uint32_t specConstantMask;
+} ShaderReflection;
+
+// Reflect the descriptor bindings, push constant block and workgroup size of a compute shader from its
+// SPIR-V module of size bytes. Bindings are sorted by set and binding. Returns VK_ERROR_INITIALIZATION_FAILED if
+// the module is malformed or uses more than REFLECT_MAX_BINDINGS bindings.
+VkResult ReflectShaderModule(const uint32_t* code, size_t size, ShaderReflection* reflection);
+VkResult ReflectShaderFile(const char* filename, ShaderReflection* reflection);
+
+const char* GetDescriptorTypeName(VkDescriptorType descriptorType);
+
+#endif
@@ -0,0 +1,296 @@
+#include "registry.h"
+#include "timer.h"
+#include <vulkan/vulkan.h>
+#include <dirent.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// The kernels of this project bind ComputeBuffers as storage buffers at consecutive bindings of set 0
+static VkResult ValidateKernelInterface(const char* name, const ShaderReflection* reflection) {
+	for (uint32_t i = 0; i < reflection->bindingCount; ++i) {
+		const ReflectedBinding* binding = &reflection->bindings[i];
+		if (binding->set != 0 || binding->binding != i) {
+			printf("Kernel %s: set %u binding %u is not consecutive in set 0\n", name, binding->set, binding->binding);
+			return VK_ERROR_FEATURE_NOT_PRESENT;
+		}
+		if (binding->descriptorType != VK_DESCRIPTOR_TYPE_STORAGE_BUFFER || binding->descriptorCount != 1) {
+			printf("Kernel %s: binding %u is a %s, only single storage buffers are supported\n", name, i,
+				GetDescriptorTypeName(binding->descriptorType));
+			return VK_ERROR_FEATURE_NOT_PRESENT;
+		}
+	}
+	if (reflection->localSizeXSpecId != REFLECT_NO_SPEC_ID && reflection->localSizeXSpecId != 0) {
+		printf("Kernel %s: local_size_x must come from specialization constant 0\n", name);
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+	}
+	return VK_SUCCESS;
+}
+
+VkResult CreateKernelRegistry(ComputeContext* context, KernelRegistry* registry) {
+	memset(registry, 0, sizeof(*registry));
+	registry->context = context;
+	registry->kernels = calloc(REGISTRY_MAX_KERNELS, sizeof(RegisteredKernel));
+	if (registry->kernels == NULL) {
+		return VK_ERROR_OUT_OF_HOST_MEMORY;
+	}
+	pthread_mutex_init(&registry->mutex, NULL);
+	pthread_cond_init(&registry->readyCondition, NULL);
+	return VK_SUCCESS;
+}
+
+void DestroyKernelRegistry(KernelRegistry* registry) {
+	WaitRegisteredKernels(registry);
+	for (uint32_t i = 0; i < registry->kernelCount; ++i) {
+		if (registry->kernels[i].state == REGISTERED_KERNEL_READY) {
+			DestroyComputeKernel(registry->context, &registry->kernels[i].kernel);
+		}
+	}
+	free(registry->kernels);
+	pthread_mutex_destroy(&registry->mutex);
+	pthread_cond_destroy(&registry->readyCondition);
+	memset(registry, 0, sizeof(*registry));
+}
+
+VkResult RegisterKernel(KernelRegistry* registry, const char* name, const char* shaderFile, uint32_t localSizeX) {
+	if (FindRegisteredKernel(registry, name) != NULL) {
+		printf("Kernel %s is already registered\n", name);
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+	if (registry->kernelCount == REGISTRY_MAX_KERNELS) {
+		printf("Cannot register more than %u kernels\n", REGISTRY_MAX_KERNELS);
+		return VK_ERROR_OUT_OF_HOST_MEMORY;
+	}
+	if (strlen(name) >= REGISTRY_MAX_NAME || strlen(shaderFile) >= sizeof(registry->kernels[0].shaderFile)) {
+		printf("Kernel name or path is too long: %s\n", shaderFile);
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+
+	RegisteredKernel* entry = &registry->kernels[registry->kernelCount];
+	memset(entry, 0, sizeof(*entry));
+	VkResult result = ReflectShaderFile(shaderFile, &entry->reflection);
+	if (result == VK_SUCCESS) {
+		result = ValidateKernelInterface(name, &entry->reflection);
+	}
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+	strcpy(entry->name, name);
+	strcpy(entry->shaderFile, shaderFile);
+
+	// A fixed workgroup size cannot be changed; a specialized one defaults to the largest size up to
+	// REGISTRY_DEFAULT_LOCAL_SIZE the device supports
+	const VkPhysicalDeviceLimits* limits = &registry->context->physicalDeviceProperties.limits;
+	if (entry->reflection.localSizeXSpecId == REFLECT_NO_SPEC_ID) {
+		entry->localSizeX = entry->reflection.localSize[0];
+	}
+	else if (localSizeX > 0) {
+		entry->localSizeX = localSizeX;
+	}
+	else {
+		entry->localSizeX = REGISTRY_DEFAULT_LOCAL_SIZE;
+		if (entry->localSizeX > limits->maxComputeWorkGroupSize[0]) {
+			entry->localSizeX = limits->maxComputeWorkGroupSize[0];
+		}
+		if (entry->localSizeX > limits->maxComputeWorkGroupInvocations) {
+			entry->localSizeX = limits->maxComputeWorkGroupInvocations;
+		}
+	}
+
+	++registry->kernelCount;
+	return VK_SUCCESS;
+}
+
+VkResult RegisterKernelDirectory(KernelRegistry* registry, const char* directory, uint32_t* registeredCount) {
+	*registeredCount = 0;
+	DIR* dir = opendir(directory);
+	if (dir == NULL) {
+		printf("Failed to open kernel directory %s\n", directory);
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+
+	struct dirent* entry = NULL;
+	while ((entry = readdir(dir)) != NULL) {
+		const size_t length = strlen(entry->d_name);
+		if (length <= 4 || strcmp(entry->d_name + length - 4, ".spv") != 0 || length - 4 >= REGISTRY_MAX_NAME) {
+			continue;
+		}
+		char name[REGISTRY_MAX_NAME];
+		memcpy(name, entry->d_name, length - 4);
+		name[length - 4] = '\0';
+
+		char path[512];
+		int pathLength = snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+		if (pathLength < 0 || (size_t) pathLength >= sizeof(path)) {
+			printf("Kernel path is too long: %s/%s\n", directory, entry->d_name);
+			continue;
+		}
+		if (RegisterKernel(registry, name, path, 0) == VK_SUCCESS) {
+			++*registeredCount;
+		}
+		else {
+			printf("Skipped %s\n", path);
+		}
+	}
+
+	closedir(dir);
+	return VK_SUCCESS;
+}
+
+RegisteredKernel* FindRegisteredKernel(KernelRegistry* registry, const char* name) {
+	for (uint32_t i = 0; i < registry->kernelCount; ++i) {
+		if (!strcmp(registry->kernels[i].name, name)) {
+			return &registry->kernels[i];
+		}
+	}
+	return NULL;
+}
+
+// Build the kernel's layout from its reflected interface
+static void GetRegisteredKernelCreateInfo(const RegisteredKernel* entry, ComputeKernelCreateInfo* createInfo) {
+	memset(createInfo, 0, sizeof(*createInfo));
+	createInfo->shaderFile = entry->shaderFile;
+	createInfo->bindingCount = entry->reflection.bindingCount;
+	createInfo->pushConstantSize = entry->reflection.pushConstantSize;
+	createInfo->localSizeX = entry->localSizeX;
+	createInfo->elementsPerInvocation = 1;
+}
+
+// Publish the result of creating the kernels at indices, created into kernels if result is VK_SUCCESS
+static void FinishRegisteredKernels(KernelRegistry* registry, const uint32_t* indices, uint32_t count,
+	ComputeKernel* kernels, VkResult result, uint64_t createNs) {
+
+	const uint64_t readyNs = GetTimeNs();
+	pthread_mutex_lock(&registry->mutex);
+	for (uint32_t i = 0; i < count; ++i) {
+		RegisteredKernel* entry = &registry->kernels[indices[i]];
+		if (result == VK_SUCCESS) {
+			entry->kernel = kernels[i];
+			entry->state = REGISTERED_KERNEL_READY;
+		}
+		else {
+			entry->state = REGISTERED_KERNEL_FAILED;
+		}
+		entry->createNs = createNs;
+		entry->readyNs = readyNs;
+	}
+	pthread_cond_broadcast(&registry->readyCondition);
+	pthread_mutex_unlock(&registry->mutex);
+}
+
+static void* CreateRegisteredKernelBatches(void* argument) {
+	RegistryThread* thread = argument;
+	KernelRegistry* registry = thread->registry;
+	uint32_t indices[REGISTRY_PIPELINE_BATCH];
+	ComputeKernelCreateInfo createInfos[REGISTRY_PIPELINE_BATCH];
+	ComputeKernel kernels[REGISTRY_PIPELINE_BATCH];
+	for (;;) {
+		// Claim the next kernels nobody has started on, skipping those a caller is already creating
+		uint32_t count = 0;
+		pthread_mutex_lock(&registry->mutex);
+		for (uint32_t i = 0; i < registry->kernelCount && count < REGISTRY_PIPELINE_BATCH; ++i) {
+			if (registry->kernels[i].state == REGISTERED_KERNEL_IDLE) {
+				registry->kernels[i].state = REGISTERED_KERNEL_CREATING;
+				indices[count++] = i;
+			}
+		}
+		pthread_mutex_unlock(&registry->mutex);
+		if (count == 0) {
+			return NULL;
+		}
+
+		for (uint32_t i = 0; i < count; ++i) {
+			GetRegisteredKernelCreateInfo(&registry->kernels[indices[i]], &createInfos[i]);
+		}
+		const uint64_t startTime = GetTimeNs();
+		VkResult result = CreateComputeKernels(registry->context, createInfos, count, kernels);
+		if (result == VK_SUCCESS) {
+			const uint64_t endTime = GetTimeNs();
+			FinishRegisteredKernels(registry, indices, count, kernels, result, endTime - startTime);
+			char name[STARTUP_MAX_NAME];
+			snprintf(name, sizeof(name), "create_pipelines (%u kernels)", count);
+			AddStartupPhase(registry->trace, name, thread->index, startTime, endTime);
+			continue;
+		}
+
+		// Create them one by one, so one broken shader does not fail the rest of the batch
+		for (uint32_t i = 0; i < count; ++i) {
+			const uint64_t kernelStartTime = GetTimeNs();
+			result = CreateComputeKernel(registry->context, &createInfos[i], &kernels[i]);
+			if (result != VK_SUCCESS) {
+				printf("Failed to create registered kernel %s\n", registry->kernels[indices[i]].name);
+			}
+			FinishRegisteredKernels(registry, &indices[i], 1, &kernels[i], result, GetTimeNs() - kernelStartTime);
+		}
+		AddStartupPhase(registry->trace, "create_pipelines (one by one)", thread->index, startTime, GetTimeNs());
+	}
+}
+
+VkResult StartRegisteredKernels(KernelRegistry* registry, uint32_t threadCount, StartupTrace* trace) {
+	WaitRegisteredKernels(registry);
+	if (threadCount == 0) {
+		threadCount = 1;
+	}
+	if (threadCount > REGISTRY_MAX_THREADS) {
+		threadCount = REGISTRY_MAX_THREADS;
+	}
+
+	registry->trace = trace;
+	for (uint32_t i = 0; i < threadCount; ++i) {
+		RegistryThread* thread = &registry->threads[i];
+		thread->registry = registry;
+		thread->index = i + 1;
+		if (pthread_create(&thread->thread, NULL, CreateRegisteredKernelBatches, thread) != 0) {
+			puts("Failed to start pipeline creation thread");
+			// The threads already started still create every kernel
+			return registry->threadCount > 0 ? VK_SUCCESS : VK_ERROR_INITIALIZATION_FAILED;
+		}
+		++registry->threadCount;
+	}
+	return VK_SUCCESS;
+}
+
+void WaitRegisteredKernels(KernelRegistry* registry) {
+	for (uint32_t i = 0; i < registry->threadCount; ++i) {
+		pthread_join(registry->threads[i].thread, NULL);
+	}
+	registry->threadCount = 0;
+}
+
+ComputeKernel* GetRegisteredKernel(KernelRegistry* registry, const char* name) {
+	RegisteredKernel* entry = FindRegisteredKernel(registry, name);
+	if (entry == NULL) {
+		printf("No kernel named %s is registered\n", name);
+		return NULL;
+	}
+
+	// Wait if a background thread is creating it, or claim it
+	pthread_mutex_lock(&registry->mutex);
+	while (entry->state == REGISTERED_KERNEL_CREATING) {
+		pthread_cond_wait(&registry->readyCondition, &registry->mutex);
+	}
+	const RegisteredKernelState state = entry->state;
+	if (state == REGISTERED_KERNEL_IDLE) {
+		entry->state = REGISTERED_KERNEL_CREATING;
+	}
+	pthread_mutex_unlock(&registry->mutex);
+	if (state == REGISTERED_KERNEL_READY) {
+		return &entry->kernel;
+	}
+	if (state == REGISTERED_KERNEL_FAILED) {
+		return NULL;
+	}
+
+	ComputeKernelCreateInfo createInfo = { 0 };
+	GetRegisteredKernelCreateInfo(entry, &createInfo);
+	ComputeKernel kernel = { 0 };
+	const uint32_t index = (uint32_t) (entry - registry->kernels);
+	uint64_t startTime = GetTimeNs();
+	VkResult result = CreateComputeKernel(registry->context, &createInfo, &kernel);
+	FinishRegisteredKernels(registry, &index, 1, &kernel, result, GetTimeNs() - startTime);
+	if (result != VK_SUCCESS) {
+		printf("Failed to create registered kernel %s\n", name);
+		return NULL;
+	}
+	return &entry->kernel;
+}
@@ -0,0 +1,91 @@
+#include <vulkan/vulkan.h>
+#include "context.h"
+#include "kernel.h"
+#include "reflect.h"
+#include "startup.h"
+#include <pthread.h>
+
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#define REGISTRY_MAX_KERNELS 64
+#define REGISTRY_MAX_NAME 64
+// Workgroup size of kernels that take local_size_x from specialization constant 0 when none is requested
+#define REGISTRY_DEFAULT_LOCAL_SIZE 256
+// Kernels per vkCreateComputePipelines call of the background threads. Smaller batches make the first kernels
+// ready sooner, larger ones give the driver more pipelines to compile in parallel.
+#define REGISTRY_PIPELINE_BATCH 8
+#define REGISTRY_MAX_THREADS 16
+
+typedef enum RegisteredKernelState {
+	// No pipeline yet; the first GetRegisteredKernel or background thread to claim it creates it
+	REGISTERED_KERNEL_IDLE,
+	REGISTERED_KERNEL_CREATING,
+	REGISTERED_KERNEL_READY,
+	REGISTERED_KERNEL_FAILED
+} RegisteredKernelState;
+
+typedef struct RegisteredKernel {
+	char name[REGISTRY_MAX_NAME];
+	char shaderFile[512];
+	ShaderReflection reflection;
+	uint32_t localSizeX;
+	ComputeKernel kernel;
+	// Guarded by the registry's mutex
+	RegisteredKernelState state;
+	// Time spent creating the kernel, or its whole batch, and when it became ready
+	uint64_t createNs;
+	uint64_t readyNs;
+} RegisteredKernel;
+
+struct KernelRegistry;
+
+typedef struct RegistryThread {
+	struct KernelRegistry* registry;
+	// 1 and up, as the thread of its startup trace phases
+	uint32_t index;
+	pthread_t thread;
+} RegistryThread;
+
+// SPIR-V kernels looked up by name. Registering a kernel reflects its bindings, push constant block and workgroup
+// size, so no host code describes its layout; the pipeline is created the first time the kernel is used, or ahead
+// of time by StartRegisteredKernels, and goes through the context's pipeline cache, so later runs skip compiling
+// it again.
+typedef struct KernelRegistry {
+	ComputeContext* context;
+	// REGISTRY_MAX_KERNELS entries, so pointers to registered kernels stay valid
+	RegisteredKernel* kernels;
+	uint32_t kernelCount;
+	// Background pipeline creation, see StartRegisteredKernels
+	RegistryThread threads[REGISTRY_MAX_THREADS];
+	uint32_t threadCount;
+	StartupTrace* trace;
+	pthread_mutex_t mutex;
+	pthread_cond_t readyCondition;
+} KernelRegistry;
+
+VkResult CreateKernelRegistry(ComputeContext* context, KernelRegistry* registry);
+void DestroyKernelRegistry(KernelRegistry* registry);
+
+// Register shaderFile as name. The shader must read and write storage buffers at bindings 0..n-1 of set 0, and
+// take its workgroup size from specialization constant 0 or declare a fixed one. localSizeX replaces the default
+// of a specialized workgroup size, 0 uses REGISTRY_DEFAULT_LOCAL_SIZE clamped to the device's limits.
+VkResult RegisterKernel(KernelRegistry* registry, const char* name, const char* shaderFile, uint32_t localSizeX);
+// Register every .spv file in directory as its file name without the extension. Files that cannot be registered
+// are reported and skipped; registeredCount receives the number that were.
+VkResult RegisterKernelDirectory(KernelRegistry* registry, const char* directory, uint32_t* registeredCount);
+
+// Create the pipelines of every registered kernel on threadCount background threads, or one if 0, batching
+// REGISTRY_PIPELINE_BATCH kernels per vkCreateComputePipelines call, and return without waiting. Jobs can start
+// as soon as the pipeline they need is ready: GetRegisteredKernel only waits for its own kernel, and creates it
+// itself if no thread has claimed it yet. Register every kernel before calling this. trace may be NULL.
+VkResult StartRegisteredKernels(KernelRegistry* registry, uint32_t threadCount, StartupTrace* trace);
+// Wait for the background threads to finish
+void WaitRegisteredKernels(KernelRegistry* registry);
+
+RegisteredKernel* FindRegisteredKernel(KernelRegistry* registry, const char* name);
+// Return the kernel registered as name, creating its pipeline on first use or waiting for a background thread
+// creating it, or NULL if there is no such kernel or its pipeline cannot be created
+ComputeKernel* GetRegisteredKernel(KernelRegistry* registry, const char* name);
+
+#endif
@@ -0,0 +1,426 @@
+#include "scheduler.h"
+#include "timer.h"
+#include <vulkan/vulkan.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// How long to wait on one device's fences before checking the next device's
+#define SCHEDULER_FENCE_POLL_NS 50000
+
+// Weight of the newest measurement in a queue's smoothed throughput
+#define SCHEDULER_THROUGHPUT_SMOOTHING 0.5
+
+static VkResult CreateScheduledQueue(ComputeScheduler* scheduler, uint32_t deviceIndex, uint32_t queueIndex, ScheduledQueue* queue) {
+	ComputeContext* context = &scheduler->contexts[deviceIndex];
+	queue->deviceIndex = deviceIndex;
+	queue->queueIndex = queueIndex;
+	queue->queue = context->computeQueues[queueIndex];
+
+	VkCommandBufferAllocateInfo commandBufferAllocateInfo = { 0 };
+	commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	commandBufferAllocateInfo.pNext = NULL;
+	commandBufferAllocateInfo.commandPool = scheduler->commandPools[deviceIndex];
+	commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	commandBufferAllocateInfo.commandBufferCount = 1;
+
+	VkResult result = vkAllocateCommandBuffers(context->device, &commandBufferAllocateInfo, &queue->commandBuffer);
+	if (result != VK_SUCCESS) {
+		puts("Failed to allocate scheduler command buffer");
+		return result;
+	}
+
+	VkFenceCreateInfo fenceInfo = { 0 };
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceInfo.pNext = NULL;
+	fenceInfo.flags = 0;
+
+	result = vkCreateFence(context->device, &fenceInfo, NULL, &queue->fence);
+	if (result != VK_SUCCESS) {
+		puts("Failed to create scheduler fence");
+		return result;
+	}
+
+	// Each queue has its own descriptor set so that concurrent shares never share bindings
+	VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = { 0 };
+	descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	descriptorSetAllocateInfo.pNext = NULL;
+	descriptorSetAllocateInfo.descriptorPool = scheduler->descriptorPools[deviceIndex];
+	descriptorSetAllocateInfo.descriptorSetCount = 1;
+	descriptorSetAllocateInfo.pSetLayouts = &scheduler->kernels[deviceIndex].descriptorSetLayout;
+
+	result = vkAllocateDescriptorSets(context->device, &descriptorSetAllocateInfo, &queue->descriptorSet);
+	if (result != VK_SUCCESS) {
+		puts("Failed to allocate scheduler descriptor set");
+		return result;
+	}
+
+	return VK_SUCCESS;
+}
+
+// Grow the queue's buffers to hold at least elementCount elements. Only called while the queue is idle.
+static VkResult ReserveScheduledQueue(ComputeScheduler* scheduler, ScheduledQueue* queue, uint64_t elementCount) {
+	if (queue->capacity >= elementCount) {
+		return VK_SUCCESS;
+	}
+	ComputeContext* context = &scheduler->contexts[queue->deviceIndex];
+
+	// Leave headroom so that shares drifting with measured throughput do not reallocate every dispatch
+	uint64_t capacity = elementCount + elementCount / 4;
+	DestroyComputeBuffer(context, &queue->buffers[0]);
+	DestroyComputeBuffer(context, &queue->buffers[1]);
+	queue->capacity = 0;
+
+	VkResult result = CreateComputeBuffer(context, capacity * scheduler->elementSize, BUFFER_LOCATION_HOST, &queue->buffers[0]);
+	if (result == VK_SUCCESS) {
+		// Results are read back through ReadComputeBuffer, which invalidates them first
+		result = CreateComputeBuffer(context, capacity * scheduler->elementSize, BUFFER_LOCATION_READBACK, &queue->buffers[1]);
+	}
+	if (result != VK_SUCCESS) {
+		puts("Failed to create scheduler buffers");
+		return result;
+	}
+
+	VkDescriptorBufferInfo bufferInfos[2] = { 0 };
+	VkWriteDescriptorSet writeDescriptorSets[2] = { 0 };
+	for (uint32_t i = 0; i < 2; ++i) {
+		bufferInfos[i].buffer = queue->buffers[i].buffer;
+		bufferInfos[i].offset = 0;
+		bufferInfos[i].range = VK_WHOLE_SIZE;
+
+		writeDescriptorSets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeDescriptorSets[i].pNext = NULL;
+		writeDescriptorSets[i].dstSet = queue->descriptorSet;
+		writeDescriptorSets[i].dstBinding = i;
+		writeDescriptorSets[i].dstArrayElement = 0;
+		writeDescriptorSets[i].descriptorCount = 1;
+		writeDescriptorSets[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writeDescriptorSets[i].pImageInfo = NULL;
+		writeDescriptorSets[i].pBufferInfo = &bufferInfos[i];
+		writeDescriptorSets[i].pTexelBufferView = NULL;
+	}
+	vkUpdateDescriptorSets(context->device, 2, writeDescriptorSets, 0, NULL);
+
+	queue->capacity = capacity;
+	return VK_SUCCESS;
+}
+
+VkResult CreateComputeScheduler(ComputeContext* contexts, uint32_t deviceCount, const ComputeKernelCreateInfo* kernelInfo,
+	uint32_t elementSize, ComputeScheduler* scheduler) {
+
+	memset(scheduler, 0, sizeof(*scheduler));
+	if (deviceCount > SCHEDULER_MAX_DEVICES) {
+		deviceCount = SCHEDULER_MAX_DEVICES;
+	}
+	if (kernelInfo->bindingCount != 2 || kernelInfo->dynamicRange > 0) {
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+	}
+	scheduler->contexts = contexts;
+	scheduler->elementSize = elementSize;
+
+	for (uint32_t d = 0; d < deviceCount; ++d) {
+		ComputeContext* context = &contexts[d];
+		const VkPhysicalDeviceLimits* limits = &context->physicalDeviceProperties.limits;
+
+		// The workgroup size may have been tuned on another device
+		ComputeKernelCreateInfo deviceKernelInfo = *kernelInfo;
+		if (deviceKernelInfo.localSizeX > limits->maxComputeWorkGroupSize[0]) {
+			deviceKernelInfo.localSizeX = limits->maxComputeWorkGroupSize[0];
+		}
+		if (deviceKernelInfo.localSizeX > limits->maxComputeWorkGroupInvocations) {
+			deviceKernelInfo.localSizeX = limits->maxComputeWorkGroupInvocations;
+		}
+
+		VkResult result = CreateComputeKernel(context, &deviceKernelInfo, &scheduler->kernels[d]);
+		if (result != VK_SUCCESS) {
+			DestroyComputeScheduler(scheduler);
+			return result;
+		}
+		scheduler->deviceCount = d + 1;
+
+		VkCommandPoolCreateInfo commandPoolInfo = { 0 };
+		commandPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		commandPoolInfo.pNext = NULL;
+		commandPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		commandPoolInfo.queueFamilyIndex = context->computeQueueIndex;
+
+		result = vkCreateCommandPool(context->device, &commandPoolInfo, NULL, &scheduler->commandPools[d]);
+		if (result != VK_SUCCESS) {
+			puts("Failed to create scheduler command pool");
+			DestroyComputeScheduler(scheduler);
+			return result;
+		}
+
+		VkDescriptorPoolSize descriptorPoolSize = { 0 };
+		descriptorPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorPoolSize.descriptorCount = 2 * context->computeQueueCount;
+
+		VkDescriptorPoolCreateInfo descriptorPoolInfo = { 0 };
+		descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		descriptorPoolInfo.pNext = NULL;
+		descriptorPoolInfo.flags = 0;
+		descriptorPoolInfo.maxSets = context->computeQueueCount;
+		descriptorPoolInfo.poolSizeCount = 1;
+		descriptorPoolInfo.pPoolSizes = &descriptorPoolSize;
+
+		result = vkCreateDescriptorPool(context->device, &descriptorPoolInfo, NULL, &scheduler->descriptorPools[d]);
+		if (result != VK_SUCCESS) {
+			puts("Failed to create scheduler descriptor pool");
+			DestroyComputeScheduler(scheduler);
+			return result;
+		}
+
+		for (uint32_t q = 0; q < context->computeQueueCount; ++q) {
+			result = CreateScheduledQueue(scheduler, d, q, &scheduler->queues[scheduler->queueCount]);
+			++scheduler->queueCount;
+			if (result != VK_SUCCESS) {
+				DestroyComputeScheduler(scheduler);
+				return result;
+			}
+		}
+	}
+
+	return VK_SUCCESS;
+}
+
+void DestroyComputeScheduler(ComputeScheduler* scheduler) {
+	for (uint32_t i = 0; i < scheduler->queueCount; ++i) {
+		ScheduledQueue* queue = &scheduler->queues[i];
+		ComputeContext* context = &scheduler->contexts[queue->deviceIndex];
+		vkDestroyFence(context->device, queue->fence, NULL);
+		DestroyComputeBuffer(context, &queue->buffers[0]);
+		DestroyComputeBuffer(context, &queue->buffers[1]);
+	}
+	// Destroying the pools frees the queues' command buffers and descriptor sets
+	for (uint32_t d = 0; d < scheduler->deviceCount; ++d) {
+		ComputeContext* context = &scheduler->contexts[d];
+		vkDestroyDescriptorPool(context->device, scheduler->descriptorPools[d], NULL);
+		vkDestroyCommandPool(context->device, scheduler->commandPools[d], NULL);
+		DestroyComputeKernel(context, &scheduler->kernels[d]);
+	}
+	memset(scheduler, 0, sizeof(*scheduler));
+}
+
+// Split elementCount elements across the queues in proportion to their measured throughput. Until every queue
+// has been measured the split is even.
+static void SplitElements(ComputeScheduler* scheduler, uint64_t elementCount) {
+	double totalThroughput = 0.0;
+	int measured = 1;
+	for (uint32_t i = 0; i < scheduler->queueCount; ++i) {
+		totalThroughput += scheduler->queues[i].throughput;
+		if (scheduler->queues[i].throughput <= 0.0) {
+			measured = 0;
+		}
+	}
+
+	uint64_t firstElement = 0;
+	for (uint32_t i = 0; i < scheduler->queueCount; ++i) {
+		ScheduledQueue* queue = &scheduler->queues[i];
+		uint64_t share = 0;
+		if (i == scheduler->queueCount - 1) {
+			share = elementCount - firstElement;
+		}
+		else if (measured) {
+			share = (uint64_t) (elementCount * (queue->throughput / totalThroughput));
+		}
+		else {
+			share = elementCount / scheduler->queueCount;
+		}
+		if (share > elementCount - firstElement) {
+			share = elementCount - firstElement;
+		}
+		queue->firstElement = firstElement;
+		queue->elementCount = share;
+		queue->elapsedNs = 0;
+		firstElement += share;
+	}
+}
+
+static VkResult RecordScheduledQueue(ComputeScheduler* scheduler, ScheduledQueue* queue) {
+	ComputeContext* context = &scheduler->contexts[queue->deviceIndex];
+	const ComputeKernel* kernel = &scheduler->kernels[queue->deviceIndex];
+
+	uint32_t groupCountX = 0;
+	uint32_t groupCountY = 0;
+	uint32_t groupCountZ = 0;
+	VkResult result = ComputeDispatchSize(context, kernel, queue->elementCount, &groupCountX, &groupCountY, &groupCountZ);
+	if (result != VK_SUCCESS) {
+		puts("Scheduled share is too large for one dispatch");
+		return result;
+	}
+
+	result = vkResetCommandBuffer(queue->commandBuffer, 0);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+	result = BeginOneTimeCommandBuffer(queue->commandBuffer);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+
+	uint32_t elementCount = (uint32_t) queue->elementCount;
+	vkCmdBindPipeline(queue->commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, kernel->pipeline);
+	vkCmdBindDescriptorSets(queue->commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, kernel->pipelineLayout, 0, 1,
+		&queue->descriptorSet, 0, NULL);
+	vkCmdPushConstants(queue->commandBuffer, kernel->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(elementCount), &elementCount);
+	vkCmdDispatch(queue->commandBuffer, groupCountX, groupCountY, groupCountZ);
+
+	VkMemoryBarrier memoryBarrier = { 0 };
+	memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memoryBarrier.pNext = NULL;
+	memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(queue->commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+		0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+
+	result = vkEndCommandBuffer(queue->commandBuffer);
+	if (result != VK_SUCCESS) {
+		puts("Failed to end recording command buffer");
+	}
+	return result;
+}
+
+// Wait for every submitted share, stamping each queue's completion time as its fence is seen signalled. Fences
+// of different devices cannot be waited on together, so with several devices each is polled in turn.
+static VkResult WaitScheduledQueues(ComputeScheduler* scheduler, const uint64_t* submitTimes) {
+	int* pending = calloc(scheduler->queueCount, sizeof(int));
+	VkFence* fences = calloc(scheduler->queueCount, sizeof(VkFence));
+	if (pending == NULL || fences == NULL) {
+		free(pending);
+		free(fences);
+		return VK_ERROR_OUT_OF_HOST_MEMORY;
+	}
+
+	uint32_t pendingCount = 0;
+	for (uint32_t i = 0; i < scheduler->queueCount; ++i) {
+		pending[i] = scheduler->queues[i].elementCount > 0;
+		pendingCount += pending[i];
+	}
+
+	const uint64_t timeout = scheduler->deviceCount > 1 ? SCHEDULER_FENCE_POLL_NS : UINT64_MAX;
+	VkResult result = VK_SUCCESS;
+	while (pendingCount > 0 && result == VK_SUCCESS) {
+		for (uint32_t d = 0; d < scheduler->deviceCount && result == VK_SUCCESS; ++d) {
+			VkDevice device = scheduler->contexts[d].device;
+			uint32_t fenceCount = 0;
+			for (uint32_t i = 0; i < scheduler->queueCount; ++i) {
+				if (pending[i] && scheduler->queues[i].deviceIndex == d) {
+					fences[fenceCount++] = scheduler->queues[i].fence;
+				}
+			}
+			if (fenceCount == 0) {
+				continue;
+			}
+
+			result = vkWaitForFences(device, fenceCount, fences, VK_FALSE, timeout);
+			if (result == VK_TIMEOUT) {
+				result = VK_SUCCESS;
+				continue;
+			}
+			if (result != VK_SUCCESS) {
+				puts("Failed to wait for fence");
+				break;
+			}
+
+			const uint64_t now = GetTimeNs();
+			for (uint32_t i = 0; i < scheduler->queueCount; ++i) {
+				ScheduledQueue* queue = &scheduler->queues[i];
+				if (pending[i] && queue->deviceIndex == d && vkGetFenceStatus(device, queue->fence) == VK_SUCCESS) {
+					queue->elapsedNs = now - submitTimes[i];
+					pending[i] = 0;
+					--pendingCount;
+				}
+			}
+		}
+	}
+
+	free(pending);
+	free(fences);
+	return result;
+}
+
+VkResult ScheduleComputeKernel(ComputeScheduler* scheduler, const void* input, void* output, uint64_t elementCount) {
+	uint64_t* submitTimes = calloc(scheduler->queueCount, sizeof(uint64_t));
+	if (submitTimes == NULL) {
+		return VK_ERROR_OUT_OF_HOST_MEMORY;
+	}
+
+	// Scatter: copy each queue's share of the input and record its dispatch
+	SplitElements(scheduler, elementCount);
+	VkResult result = VK_SUCCESS;
+	for (uint32_t i = 0; i < scheduler->queueCount && result == VK_SUCCESS; ++i) {
+		ScheduledQueue* queue = &scheduler->queues[i];
+		if (queue->elementCount == 0) {
+			continue;
+		}
+		result = ReserveScheduledQueue(scheduler, queue, queue->elementCount);
+		if (result == VK_SUCCESS) {
+			result = WriteComputeBuffer(&scheduler->contexts[queue->deviceIndex], &queue->buffers[0], 0,
+				(const char*) input + queue->firstElement * scheduler->elementSize, queue->elementCount * scheduler->elementSize);
+		}
+		if (result == VK_SUCCESS) {
+			result = RecordScheduledQueue(scheduler, queue);
+		}
+	}
+
+	// Submit every share before waiting on any, so all queues run concurrently
+	uint32_t submittedCount = 0;
+	for (uint32_t i = 0; i < scheduler->queueCount && result == VK_SUCCESS; ++i) {
+		ScheduledQueue* queue = &scheduler->queues[i];
+		if (queue->elementCount == 0) {
+			continue;
+		}
+		submitTimes[i] = GetTimeNs();
+		result = SubmitCommandBuffer(queue->queue, queue->commandBuffer, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, queue->fence);
+		if (result != VK_SUCCESS) {
+			// Only wait for the shares already submitted
+			for (uint32_t j = i; j < scheduler->queueCount; ++j) {
+				scheduler->queues[j].elementCount = 0;
+			}
+		}
+		else {
+			++submittedCount;
+		}
+	}
+
+	if (submittedCount > 0) {
+		VkResult waitResult = WaitScheduledQueues(scheduler, submitTimes);
+		if (result == VK_SUCCESS) {
+			result = waitResult;
+		}
+	}
+	free(submitTimes);
+
+	for (uint32_t i = 0; i < scheduler->queueCount; ++i) {
+		ScheduledQueue* queue = &scheduler->queues[i];
+		if (queue->elementCount > 0) {
+			vkResetFences(scheduler->contexts[queue->deviceIndex].device, 1, &queue->fence);
+		}
+	}
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+
+	// Gather the output shares and fold the measured rates into each queue's throughput
+	for (uint32_t i = 0; i < scheduler->queueCount; ++i) {
+		ScheduledQueue* queue = &scheduler->queues[i];
+		if (queue->elementCount == 0) {
+			continue;
+		}
+		result = ReadComputeBuffer(&scheduler->contexts[queue->deviceIndex], &queue->buffers[1], 0,
+			(char*) output + queue->firstElement * scheduler->elementSize, queue->elementCount * scheduler->elementSize);
+		if (result != VK_SUCCESS) {
+			return result;
+		}
+
+		const double rate = queue->elementCount * 1e9 / (queue->elapsedNs > 0 ? queue->elapsedNs : 1);
+		if (queue->throughput <= 0.0) {
+			queue->throughput = rate;
+		}
+		else {
+			queue->throughput += SCHEDULER_THROUGHPUT_SMOOTHING * (rate - queue->throughput);
+		}
+	}
+
+	return VK_SUCCESS;
+}
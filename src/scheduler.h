@@ -0,0 +1,57 @@
+#include <vulkan/vulkan.h>
+#include "context.h"
+#include "buffer.h"
+#include "kernel.h"
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#define SCHEDULER_MAX_DEVICES 8
+#define SCHEDULER_MAX_QUEUES (SCHEDULER_MAX_DEVICES * MAX_COMPUTE_QUEUES)
+
+// One compute queue taking part in scheduled dispatches, with its own command buffer, fence, descriptor set and
+// pair of host visible buffers holding its share of the input and output
+typedef struct ScheduledQueue {
+	uint32_t deviceIndex;
+	uint32_t queueIndex;
+	VkQueue queue;
+	VkCommandBuffer commandBuffer;
+	VkFence fence;
+	VkDescriptorSet descriptorSet;
+	ComputeBuffer buffers[2];
+	// Elements the buffers can hold
+	uint64_t capacity;
+	// Smoothed elements per second over previous dispatches, or 0 before the first one
+	double throughput;
+	// Share of the last dispatch and the host time from its submission to its completion
+	uint64_t firstElement;
+	uint64_t elementCount;
+	uint64_t elapsedNs;
+} ScheduledQueue;
+
+// Splits elementwise dispatches across every compute queue of every context. Each queue gets a share proportional
+// to the throughput it achieved on earlier dispatches (equal shares at first), so faster GPUs and queues that
+// are less contended receive more work.
+typedef struct ComputeScheduler {
+	ComputeContext* contexts;
+	uint32_t deviceCount;
+	uint32_t elementSize;
+	ComputeKernel kernels[SCHEDULER_MAX_DEVICES];
+	VkCommandPool commandPools[SCHEDULER_MAX_DEVICES];
+	VkDescriptorPool descriptorPools[SCHEDULER_MAX_DEVICES];
+	ScheduledQueue queues[SCHEDULER_MAX_QUEUES];
+	uint32_t queueCount;
+} ComputeScheduler;
+
+// Create kernelInfo's kernel on each of deviceCount contexts. The kernel must be elementwise: binding 0 is read
+// and binding 1 written at the same index, elementSize bytes per element, and its only push constant is the
+// uint32_t element count. localSizeX is clamped to each device's limits.
+VkResult CreateComputeScheduler(ComputeContext* contexts, uint32_t deviceCount, const ComputeKernelCreateInfo* kernelInfo,
+	uint32_t elementSize, ComputeScheduler* scheduler);
+void DestroyComputeScheduler(ComputeScheduler* scheduler);
+
+// Run the kernel over elementCount elements of input, writing output. Shares are copied into each queue's buffers,
+// dispatched on all queues at once and gathered back into output, then the measured throughputs are updated.
+VkResult ScheduleComputeKernel(ComputeScheduler* scheduler, const void* input, void* output, uint64_t elementCount);
+
+#endif
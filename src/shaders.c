@@ -1,58 +1,145 @@
+#define _POSIX_C_SOURCE 200112L
 #include "shaders.h"
 #include <vulkan/vulkan.h>
-#include <stdlib.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
-VkResult LoadShader(VkDevice device, const char* filename, VkShaderModule* shader) {
-	FILE* file = fopen(filename, "rb");
-	if (file == NULL) {
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef EMBED_SHADERS
+// Generated by the Makefile from the compiled shaders
+extern const EmbeddedShader embeddedShaders[];
+extern const uint32_t embeddedShaderCount;
+#endif
+
+static const EmbeddedShader* FindEmbeddedShader(const char* filename) {
+#ifdef EMBED_SHADERS
+	for (uint32_t i = 0; i < embeddedShaderCount; ++i) {
+		if (!strcmp(embeddedShaders[i].filename, filename)) {
+			return &embeddedShaders[i];
+		}
+	}
+#endif
+	(void) filename;
+	return NULL;
+}
+
+// Map the whole file read-only. Mappings start on a page boundary, so the words are always aligned.
+static VkResult MapShaderFile(const char* filename, ShaderCode* shader) {
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
 		printf("Failed to open shader file %s\n", filename);
 		return VK_ERROR_UNKNOWN;
 	}
-
-	int result = fseek(file, 0, SEEK_END);
-	if (result == -1) {
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
 		printf("Failed to read shader file %s\n", filename);
-		fclose(file);
+		CloseHandle(file);
 		return VK_ERROR_UNKNOWN;
 	}
-
-	long file_size = ftell(file);
-	if (file_size == -1) {
-		printf("Failed to read shader file %s\n", filename);
-		fclose(file);
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (mapping == NULL) {
+		printf("Failed to map shader file %s\n", filename);
 		return VK_ERROR_UNKNOWN;
 	}
-
-	result = fseek(file, 0, SEEK_SET);
-	if (result == -1) {
+	void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (data == NULL) {
+		printf("Failed to map shader file %s\n", filename);
+		CloseHandle(mapping);
+		return VK_ERROR_UNKNOWN;
+	}
+	shader->mappingHandle = mapping;
+	shader->size = (size_t) fileSize.QuadPart;
+#else
+	int file = open(filename, O_RDONLY);
+	if (file == -1) {
+		printf("Failed to open shader file %s\n", filename);
+		return VK_ERROR_UNKNOWN;
+	}
+	struct stat fileStat;
+	if (fstat(file, &fileStat) == -1 || fileStat.st_size == 0) {
 		printf("Failed to read shader file %s\n", filename);
-		fclose(file);
+		close(file);
 		return VK_ERROR_UNKNOWN;
 	}
+	void* data = mmap(NULL, (size_t) fileStat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+	if (data == MAP_FAILED) {
+		printf("Failed to map shader file %s\n", filename);
+		return VK_ERROR_UNKNOWN;
+	}
+	shader->size = (size_t) fileStat.st_size;
+#endif
+	shader->code = data;
+	shader->mapped = 1;
+	return VK_SUCCESS;
+}
 
-	uint32_t* buffer = malloc(file_size);
+VkResult GetShaderCode(const char* filename, ShaderCode* shader) {
+	memset(shader, 0, sizeof(*shader));
+	const EmbeddedShader* embedded = FindEmbeddedShader(filename);
+	if (embedded != NULL) {
+		shader->code = embedded->code;
+		shader->size = embedded->size;
+	}
+	else {
+		VkResult result = MapShaderFile(filename, shader);
+		if (result != VK_SUCCESS) {
+			return result;
+		}
+	}
 
-	size_t bytes_read = fread(buffer, 1, file_size, file);
-	if (bytes_read < file_size) {
-		printf("Failed to read shader file %s\n", filename);
-		fclose(file);
-		free(buffer);
-		return VK_ERROR_UNKNOWN;
+	if ((uintptr_t) shader->code % 4 != 0 || shader->size % 4 != 0 || shader->size < 5 * sizeof(uint32_t) ||
+		shader->code[0] != SPIRV_MAGIC) {
+		printf("Shader file %s is not a SPIR-V module\n", filename);
+		ReleaseShaderCode(shader);
+		return VK_ERROR_INITIALIZATION_FAILED;
 	}
+	return VK_SUCCESS;
+}
 
-	fclose(file);
+void ReleaseShaderCode(ShaderCode* shader) {
+	if (shader->mapped) {
+#ifdef _WIN32
+		UnmapViewOfFile(shader->code);
+		CloseHandle(shader->mappingHandle);
+#else
+		munmap((void*) shader->code, shader->size);
+#endif
+	}
+	memset(shader, 0, sizeof(*shader));
+}
 
+VkResult CreateShaderModule(VkDevice device, const uint32_t* code, size_t size, VkShaderModule* shader) {
 	VkShaderModuleCreateInfo shaderCreateInfo = { 0 };
 	shaderCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
 	shaderCreateInfo.pNext = NULL;
 	shaderCreateInfo.flags = 0;
-	shaderCreateInfo.codeSize = file_size;
-	shaderCreateInfo.pCode = buffer;
+	shaderCreateInfo.codeSize = size;
+	shaderCreateInfo.pCode = code;
+	return vkCreateShaderModule(device, &shaderCreateInfo, NULL, shader);
+}
+
+VkResult LoadShader(VkDevice device, const char* filename, VkShaderModule* shader) {
+	ShaderCode code = { 0 };
+	VkResult ret_val = GetShaderCode(filename, &code);
+	if (ret_val != VK_SUCCESS) {
+		return ret_val;
+	}
 
-	VkResult ret_val = vkCreateShaderModule(device, &shaderCreateInfo, NULL, shader);
+	ret_val = CreateShaderModule(device, code.code, code.size, shader);
 
-	free(buffer);
+	ReleaseShaderCode(&code);
 
 	return ret_val;
 }
@@ -1,8 +1,36 @@
 #include <vulkan/vulkan.h>
+#include <stddef.h>
 
 #ifndef SHADERS_H
 #define SHADERS_H
 
+#define SPIRV_MAGIC 0x07230203
+
+// SPIR-V compiled into the binary by building with EMBED_SHADERS=1, looked up by the path of its .spv file
+typedef struct EmbeddedShader {
+	const char* filename;
+	const uint32_t* code;
+	size_t size;
+} EmbeddedShader;
+
+// SPIR-V words of a shader, either embedded in the binary or a read-only mapping of its file
+typedef struct ShaderCode {
+	const uint32_t* code;
+	size_t size;
+	// Non-zero if the code is a file mapping that ReleaseShaderCode unmaps
+	int mapped;
+#ifdef _WIN32
+	void* mappingHandle;
+#endif
+} ShaderCode;
+
+// Find filename among the embedded shaders, or else memory-map it. The code is checked to be 4-byte aligned,
+// a whole number of words and to start with the SPIR-V magic number.
+VkResult GetShaderCode(const char* filename, ShaderCode* shader);
+void ReleaseShaderCode(ShaderCode* shader);
+
+// Create a shader module from size bytes of SPIR-V, such as a module generated at runtime
+VkResult CreateShaderModule(VkDevice device, const uint32_t* code, size_t size, VkShaderModule* shader);
 VkResult LoadShader(VkDevice device, const char* filename, VkShaderModule* shader);
 
 #endif
@@ -0,0 +1,332 @@
+#include "staging.h"
+#include <vulkan/vulkan.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MIN_STAGING_SIZE (1ull * 1024 * 1024)
+#define STAGING_ALIGNMENT 256
+
+static VkDeviceSize AlignStagingOffset(VkDeviceSize offset) {
+	return (offset + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT * STAGING_ALIGNMENT;
+}
+
+// Grow the context's staging buffer so that it holds at least size bytes
+static VkResult EnsureStagingCapacity(ComputeContext* context, VkDeviceSize size) {
+	if (context->stagingBuffer != VK_NULL_HANDLE && context->stagingSize >= size) {
+		return VK_SUCCESS;
+	}
+
+	vkDestroyBuffer(context->device, context->stagingBuffer, NULL);
+	FreeDeviceMemory(&context->allocator, &context->stagingAllocation);
+	context->stagingBuffer = VK_NULL_HANDLE;
+	context->stagingSize = 0;
+
+	VkDeviceSize stagingSize = MIN_STAGING_SIZE;
+	while (stagingSize < size) {
+		stagingSize *= 2;
+	}
+
+	VkBufferCreateInfo bufferCreateInfo = { 0 };
+	bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferCreateInfo.pNext = NULL;
+	bufferCreateInfo.flags = 0;
+	bufferCreateInfo.size = stagingSize;
+	bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	bufferCreateInfo.queueFamilyIndexCount = 1;
+	bufferCreateInfo.pQueueFamilyIndices = &context->transferQueueIndex;
+
+	VkResult result = vkCreateBuffer(context->device, &bufferCreateInfo, NULL, &context->stagingBuffer);
+	if (result != VK_SUCCESS) {
+		puts("Failed to create staging buffer");
+		return result;
+	}
+
+	VkMemoryRequirements memoryRequirements = { 0 };
+	vkGetBufferMemoryRequirements(context->device, context->stagingBuffer, &memoryRequirements);
+
+	result = AllocateDeviceMemory(&context->allocator, &memoryRequirements,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &context->stagingAllocation);
+	if (result == VK_SUCCESS) {
+		result = vkBindBufferMemory(context->device, context->stagingBuffer,
+			context->stagingAllocation.memory, context->stagingAllocation.offset);
+	}
+	if (result != VK_SUCCESS) {
+		puts("Failed to allocate memory for staging buffer");
+		vkDestroyBuffer(context->device, context->stagingBuffer, NULL);
+		FreeDeviceMemory(&context->allocator, &context->stagingAllocation);
+		context->stagingBuffer = VK_NULL_HANDLE;
+		return result;
+	}
+
+	context->stagingSize = stagingSize;
+	return VK_SUCCESS;
+}
+
+void CmdBufferOwnershipBarrier(VkCommandBuffer commandBuffer, VkBuffer buffer,
+	VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask,
+	VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask,
+	uint32_t srcQueueFamilyIndex, uint32_t dstQueueFamilyIndex) {
+
+	VkBufferMemoryBarrier bufferBarrier = { 0 };
+	bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	bufferBarrier.pNext = NULL;
+	bufferBarrier.srcAccessMask = srcAccessMask;
+	bufferBarrier.dstAccessMask = dstAccessMask;
+	bufferBarrier.srcQueueFamilyIndex = srcQueueFamilyIndex;
+	bufferBarrier.dstQueueFamilyIndex = dstQueueFamilyIndex;
+	bufferBarrier.buffer = buffer;
+	bufferBarrier.offset = 0;
+	bufferBarrier.size = VK_WHOLE_SIZE;
+
+	vkCmdPipelineBarrier(commandBuffer, srcStageMask, dstStageMask, 0, 0, NULL, 1, &bufferBarrier, 0, NULL);
+}
+
+// A submission failed after an earlier one signalled semaphore, which no later submission will wait on. Let
+// queue finish the signal, then replace the semaphore with an unsignalled one so the next call can use it.
+static void ReplaceSignalledSemaphore(ComputeContext* context, VkQueue queue, VkSemaphore* semaphore) {
+	vkQueueWaitIdle(queue);
+	vkDestroySemaphore(context->device, *semaphore, NULL);
+	*semaphore = VK_NULL_HANDLE;
+
+	VkSemaphoreCreateInfo semaphoreInfo = { 0 };
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreInfo.pNext = NULL;
+	semaphoreInfo.flags = 0;
+	if (vkCreateSemaphore(context->device, &semaphoreInfo, NULL, semaphore) != VK_SUCCESS) {
+		puts("Failed to create semaphore");
+	}
+}
+
+VkResult DispatchComputeKernelStaged(ComputeContext* context, ComputeKernel* kernel, const ComputeBuffer* buffers,
+	const StagingCopy* uploads, uint32_t uploadCount, const StagingCopy* downloads, uint32_t downloadCount,
+	const void* pushConstants, uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ) {
+
+	const uint32_t transferFamily = context->transferQueueIndex;
+	const uint32_t computeFamily = context->computeQueueIndex;
+	const int transferOwnership = transferFamily != computeFamily;
+	if (transferOwnership && downloadCount > MAX_RELEASED_BUFFERS) {
+		printf("Staged dispatches download at most %u buffers\n", MAX_RELEASED_BUFFERS);
+		return VK_ERROR_TOO_MANY_OBJECTS;
+	}
+
+	// Lay out all uploads followed by all downloads in the staging buffer
+	VkDeviceSize stagingSize = 0;
+	for (uint32_t i = 0; i < uploadCount; ++i) {
+		stagingSize = AlignStagingOffset(stagingSize) + uploads[i].size;
+	}
+	for (uint32_t i = 0; i < downloadCount; ++i) {
+		stagingSize = AlignStagingOffset(stagingSize) + downloads[i].size;
+	}
+
+	VkResult result = EnsureStagingCapacity(context, stagingSize);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+
+	result = BindComputeBuffers(context, kernel, buffers);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+
+	char* stagingMapped = context->stagingAllocation.mapped;
+	const VkMemoryPropertyFlags stagingFlags =
+		context->memoryProperties.memoryTypes[context->stagingAllocation.memoryTypeIndex].propertyFlags;
+	VkDeviceSize stagingOffset = 0;
+
+	// Upload: host -> staging -> buffer on the transfer queue, then release the buffers to the compute family
+	if (uploadCount > 0) {
+		result = BeginOneTimeCommandBuffer(context->uploadCommandBuffer);
+		if (result != VK_SUCCESS) {
+			return result;
+		}
+		uint32_t scope = CmdBeginProfileScope(context->profiler, context->uploadCommandBuffer, transferFamily, "upload");
+
+		for (uint32_t i = 0; i < uploadCount; ++i) {
+			stagingOffset = AlignStagingOffset(stagingOffset);
+			CopyToMappedMemory(&context->hostCopier, stagingMapped + stagingOffset, uploads[i].hostData, uploads[i].size,
+				stagingFlags);
+
+			VkBufferCopy region = { 0 };
+			region.srcOffset = stagingOffset;
+			region.dstOffset = 0;
+			region.size = uploads[i].size;
+			vkCmdCopyBuffer(context->uploadCommandBuffer, context->stagingBuffer, buffers[uploads[i].binding].buffer, 1, &region);
+			stagingOffset += uploads[i].size;
+
+			if (transferOwnership) {
+				CmdBufferOwnershipBarrier(context->uploadCommandBuffer, buffers[uploads[i].binding].buffer,
+					VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+					VK_ACCESS_TRANSFER_WRITE_BIT, 0, transferFamily, computeFamily);
+			}
+		}
+		CmdEndProfileScope(context->profiler, context->uploadCommandBuffer, scope);
+
+		result = vkEndCommandBuffer(context->uploadCommandBuffer);
+		if (result != VK_SUCCESS) {
+			puts("Failed to end recording command buffer");
+			return result;
+		}
+	}
+
+	// Compute: acquire buffers released by the last download and uploaded buffers, dispatch, then release
+	// downloaded buffers to the transfer family. Buffers uploaded again are acquired from the upload instead.
+	for (uint32_t i = 0; i < uploadCount; ++i) {
+		for (uint32_t j = 0; j < context->releasedBufferCount; ++j) {
+			if (context->releasedBuffers[j] == buffers[uploads[i].binding].buffer) {
+				context->releasedBuffers[j] = context->releasedBuffers[--context->releasedBufferCount];
+				break;
+			}
+		}
+	}
+	result = BeginComputeCommandBuffer(context);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+
+	if (transferOwnership) {
+		for (uint32_t i = 0; i < uploadCount; ++i) {
+			CmdBufferOwnershipBarrier(context->commandBuffer, buffers[uploads[i].binding].buffer,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				0, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, transferFamily, computeFamily);
+		}
+	}
+
+	uint32_t dispatchScope = CmdBeginProfileScope(context->profiler, context->commandBuffer, computeFamily, "dispatch");
+	CmdDispatchComputeKernel(context->commandBuffer, kernel, pushConstants, groupCountX, groupCountY, groupCountZ);
+	CmdEndProfileScope(context->profiler, context->commandBuffer, dispatchScope);
+
+	if (downloadCount > 0 && transferOwnership) {
+		for (uint32_t i = 0; i < downloadCount; ++i) {
+			CmdBufferOwnershipBarrier(context->commandBuffer, buffers[downloads[i].binding].buffer,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+				VK_ACCESS_SHADER_WRITE_BIT, 0, computeFamily, transferFamily);
+		}
+	}
+	else if (downloadCount == 0) {
+		// Host located buffers are read directly after the fence, so make shader writes visible to the host
+		VkMemoryBarrier memoryBarrier = { 0 };
+		memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		memoryBarrier.pNext = NULL;
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(context->commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+			0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+	}
+
+	result = vkEndCommandBuffer(context->commandBuffer);
+	if (result != VK_SUCCESS) {
+		puts("Failed to end recording command buffer");
+		return result;
+	}
+
+	// Download: acquire the buffers on the transfer family, copy buffer -> staging and make it visible to the host,
+	// then release the buffers back to the compute family, which acquires them in its next command buffer
+	VkDeviceSize downloadOffset = stagingOffset;
+	if (downloadCount > 0) {
+		result = BeginOneTimeCommandBuffer(context->downloadCommandBuffer);
+		if (result != VK_SUCCESS) {
+			return result;
+		}
+		uint32_t scope = CmdBeginProfileScope(context->profiler, context->downloadCommandBuffer, transferFamily, "download");
+
+		for (uint32_t i = 0; i < downloadCount; ++i) {
+			if (transferOwnership) {
+				CmdBufferOwnershipBarrier(context->downloadCommandBuffer, buffers[downloads[i].binding].buffer,
+					VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+					0, VK_ACCESS_TRANSFER_READ_BIT, computeFamily, transferFamily);
+			}
+
+			stagingOffset = AlignStagingOffset(stagingOffset);
+			VkBufferCopy region = { 0 };
+			region.srcOffset = 0;
+			region.dstOffset = stagingOffset;
+			region.size = downloads[i].size;
+			vkCmdCopyBuffer(context->downloadCommandBuffer, buffers[downloads[i].binding].buffer, context->stagingBuffer, 1, &region);
+			stagingOffset += downloads[i].size;
+
+			if (transferOwnership) {
+				CmdBufferOwnershipBarrier(context->downloadCommandBuffer, buffers[downloads[i].binding].buffer,
+					VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+					0, 0, transferFamily, computeFamily);
+			}
+		}
+
+		VkMemoryBarrier memoryBarrier = { 0 };
+		memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		memoryBarrier.pNext = NULL;
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(context->downloadCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+			0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+		CmdEndProfileScope(context->profiler, context->downloadCommandBuffer, scope);
+
+		result = vkEndCommandBuffer(context->downloadCommandBuffer);
+		if (result != VK_SUCCESS) {
+			puts("Failed to end recording command buffer");
+			return result;
+		}
+	}
+
+	// Submit the three stages together; the semaphores order them on the device
+	uint32_t batch = SubmitProfileBatch(context->profiler, "staged_dispatch");
+	if (uploadCount > 0) {
+		result = SubmitCommandBuffer(context->transferQueue, context->uploadCommandBuffer,
+			VK_NULL_HANDLE, 0, context->uploadSemaphore, VK_NULL_HANDLE);
+		if (result != VK_SUCCESS) {
+			return result;
+		}
+	}
+
+	result = SubmitCommandBuffer(context->computeQueue, context->commandBuffer,
+		uploadCount > 0 ? context->uploadSemaphore : VK_NULL_HANDLE, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		downloadCount > 0 ? context->computeSemaphore : VK_NULL_HANDLE,
+		downloadCount > 0 ? VK_NULL_HANDLE : context->fence);
+	if (result != VK_SUCCESS) {
+		if (uploadCount > 0) {
+			ReplaceSignalledSemaphore(context, context->transferQueue, &context->uploadSemaphore);
+		}
+		return result;
+	}
+
+	if (downloadCount > 0) {
+		result = SubmitCommandBuffer(context->transferQueue, context->downloadCommandBuffer,
+			context->computeSemaphore, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_NULL_HANDLE, context->fence);
+		if (result != VK_SUCCESS) {
+			ReplaceSignalledSemaphore(context, context->computeQueue, &context->computeSemaphore);
+			return result;
+		}
+		for (uint32_t i = 0; transferOwnership && i < downloadCount; ++i) {
+			const VkBuffer buffer = buffers[downloads[i].binding].buffer;
+			uint32_t j = 0;
+			while (j < context->releasedBufferCount && context->releasedBuffers[j] != buffer) {
+				++j;
+			}
+			if (j == context->releasedBufferCount) {
+				context->releasedBuffers[context->releasedBufferCount++] = buffer;
+			}
+		}
+	}
+
+	result = vkWaitForFences(context->device, 1, &context->fence, VK_TRUE, UINT64_MAX);
+	if (result != VK_SUCCESS) {
+		puts("Failed to wait for fence");
+		return result;
+	}
+	CompleteProfileBatch(context->profiler, batch);
+	result = vkResetFences(context->device, 1, &context->fence);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+
+	stagingOffset = downloadOffset;
+	for (uint32_t i = 0; i < downloadCount; ++i) {
+		stagingOffset = AlignStagingOffset(stagingOffset);
+		CopyFromMappedMemory(&context->hostCopier, downloads[i].hostData, stagingMapped + stagingOffset, downloads[i].size,
+			stagingFlags);
+		stagingOffset += downloads[i].size;
+	}
+
+	return VK_SUCCESS;
+}
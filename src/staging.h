@@ -0,0 +1,33 @@
+#include <vulkan/vulkan.h>
+#include "context.h"
+#include "buffer.h"
+#include "kernel.h"
+
+#ifndef STAGING_H
+#define STAGING_H
+
+// A copy between host memory and the first size bytes of buffers[binding]
+typedef struct StagingCopy {
+	uint32_t binding;
+	// Source of an upload or destination of a download
+	void* hostData;
+	VkDeviceSize size;
+} StagingCopy;
+
+// Record one half of a queue family ownership transfer of a whole buffer, or a plain barrier when the families are equal
+void CmdBufferOwnershipBarrier(VkCommandBuffer commandBuffer, VkBuffer buffer,
+	VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask,
+	VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask,
+	uint32_t srcQueueFamilyIndex, uint32_t dstQueueFamilyIndex);
+
+// Upload host data through the context's staging buffer on the transfer queue, run the kernel on the compute queue,
+// then download results through the staging buffer on the transfer queue. The three submissions are chained with
+// semaphores, and buffer ownership is transferred between the queue families when they differ, so the host only
+// waits once. Downloaded buffers are handed back to the compute family by the next BeginComputeCommandBuffer;
+// other command buffers must not use them before that. Intended for BUFFER_LOCATION_DEVICE buffers but works
+// with any buffer.
+VkResult DispatchComputeKernelStaged(ComputeContext* context, ComputeKernel* kernel, const ComputeBuffer* buffers,
+	const StagingCopy* uploads, uint32_t uploadCount, const StagingCopy* downloads, uint32_t downloadCount,
+	const void* pushConstants, uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ);
+
+#endif
@@ -0,0 +1,68 @@
+#include "startup.h"
+#include "timer.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+void InitStartupTrace(StartupTrace* trace) {
+	memset(trace, 0, sizeof(*trace));
+	pthread_mutex_init(&trace->mutex, NULL);
+	trace->originNs = GetTimeNs();
+}
+
+void DestroyStartupTrace(StartupTrace* trace) {
+	pthread_mutex_destroy(&trace->mutex);
+}
+
+void AddStartupPhase(StartupTrace* trace, const char* name, uint32_t thread, uint64_t startNs, uint64_t endNs) {
+	if (trace == NULL) {
+		return;
+	}
+	pthread_mutex_lock(&trace->mutex);
+	if (trace->phaseCount < STARTUP_MAX_PHASES) {
+		StartupPhase* phase = &trace->phases[trace->phaseCount++];
+		snprintf(phase->name, sizeof(phase->name), "%s", name);
+		phase->thread = thread;
+		phase->startNs = startNs;
+		phase->endNs = endNs;
+	}
+	pthread_mutex_unlock(&trace->mutex);
+}
+
+void PrintStartupTrace(StartupTrace* trace) {
+	pthread_mutex_lock(&trace->mutex);
+	StartupPhase phases[STARTUP_MAX_PHASES];
+	const uint32_t phaseCount = trace->phaseCount;
+	memcpy(phases, trace->phases, phaseCount * sizeof(StartupPhase));
+	pthread_mutex_unlock(&trace->mutex);
+
+	// Phases are recorded as they end, so sort them by start
+	for (uint32_t i = 1; i < phaseCount; ++i) {
+		StartupPhase phase = phases[i];
+		uint32_t j = i;
+		for (; j > 0 && phases[j - 1].startNs > phase.startNs; --j) {
+			phases[j] = phases[j - 1];
+		}
+		phases[j] = phase;
+	}
+
+	uint64_t mainEndNs = trace->originNs;
+	uint64_t backgroundNs = 0;
+	printf("%-32s %8s %10s %10s\n", "Startup phase", "Thread", "Start ms", "ms");
+	for (uint32_t i = 0; i < phaseCount; ++i) {
+		const StartupPhase* phase = &phases[i];
+		char thread[16];
+		if (phase->thread == 0) {
+			snprintf(thread, sizeof(thread), "main");
+			mainEndNs = phase->endNs > mainEndNs ? phase->endNs : mainEndNs;
+		}
+		else {
+			snprintf(thread, sizeof(thread), "bg %u", phase->thread);
+			backgroundNs += phase->endNs - phase->startNs;
+		}
+		printf("%-32s %8s %10.3f %10.3f\n", phase->name, thread, NsToMs(phase->startNs - trace->originNs),
+			NsToMs(phase->endNs - phase->startNs));
+	}
+	printf("Main thread busy until %.3f ms, %.3f ms of work done in the background\n",
+		NsToMs(mainEndNs - trace->originNs), NsToMs(backgroundNs));
+}
@@ -0,0 +1,36 @@
+#include <pthread.h>
+#include <stdint.h>
+
+#ifndef STARTUP_H
+#define STARTUP_H
+
+#define STARTUP_MAX_PHASES 64
+#define STARTUP_MAX_NAME 64
+
+typedef struct StartupPhase {
+	char name[STARTUP_MAX_NAME];
+	// 0 for the main thread, 1 and up for background threads
+	uint32_t thread;
+	uint64_t startNs;
+	uint64_t endNs;
+} StartupPhase;
+
+// Time spent in each phase of startup, on the main thread and on the threads creating pipelines in the background,
+// so it shows what the first job actually waited for
+typedef struct StartupTrace {
+	uint64_t originNs;
+	StartupPhase phases[STARTUP_MAX_PHASES];
+	uint32_t phaseCount;
+	pthread_mutex_t mutex;
+} StartupTrace;
+
+// Start the trace at the current time
+void InitStartupTrace(StartupTrace* trace);
+void DestroyStartupTrace(StartupTrace* trace);
+
+// Record a phase from any thread. Does nothing if trace is NULL; phases past STARTUP_MAX_PHASES are dropped.
+void AddStartupPhase(StartupTrace* trace, const char* name, uint32_t thread, uint64_t startNs, uint64_t endNs);
+// Print the phases recorded so far in order of their start, relative to the start of the trace
+void PrintStartupTrace(StartupTrace* trace);
+
+#endif
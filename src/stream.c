@@ -0,0 +1,385 @@
+#include "stream.h"
+#include "staging.h"
+#include "timer.h"
+#include <vulkan/vulkan.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// The minimum maxPushConstantsSize guaranteed by the spec
+#define MAX_STREAM_PUSH_CONSTANT_SIZE 128
+
+static VkResult CreateStreamSlot(ComputeContext* context, ComputeStream* stream, StreamSlot* slot) {
+	VkResult result = CreateComputeBuffer(context, stream->chunkSize, BUFFER_LOCATION_HOST, &slot->stagingInput);
+	if (result == VK_SUCCESS) {
+		result = CreateComputeBuffer(context, stream->chunkSize, BUFFER_LOCATION_READBACK, &slot->stagingOutput);
+	}
+	if (result == VK_SUCCESS) {
+		result = CreateComputeBuffer(context, stream->chunkSize, BUFFER_LOCATION_DEVICE, &slot->input);
+	}
+	if (result == VK_SUCCESS) {
+		result = CreateComputeBuffer(context, stream->chunkSize, BUFFER_LOCATION_DEVICE, &slot->output);
+	}
+	if (result != VK_SUCCESS) {
+		puts("Failed to create stream buffers");
+		return result;
+	}
+
+	// Each slot has its own descriptor set so that chunks in flight never share bindings
+	VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = { 0 };
+	descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	descriptorSetAllocateInfo.pNext = NULL;
+	descriptorSetAllocateInfo.descriptorPool = stream->descriptorPool;
+	descriptorSetAllocateInfo.descriptorSetCount = 1;
+	descriptorSetAllocateInfo.pSetLayouts = &stream->kernel->descriptorSetLayout;
+
+	result = vkAllocateDescriptorSets(context->device, &descriptorSetAllocateInfo, &slot->descriptorSet);
+	if (result != VK_SUCCESS) {
+		puts("Failed to allocate stream descriptor set");
+		return result;
+	}
+
+	VkDescriptorBufferInfo bufferInfos[2] = { 0 };
+	bufferInfos[0].buffer = slot->input.buffer;
+	bufferInfos[0].offset = 0;
+	bufferInfos[0].range = VK_WHOLE_SIZE;
+	bufferInfos[1].buffer = slot->output.buffer;
+	bufferInfos[1].offset = 0;
+	bufferInfos[1].range = VK_WHOLE_SIZE;
+
+	VkWriteDescriptorSet writeDescriptorSets[2] = { 0 };
+	for (uint32_t i = 0; i < 2; ++i) {
+		writeDescriptorSets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeDescriptorSets[i].pNext = NULL;
+		writeDescriptorSets[i].dstSet = slot->descriptorSet;
+		writeDescriptorSets[i].dstBinding = i;
+		writeDescriptorSets[i].dstArrayElement = 0;
+		writeDescriptorSets[i].descriptorCount = 1;
+		writeDescriptorSets[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writeDescriptorSets[i].pImageInfo = NULL;
+		writeDescriptorSets[i].pBufferInfo = &bufferInfos[i];
+		writeDescriptorSets[i].pTexelBufferView = NULL;
+	}
+	vkUpdateDescriptorSets(context->device, 2, writeDescriptorSets, 0, NULL);
+
+	// Allocate command buffers from the context's pools
+	VkCommandBufferAllocateInfo commandBufferAllocateInfo = { 0 };
+	commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	commandBufferAllocateInfo.pNext = NULL;
+	commandBufferAllocateInfo.commandPool = context->transferCommandPool;
+	commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	commandBufferAllocateInfo.commandBufferCount = 1;
+
+	result = vkAllocateCommandBuffers(context->device, &commandBufferAllocateInfo, &slot->uploadCommandBuffer);
+	if (result == VK_SUCCESS) {
+		result = vkAllocateCommandBuffers(context->device, &commandBufferAllocateInfo, &slot->downloadCommandBuffer);
+	}
+	if (result == VK_SUCCESS) {
+		commandBufferAllocateInfo.commandPool = context->commandPool;
+		result = vkAllocateCommandBuffers(context->device, &commandBufferAllocateInfo, &slot->computeCommandBuffer);
+	}
+	if (result != VK_SUCCESS) {
+		puts("Failed to allocate stream command buffers");
+		return result;
+	}
+
+	VkSemaphoreCreateInfo semaphoreInfo = { 0 };
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreInfo.pNext = NULL;
+	semaphoreInfo.flags = 0;
+
+	result = vkCreateSemaphore(context->device, &semaphoreInfo, NULL, &slot->uploadSemaphore);
+	if (result == VK_SUCCESS) {
+		result = vkCreateSemaphore(context->device, &semaphoreInfo, NULL, &slot->computeSemaphore);
+	}
+	if (result != VK_SUCCESS) {
+		puts("Failed to create stream semaphores");
+		return result;
+	}
+
+	VkFenceCreateInfo fenceInfo = { 0 };
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceInfo.pNext = NULL;
+	fenceInfo.flags = 0;
+
+	result = vkCreateFence(context->device, &fenceInfo, NULL, &slot->fence);
+	if (result != VK_SUCCESS) {
+		puts("Failed to create stream fence");
+		return result;
+	}
+
+	return VK_SUCCESS;
+}
+
+VkResult CreateComputeStream(ComputeContext* context, ComputeKernel* kernel, uint32_t slotCount,
+	VkDeviceSize chunkSize, VkDeviceSize elementSize, ComputeStream* stream) {
+
+	memset(stream, 0, sizeof(*stream));
+
+	uint32_t groupCountX = 0;
+	uint32_t groupCountY = 0;
+	uint32_t groupCountZ = 0;
+	if (kernel->bindingCount != 2 || kernel->dynamicRange > 0 || slotCount == 0 || elementSize == 0 || chunkSize % elementSize != 0 ||
+		kernel->pushConstantSize > MAX_STREAM_PUSH_CONSTANT_SIZE ||
+		ComputeDispatchSize(context, kernel, chunkSize / elementSize, &groupCountX, &groupCountY, &groupCountZ) != VK_SUCCESS) {
+		puts("Invalid stream configuration");
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+
+	stream->kernel = kernel;
+	stream->slotCount = slotCount;
+	stream->chunkSize = chunkSize;
+	stream->elementSize = elementSize;
+
+	stream->slots = calloc(slotCount, sizeof(StreamSlot));
+	if (stream->slots == NULL) {
+		return VK_ERROR_OUT_OF_HOST_MEMORY;
+	}
+
+	VkDescriptorPoolSize descriptorPoolSize = { 0 };
+	descriptorPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	descriptorPoolSize.descriptorCount = 2 * slotCount;
+
+	VkDescriptorPoolCreateInfo descriptorPoolInfo = { 0 };
+	descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptorPoolInfo.pNext = NULL;
+	descriptorPoolInfo.flags = 0;
+	descriptorPoolInfo.maxSets = slotCount;
+	descriptorPoolInfo.poolSizeCount = 1;
+	descriptorPoolInfo.pPoolSizes = &descriptorPoolSize;
+
+	VkResult result = vkCreateDescriptorPool(context->device, &descriptorPoolInfo, NULL, &stream->descriptorPool);
+	if (result != VK_SUCCESS) {
+		puts("Failed to create stream descriptor pool");
+		DestroyComputeStream(context, stream);
+		return result;
+	}
+
+	for (uint32_t i = 0; i < slotCount; ++i) {
+		result = CreateStreamSlot(context, stream, &stream->slots[i]);
+		if (result != VK_SUCCESS) {
+			DestroyComputeStream(context, stream);
+			return result;
+		}
+	}
+
+	return VK_SUCCESS;
+}
+
+void DestroyComputeStream(ComputeContext* context, ComputeStream* stream) {
+	for (uint32_t i = 0; stream->slots != NULL && i < stream->slotCount; ++i) {
+		StreamSlot* slot = &stream->slots[i];
+		if (slot->pending) {
+			vkWaitForFences(context->device, 1, &slot->fence, VK_TRUE, UINT64_MAX);
+		}
+		vkDestroyFence(context->device, slot->fence, NULL);
+		vkDestroySemaphore(context->device, slot->uploadSemaphore, NULL);
+		vkDestroySemaphore(context->device, slot->computeSemaphore, NULL);
+		if (slot->uploadCommandBuffer != VK_NULL_HANDLE) {
+			vkFreeCommandBuffers(context->device, context->transferCommandPool, 1, &slot->uploadCommandBuffer);
+		}
+		if (slot->downloadCommandBuffer != VK_NULL_HANDLE) {
+			vkFreeCommandBuffers(context->device, context->transferCommandPool, 1, &slot->downloadCommandBuffer);
+		}
+		if (slot->computeCommandBuffer != VK_NULL_HANDLE) {
+			vkFreeCommandBuffers(context->device, context->commandPool, 1, &slot->computeCommandBuffer);
+		}
+		DestroyComputeBuffer(context, &slot->stagingInput);
+		DestroyComputeBuffer(context, &slot->stagingOutput);
+		DestroyComputeBuffer(context, &slot->input);
+		DestroyComputeBuffer(context, &slot->output);
+	}
+	free(stream->slots);
+	vkDestroyDescriptorPool(context->device, stream->descriptorPool, NULL);
+	memset(stream, 0, sizeof(*stream));
+}
+
+// Record and submit upload -> dispatch -> download for the chunk already written to the slot's staging input
+static VkResult SubmitStreamSlot(ComputeContext* context, ComputeStream* stream, StreamSlot* slot) {
+	const uint32_t transferFamily = context->transferQueueIndex;
+	const uint32_t computeFamily = context->computeQueueIndex;
+	const int transferOwnership = transferFamily != computeFamily;
+
+	VkBufferCopy region = { 0 };
+	region.srcOffset = 0;
+	region.dstOffset = 0;
+	region.size = slot->size;
+
+	// Upload on the transfer queue
+	VkResult result = BeginOneTimeCommandBuffer(slot->uploadCommandBuffer);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+	uint32_t scope = CmdBeginProfileScope(context->profiler, slot->uploadCommandBuffer, transferFamily, "stream_upload");
+	vkCmdCopyBuffer(slot->uploadCommandBuffer, slot->stagingInput.buffer, slot->input.buffer, 1, &region);
+	CmdEndProfileScope(context->profiler, slot->uploadCommandBuffer, scope);
+	if (transferOwnership) {
+		CmdBufferOwnershipBarrier(slot->uploadCommandBuffer, slot->input.buffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			VK_ACCESS_TRANSFER_WRITE_BIT, 0, transferFamily, computeFamily);
+	}
+	result = vkEndCommandBuffer(slot->uploadCommandBuffer);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+
+	// Dispatch on the compute queue
+	result = BeginOneTimeCommandBuffer(slot->computeCommandBuffer);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+	if (transferOwnership) {
+		CmdBufferOwnershipBarrier(slot->computeCommandBuffer, slot->input.buffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, VK_ACCESS_SHADER_READ_BIT, transferFamily, computeFamily);
+	}
+	// The last chunk may be partial; the kernel's bounds check masks the remainder of the final workgroup
+	uint32_t pushConstants[MAX_STREAM_PUSH_CONSTANT_SIZE / sizeof(uint32_t)] = { 0 };
+	pushConstants[0] = (uint32_t) ((slot->size + stream->elementSize - 1) / stream->elementSize);
+	uint32_t groupCountX = 0;
+	uint32_t groupCountY = 0;
+	uint32_t groupCountZ = 0;
+	result = ComputeDispatchSize(context, stream->kernel, pushConstants[0], &groupCountX, &groupCountY, &groupCountZ);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+	vkCmdBindPipeline(slot->computeCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, stream->kernel->pipeline);
+	vkCmdBindDescriptorSets(slot->computeCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, stream->kernel->pipelineLayout,
+		0, 1, &slot->descriptorSet, 0, NULL);
+	if (stream->kernel->pushConstantSize > 0) {
+		vkCmdPushConstants(slot->computeCommandBuffer, stream->kernel->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT,
+			0, stream->kernel->pushConstantSize, pushConstants);
+	}
+	scope = CmdBeginProfileScope(context->profiler, slot->computeCommandBuffer, computeFamily, "stream_dispatch");
+	vkCmdDispatch(slot->computeCommandBuffer, groupCountX, groupCountY, groupCountZ);
+	CmdEndProfileScope(context->profiler, slot->computeCommandBuffer, scope);
+	if (transferOwnership) {
+		CmdBufferOwnershipBarrier(slot->computeCommandBuffer, slot->output.buffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			VK_ACCESS_SHADER_WRITE_BIT, 0, computeFamily, transferFamily);
+	}
+	result = vkEndCommandBuffer(slot->computeCommandBuffer);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+
+	// Download on the transfer queue
+	result = BeginOneTimeCommandBuffer(slot->downloadCommandBuffer);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+	if (transferOwnership) {
+		CmdBufferOwnershipBarrier(slot->downloadCommandBuffer, slot->output.buffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, VK_ACCESS_TRANSFER_READ_BIT, computeFamily, transferFamily);
+	}
+	scope = CmdBeginProfileScope(context->profiler, slot->downloadCommandBuffer, transferFamily, "stream_download");
+	vkCmdCopyBuffer(slot->downloadCommandBuffer, slot->output.buffer, slot->stagingOutput.buffer, 1, &region);
+	CmdEndProfileScope(context->profiler, slot->downloadCommandBuffer, scope);
+
+	VkMemoryBarrier memoryBarrier = { 0 };
+	memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memoryBarrier.pNext = NULL;
+	memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(slot->downloadCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+		0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+
+	result = vkEndCommandBuffer(slot->downloadCommandBuffer);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+
+	slot->profileBatch = SubmitProfileBatch(context->profiler, "stream_chunk");
+	result = SubmitCommandBuffer(context->transferQueue, slot->uploadCommandBuffer,
+		VK_NULL_HANDLE, 0, slot->uploadSemaphore, VK_NULL_HANDLE);
+	if (result == VK_SUCCESS) {
+		result = SubmitCommandBuffer(context->computeQueue, slot->computeCommandBuffer,
+			slot->uploadSemaphore, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, slot->computeSemaphore, VK_NULL_HANDLE);
+	}
+	if (result == VK_SUCCESS) {
+		result = SubmitCommandBuffer(context->transferQueue, slot->downloadCommandBuffer,
+			slot->computeSemaphore, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_NULL_HANDLE, slot->fence);
+	}
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+
+	slot->pending = 1;
+	return VK_SUCCESS;
+}
+
+// Wait for a slot's chunk to come back and hand it to the drain callback
+static VkResult FinishStreamSlot(ComputeContext* context, StreamSlot* slot, StreamDrainCallback drain, void* userData) {
+	VkResult result = vkWaitForFences(context->device, 1, &slot->fence, VK_TRUE, UINT64_MAX);
+	if (result != VK_SUCCESS) {
+		puts("Failed to wait for stream fence");
+		return result;
+	}
+	slot->pending = 0;
+	CompleteProfileBatch(context->profiler, slot->profileBatch);
+
+	result = vkResetFences(context->device, 1, &slot->fence);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+
+	if (drain != NULL) {
+		result = InvalidateComputeBuffer(context, &slot->stagingOutput, 0, slot->size);
+		if (result != VK_SUCCESS) {
+			return result;
+		}
+		drain(userData, slot->stagingOutput.mapped, slot->offset, slot->size);
+	}
+	return VK_SUCCESS;
+}
+
+VkResult RunComputeStream(ComputeContext* context, ComputeStream* stream, VkDeviceSize totalSize,
+	StreamFillCallback fill, StreamDrainCallback drain, void* userData, ComputeStreamStats* stats) {
+
+	uint64_t startTime = GetTimeNs();
+	uint32_t chunkIndex = 0;
+	VkResult result = VK_SUCCESS;
+
+	for (VkDeviceSize offset = 0; offset < totalSize; offset += stream->chunkSize, ++chunkIndex) {
+		StreamSlot* slot = &stream->slots[chunkIndex % stream->slotCount];
+
+		// Reusing a slot means its previous chunk (slotCount chunks ago) must be drained first
+		if (slot->pending) {
+			result = FinishStreamSlot(context, slot, drain, userData);
+			if (result != VK_SUCCESS) {
+				return result;
+			}
+		}
+
+		slot->offset = offset;
+		slot->size = totalSize - offset < stream->chunkSize ? totalSize - offset : stream->chunkSize;
+		if (fill != NULL) {
+			fill(userData, slot->stagingInput.mapped, slot->offset, slot->size);
+		}
+
+		result = SubmitStreamSlot(context, stream, slot);
+		if (result != VK_SUCCESS) {
+			return result;
+		}
+	}
+
+	// Drain the chunks still in flight, oldest first
+	for (uint32_t i = 0; i < stream->slotCount; ++i) {
+		StreamSlot* slot = &stream->slots[(chunkIndex + i) % stream->slotCount];
+		if (slot->pending) {
+			result = FinishStreamSlot(context, slot, drain, userData);
+			if (result != VK_SUCCESS) {
+				return result;
+			}
+		}
+	}
+
+	if (stats != NULL) {
+		stats->bytesProcessed = totalSize;
+		stats->chunkCount = chunkIndex;
+		stats->elapsedNs = GetTimeNs() - startTime;
+		stats->throughputGBs = stats->elapsedNs > 0 ? (double) totalSize / (double) stats->elapsedNs : 0.0;
+	}
+	return VK_SUCCESS;
+}
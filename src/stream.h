@@ -0,0 +1,65 @@
+#include <vulkan/vulkan.h>
+#include "context.h"
+#include "buffer.h"
+#include "kernel.h"
+
+#ifndef STREAM_H
+#define STREAM_H
+
+// Called to produce the next chunk of input. Write up to size bytes of the stream starting at offset into dst.
+typedef void (*StreamFillCallback)(void* userData, void* dst, VkDeviceSize offset, VkDeviceSize size);
+
+// Called with each finished chunk of output, in stream order
+typedef void (*StreamDrainCallback)(void* userData, const void* src, VkDeviceSize offset, VkDeviceSize size);
+
+// One in-flight chunk: host visible staging for both directions (host cached for the output), device local
+// working buffers and the command buffers and synchronization that move a chunk through upload -> dispatch -> download
+typedef struct StreamSlot {
+	ComputeBuffer stagingInput;
+	ComputeBuffer stagingOutput;
+	ComputeBuffer input;
+	ComputeBuffer output;
+	VkDescriptorSet descriptorSet;
+	VkCommandBuffer uploadCommandBuffer;
+	VkCommandBuffer computeCommandBuffer;
+	VkCommandBuffer downloadCommandBuffer;
+	VkSemaphore uploadSemaphore;
+	VkSemaphore computeSemaphore;
+	VkFence fence;
+	int pending;
+	uint32_t profileBatch;
+	VkDeviceSize offset;
+	VkDeviceSize size;
+} StreamSlot;
+
+// Pipelined streaming of an elementwise kernel (binding 0 in, binding 1 out, same element size) over inputs larger than
+// device memory. While the GPU works on one chunk, the host fills the next slot and drains the oldest one, and
+// uploads, dispatches and downloads of different chunks overlap across the transfer and compute queues.
+typedef struct ComputeStream {
+	ComputeKernel* kernel;
+	uint32_t slotCount;
+	VkDeviceSize chunkSize;
+	VkDeviceSize elementSize;
+	VkDescriptorPool descriptorPool;
+	StreamSlot* slots;
+} ComputeStream;
+
+typedef struct ComputeStreamStats {
+	VkDeviceSize bytesProcessed;
+	uint32_t chunkCount;
+	uint64_t elapsedNs;
+	// Input bytes processed per second, in units of 1e9 bytes
+	double throughputGBs;
+} ComputeStreamStats;
+
+// The kernel is dispatched over chunkSize / elementSize elements per chunk, with the element count pushed
+// as its first push constant
+VkResult CreateComputeStream(ComputeContext* context, ComputeKernel* kernel, uint32_t slotCount,
+	VkDeviceSize chunkSize, VkDeviceSize elementSize, ComputeStream* stream);
+void DestroyComputeStream(ComputeContext* context, ComputeStream* stream);
+
+// Stream totalSize bytes through the kernel, blocking until every chunk has been drained
+VkResult RunComputeStream(ComputeContext* context, ComputeStream* stream, VkDeviceSize totalSize,
+	StreamFillCallback fill, StreamDrainCallback drain, void* userData, ComputeStreamStats* stats);
+
+#endif
@@ -0,0 +1,435 @@
+#define _POSIX_C_SOURCE 200112L
+#include "submitter.h"
+#include <vulkan/vulkan.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// How long the submitter thread waits on its oldest fence before checking for new jobs again
+#define SUBMITTER_FENCE_POLL_NS 100000
+
+// Lock-free multi-producer push onto the submitter's job queue. The exchange is sequentially consistent because
+// WakeSubmitter's load of sleeping must not be ordered before it: the submitter stores sleeping, then loads tail,
+// and with weaker orderings both sides could miss the other's store and the wakeup would be lost.
+static void PushJob(ComputeSubmitter* submitter, SubmitJob* job) {
+	__atomic_store_n(&job->next, NULL, __ATOMIC_RELAXED);
+	SubmitJob* previous = __atomic_exchange_n(&submitter->tail, job, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&previous->next, job, __ATOMIC_RELEASE);
+}
+
+// Pop the oldest job. Only called on the submitter thread. Returns NULL if the queue is empty or a producer is
+// between its exchange and its link, in which case the job is picked up on the next call.
+static SubmitJob* PopJob(ComputeSubmitter* submitter) {
+	SubmitJob* head = submitter->head;
+	SubmitJob* next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+	if (head == &submitter->stub) {
+		if (next == NULL) {
+			return NULL;
+		}
+		submitter->head = next;
+		head = next;
+		next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+	}
+	if (next != NULL) {
+		submitter->head = next;
+		return head;
+	}
+
+	SubmitJob* tail = __atomic_load_n(&submitter->tail, __ATOMIC_ACQUIRE);
+	if (tail != head) {
+		return NULL;
+	}
+	// head is the last job; put the stub behind it so head can be handed out
+	PushJob(submitter, &submitter->stub);
+	next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+	if (next != NULL) {
+		submitter->head = next;
+		return head;
+	}
+	return NULL;
+}
+
+static int IsJobQueueEmpty(ComputeSubmitter* submitter) {
+	SubmitJob* head = submitter->head;
+	return __atomic_load_n(&head->next, __ATOMIC_ACQUIRE) == NULL &&
+		__atomic_load_n(&submitter->tail, __ATOMIC_SEQ_CST) == head;
+}
+
+static void WakeSubmitter(ComputeSubmitter* submitter) {
+	if (__atomic_load_n(&submitter->sleeping, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&submitter->mutex);
+		pthread_cond_signal(&submitter->wakeCondition);
+		pthread_mutex_unlock(&submitter->mutex);
+	}
+}
+
+// Report a list of jobs as finished and let their workers reuse them
+static void CompleteJobs(ComputeSubmitter* submitter, SubmitJob* jobs, VkResult result) {
+	while (jobs != NULL) {
+		SubmitJob* next = jobs->batchNext;
+		if (jobs->future != NULL) {
+			jobs->future->result = result;
+			__atomic_store_n(&jobs->future->done, 1, __ATOMIC_RELEASE);
+		}
+		if (jobs->callback != NULL) {
+			jobs->callback(jobs->userData, result);
+		}
+		__atomic_store_n(&jobs->busy, 0, __ATOMIC_RELEASE);
+		jobs = next;
+	}
+
+	pthread_mutex_lock(&submitter->mutex);
+	pthread_cond_broadcast(&submitter->completeCondition);
+	pthread_mutex_unlock(&submitter->mutex);
+}
+
+// Wait up to timeout for the oldest submission and complete its jobs. Returns VK_TIMEOUT if it is still running.
+static VkResult CompleteOldestBatch(ComputeSubmitter* submitter, uint64_t timeout) {
+	SubmitBatch* batch = &submitter->batches[submitter->oldestBatch];
+	VkResult result = vkWaitForFences(submitter->context->device, 1, &batch->fence, VK_TRUE, timeout);
+	if (result == VK_TIMEOUT) {
+		return result;
+	}
+
+	vkResetFences(submitter->context->device, 1, &batch->fence);
+	SubmitJob* jobs = batch->jobs;
+	batch->jobs = NULL;
+	submitter->oldestBatch = (submitter->oldestBatch + 1) % SUBMITTER_MAX_IN_FLIGHT;
+	submitter->batchCount--;
+	CompleteJobs(submitter, jobs, result);
+	return VK_SUCCESS;
+}
+
+// Submit up to SUBMITTER_MAX_BATCH_JOBS queued jobs with one vkQueueSubmit. Returns the number submitted.
+static uint32_t SubmitQueuedJobs(ComputeSubmitter* submitter) {
+	SubmitJob* first = PopJob(submitter);
+	if (first == NULL) {
+		return 0;
+	}
+
+	if (submitter->batchCount == SUBMITTER_MAX_IN_FLIGHT) {
+		CompleteOldestBatch(submitter, UINT64_MAX);
+	}
+	SubmitBatch* batch = &submitter->batches[(submitter->oldestBatch + submitter->batchCount) % SUBMITTER_MAX_IN_FLIGHT];
+
+	uint32_t count = 0;
+	SubmitJob* last = NULL;
+	for (SubmitJob* job = first; job != NULL; job = count < SUBMITTER_MAX_BATCH_JOBS ? PopJob(submitter) : NULL) {
+		submitter->submitCommandBuffers[count++] = job->commandBuffer;
+		job->batchNext = NULL;
+		if (last == NULL) {
+			batch->jobs = job;
+		}
+		else {
+			last->batchNext = job;
+		}
+		last = job;
+	}
+
+	VkSubmitInfo submitInfo = { 0 };
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = NULL;
+	submitInfo.waitSemaphoreCount = 0;
+	submitInfo.pWaitSemaphores = NULL;
+	submitInfo.pWaitDstStageMask = NULL;
+	submitInfo.commandBufferCount = count;
+	submitInfo.pCommandBuffers = submitter->submitCommandBuffers;
+	submitInfo.signalSemaphoreCount = 0;
+	submitInfo.pSignalSemaphores = NULL;
+
+	VkResult result = vkQueueSubmit(submitter->queue, 1, &submitInfo, batch->fence);
+	if (result != VK_SUCCESS) {
+		puts("Failed to submit jobs");
+		SubmitJob* jobs = batch->jobs;
+		batch->jobs = NULL;
+		CompleteJobs(submitter, jobs, result);
+		return count;
+	}
+
+	submitter->batchCount++;
+	submitter->submitCount++;
+	submitter->jobCount += count;
+	return count;
+}
+
+static void* RunSubmitter(void* argument) {
+	ComputeSubmitter* submitter = argument;
+	for (;;) {
+		if (SubmitQueuedJobs(submitter) > 0) {
+			continue;
+		}
+
+		// Nothing queued: retire finished submissions, briefly waiting on the oldest so new jobs are not delayed
+		if (submitter->batchCount > 0) {
+			CompleteOldestBatch(submitter, SUBMITTER_FENCE_POLL_NS);
+			continue;
+		}
+
+		// Idle: sleep until a producer pushes a job or the submitter is destroyed
+		pthread_mutex_lock(&submitter->mutex);
+		__atomic_store_n(&submitter->sleeping, 1, __ATOMIC_SEQ_CST);
+		while (IsJobQueueEmpty(submitter) && !__atomic_load_n(&submitter->stop, __ATOMIC_ACQUIRE)) {
+			pthread_cond_wait(&submitter->wakeCondition, &submitter->mutex);
+		}
+		__atomic_store_n(&submitter->sleeping, 0, __ATOMIC_SEQ_CST);
+		int stop = __atomic_load_n(&submitter->stop, __ATOMIC_ACQUIRE) && IsJobQueueEmpty(submitter);
+		pthread_mutex_unlock(&submitter->mutex);
+		if (stop) {
+			break;
+		}
+	}
+	return NULL;
+}
+
+VkResult CreateComputeSubmitter(ComputeContext* context, VkQueue queue, uint32_t queueFamilyIndex, ComputeSubmitter* submitter) {
+	memset(submitter, 0, sizeof(*submitter));
+	submitter->context = context;
+	submitter->queue = queue;
+	submitter->queueFamilyIndex = queueFamilyIndex;
+	submitter->head = &submitter->stub;
+	submitter->tail = &submitter->stub;
+
+	VkFenceCreateInfo fenceInfo = { 0 };
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceInfo.pNext = NULL;
+	fenceInfo.flags = 0;
+
+	for (uint32_t i = 0; i < SUBMITTER_MAX_IN_FLIGHT; ++i) {
+		VkResult result = vkCreateFence(context->device, &fenceInfo, NULL, &submitter->batches[i].fence);
+		if (result != VK_SUCCESS) {
+			puts("Failed to create submitter fence");
+			for (uint32_t j = 0; j < i; ++j) {
+				vkDestroyFence(context->device, submitter->batches[j].fence, NULL);
+			}
+			return result;
+		}
+	}
+
+	pthread_mutex_init(&submitter->mutex, NULL);
+	pthread_cond_init(&submitter->wakeCondition, NULL);
+	pthread_cond_init(&submitter->completeCondition, NULL);
+	if (pthread_create(&submitter->thread, NULL, RunSubmitter, submitter) != 0) {
+		puts("Failed to start submitter thread");
+		pthread_cond_destroy(&submitter->completeCondition);
+		pthread_cond_destroy(&submitter->wakeCondition);
+		pthread_mutex_destroy(&submitter->mutex);
+		for (uint32_t i = 0; i < SUBMITTER_MAX_IN_FLIGHT; ++i) {
+			vkDestroyFence(context->device, submitter->batches[i].fence, NULL);
+		}
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+	return VK_SUCCESS;
+}
+
+void DestroyComputeSubmitter(ComputeSubmitter* submitter) {
+	pthread_mutex_lock(&submitter->mutex);
+	__atomic_store_n(&submitter->stop, 1, __ATOMIC_RELEASE);
+	pthread_cond_signal(&submitter->wakeCondition);
+	pthread_mutex_unlock(&submitter->mutex);
+	pthread_join(submitter->thread, NULL);
+
+	pthread_cond_destroy(&submitter->completeCondition);
+	pthread_cond_destroy(&submitter->wakeCondition);
+	pthread_mutex_destroy(&submitter->mutex);
+	for (uint32_t i = 0; i < SUBMITTER_MAX_IN_FLIGHT; ++i) {
+		vkDestroyFence(submitter->context->device, submitter->batches[i].fence, NULL);
+	}
+	memset(submitter, 0, sizeof(*submitter));
+}
+
+VkResult CreateSubmitWorker(ComputeSubmitter* submitter, SubmitWorker* worker) {
+	memset(worker, 0, sizeof(*worker));
+	worker->submitter = submitter;
+	VkDevice device = submitter->context->device;
+
+	VkCommandPoolCreateInfo commandPoolInfo = { 0 };
+	commandPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	commandPoolInfo.pNext = NULL;
+	commandPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	commandPoolInfo.queueFamilyIndex = submitter->queueFamilyIndex;
+
+	VkResult result = vkCreateCommandPool(device, &commandPoolInfo, NULL, &worker->commandPool);
+	if (result != VK_SUCCESS) {
+		puts("Failed to create worker command pool");
+		return result;
+	}
+
+	VkCommandBuffer commandBuffers[WORKER_MAX_JOBS];
+	VkCommandBufferAllocateInfo commandBufferAllocateInfo = { 0 };
+	commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	commandBufferAllocateInfo.pNext = NULL;
+	commandBufferAllocateInfo.commandPool = worker->commandPool;
+	commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	commandBufferAllocateInfo.commandBufferCount = WORKER_MAX_JOBS;
+
+	result = vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, commandBuffers);
+	if (result != VK_SUCCESS) {
+		puts("Failed to allocate worker command buffers");
+		DestroySubmitWorker(worker);
+		return result;
+	}
+	for (uint32_t i = 0; i < WORKER_MAX_JOBS; ++i) {
+		worker->jobs[i].commandBuffer = commandBuffers[i];
+	}
+
+	// Sets are freed and reallocated when a job slot switches to a kernel with a different layout
+	VkDescriptorPoolSize descriptorPoolSize = { 0 };
+	descriptorPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	descriptorPoolSize.descriptorCount = WORKER_MAX_JOBS * WORKER_MAX_BINDINGS;
+
+	VkDescriptorPoolCreateInfo descriptorPoolInfo = { 0 };
+	descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptorPoolInfo.pNext = NULL;
+	descriptorPoolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+	descriptorPoolInfo.maxSets = WORKER_MAX_JOBS;
+	descriptorPoolInfo.poolSizeCount = 1;
+	descriptorPoolInfo.pPoolSizes = &descriptorPoolSize;
+
+	result = vkCreateDescriptorPool(device, &descriptorPoolInfo, NULL, &worker->descriptorPool);
+	if (result != VK_SUCCESS) {
+		puts("Failed to create worker descriptor pool");
+		DestroySubmitWorker(worker);
+		return result;
+	}
+
+	return VK_SUCCESS;
+}
+
+// Block until the submitter has completed the job
+static void WaitJobIdle(ComputeSubmitter* submitter, SubmitJob* job) {
+	if (!__atomic_load_n(&job->busy, __ATOMIC_ACQUIRE)) {
+		return;
+	}
+	pthread_mutex_lock(&submitter->mutex);
+	while (__atomic_load_n(&job->busy, __ATOMIC_ACQUIRE)) {
+		pthread_cond_wait(&submitter->completeCondition, &submitter->mutex);
+	}
+	pthread_mutex_unlock(&submitter->mutex);
+}
+
+void DestroySubmitWorker(SubmitWorker* worker) {
+	VkDevice device = worker->submitter->context->device;
+	for (uint32_t i = 0; i < WORKER_MAX_JOBS; ++i) {
+		WaitJobIdle(worker->submitter, &worker->jobs[i]);
+	}
+	// Destroying the pools frees their command buffers and descriptor sets
+	vkDestroyDescriptorPool(device, worker->descriptorPool, NULL);
+	vkDestroyCommandPool(device, worker->commandPool, NULL);
+	memset(worker, 0, sizeof(*worker));
+}
+
+VkResult SubmitComputeKernelAsync(SubmitWorker* worker, const ComputeKernel* kernel, const ComputeBuffer* buffers,
+	const void* pushConstants, uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ,
+	ComputeCallback callback, void* userData, ComputeFuture* future) {
+
+	if (kernel->dynamicRange > 0 || kernel->bindingCount > WORKER_MAX_BINDINGS) {
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+	}
+	VkDevice device = worker->submitter->context->device;
+
+	SubmitJob* job = &worker->jobs[worker->nextJob];
+	worker->nextJob = (worker->nextJob + 1) % WORKER_MAX_JOBS;
+	WaitJobIdle(worker->submitter, job);
+
+	// Descriptor set for the kernel's layout, written with this job's buffers
+	if (job->descriptorSetLayout != kernel->descriptorSetLayout) {
+		if (job->descriptorSet != VK_NULL_HANDLE) {
+			vkFreeDescriptorSets(device, worker->descriptorPool, 1, &job->descriptorSet);
+			job->descriptorSet = VK_NULL_HANDLE;
+			job->descriptorSetLayout = VK_NULL_HANDLE;
+		}
+
+		VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = { 0 };
+		descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		descriptorSetAllocateInfo.pNext = NULL;
+		descriptorSetAllocateInfo.descriptorPool = worker->descriptorPool;
+		descriptorSetAllocateInfo.descriptorSetCount = 1;
+		descriptorSetAllocateInfo.pSetLayouts = &kernel->descriptorSetLayout;
+
+		VkResult result = vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo, &job->descriptorSet);
+		if (result != VK_SUCCESS) {
+			puts("Failed to allocate worker descriptor set");
+			return result;
+		}
+		job->descriptorSetLayout = kernel->descriptorSetLayout;
+	}
+
+	VkDescriptorBufferInfo bufferInfos[WORKER_MAX_BINDINGS];
+	VkWriteDescriptorSet writeDescriptorSets[WORKER_MAX_BINDINGS];
+	for (uint32_t i = 0; i < kernel->bindingCount; ++i) {
+		bufferInfos[i].buffer = buffers[i].buffer;
+		bufferInfos[i].offset = 0;
+		bufferInfos[i].range = VK_WHOLE_SIZE;
+
+		memset(&writeDescriptorSets[i], 0, sizeof(writeDescriptorSets[i]));
+		writeDescriptorSets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeDescriptorSets[i].pNext = NULL;
+		writeDescriptorSets[i].dstSet = job->descriptorSet;
+		writeDescriptorSets[i].dstBinding = i;
+		writeDescriptorSets[i].dstArrayElement = 0;
+		writeDescriptorSets[i].descriptorCount = 1;
+		writeDescriptorSets[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writeDescriptorSets[i].pBufferInfo = &bufferInfos[i];
+	}
+	vkUpdateDescriptorSets(device, kernel->bindingCount, writeDescriptorSets, 0, NULL);
+
+	// Record the dispatch into the job's command buffer
+	VkResult result = vkResetCommandBuffer(job->commandBuffer, 0);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+	result = BeginOneTimeCommandBuffer(job->commandBuffer);
+	if (result != VK_SUCCESS) {
+		return result;
+	}
+
+	vkCmdBindPipeline(job->commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, kernel->pipeline);
+	vkCmdBindDescriptorSets(job->commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, kernel->pipelineLayout, 0, 1, &job->descriptorSet, 0, NULL);
+	if (kernel->pushConstantSize > 0) {
+		vkCmdPushConstants(job->commandBuffer, kernel->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, kernel->pushConstantSize, pushConstants);
+	}
+	vkCmdDispatch(job->commandBuffer, groupCountX, groupCountY, groupCountZ);
+
+	VkMemoryBarrier memoryBarrier = { 0 };
+	memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memoryBarrier.pNext = NULL;
+	memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(job->commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+		0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+
+	result = vkEndCommandBuffer(job->commandBuffer);
+	if (result != VK_SUCCESS) {
+		puts("Failed to end recording command buffer");
+		return result;
+	}
+
+	job->future = future;
+	job->callback = callback;
+	job->userData = userData;
+	if (future != NULL) {
+		future->result = VK_NOT_READY;
+		__atomic_store_n(&future->done, 0, __ATOMIC_RELAXED);
+	}
+	__atomic_store_n(&job->busy, 1, __ATOMIC_RELAXED);
+
+	PushJob(worker->submitter, job);
+	WakeSubmitter(worker->submitter);
+	return VK_SUCCESS;
+}
+
+int IsComputeFutureDone(const ComputeFuture* future) {
+	return __atomic_load_n(&future->done, __ATOMIC_ACQUIRE);
+}
+
+VkResult WaitComputeFuture(ComputeSubmitter* submitter, ComputeFuture* future) {
+	if (!IsComputeFutureDone(future)) {
+		pthread_mutex_lock(&submitter->mutex);
+		while (!IsComputeFutureDone(future)) {
+			pthread_cond_wait(&submitter->completeCondition, &submitter->mutex);
+		}
+		pthread_mutex_unlock(&submitter->mutex);
+	}
+	return future->result;
+}
@@ -0,0 +1,108 @@
+#include <vulkan/vulkan.h>
+#include <pthread.h>
+#include "context.h"
+#include "buffer.h"
+#include "kernel.h"
+
+#ifndef SUBMITTER_H
+#define SUBMITTER_H
+
+// Most jobs combined into one vkQueueSubmit
+#define SUBMITTER_MAX_BATCH_JOBS 256
+// Submissions the submitter thread keeps in flight before waiting for the oldest
+#define SUBMITTER_MAX_IN_FLIGHT 16
+// Jobs each worker can have queued or executing at once
+#define WORKER_MAX_JOBS 64
+// Bindings per kernel supported by workers' descriptor pools
+#define WORKER_MAX_BINDINGS 8
+
+// Called on the submitter thread once a job has finished, with VK_SUCCESS or the error that failed it.
+// It must return quickly and must not wait on other jobs.
+typedef void (*ComputeCallback)(void* userData, VkResult result);
+
+// Completion state of one asynchronous job, owned by the caller
+typedef struct ComputeFuture {
+	// Set with release semantics after result is written
+	int done;
+	VkResult result;
+} ComputeFuture;
+
+typedef struct SubmitJob {
+	// Link in the submitter's job queue, then in the list of jobs of one submission
+	struct SubmitJob* next;
+	struct SubmitJob* batchNext;
+	VkCommandBuffer commandBuffer;
+	VkDescriptorSet descriptorSet;
+	VkDescriptorSetLayout descriptorSetLayout;
+	ComputeFuture* future;
+	ComputeCallback callback;
+	void* userData;
+	// Non-zero from submission until the submitter has completed the job
+	int busy;
+} SubmitJob;
+
+typedef struct SubmitBatch {
+	VkFence fence;
+	SubmitJob* jobs;
+} SubmitBatch;
+
+// Owns one VkQueue and a thread that submits jobs pushed by any number of producer threads. Producers push onto
+// a lock-free multi-producer single-consumer queue; the submitter thread drains it, submits everything it finds
+// in one vkQueueSubmit and completes futures and callbacks as fences signal. Nothing else may use the queue
+// while the submitter exists.
+typedef struct ComputeSubmitter {
+	ComputeContext* context;
+	VkQueue queue;
+	uint32_t queueFamilyIndex;
+	pthread_t thread;
+	// Intrusive Vyukov queue: producers exchange tail, the submitter thread alone advances head
+	SubmitJob stub;
+	SubmitJob* head;
+	SubmitJob* tail;
+	// The submitter thread only sleeps with mutex held and sleeping set, so producers only lock to wake it
+	int sleeping;
+	int stop;
+	pthread_mutex_t mutex;
+	pthread_cond_t wakeCondition;
+	pthread_cond_t completeCondition;
+	SubmitBatch batches[SUBMITTER_MAX_IN_FLIGHT];
+	uint32_t oldestBatch;
+	uint32_t batchCount;
+	VkCommandBuffer submitCommandBuffers[SUBMITTER_MAX_BATCH_JOBS];
+	// Statistics, only written by the submitter thread
+	uint64_t submitCount;
+	uint64_t jobCount;
+} ComputeSubmitter;
+
+// Per producer thread state: command and descriptor pools are externally synchronized, so each thread records
+// into its own. A worker must only be used by the thread that created it.
+typedef struct SubmitWorker {
+	ComputeSubmitter* submitter;
+	VkCommandPool commandPool;
+	VkDescriptorPool descriptorPool;
+	SubmitJob jobs[WORKER_MAX_JOBS];
+	uint32_t nextJob;
+} SubmitWorker;
+
+// Start a submitter thread for queue, which belongs to queueFamilyIndex
+VkResult CreateComputeSubmitter(ComputeContext* context, VkQueue queue, uint32_t queueFamilyIndex, ComputeSubmitter* submitter);
+// Finish all queued jobs, then stop the thread. Workers must be destroyed first.
+void DestroyComputeSubmitter(ComputeSubmitter* submitter);
+
+VkResult CreateSubmitWorker(ComputeSubmitter* submitter, SubmitWorker* worker);
+// Wait for the worker's outstanding jobs and free its pools
+void DestroySubmitWorker(SubmitWorker* worker);
+
+// Record the kernel over buffers[0..bindingCount-1] into one of the worker's command buffers and queue it.
+// Returns once the job is queued; future (if not NULL) and callback (if not NULL) report its completion. Blocks
+// only if all WORKER_MAX_JOBS of the worker's jobs are still pending. Kernels with a dynamicRange are not supported.
+VkResult SubmitComputeKernelAsync(SubmitWorker* worker, const ComputeKernel* kernel, const ComputeBuffer* buffers,
+	const void* pushConstants, uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ,
+	ComputeCallback callback, void* userData, ComputeFuture* future);
+
+// Returns non-zero once the future's job has completed
+int IsComputeFutureDone(const ComputeFuture* future);
+// Block until the future's job has completed and return its result
+VkResult WaitComputeFuture(ComputeSubmitter* submitter, ComputeFuture* future);
+
+#endif
@@ -0,0 +1,22 @@
+#define _POSIX_C_SOURCE 199309L
+#include "timer.h"
+
+#ifdef _WIN32
+#include <windows.h>
+
+uint64_t GetTimeNs(void) {
+	LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return (uint64_t) ((double) counter.QuadPart * 1e9 / (double) frequency.QuadPart);
+}
+#else
+#include <time.h>
+
+uint64_t GetTimeNs(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+#endif
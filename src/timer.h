@@ -0,0 +1,13 @@
+#include <stdint.h>
+
+#ifndef TIMER_H
+#define TIMER_H
+
+// Monotonic wall clock time in nanoseconds, for measuring intervals only
+uint64_t GetTimeNs(void);
+
+static inline double NsToMs(uint64_t ns) {
+	return (double) ns / 1e6;
+}
+
+#endif
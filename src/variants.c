@@ -0,0 +1,28 @@
+#include "variants.h"
+#include <string.h>
+
+const KernelVariant kernelVariants[] = {
+	{ "scalar", "shaders/double.spv", 1, 0 },
+	{ "vec4", "shaders/double_vec4.spv", 4, 0 },
+	{ "scalar-grid", "shaders/double.spv", 1, GRID_STRIDE_GROUP_COUNT },
+	{ "vec4-grid", "shaders/double_vec4.spv", 4, GRID_STRIDE_GROUP_COUNT },
+};
+const uint32_t kernelVariantCount = sizeof(kernelVariants) / sizeof(kernelVariants[0]);
+
+const KernelVariant* FindKernelVariant(const char* name) {
+	for (uint32_t i = 0; i < kernelVariantCount; ++i) {
+		if (!strcmp(kernelVariants[i].name, name)) {
+			return &kernelVariants[i];
+		}
+	}
+	return NULL;
+}
+
+void GetKernelVariantCreateInfo(const KernelVariant* variant, ComputeKernelCreateInfo* createInfo) {
+	memset(createInfo, 0, sizeof(*createInfo));
+	createInfo->shaderFile = variant->shaderFile;
+	createInfo->bindingCount = 2;
+	createInfo->pushConstantSize = sizeof(uint32_t);
+	createInfo->vectorWidth = variant->vectorWidth;
+	createInfo->maxGroupCount = variant->maxGroupCount;
+}
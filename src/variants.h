@@ -0,0 +1,27 @@
+#include <vulkan/vulkan.h>
+#include "kernel.h"
+
+#ifndef VARIANTS_H
+#define VARIANTS_H
+
+// Workgroups launched by the grid-stride variants; enough to keep every compute unit of current GPUs busy
+#define GRID_STRIDE_GROUP_COUNT 1024
+
+// One way of running the elementwise doubling kernel
+typedef struct KernelVariant {
+	const char* name;
+	const char* shaderFile;
+	uint32_t vectorWidth;
+	uint32_t maxGroupCount;
+} KernelVariant;
+
+extern const KernelVariant kernelVariants[];
+extern const uint32_t kernelVariantCount;
+
+// Returns NULL if no variant has this name
+const KernelVariant* FindKernelVariant(const char* name);
+
+// Fill in everything but the autotuned localSizeX and elementsPerInvocation
+void GetKernelVariantCreateInfo(const KernelVariant* variant, ComputeKernelCreateInfo* createInfo);
+
+#endif